@@ -3,6 +3,7 @@
 #define MANASCRIPT_AST_HPP
 
 #include "token.hpp"
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <string>
@@ -18,12 +19,49 @@ class AstVisitor;
 using ExprPtr = std::shared_ptr<Expression>;
 using StmtPtr = std::shared_ptr<Statement>;
 
+/**
+ * @brief Concrete type of an AST node, used for dispatch without virtual calls
+ */
+enum class NodeKind : uint8_t {
+    // Expressions
+    LITERAL_EXPR,
+    UNARY_EXPR,
+    BINARY_EXPR,
+    GROUPING_EXPR,
+    VARIABLE_EXPR,
+    ASSIGN_EXPR,
+    CALL_EXPR,
+    ARRAY_EXPR,
+    INDEX_EXPR,
+    INDEX_ASSIGN_EXPR,
+    SLICE_EXPR,
+    SPAWN_EXPR,
+    
+    // Statements
+    EXPRESSION_STMT,
+    VAR_DECL_STMT,
+    BLOCK_STMT,
+    IF_STMT,
+    WHILE_STMT,
+    FOR_STMT,
+    BREAK_STMT,
+    CONTINUE_STMT,
+    FUNCTION_STMT,
+    RETURN_STMT
+};
+
 /**
  * @brief Base class for all AST nodes
  */
 class AstNode {
 public:
+    explicit AstNode(NodeKind kind) : kind(kind) {}
     virtual ~AstNode() = default;
+    
+    NodeKind getKind() const { return kind; }
+    
+private:
+    NodeKind kind;
 };
 
 /**
@@ -31,6 +69,7 @@ public:
  */
 class Expression : public AstNode {
 public:
+    explicit Expression(NodeKind kind) : AstNode(kind) {}
     virtual ~Expression() = default;
     virtual void accept(AstVisitor& visitor) = 0;
 };
@@ -40,6 +79,7 @@ public:
  */
 class Statement : public AstNode {
 public:
+    explicit Statement(NodeKind kind) : AstNode(kind) {}
     virtual ~Statement() = default;
     virtual void accept(AstVisitor& visitor) = 0;
 };
@@ -59,6 +99,11 @@ public:
     virtual void visitVariableExpr(class VariableExpr& expr) = 0;
     virtual void visitAssignExpr(class AssignExpr& expr) = 0;
     virtual void visitCallExpr(class CallExpr& expr) = 0;
+    virtual void visitArrayExpr(class ArrayExpr& expr) = 0;
+    virtual void visitIndexExpr(class IndexExpr& expr) = 0;
+    virtual void visitIndexAssignExpr(class IndexAssignExpr& expr) = 0;
+    virtual void visitSliceExpr(class SliceExpr& expr) = 0;
+    virtual void visitSpawnExpr(class SpawnExpr& expr) = 0;
     
     // Statement visitors
     virtual void visitExpressionStmt(class ExpressionStmt& stmt) = 0;
@@ -66,6 +111,9 @@ public:
     virtual void visitBlockStmt(class BlockStmt& stmt) = 0;
     virtual void visitIfStmt(class IfStmt& stmt) = 0;
     virtual void visitWhileStmt(class WhileStmt& stmt) = 0;
+    virtual void visitForStmt(class ForStmt& stmt) = 0;
+    virtual void visitBreakStmt(class BreakStmt& stmt) = 0;
+    virtual void visitContinueStmt(class ContinueStmt& stmt) = 0;
     virtual void visitFunctionStmt(class FunctionStmt& stmt) = 0;
     virtual void visitReturnStmt(class ReturnStmt& stmt) = 0;
 };
@@ -77,7 +125,8 @@ class LiteralExpr : public Expression {
 public:
     using LiteralValue = std::variant<int, double, std::string, bool, std::nullptr_t>;
     
-    LiteralExpr(const LiteralValue& value) : value(value) {}
+    LiteralExpr(const LiteralValue& value)
+        : Expression(NodeKind::LITERAL_EXPR), value(value) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitLiteralExpr(*this);
@@ -95,7 +144,7 @@ private:
 class UnaryExpr : public Expression {
 public:
     UnaryExpr(Token op, ExprPtr right)
-        : op(op), right(right) {}
+        : Expression(NodeKind::UNARY_EXPR), op(op), right(right) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitUnaryExpr(*this);
@@ -115,7 +164,7 @@ private:
 class BinaryExpr : public Expression {
 public:
     BinaryExpr(ExprPtr left, Token op, ExprPtr right)
-        : left(left), op(op), right(right) {}
+        : Expression(NodeKind::BINARY_EXPR), left(left), op(op), right(right) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitBinaryExpr(*this);
@@ -137,7 +186,7 @@ private:
 class GroupingExpr : public Expression {
 public:
     GroupingExpr(ExprPtr expression)
-        : expression(expression) {}
+        : Expression(NodeKind::GROUPING_EXPR), expression(expression) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitGroupingExpr(*this);
@@ -155,7 +204,7 @@ private:
 class VariableExpr : public Expression {
 public:
     VariableExpr(Token name)
-        : name(name) {}
+        : Expression(NodeKind::VARIABLE_EXPR), name(name) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitVariableExpr(*this);
@@ -173,7 +222,7 @@ private:
 class AssignExpr : public Expression {
 public:
     AssignExpr(Token name, ExprPtr value)
-        : name(name), value(value) {}
+        : Expression(NodeKind::ASSIGN_EXPR), name(name), value(value) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitAssignExpr(*this);
@@ -193,7 +242,7 @@ private:
 class CallExpr : public Expression {
 public:
     CallExpr(ExprPtr callee, Token paren, std::vector<ExprPtr> arguments)
-        : callee(callee), paren(paren), arguments(arguments) {}
+        : Expression(NodeKind::CALL_EXPR), callee(callee), paren(paren), arguments(arguments) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitCallExpr(*this);
@@ -209,13 +258,131 @@ private:
     std::vector<ExprPtr> arguments;
 };
 
+/**
+ * @brief Represents an array literal (e.g., [1.5, 2.5]) or a filled array (e.g., [0.0; n])
+ */
+class ArrayExpr : public Expression {
+public:
+    ArrayExpr(Token bracket, std::vector<ExprPtr> elements, ExprPtr count = nullptr)
+        : Expression(NodeKind::ARRAY_EXPR), bracket(bracket), elements(elements), count(count) {}
+    
+    void accept(AstVisitor& visitor) override {
+        visitor.visitArrayExpr(*this);
+    }
+    
+    const Token& getBracket() const { return bracket; }
+    const std::vector<ExprPtr>& getElements() const { return elements; }
+    
+    // Null for literals; for filled arrays the single element is the fill value
+    ExprPtr getCount() const { return count; }
+    
+private:
+    Token bracket;  // Left bracket token, used for error reporting
+    std::vector<ExprPtr> elements;
+    ExprPtr count;
+};
+
+/**
+ * @brief Represents reading an array element (e.g., a[i])
+ */
+class IndexExpr : public Expression {
+public:
+    IndexExpr(ExprPtr array, Token bracket, ExprPtr index)
+        : Expression(NodeKind::INDEX_EXPR), array(array), bracket(bracket), index(index) {}
+    
+    void accept(AstVisitor& visitor) override {
+        visitor.visitIndexExpr(*this);
+    }
+    
+    ExprPtr getArray() const { return array; }
+    const Token& getBracket() const { return bracket; }
+    ExprPtr getIndex() const { return index; }
+    
+private:
+    ExprPtr array;
+    Token bracket;  // Right bracket token, used for error reporting
+    ExprPtr index;
+};
+
+/**
+ * @brief Represents storing an array element (e.g., a[i] = x)
+ */
+class IndexAssignExpr : public Expression {
+public:
+    IndexAssignExpr(ExprPtr array, Token bracket, ExprPtr index, ExprPtr value)
+        : Expression(NodeKind::INDEX_ASSIGN_EXPR), array(array), bracket(bracket), index(index), value(value) {}
+    
+    void accept(AstVisitor& visitor) override {
+        visitor.visitIndexAssignExpr(*this);
+    }
+    
+    ExprPtr getArray() const { return array; }
+    const Token& getBracket() const { return bracket; }
+    ExprPtr getIndex() const { return index; }
+    ExprPtr getValue() const { return value; }
+    
+private:
+    ExprPtr array;
+    Token bracket;  // Right bracket token, used for error reporting
+    ExprPtr index;
+    ExprPtr value;
+};
+
+/**
+ * @brief Represents a view of part of an array (e.g., a[1:n], a[:n], a[1:])
+ *
+ * Slices share storage with the array they are taken from.
+ */
+class SliceExpr : public Expression {
+public:
+    SliceExpr(ExprPtr array, Token bracket, ExprPtr start, ExprPtr end)
+        : Expression(NodeKind::SLICE_EXPR), array(array), bracket(bracket), start(start), end(end) {}
+    
+    void accept(AstVisitor& visitor) override {
+        visitor.visitSliceExpr(*this);
+    }
+    
+    ExprPtr getArray() const { return array; }
+    const Token& getBracket() const { return bracket; }
+    ExprPtr getStart() const { return start; }  // Null means 0
+    ExprPtr getEnd() const { return end; }      // Null means the array's length
+    
+private:
+    ExprPtr array;
+    Token bracket;  // Right bracket token, used for error reporting
+    ExprPtr start;
+    ExprPtr end;
+};
+
+/**
+ * @brief Represents starting a call as a task (e.g., spawn f(x))
+ *
+ * Evaluates to a handle; join(handle) waits for the call and returns its result.
+ */
+class SpawnExpr : public Expression {
+public:
+    SpawnExpr(Token keyword, std::shared_ptr<CallExpr> call)
+        : Expression(NodeKind::SPAWN_EXPR), keyword(keyword), call(call) {}
+    
+    void accept(AstVisitor& visitor) override {
+        visitor.visitSpawnExpr(*this);
+    }
+    
+    const Token& getKeyword() const { return keyword; }
+    const std::shared_ptr<CallExpr>& getCall() const { return call; }
+    
+private:
+    Token keyword;
+    std::shared_ptr<CallExpr> call;
+};
+
 /**
  * @brief Represents an expression statement
  */
 class ExpressionStmt : public Statement {
 public:
     ExpressionStmt(ExprPtr expression)
-        : expression(expression) {}
+        : Statement(NodeKind::EXPRESSION_STMT), expression(expression) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitExpressionStmt(*this);
@@ -233,7 +400,7 @@ private:
 class VarDeclStmt : public Statement {
 public:
     VarDeclStmt(Token name, ExprPtr initializer = nullptr, bool is_const = false)
-        : name(name), initializer(initializer), is_const(is_const) {}
+        : Statement(NodeKind::VAR_DECL_STMT), name(name), initializer(initializer), is_const(is_const) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitVarDeclStmt(*this);
@@ -255,7 +422,7 @@ private:
 class BlockStmt : public Statement {
 public:
     BlockStmt(std::vector<StmtPtr> statements)
-        : statements(statements) {}
+        : Statement(NodeKind::BLOCK_STMT), statements(statements) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitBlockStmt(*this);
@@ -273,7 +440,7 @@ private:
 class IfStmt : public Statement {
 public:
     IfStmt(ExprPtr condition, StmtPtr then_branch, StmtPtr else_branch = nullptr)
-        : condition(condition), then_branch(then_branch), else_branch(else_branch) {}
+        : Statement(NodeKind::IF_STMT), condition(condition), then_branch(then_branch), else_branch(else_branch) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitIfStmt(*this);
@@ -294,19 +461,100 @@ private:
  */
 class WhileStmt : public Statement {
 public:
-    WhileStmt(ExprPtr condition, StmtPtr body)
-        : condition(condition), body(body) {}
+    WhileStmt(Token keyword, ExprPtr condition, StmtPtr body)
+        : Statement(NodeKind::WHILE_STMT), keyword(keyword), condition(condition), body(body) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitWhileStmt(*this);
     }
     
+    const Token& getKeyword() const { return keyword; }
+    ExprPtr getCondition() const { return condition; }
+    StmtPtr getBody() const { return body; }
+    
+private:
+    Token keyword;
+    ExprPtr condition;
+    StmtPtr body;
+};
+
+/**
+ * @brief Represents a for statement: for (initializer; condition; increment) body
+ *
+ * Any part of the header may be missing; a missing condition is always true.
+ * The initializer's variable is scoped to the loop.
+ *
+ * A `parallel for` runs its iterations in any order, possibly at the same
+ * time. The parser only accepts the header
+ * `(var i = start; i < end; i = i + 1)`, with `<=` allowed, and a body
+ * without break or return.
+ */
+class ForStmt : public Statement {
+public:
+    ForStmt(Token keyword, StmtPtr initializer, ExprPtr condition, ExprPtr increment, StmtPtr body,
+            bool parallel = false)
+        : Statement(NodeKind::FOR_STMT), keyword(keyword), initializer(initializer),
+          condition(condition), increment(increment), body(body), parallel(parallel) {}
+    
+    void accept(AstVisitor& visitor) override {
+        visitor.visitForStmt(*this);
+    }
+    
+    const Token& getKeyword() const { return keyword; }
+    StmtPtr getInitializer() const { return initializer; }
     ExprPtr getCondition() const { return condition; }
+    ExprPtr getIncrement() const { return increment; }
     StmtPtr getBody() const { return body; }
+    bool isParallel() const { return parallel; }
+    
+    // Range of a parallel for
+    const VarDeclStmt& getVariable() const { return static_cast<const VarDeclStmt&>(*initializer); }
+    ExprPtr getLimit() const { return static_cast<const BinaryExpr&>(*condition).getRight(); }
+    bool isInclusive() const {
+        return static_cast<const BinaryExpr&>(*condition).getOperator().type == TokenType::LESS_EQUAL;
+    }
     
 private:
+    Token keyword;
+    StmtPtr initializer;
     ExprPtr condition;
+    ExprPtr increment;
     StmtPtr body;
+    bool parallel;
+};
+
+/**
+ * @brief Represents a break statement
+ */
+class BreakStmt : public Statement {
+public:
+    BreakStmt(Token keyword) : Statement(NodeKind::BREAK_STMT), keyword(keyword) {}
+    
+    void accept(AstVisitor& visitor) override {
+        visitor.visitBreakStmt(*this);
+    }
+    
+    const Token& getKeyword() const { return keyword; }
+    
+private:
+    Token keyword;
+};
+
+/**
+ * @brief Represents a continue statement
+ */
+class ContinueStmt : public Statement {
+public:
+    ContinueStmt(Token keyword) : Statement(NodeKind::CONTINUE_STMT), keyword(keyword) {}
+    
+    void accept(AstVisitor& visitor) override {
+        visitor.visitContinueStmt(*this);
+    }
+    
+    const Token& getKeyword() const { return keyword; }
+    
+private:
+    Token keyword;
 };
 
 /**
@@ -314,8 +562,8 @@ private:
  */
 class FunctionStmt : public Statement {
 public:
-    FunctionStmt(Token name, std::vector<Token> params, std::vector<StmtPtr> body)
-        : name(name), params(params), body(body) {}
+    FunctionStmt(Token name, std::vector<Token> params, std::vector<StmtPtr> body, bool memo = false)
+        : Statement(NodeKind::FUNCTION_STMT), name(name), params(params), body(body), memo(memo) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitFunctionStmt(*this);
@@ -325,10 +573,18 @@ public:
     const std::vector<Token>& getParams() const { return params; }
     const std::vector<StmtPtr>& getBody() const { return body; }
     
+    /**
+     * @brief Whether the function was declared `memo function`
+     *
+     * Compiled calls then return cached results for arguments seen before.
+     */
+    bool isMemo() const { return memo; }
+    
 private:
     Token name;
     std::vector<Token> params;
     std::vector<StmtPtr> body;
+    bool memo;
 };
 
 /**
@@ -337,7 +593,7 @@ private:
 class ReturnStmt : public Statement {
 public:
     ReturnStmt(Token keyword, ExprPtr value = nullptr)
-        : keyword(keyword), value(value) {}
+        : Statement(NodeKind::RETURN_STMT), keyword(keyword), value(value) {}
     
     void accept(AstVisitor& visitor) override {
         visitor.visitReturnStmt(*this);
@@ -346,6 +602,20 @@ public:
     const Token& getKeyword() const { return keyword; }
     ExprPtr getValue() const { return value; }
     
+    /**
+     * @brief The call in tail position, if the returned value is a call
+     *
+     * Nothing is left to do in the caller once such a call returns, so
+     * engines may reuse the caller's frame for it.
+     */
+    CallExpr* getTailCall() const {
+        Expression* expr = value.get();
+        while (auto* grouping = dynamic_cast<GroupingExpr*>(expr)) {
+            expr = grouping->getExpression().get();
+        }
+        return dynamic_cast<CallExpr*>(expr);
+    }
+    
 private:
     Token keyword;  // 'return' token, used for error reporting
     ExprPtr value;
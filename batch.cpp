@@ -0,0 +1,117 @@
+#include "batch.hpp"
+#include "error.hpp"
+
+#include <llvm/Support/ThreadPool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+
+namespace mana {
+
+namespace {
+
+bool isScript(const std::filesystem::path& path) {
+    std::string extension = path.extension().string();
+    return extension == ".mana" || extension == ".ms";
+}
+
+} // namespace
+
+bool collectScripts(const std::vector<std::string>& paths, std::vector<std::string>& scripts) {
+    bool ok = true;
+    for (const std::string& path : paths) {
+        std::error_code error;
+        if (!std::filesystem::is_directory(path, error)) {
+            if (!std::filesystem::exists(path, error)) {
+                std::cerr << "Error: Could not find '" << path << "'\n";
+                ok = false;
+                continue;
+            }
+            scripts.push_back(path);
+            continue;
+        }
+
+        std::vector<std::string> found;
+        auto options = std::filesystem::directory_options::skip_permission_denied;
+        for (std::filesystem::recursive_directory_iterator it(path, options, error), end;
+             it != end && !error; it.increment(error)) {
+            if (it->is_regular_file(error) && isScript(it->path())) {
+                found.push_back(it->path().string());
+            }
+        }
+        if (error) {
+            std::cerr << "Error: Could not read directory '" << path << "': " << error.message() << "\n";
+            ok = false;
+        }
+        std::sort(found.begin(), found.end());
+        scripts.insert(scripts.end(), found.begin(), found.end());
+    }
+    return ok;
+}
+
+BatchResult runBatch(const std::vector<std::string>& scripts, unsigned jobs, const BatchTask& task,
+                     std::ostream& os) {
+    BatchResult result;
+    result.scripts = scripts.size();
+
+    std::vector<std::unique_ptr<DiagnosticManager>> reports(scripts.size());
+    std::vector<uint8_t> failed(scripts.size(), 0);
+    std::mutex mutex;
+    size_t printed = 0;
+    std::atomic<size_t> next{0};
+
+    auto work = [&]() {
+        for (size_t i; (i = next.fetch_add(1)) < scripts.size();) {
+            auto report = std::make_unique<DiagnosticManager>();
+            bool ok = false;
+            {
+                DiagnosticCapture capture(*report);
+                try {
+                    ok = task(scripts[i]);
+                } catch (const std::exception& e) {
+                    diagnostics.report(DiagnosticSeverity::ERROR, e.what(), SourceLocation(scripts[i]));
+                }
+                ok = ok && !report->hasErrors();
+            }
+
+            // Print every finished script that no earlier one is waiting on
+            std::lock_guard<std::mutex> lock(mutex);
+            reports[i] = std::move(report);
+            failed[i] = !ok;
+            while (printed < scripts.size() && reports[printed]) {
+                for (const Diagnostic& diagnostic : reports[printed]->getDiagnostics()) {
+                    // Some code generation errors carry no location; say which script they're from
+                    SourceLocation location = diagnostic.getLocation();
+                    if (location.filename.empty()) {
+                        location = SourceLocation(scripts[printed]);
+                    }
+                    os << Diagnostic(diagnostic.getSeverity(), diagnostic.getMessage(), location,
+                                     diagnostic.getCodeContext()).toString() << "\n";
+                }
+                os.flush();
+                reports[printed].reset();
+                result.failed += failed[printed];
+                printed++;
+            }
+        }
+    };
+
+    llvm::ThreadPoolStrategy strategy = llvm::hardware_concurrency(jobs);
+    unsigned threads = std::min<size_t>(strategy.compute_thread_count(), scripts.size());
+    if (threads <= 1) {
+        work();
+        return result;
+    }
+
+    llvm::ThreadPool pool(strategy);
+    for (unsigned i = 0; i < threads; ++i) {
+        pool.async(work);
+    }
+    pool.wait();
+    return result;
+}
+
+} // namespace mana
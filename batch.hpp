@@ -0,0 +1,53 @@
+#ifndef MANASCRIPT_BATCH_HPP
+#define MANASCRIPT_BATCH_HPP
+
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Expand the paths given to `--check` or `build` into script files
+ *
+ * Files are taken as given; directories are searched recursively for `.mana`
+ * and `.ms` files, listed in sorted order. Paths that can't be read are
+ * reported on stderr.
+ * @return False if a path could not be read
+ */
+bool collectScripts(const std::vector<std::string>& paths, std::vector<std::string>& scripts);
+
+/**
+ * @brief Processes one script of a batch
+ *
+ * Runs on a worker thread with `diagnostics` captured for this script, so the
+ * usual front end and code generator can be used unchanged.
+ * @return False if the script failed
+ */
+using BatchTask = std::function<bool(const std::string& path)>;
+
+/**
+ * @brief Totals of a batch
+ */
+struct BatchResult {
+    size_t scripts = 0;
+    size_t failed = 0;
+};
+
+/**
+ * @brief Run `task` on every script on a pool of `jobs` threads
+ *
+ * Scripts are handed out one at a time as threads free up, so a few large
+ * scripts don't hold back the rest. Each script's diagnostics are printed to
+ * `os` as a group, in the order of `scripts`, as soon as every script before
+ * it has finished; the output is the same for any number of threads.
+ * @param jobs Worker threads, 0 = one per hardware thread
+ */
+BatchResult runBatch(const std::vector<std::string>& scripts, unsigned jobs, const BatchTask& task,
+                     std::ostream& os = std::cerr);
+
+} // namespace mana
+
+#endif // MANASCRIPT_BATCH_HPP
@@ -0,0 +1,253 @@
+#include "corpus.hpp"
+
+#include <cctype>
+
+namespace mana {
+
+namespace {
+
+/**
+ * @brief splitmix64; unlike <random> distributions, identical on every platform
+ */
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform enough for picking among a handful of choices
+    size_t below(size_t bound) { return static_cast<size_t>(next() % bound); }
+
+private:
+    uint64_t state;
+};
+
+const char* const WORDS[] = {
+    "alpha", "buffer", "counter", "delta", "element", "factor", "gamma", "handle",
+    "index", "jitter", "kernel", "length", "matrix", "offset", "pointer", "quotient",
+    "result", "scale", "total", "value", "weight", "extent", "stride", "cursor"
+};
+const size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+// No modulo: a variable divisor could be zero when a corpus is run
+const char* const OPERATORS[] = {" + ", " - ", " * "};
+
+/**
+ * @brief Writes one program, a function at a time
+ */
+class CorpusWriter {
+public:
+    CorpusWriter(CorpusKind kind, uint64_t seed) : kind(kind), random(seed) {}
+
+    std::string generate(size_t target_bytes) {
+        std::string calls;
+        size_t function = 0;
+        while (out.size() + calls.size() < target_bytes) {
+            std::string name = functionName(function);
+            writeFunction(name, function);
+            calls += "total = total + " + name + "(" + std::to_string(random.below(100)) +
+                     ") % 1000;\n";
+            function++;
+        }
+
+        out += "var total = 0;\n";
+        out += calls;
+        out += "print(total);\n";
+        return std::move(out);
+    }
+
+private:
+    CorpusKind kind;
+    Random random;
+    std::string out;
+
+    std::string functionName(size_t index) {
+        switch (kind) {
+            case CorpusKind::EXPRESSIONS: return "expr" + std::to_string(index);
+            case CorpusKind::IDENTIFIERS: return "compute_" + words(2) + "_" + std::to_string(index);
+            case CorpusKind::NESTED: return "nest" + std::to_string(index);
+            case CorpusKind::FUNCTIONS: return "f" + std::to_string(index);
+        }
+        return "f" + std::to_string(index);
+    }
+
+    std::string words(size_t count) {
+        std::string name;
+        for (size_t i = 0; i < count; ++i) {
+            if (i > 0) {
+                name += "_";
+            }
+            name += WORDS[random.below(WORD_COUNT)];
+        }
+        return name;
+    }
+
+    void writeFunction(const std::string& name, size_t index) {
+        switch (kind) {
+            case CorpusKind::EXPRESSIONS: writeExpressions(name); break;
+            case CorpusKind::IDENTIFIERS: writeIdentifiers(name); break;
+            case CorpusKind::NESTED: writeNested(name); break;
+            case CorpusKind::FUNCTIONS: writeSmallFunction(name, index); break;
+        }
+    }
+
+    // A random expression tree over the given operands
+    std::string expression(const std::vector<std::string>& operands, int depth) {
+        if (depth == 0 || random.below(4) == 0) {
+            if (random.below(3) == 0) {
+                return std::to_string(random.below(1000) + 1);
+            }
+            return operands[random.below(operands.size())];
+        }
+        return "(" + expression(operands, depth - 1) + OPERATORS[random.below(3)] +
+               expression(operands, depth - 1) + ")";
+    }
+
+    void writeExpressions(const std::string& name) {
+        out += "function " + name + "(p) {\n";
+        std::vector<std::string> locals = {"p"};
+        for (int i = 0; i < 16; ++i) {
+            std::string local = "v" + std::to_string(i);
+            out += "    var " + local + " = " + expression(locals, 5) + " % 1009;\n";
+            locals.push_back(local);
+        }
+        out += "    return " + expression(locals, 3) + ";\n}\n";
+    }
+
+    void writeIdentifiers(const std::string& name) {
+        std::string param = "input_" + words(2);
+        out += "function " + name + "(" + param + ") {\n";
+        std::vector<std::string> locals = {param};
+
+        for (int i = 0; i < 24; ++i) {
+            std::string local = words(3) + "_" + std::to_string(i);
+            const std::string& a = locals[random.below(locals.size())];
+            const std::string& b = locals[random.below(locals.size())];
+            out += "    var " + local + " = " + a + " + " + b + " % 97;\n";
+            if (random.below(4) == 0) {
+                out += "    " + locals[random.below(locals.size())] + " = " + local + " - " + a + ";\n";
+            }
+            locals.push_back(local);
+        }
+        out += "    return " + locals.back() + ";\n}\n";
+    }
+
+    void indent(int depth) { out.append(static_cast<size_t>(depth) * 4, ' '); }
+
+    void writeNested(const std::string& name) {
+        const int depth = 32;
+        out += "function " + name + "(p) {\n    var r = p;\n";
+        for (int level = 1; level <= depth; ++level) {
+            indent(level);
+            switch (random.below(3)) {
+                case 0:
+                    out += "if (r % " + std::to_string(level + 1) + " != 0) {\n";
+                    break;
+                case 1: {
+                    std::string counter = "i" + std::to_string(level);
+                    out += "var " + counter + " = 0;\n";
+                    indent(level);
+                    out += "while (" + counter + " < 2) {\n";
+                    indent(level + 1);
+                    out += counter + " = " + counter + " + 1;\n";
+                    break;
+                }
+                default:
+                    out += "{\n";
+                    break;
+            }
+
+            // Parentheses nest as deep as the statements
+            indent(level + 1);
+            out += "r = ";
+            for (int i = 0; i < level; ++i) {
+                out += "(";
+            }
+            out += "r";
+            for (int i = 0; i < level; ++i) {
+                out += OPERATORS[i % 2] + std::to_string(i + 1) + ")";
+            }
+            out += " % 10007;\n";
+        }
+        for (int level = depth; level >= 1; --level) {
+            indent(level);
+            out += "}\n";
+        }
+        out += "    return r;\n}\n";
+    }
+
+    void writeSmallFunction(const std::string& name, size_t index) {
+        out += "function " + name + "(a) { return ";
+        if (index > 0 && random.below(2) == 0) {
+            // Chains keep inference and codegen resolving callees
+            out += "f" + std::to_string(random.below(index)) + "(a) + 1";
+        } else {
+            out += "a * " + std::to_string(random.below(50) + 2) + " - " + std::to_string(random.below(50));
+        }
+        out += "; }\n";
+    }
+};
+
+} // namespace
+
+const char* corpusKindName(CorpusKind kind) {
+    switch (kind) {
+        case CorpusKind::EXPRESSIONS: return "expressions";
+        case CorpusKind::IDENTIFIERS: return "identifiers";
+        case CorpusKind::NESTED: return "nested";
+        case CorpusKind::FUNCTIONS: return "functions";
+    }
+    return "unknown";
+}
+
+const std::vector<CorpusKind>& corpusKinds() {
+    static const std::vector<CorpusKind> kinds = {
+        CorpusKind::EXPRESSIONS, CorpusKind::IDENTIFIERS, CorpusKind::NESTED, CorpusKind::FUNCTIONS
+    };
+    return kinds;
+}
+
+std::string generateCorpus(CorpusKind kind, size_t target_bytes, uint64_t seed) {
+    CorpusWriter writer(kind, seed * 4 + static_cast<uint64_t>(kind));
+    return writer.generate(target_bytes);
+}
+
+size_t parseSize(const std::string& text) {
+    size_t digits = 0;
+    while (digits < text.size() && std::isdigit(static_cast<unsigned char>(text[digits]))) {
+        digits++;
+    }
+    if (digits == 0) {
+        return 0;
+    }
+
+    size_t value = std::stoull(text.substr(0, digits));
+    std::string unit = text.substr(digits);
+    if (unit.empty() || unit == "B") {
+        return value;
+    }
+    if (unit == "K" || unit == "KB") {
+        return value << 10;
+    }
+    if (unit == "M" || unit == "MB") {
+        return value << 20;
+    }
+    return 0;
+}
+
+std::string formatSize(size_t bytes) {
+    if (bytes >= (1u << 20) && bytes % (1u << 20) == 0) {
+        return std::to_string(bytes >> 20) + "M";
+    }
+    if (bytes >= (1u << 10) && bytes % (1u << 10) == 0) {
+        return std::to_string(bytes >> 10) + "K";
+    }
+    return std::to_string(bytes);
+}
+
+} // namespace mana
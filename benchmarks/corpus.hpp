@@ -0,0 +1,51 @@
+#ifndef MANASCRIPT_BENCHMARKS_CORPUS_HPP
+#define MANASCRIPT_BENCHMARKS_CORPUS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Shape of a synthetic program
+ */
+enum class CorpusKind {
+    EXPRESSIONS,    // Long arithmetic expressions over few locals
+    IDENTIFIERS,    // Many long, distinct identifiers in short statements
+    NESTED,         // Deeply nested blocks, conditionals, loops and parentheses
+    FUNCTIONS       // Thousands of tiny functions, each called from main
+};
+
+const char* corpusKindName(CorpusKind kind);
+
+/**
+ * @brief Every corpus kind, in a fixed order
+ */
+const std::vector<CorpusKind>& corpusKinds();
+
+/**
+ * @brief Generate a valid Manascript program of at least `target_bytes` bytes
+ *
+ * The output depends only on the arguments, on every platform, so benchmark
+ * results are comparable between machines and releases. Programs are split
+ * into functions called once from the top level, so every corpus exercises
+ * type inference and code generation as well as the front end.
+ */
+std::string generateCorpus(CorpusKind kind, size_t target_bytes, uint64_t seed = 1);
+
+/**
+ * @brief Parse a size such as "64K", "1M" or "100M"
+ * @return 0 if the text is not a size
+ */
+size_t parseSize(const std::string& text);
+
+/**
+ * @brief Format a size the way parseSize() reads it
+ */
+std::string formatSize(size_t bytes);
+
+} // namespace mana
+
+#endif // MANASCRIPT_BENCHMARKS_CORPUS_HPP
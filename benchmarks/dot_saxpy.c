@@ -0,0 +1,35 @@
+/* Native reference for dot_saxpy.mana: cc -O2 -march=native dot_saxpy.c */
+#include <stdio.h>
+#include <stdlib.h>
+
+static double dot(const double* a, const double* b, int n) {
+    double s = 0.0;
+    for (int i = 0; i < n; ++i) {
+        s += a[i] * b[i];
+    }
+    return s;
+}
+
+static void saxpy(double alpha, const double* x, double* y, int n) {
+    for (int i = 0; i < n; ++i) {
+        y[i] = alpha * x[i] + y[i];
+    }
+}
+
+int main(void) {
+    int n = 1048576;
+    double* x = aligned_alloc(64, n * sizeof(double));
+    double* y = aligned_alloc(64, n * sizeof(double));
+    for (int i = 0; i < n; ++i) {
+        x[i] = i * 0.001;
+        y[i] = i * 0.002;
+    }
+
+    double total = 0.0;
+    for (int round = 0; round < 200; ++round) {
+        saxpy(0.5, x, y, n);
+        total += dot(x, y, n);
+    }
+    printf("%f\n", total);
+    return 0;
+}
@@ -0,0 +1,324 @@
+// Compiler throughput benchmarks over synthetic corpora; see README.md
+#include "corpus.hpp"
+
+#include "codegen.hpp"
+#include "compile_stats.hpp"
+#include "error.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+
+#include <benchmark/benchmark.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+
+namespace mana {
+
+namespace {
+
+/**
+ * @brief A generated program and its front-end results, built once per run
+ */
+struct Corpus {
+    std::string source;
+    std::vector<Token> tokens;
+    std::vector<StmtPtr> statements;
+    uint64_t nodes = 0;
+    uint64_t functions = 0;
+    bool valid = true;
+};
+
+const char* const CORPUS_FILE = "bench.mana";
+
+Corpus& getCorpus(CorpusKind kind, size_t size) {
+    static std::map<std::pair<CorpusKind, size_t>, std::unique_ptr<Corpus>> corpora;
+    std::unique_ptr<Corpus>& corpus = corpora[{kind, size}];
+    if (corpus) {
+        return *corpus;
+    }
+
+    corpus = std::make_unique<Corpus>();
+    corpus->source = generateCorpus(kind, size);
+
+    diagnostics.clear();
+    Lexer lexer(corpus->source, CORPUS_FILE);
+    corpus->tokens = lexer.scanTokens();
+    Parser parser(corpus->tokens, CORPUS_FILE);
+    corpus->statements = parser.parse();
+    corpus->nodes = countAstNodes(corpus->statements);
+
+    CodeGenerator generator;
+    generator.initialize(CORPUS_FILE);
+    generator.generate(corpus->statements);
+    for (const llvm::Function& function : generator.getModule()) {
+        if (!function.isDeclaration()) {
+            corpus->functions++;
+        }
+    }
+
+    corpus->valid = !diagnostics.hasErrors();
+    if (!corpus->valid) {
+        diagnostics.printDiagnostics();
+    }
+    diagnostics.clear();
+    return *corpus;
+}
+
+// Throughput counters; names are what --compare matches on
+void setRate(benchmark::State& state, const char* name, uint64_t per_iteration, const Corpus& corpus) {
+    state.counters[name] = benchmark::Counter(
+        static_cast<double>(per_iteration), benchmark::Counter::kIsIterationInvariantRate
+    );
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * corpus.source.size()));
+}
+
+void benchLex(benchmark::State& state, CorpusKind kind, size_t size) {
+    Corpus& corpus = getCorpus(kind, size);
+    for (auto _ : state) {
+        Lexer lexer(corpus.source, CORPUS_FILE);
+        std::vector<Token> tokens = lexer.scanTokens();
+        benchmark::DoNotOptimize(tokens.data());
+    }
+    setRate(state, "tokens", corpus.tokens.size(), corpus);
+}
+
+void benchParse(benchmark::State& state, CorpusKind kind, size_t size) {
+    Corpus& corpus = getCorpus(kind, size);
+    for (auto _ : state) {
+        Parser parser(corpus.tokens, CORPUS_FILE);
+        std::vector<StmtPtr> statements = parser.parse();
+        benchmark::DoNotOptimize(statements.data());
+    }
+    setRate(state, "nodes", corpus.nodes, corpus);
+}
+
+void benchCodegen(benchmark::State& state, CorpusKind kind, size_t size) {
+    Corpus& corpus = getCorpus(kind, size);
+    if (!corpus.valid) {
+        state.SkipWithError("generated program does not compile");
+        return;
+    }
+
+    // Includes type inference and verification, as the driver runs them
+    for (auto _ : state) {
+        CodeGenerator generator;
+        generator.initialize(CORPUS_FILE);
+        generator.generate(corpus.statements);
+        benchmark::DoNotOptimize(&generator.getModule());
+    }
+    setRate(state, "functions", corpus.functions, corpus);
+}
+
+/**
+ * @brief Console output that also keeps every result for --compare
+ */
+class RecordingReporter : public benchmark::ConsoleReporter {
+public:
+    std::map<std::string, std::map<std::string, double>> results;
+
+    void ReportRuns(const std::vector<Run>& runs) override {
+        ConsoleReporter::ReportRuns(runs);
+        for (const Run& run : runs) {
+            std::map<std::string, double>& counters = results[run.benchmark_name()];
+            for (const auto& [name, counter] : run.counters) {
+                counters[name] = counter.value;
+            }
+        }
+    }
+};
+
+const char* const RATE_COUNTERS[] = {"tokens", "nodes", "functions"};
+
+/**
+ * @brief Compare rates against a JSON file written with --benchmark_out
+ * @return Number of benchmarks slower than the baseline by more than `threshold`
+ */
+int compareWithBaseline(const RecordingReporter& reporter, const std::string& path, double threshold) {
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer) {
+        std::cerr << "Error: Could not read baseline '" << path << "'\n";
+        return -1;
+    }
+    llvm::Expected<llvm::json::Value> json = llvm::json::parse((*buffer)->getBuffer());
+    if (!json) {
+        std::cerr << "Error: Invalid baseline '" << path << "': " << llvm::toString(json.takeError()) << "\n";
+        return -1;
+    }
+
+    const llvm::json::Object* root = json->getAsObject();
+    const llvm::json::Array* benchmarks = root ? root->getArray("benchmarks") : nullptr;
+    if (!benchmarks) {
+        std::cerr << "Error: Baseline '" << path << "' has no benchmarks\n";
+        return -1;
+    }
+
+    int regressions = 0;
+    std::cout << "\nComparison with " << path << " (threshold " << threshold * 100 << "%)\n";
+    for (const llvm::json::Value& entry : *benchmarks) {
+        const llvm::json::Object* baseline = entry.getAsObject();
+        if (!baseline) {
+            continue;
+        }
+        llvm::Optional<llvm::StringRef> name = baseline->getString("name");
+        if (!name) {
+            continue;
+        }
+        auto current = reporter.results.find(name->str());
+        if (current == reporter.results.end()) {
+            continue;
+        }
+
+        for (const char* counter : RATE_COUNTERS) {
+            llvm::Optional<double> before = baseline->getNumber(counter);
+            auto after = current->second.find(counter);
+            if (!before || *before <= 0 || after == current->second.end()) {
+                continue;
+            }
+
+            double change = after->second / *before - 1.0;
+            bool regressed = change < -threshold;
+            regressions += regressed;
+            std::cout << std::left << std::setw(40) << name->str() << std::right
+                      << std::fixed << std::setprecision(1) << std::setw(8) << change * 100 << "% "
+                      << counter << "/s" << (regressed ? "  REGRESSION" : "") << "\n";
+        }
+    }
+    return regressions;
+}
+
+void printUsage() {
+    std::cout << "Usage: mana_bench [options] [benchmark options]\n\n"
+              << "Options:\n"
+              << "  --sizes=LIST         Corpus sizes, e.g. 1K,64K,1M,100M (default 1K,64K,1M)\n"
+              << "  --kinds=LIST         Corpus kinds: expressions,identifiers,nested,functions\n"
+              << "  --emit-corpus=DIR    Write the corpora as .mana files and exit\n"
+              << "  --compare=FILE       Compare with a --benchmark_out JSON file; exit 1 on\n"
+              << "                       any regression\n"
+              << "  --threshold=PERCENT  Slowdown counted as a regression (default 5)\n\n"
+              << "Google Benchmark options such as --benchmark_filter, --benchmark_out=FILE\n"
+              << "and --benchmark_out_format=json are passed through.\n";
+}
+
+std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> items;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+} // namespace
+
+} // namespace mana
+
+int main(int argc, char* argv[]) {
+    std::vector<size_t> sizes = {1u << 10, 64u << 10, 1u << 20};
+    std::vector<mana::CorpusKind> kinds = mana::corpusKinds();
+    std::string emit_dir;
+    std::string baseline;
+    double threshold = 0.05;
+
+    // Take our options out before Google Benchmark sees the rest
+    std::vector<char*> remaining = {argv[0]};
+    for (int i = 1; i < argc; ++i) {
+        std::string opt = argv[i];
+        if (opt == "-h" || opt == "--help") {
+            mana::printUsage();
+            return 0;
+        } else if (opt.rfind("--sizes=", 0) == 0) {
+            sizes.clear();
+            for (const std::string& item : mana::splitList(opt.substr(8))) {
+                size_t size = mana::parseSize(item);
+                if (size == 0) {
+                    std::cerr << "Error: Invalid size '" << item << "'\n";
+                    return 1;
+                }
+                sizes.push_back(size);
+            }
+        } else if (opt.rfind("--kinds=", 0) == 0) {
+            kinds.clear();
+            for (const std::string& item : mana::splitList(opt.substr(8))) {
+                bool found = false;
+                for (mana::CorpusKind kind : mana::corpusKinds()) {
+                    if (item == mana::corpusKindName(kind)) {
+                        kinds.push_back(kind);
+                        found = true;
+                    }
+                }
+                if (!found) {
+                    std::cerr << "Error: Unknown corpus kind '" << item << "'\n";
+                    return 1;
+                }
+            }
+        } else if (opt.rfind("--emit-corpus=", 0) == 0) {
+            emit_dir = opt.substr(14);
+        } else if (opt.rfind("--compare=", 0) == 0) {
+            baseline = opt.substr(10);
+        } else if (opt.rfind("--threshold=", 0) == 0) {
+            threshold = std::stod(opt.substr(12)) / 100.0;
+        } else {
+            remaining.push_back(argv[i]);
+        }
+    }
+
+    if (!emit_dir.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(emit_dir, error);
+        if (error) {
+            std::cerr << "Error: Could not create '" << emit_dir << "': " << error.message() << "\n";
+            return 1;
+        }
+        for (mana::CorpusKind kind : kinds) {
+            for (size_t size : sizes) {
+                std::string path = emit_dir + "/" + mana::corpusKindName(kind) + "_" +
+                                   mana::formatSize(size) + ".mana";
+                std::ofstream out(path, std::ios::binary);
+                if (!out) {
+                    std::cerr << "Error: Could not write '" << path << "'\n";
+                    return 1;
+                }
+                out << mana::generateCorpus(kind, size);
+            }
+        }
+        return 0;
+    }
+
+    for (mana::CorpusKind kind : kinds) {
+        for (size_t size : sizes) {
+            std::string suffix = std::string(mana::corpusKindName(kind)) + "/" + mana::formatSize(size);
+            benchmark::RegisterBenchmark(("lex/" + suffix).c_str(), mana::benchLex, kind, size)
+                ->Unit(benchmark::kMillisecond);
+            benchmark::RegisterBenchmark(("parse/" + suffix).c_str(), mana::benchParse, kind, size)
+                ->Unit(benchmark::kMillisecond);
+            benchmark::RegisterBenchmark(("codegen/" + suffix).c_str(), mana::benchCodegen, kind, size)
+                ->Unit(benchmark::kMillisecond);
+        }
+    }
+
+    int benchmark_argc = static_cast<int>(remaining.size());
+    benchmark::Initialize(&benchmark_argc, remaining.data());
+    if (benchmark::ReportUnrecognizedArguments(benchmark_argc, remaining.data())) {
+        return 1;
+    }
+
+    mana::RecordingReporter reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+
+    if (!baseline.empty()) {
+        int regressions = mana::compareWithBaseline(reporter, baseline, threshold);
+        return regressions == 0 ? 0 : 1;
+    }
+    return 0;
+}
@@ -0,0 +1,523 @@
+// Runs the mana programs in workloads/ under every engine; see README.md
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+/**
+ * @brief A program, its expected output and the engines that can run it
+ */
+struct Workload {
+    std::string name;
+    std::string path;
+    std::string expected;
+    std::vector<std::string> engines;   // Empty means every engine
+    std::vector<std::string> args;      // Passed before the script
+    std::vector<std::string> errors;    // Expected on stderr with exit status 1
+};
+
+struct RunResult {
+    bool ok = false;
+    int status = -1;                    // Exit status, -1 when killed by a signal
+    std::string failure;
+    double wall_ms = 0;
+    uint64_t peak_rss_kb = 0;
+    int64_t instructions = -1;          // -1 when perf events are unavailable
+};
+
+struct Measurement {
+    std::string workload;
+    std::string engine;
+    std::string opt;                    // "-" for engines without optimization levels
+    RunResult result;
+
+    std::string key() const { return workload + "/" + engine + "/" + opt; }
+};
+
+std::vector<std::string> splitList(const std::string& text, char separator = ',') {
+    std::vector<std::string> items;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, separator)) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+bool readFile(const std::string& path, std::string& contents) {
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer) {
+        return false;
+    }
+    contents = (*buffer)->getBuffer().str();
+    return true;
+}
+
+/**
+ * @brief Text after each "// key:" comment of a workload
+ */
+std::vector<std::string> directives(const std::string& source, const std::string& key) {
+    const std::string marker = "// " + key + ":";
+    std::vector<std::string> values;
+    for (size_t at = source.find(marker); at != std::string::npos; at = source.find(marker, at + 1)) {
+        size_t begin = source.find_first_not_of(' ', at + marker.size());
+        size_t end = source.find('\n', at);
+        values.push_back(begin < end ? source.substr(begin, end - begin) : "");
+    }
+    return values;
+}
+
+/**
+ * @brief Every NAME.mana with a NAME.expected next to it, sorted by name
+ *
+ * A "// engines: a b" line restricts a workload to the listed engines and
+ * "// args: ..." passes options before the script. "// error: TEXT" lines
+ * expect the program to fail: exit status 1 with every TEXT on stderr, after
+ * printing what NAME.expected holds.
+ */
+std::vector<Workload> loadWorkloads(const std::string& dir) {
+    std::vector<Workload> workloads;
+    std::error_code error;
+    for (llvm::sys::fs::directory_iterator it(dir, error), end; it != end && !error; it.increment(error)) {
+        llvm::StringRef path = it->path();
+        if (llvm::sys::path::extension(path) != ".mana") {
+            continue;
+        }
+
+        Workload workload;
+        workload.name = llvm::sys::path::stem(path).str();
+        workload.path = path.str();
+        std::string source;
+        if (!readFile(workload.path, source) ||
+            !readFile(dir + "/" + workload.name + ".expected", workload.expected)) {
+            std::cerr << "Skipping " << workload.path << ": no .expected file\n";
+            continue;
+        }
+
+        for (const std::string& line : directives(source, "engines")) {
+            workload.engines = splitList(line, ' ');
+        }
+        for (const std::string& line : directives(source, "args")) {
+            workload.args = splitList(line, ' ');
+        }
+        workload.errors = directives(source, "error");
+        workloads.push_back(std::move(workload));
+    }
+
+    std::sort(workloads.begin(), workloads.end(), [](const Workload& a, const Workload& b) {
+        return a.name < b.name;
+    });
+    return workloads;
+}
+
+/**
+ * @brief Count user-space instructions retired by a process and its threads
+ * @return File descriptor, or -1 if perf events are unavailable
+ */
+int openInstructionCounter(pid_t pid) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0));
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+/**
+ * @brief Run a command once, capturing its standard output and error
+ *
+ * The child waits on a pipe until the instruction counter is attached, so the
+ * count starts exactly at exec.
+ */
+RunResult runOnce(const std::vector<std::string>& command, std::string& output, std::string& errors) {
+    RunResult result;
+    int go[2];
+    int out[2];
+    int err[2];
+    if (pipe(go) != 0 || pipe(out) != 0 || pipe(err) != 0) {
+        result.failure = "pipe failed";
+        return result;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        result.failure = "fork failed";
+        return result;
+    }
+    if (pid == 0) {
+        close(go[1]);
+        close(out[0]);
+        close(err[0]);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(err[1], STDERR_FILENO);
+        close(out[1]);
+        close(err[1]);
+
+        char signal;
+        if (read(go[0], &signal, 1) != 1) {
+            _exit(127);
+        }
+        std::vector<char*> argv;
+        for (const std::string& arg : command) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+
+    close(go[0]);
+    close(out[1]);
+    close(err[1]);
+    int counter = openInstructionCounter(pid);
+
+    auto start = std::chrono::steady_clock::now();
+    if (write(go[1], "x", 1) != 1) {
+        result.failure = "could not start child";
+    }
+    close(go[1]);
+
+    // Both streams at once, so a child filling one pipe can't stall
+    output.clear();
+    errors.clear();
+    struct pollfd streams[2] = {{out[0], POLLIN, 0}, {err[0], POLLIN, 0}};
+    std::string* targets[2] = {&output, &errors};
+    int open_streams = 2;
+    char buffer[65536];
+    while (open_streams > 0 && poll(streams, 2, -1) > 0) {
+        for (int i = 0; i < 2; ++i) {
+            if (streams[i].fd < 0 || streams[i].revents == 0) {
+                continue;
+            }
+            ssize_t count = read(streams[i].fd, buffer, sizeof(buffer));
+            if (count > 0) {
+                targets[i]->append(buffer, static_cast<size_t>(count));
+            } else {
+                close(streams[i].fd);
+                streams[i].fd = -1;
+                open_streams--;
+            }
+        }
+    }
+
+    int status = 0;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    result.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    result.peak_rss_kb = static_cast<uint64_t>(usage.ru_maxrss);
+
+    if (counter >= 0) {
+        uint64_t instructions = 0;
+        if (read(counter, &instructions, sizeof(instructions)) == sizeof(instructions)) {
+            result.instructions = static_cast<int64_t>(instructions);
+        }
+        close(counter);
+    }
+
+    if (!WIFSIGNALED(status)) {
+        result.status = WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        result.failure = "killed by signal " + std::to_string(WTERMSIG(status));
+    } else if (WEXITSTATUS(status) == 127) {
+        result.failure = "could not run " + command[0];
+    } else if (WEXITSTATUS(status) != 0) {
+        result.failure = "exit status " + std::to_string(WEXITSTATUS(status));
+    } else if (result.failure.empty()) {
+        result.ok = true;
+    }
+    return result;
+}
+
+/**
+ * @brief Best of `runs` runs: fastest time, smallest instruction count, largest peak RSS
+ */
+RunResult measure(const std::vector<std::string>& command, const Workload& workload, int runs) {
+    RunResult best;
+    for (int i = 0; i < runs; ++i) {
+        std::string output;
+        std::string errors;
+        RunResult result = runOnce(command, output, errors);
+        if (!workload.errors.empty()) {
+            bool reported = std::all_of(workload.errors.begin(), workload.errors.end(),
+                                        [&](const std::string& error) { return errors.find(error) != std::string::npos; });
+            result.ok = result.status == 1 && reported;
+            if (result.status == 0) {
+                result.failure = "no error";
+            } else if (result.status == 1) {
+                result.failure = reported ? "" : "wrong error";
+            }
+        }
+        if (result.ok && output != workload.expected) {
+            result.ok = false;
+            result.failure = "wrong output";
+        }
+        if (!result.ok) {
+            return result;
+        }
+
+        if (i == 0) {
+            best = result;
+            continue;
+        }
+        best.wall_ms = std::min(best.wall_ms, result.wall_ms);
+        best.peak_rss_kb = std::max(best.peak_rss_kb, result.peak_rss_kb);
+        if (result.instructions >= 0) {
+            best.instructions = best.instructions < 0
+                ? result.instructions : std::min(best.instructions, result.instructions);
+        }
+    }
+    return best;
+}
+
+void writeJson(const std::string& path, const std::string& mana, const std::vector<Measurement>& results) {
+    std::error_code error;
+    llvm::raw_fd_ostream stream(path, error);
+    if (error) {
+        std::cerr << "Error: Could not write '" << path << "': " << error.message() << "\n";
+        return;
+    }
+
+    llvm::json::OStream json(stream, 2);
+    json.object([&]() {
+        json.attribute("mana", mana);
+        json.attributeArray("results", [&]() {
+            for (const Measurement& m : results) {
+                json.object([&]() {
+                    json.attribute("workload", m.workload);
+                    json.attribute("engine", m.engine);
+                    json.attribute("opt", m.opt);
+                    json.attribute("ok", m.result.ok);
+                    if (!m.result.ok) {
+                        json.attribute("failure", m.result.failure);
+                        return;
+                    }
+                    json.attribute("wall_ms", m.result.wall_ms);
+                    json.attribute("peak_rss_kb", static_cast<int64_t>(m.result.peak_rss_kb));
+                    if (m.result.instructions >= 0) {
+                        json.attribute("instructions", m.result.instructions);
+                    }
+                });
+            }
+        });
+    });
+    stream << "\n";
+}
+
+/**
+ * @brief Compare with a file written by --json
+ * @return Number of regressions, or -1 if the baseline can't be read
+ *
+ * Instruction counts are compared when both runs have them, since they are
+ * far less noisy than time; otherwise wall time is.
+ */
+int compareWithBaseline(const std::string& path, const std::vector<Measurement>& results, double threshold) {
+    std::string text;
+    if (!readFile(path, text)) {
+        std::cerr << "Error: Could not read baseline '" << path << "'\n";
+        return -1;
+    }
+    llvm::Expected<llvm::json::Value> json = llvm::json::parse(text);
+    if (!json) {
+        std::cerr << "Error: Invalid baseline '" << path << "': " << llvm::toString(json.takeError()) << "\n";
+        return -1;
+    }
+    const llvm::json::Object* root = json->getAsObject();
+    const llvm::json::Array* entries = root ? root->getArray("results") : nullptr;
+    if (!entries) {
+        std::cerr << "Error: Baseline '" << path << "' has no results\n";
+        return -1;
+    }
+
+    std::map<std::string, const llvm::json::Object*> baseline;
+    for (const llvm::json::Value& entry : *entries) {
+        const llvm::json::Object* object = entry.getAsObject();
+        if (!object || !object->getString("workload") || !object->getString("engine") ||
+            !object->getString("opt")) {
+            continue;
+        }
+        baseline[object->getString("workload")->str() + "/" + object->getString("engine")->str() + "/" +
+                 object->getString("opt")->str()] = object;
+    }
+
+    int regressions = 0;
+    std::cout << "\nComparison with " << path << " (threshold " << threshold * 100 << "%)\n";
+    for (const Measurement& m : results) {
+        auto it = baseline.find(m.key());
+        if (it == baseline.end() || !m.result.ok) {
+            continue;
+        }
+
+        const char* metric = "wall_ms";
+        double after = m.result.wall_ms;
+        llvm::Optional<int64_t> instructions = it->second->getInteger("instructions");
+        if (instructions && m.result.instructions >= 0) {
+            metric = "instructions";
+            after = static_cast<double>(m.result.instructions);
+        }
+        llvm::Optional<double> before = it->second->getNumber(metric);
+        if (!before || *before <= 0) {
+            continue;
+        }
+
+        double change = after / *before - 1.0;
+        bool regressed = change > threshold;
+        regressions += regressed;
+        std::cout << std::left << std::setw(28) << m.key() << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(8) << change * 100 << "% " << metric
+                  << (regressed ? "  REGRESSION" : "") << "\n";
+    }
+    return regressions;
+}
+
+void printUsage() {
+    std::cout << "Usage: mana_workloads [options]\n\n"
+              << "Options:\n"
+              << "  --mana=PATH          Interpreter to run (default: manascript on PATH)\n"
+              << "  --dir=DIR            Workload directory (default benchmarks/workloads)\n"
+              << "  --engines=LIST       Engines to run (default jit,interp,vm,tiered)\n"
+              << "  --opt=LIST           Optimization levels for jit and tiered (default 0,2)\n"
+              << "  --filter=TEXT        Only workloads whose name contains TEXT\n"
+              << "  --runs=N             Runs per measurement, best is kept (default 3)\n"
+              << "  --json=FILE          Write the results as JSON\n"
+              << "  --baseline=FILE      Compare with an earlier --json file\n"
+              << "  --threshold=PERCENT  Slowdown counted as a regression (default 5)\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string mana = "manascript";
+    std::string dir = "benchmarks/workloads";
+    std::vector<std::string> engines = {"jit", "interp", "vm", "tiered"};
+    std::vector<std::string> opt_levels = {"0", "2"};
+    std::string filter;
+    int runs = 3;
+    std::string json_path;
+    std::string baseline;
+    double threshold = 0.05;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string opt = argv[i];
+        auto value = [&](const char* prefix) { return opt.substr(std::strlen(prefix)); };
+        if (opt == "-h" || opt == "--help") {
+            printUsage();
+            return 0;
+        } else if (opt.rfind("--mana=", 0) == 0) {
+            mana = value("--mana=");
+        } else if (opt.rfind("--dir=", 0) == 0) {
+            dir = value("--dir=");
+        } else if (opt.rfind("--engines=", 0) == 0) {
+            engines = splitList(value("--engines="));
+        } else if (opt.rfind("--opt=", 0) == 0) {
+            opt_levels = splitList(value("--opt="));
+        } else if (opt.rfind("--filter=", 0) == 0) {
+            filter = value("--filter=");
+        } else if (opt.rfind("--runs=", 0) == 0) {
+            runs = std::max(1, std::stoi(value("--runs=")));
+        } else if (opt.rfind("--json=", 0) == 0) {
+            json_path = value("--json=");
+        } else if (opt.rfind("--baseline=", 0) == 0) {
+            baseline = value("--baseline=");
+        } else if (opt.rfind("--threshold=", 0) == 0) {
+            threshold = std::stod(value("--threshold=")) / 100.0;
+        } else {
+            std::cerr << "Error: Unknown option '" << opt << "'\n";
+            return 1;
+        }
+    }
+
+    std::vector<Workload> workloads = loadWorkloads(dir);
+    if (workloads.empty()) {
+        std::cerr << "Error: No workloads in '" << dir << "'\n";
+        return 1;
+    }
+
+    std::cout << std::left << std::setw(14) << "workload" << std::setw(8) << "engine" << std::setw(5) << "opt"
+              << std::right << std::setw(12) << "wall ms" << std::setw(12) << "peak KB"
+              << std::setw(16) << "instructions" << "  status\n";
+
+    std::vector<Measurement> results;
+    int failures = 0;
+    for (const Workload& workload : workloads) {
+        if (workload.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        for (const std::string& engine : engines) {
+            if (!workload.engines.empty() &&
+                std::find(workload.engines.begin(), workload.engines.end(), engine) == workload.engines.end()) {
+                continue;
+            }
+
+            // The interpreters have no optimization levels
+            bool compiles = engine == "jit" || engine == "tiered";
+            std::vector<std::string> levels = compiles ? opt_levels : std::vector<std::string>{"-"};
+            for (const std::string& level : levels) {
+                std::vector<std::string> command = {mana, "--engine=" + engine, "--no-cache"};
+                if (compiles) {
+                    command.push_back("-O" + level);
+                }
+                command.insert(command.end(), workload.args.begin(), workload.args.end());
+                command.push_back(workload.path);
+
+                Measurement m{workload.name, engine, compiles ? "O" + level : "-", {}};
+                m.result = measure(command, workload, runs);
+                failures += !m.result.ok;
+
+                std::cout << std::left << std::setw(14) << m.workload << std::setw(8) << m.engine
+                          << std::setw(5) << m.opt << std::right << std::fixed << std::setprecision(1)
+                          << std::setw(12) << m.result.wall_ms << std::setw(12) << m.result.peak_rss_kb
+                          << std::setw(16)
+                          << (m.result.instructions >= 0 ? std::to_string(m.result.instructions) : "n/a")
+                          << "  " << (m.result.ok ? "ok" : m.result.failure) << std::endl;
+                results.push_back(std::move(m));
+            }
+        }
+    }
+
+    if (!json_path.empty()) {
+        writeJson(json_path, mana, results);
+    }
+
+    int regressions = 0;
+    if (!baseline.empty()) {
+        regressions = compareWithBaseline(baseline, results, threshold);
+    }
+    return failures == 0 && regressions == 0 ? 0 : 1;
+}
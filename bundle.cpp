@@ -0,0 +1,184 @@
+#include "bundle.hpp"
+#include "error.hpp"
+#include "runtime.hpp"
+
+#include <cstring>
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mana {
+
+namespace {
+
+// Compiled code of a bundle only runs on the machine it was written for
+#if defined(__x86_64__)
+const uint32_t HOST_MACHINE = EM_X86_64;
+#else
+const uint32_t HOST_MACHINE = EM_NONE;
+#endif
+
+void* resolveImport(const char* name) {
+    for (const RuntimeSymbol& symbol : getRuntimeSymbols()) {
+        if (std::strcmp(symbol.name, name) == 0) {
+            return symbol.address;
+        }
+    }
+    return dlsym(RTLD_DEFAULT, name);
+}
+
+// Whether [offset, offset + size) lies within a range of `limit` bytes
+bool inRange(uint64_t offset, uint64_t size, uint64_t limit) {
+    return offset <= limit && size <= limit - offset;
+}
+
+} // namespace
+
+uint64_t hashSource(const std::string& source, uint64_t seed) {
+    uint64_t hash = seed;
+    for (unsigned char c : source) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::unique_ptr<Bundle> Bundle::load(const std::string& path) {
+    auto fail = [&](const std::string& message) {
+        diagnostics.report(DiagnosticSeverity::ERROR, message, SourceLocation(path));
+        return nullptr;
+    };
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return fail("Could not open bundle: " + std::string(std::strerror(errno)));
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(BundleHeader)) {
+        close(fd);
+        return fail("Not a bundle");
+    }
+
+    std::unique_ptr<Bundle> bundle(new Bundle());
+    bundle->mapping_size = static_cast<size_t>(status.st_size);
+    bundle->mapping = mmap(nullptr, bundle->mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (bundle->mapping == MAP_FAILED) {
+        bundle->mapping = nullptr;
+        return fail("Could not map bundle: " + std::string(std::strerror(errno)));
+    }
+
+    char* base = static_cast<char*>(bundle->mapping);
+    const BundleHeader& header = *reinterpret_cast<const BundleHeader*>(base);
+    if (header.magic != BUNDLE_MAGIC || header.version != BUNDLE_VERSION) {
+        return fail("Not a bundle of this version");
+    }
+    if (header.machine != HOST_MACHINE) {
+        return fail("Bundle was compiled for another architecture");
+    }
+
+    uint64_t tables = sizeof(BundleHeader);
+    uint64_t tables_size = header.export_count * sizeof(BundleExport) +
+                           header.import_count * sizeof(BundleImport) +
+                           header.relocation_count * sizeof(BundleRelocation) + header.names_size;
+    if (!inRange(tables, tables_size, header.image_offset) ||
+        header.image_offset % BUNDLE_PAGE_SIZE != 0 || header.code_size % BUNDLE_PAGE_SIZE != 0 ||
+        header.code_size > header.image_size ||
+        !inRange(header.image_offset, header.image_size, bundle->mapping_size) ||
+        BUNDLE_PAGE_SIZE % static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) != 0) {
+        return fail("Bundle is corrupt");
+    }
+
+    const auto* exports = reinterpret_cast<const BundleExport*>(base + tables);
+    const auto* imports = reinterpret_cast<const BundleImport*>(exports + header.export_count);
+    const auto* relocations = reinterpret_cast<const BundleRelocation*>(imports + header.import_count);
+    const char* names = reinterpret_cast<const char*>(relocations + header.relocation_count);
+    auto name = [&](uint32_t offset) -> const char* {
+        return offset < header.names_size && std::memchr(names + offset, '\0', header.names_size - offset)
+            ? names + offset : nullptr;
+    };
+
+    // Only data pages are written; they become private copies of the file
+    char* image = base + header.image_offset;
+    uint64_t data_size = header.image_size - header.code_size;
+    if (data_size > 0 && mprotect(image + header.code_size, data_size, PROT_READ | PROT_WRITE) != 0) {
+        return fail("Could not map bundle data: " + std::string(std::strerror(errno)));
+    }
+
+    for (uint32_t i = 0; i < header.relocation_count; ++i) {
+        const BundleRelocation& relocation = relocations[i];
+        if (relocation.offset < header.code_size || !inRange(relocation.offset, 8, header.image_size)) {
+            return fail("Bundle is corrupt");
+        }
+        uint64_t address = reinterpret_cast<uint64_t>(image) + relocation.target;
+        std::memcpy(image + relocation.offset, &address, sizeof(address));
+    }
+    for (uint32_t i = 0; i < header.import_count; ++i) {
+        const BundleImport& import = imports[i];
+        const char* symbol = name(import.name);
+        if (!symbol || import.offset < header.code_size || !inRange(import.offset, 8, header.image_size)) {
+            return fail("Bundle is corrupt");
+        }
+        void* resolved = resolveImport(symbol);
+        if (!resolved) {
+            return fail("Bundle needs symbol '" + std::string(symbol) + "', which this process lacks");
+        }
+        uint64_t address = reinterpret_cast<uint64_t>(resolved) + static_cast<uint64_t>(import.addend);
+        std::memcpy(image + import.offset, &address, sizeof(address));
+    }
+
+    if (header.code_size > 0 && mprotect(image, header.code_size, PROT_READ | PROT_EXEC) != 0) {
+        return fail("Could not map bundle code: " + std::string(std::strerror(errno)));
+    }
+
+    for (uint32_t i = 0; i < header.export_count; ++i) {
+        const char* symbol = name(exports[i].name);
+        if (!symbol || exports[i].offset >= header.code_size) {
+            return fail("Bundle is corrupt");
+        }
+        bundle->exports.emplace(symbol, &exports[i]);
+    }
+    bundle->image = image;
+    return bundle;
+}
+
+Bundle::~Bundle() {
+    if (mapping) {
+        munmap(mapping, mapping_size);
+    }
+}
+
+uint64_t Bundle::getSourceHash() const {
+    return reinterpret_cast<const BundleHeader*>(mapping)->source_hash;
+}
+
+void* Bundle::lookup(const std::string& mangled, StaticType result) const {
+    auto it = exports.find(mangled);
+    if (it == exports.end()) {
+        return nullptr;
+    }
+
+    // A void handle may discard any result
+    StaticType type = static_cast<StaticType>(it->second->return_type);
+    if (result != StaticType::VOID && type != result) {
+        return nullptr;
+    }
+    return const_cast<char*>(image + it->second->offset);
+}
+
+int Bundle::run() const {
+    auto main = reinterpret_cast<int32_t (*)()>(lookup("main", StaticType::INT));
+    if (!main) {
+        diagnostics.report(DiagnosticSeverity::ERROR, "Bundle has no main", SourceLocation());
+        return 1;
+    }
+    int32_t result = main();
+    flushOutput();
+    return result;
+}
+
+} // namespace mana
@@ -0,0 +1,142 @@
+#ifndef MANASCRIPT_BUNDLE_HPP
+#define MANASCRIPT_BUNDLE_HPP
+
+#include "engine.hpp"
+#include "type_inference.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace llvm {
+class Module;
+}
+
+namespace mana {
+
+// On-disk layout of a .manac bundle. Everything is little-endian and offsets
+// into the image are relative to its first byte.
+//
+//   BundleHeader | exports | imports | relocations | names | pad | image
+//
+// The image starts on a page boundary and is mapped as is: code pages first
+// (read and execute), then data pages (read and write). Code never needs
+// patching: it reaches data, GOT slots and call stubs through PC-relative
+// offsets fixed when the bundle was written. Loading only writes absolute
+// addresses into the data pages.
+
+const uint32_t BUNDLE_MAGIC = 0x43414e4d;      // "MNAC"
+const uint32_t BUNDLE_VERSION = 1;
+const uint64_t BUNDLE_PAGE_SIZE = 4096;
+
+struct BundleHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t machine;               // ELF e_machine the code was compiled for
+    uint32_t reserved;
+    uint64_t source_hash;           // hashSource() of the script and its imports
+    uint64_t image_offset;          // File offset of the image, page-aligned
+    uint64_t image_size;
+    uint64_t code_size;             // Bytes of code pages at the start of the image
+    uint32_t export_count;
+    uint32_t import_count;
+    uint32_t relocation_count;
+    uint32_t names_size;
+};
+
+// A function callable from the host; the name is mangled with its parameter types
+struct BundleExport {
+    uint32_t name;                  // Offset into the names
+    uint8_t return_type;            // StaticType
+    uint8_t reserved[3];
+    uint64_t offset;
+};
+
+// An 8-byte slot that receives the address of a runtime or C library symbol plus addend
+struct BundleImport {
+    uint32_t name;
+    uint32_t reserved;
+    uint64_t offset;
+    int64_t addend;
+};
+
+// An 8-byte slot that receives the image's load address plus `target`
+struct BundleRelocation {
+    uint64_t offset;
+    uint64_t target;
+};
+
+/**
+ * @brief 64-bit FNV-1a of source text, chained through `seed` across files
+ */
+uint64_t hashSource(const std::string& source, uint64_t seed = 0xcbf29ce484222325ull);
+
+/**
+ * @brief Compile a whole program's module to native code and write it as a bundle
+ *
+ * Code is generated position-independent for the baseline CPU of the host
+ * architecture, so a bundle runs on any machine of that architecture and OS.
+ * Only x86-64 ELF is supported. Errors are reported to `diagnostics`.
+ * @return False if the bundle could not be written
+ */
+bool writeBundle(llvm::Module& module, unsigned opt_level, uint64_t source_hash, const std::string& path);
+
+/**
+ * @brief A bundle mapped into memory, ready to run
+ *
+ * Loading maps the file, fills in a handful of addresses and flips page
+ * protections; it uses neither the compiler nor LLVM, so a script starts in
+ * microseconds. Functions are available for the signatures the script was
+ * compiled with.
+ */
+class Bundle {
+public:
+    /**
+     * @brief Map a bundle file
+     * @return Null after reporting to `diagnostics` if the file is not a
+     * bundle for this machine or needs a symbol the process doesn't have
+     */
+    static std::unique_ptr<Bundle> load(const std::string& path);
+
+    ~Bundle();
+
+    Bundle(const Bundle&) = delete;
+    Bundle& operator=(const Bundle&) = delete;
+
+    /**
+     * @brief Typed handle to a compiled function; empty if the bundle has no
+     * function of that signature
+     */
+    template <typename Signature>
+    FunctionHandle<Signature> get(const std::string& name) const;
+
+    /**
+     * @brief Run the top-level statements
+     * @return Exit code of the script
+     */
+    int run() const;
+
+    uint64_t getSourceHash() const;
+
+private:
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    const char* image = nullptr;
+    std::unordered_map<std::string, const BundleExport*> exports;
+
+    Bundle() = default;
+    void* lookup(const std::string& mangled, StaticType result) const;
+};
+
+template <typename Signature>
+FunctionHandle<Signature> Bundle::get(const std::string& name) const {
+    using Types = SignatureTypes<Signature>;
+    return FunctionHandle<Signature>(lookup(TypeInference::mangle(name, Types::params()), Types::result));
+}
+
+} // namespace mana
+
+#endif // MANASCRIPT_BUNDLE_HPP
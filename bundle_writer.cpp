@@ -0,0 +1,481 @@
+#include "bundle.hpp"
+#include "codegen.hpp"
+#include "error.hpp"
+#include "jit.hpp"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/BinaryFormat/ELF.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Object/ELFObjectFile.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <unordered_map>
+
+namespace mana {
+
+namespace {
+
+const uint64_t STUB_SIZE = 8;
+
+uint64_t alignTo(uint64_t value, uint64_t alignment) {
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+// Static type a host sees for a compiled function's result
+StaticType resultType(const llvm::Function& function) {
+    if (function.getName() == "main") {
+        return StaticType::INT;
+    }
+    llvm::Type* type = function.getReturnType();
+    if (type->isIntegerTy(1))  return StaticType::BOOL;
+    if (type->isIntegerTy(32)) return StaticType::INT;
+    if (type->isDoubleTy())    return StaticType::DOUBLE;
+    if (type->isVoidTy())      return StaticType::VOID;
+    if (type->isPointerTy()) {
+        // A string or a task, which only the specialization knows
+        llvm::Attribute result = function.getFnAttribute(RESULT_TYPE_ATTRIBUTE);
+        if (result.isValid() && result.getValueAsString() == staticTypeSuffix(StaticType::STRING)) {
+            return StaticType::STRING;
+        }
+        return StaticType::UNKNOWN;
+    }
+    if (auto* array = llvm::dyn_cast<llvm::StructType>(type)) {
+        if (array->hasName() && array->getName() == "mana.array.f64") return StaticType::DOUBLE_ARRAY;
+        if (array->hasName() && array->getName() == "mana.array.i32") return StaticType::INT_ARRAY;
+    }
+    return StaticType::UNKNOWN;
+}
+
+/**
+ * @brief Lays out a relocatable object as a bundle image and resolves it
+ *
+ * Sections are placed at fixed image offsets, so every PC-relative
+ * relocation is resolved here. Calls to symbols outside the object go
+ * through a jump stub and an 8-byte slot; slots and absolute pointers in
+ * data are what's left for the loader.
+ */
+class ImageBuilder {
+public:
+    ImageBuilder(const llvm::object::ELF64LEObjectFile& object, const std::string& path)
+        : object(object), path(path) {}
+
+    bool build(const llvm::Module& module, BundleHeader& header);
+
+    std::vector<BundleExport> exports;
+    std::vector<BundleImport> imports;
+    std::vector<BundleRelocation> relocations;
+    std::string names;
+    std::vector<char> image;
+
+private:
+    // Where a relocation's symbol lives: an image offset or an external name
+    struct Target {
+        bool external = false;
+        uint64_t address = 0;
+        std::string name;
+    };
+
+    const llvm::object::ELF64LEObjectFile& object;
+    std::string path;
+    std::unordered_map<uint64_t, uint64_t> section_offsets;     // By section index
+    std::map<std::string, uint64_t> stubs;                      // By external name
+    std::map<std::string, uint64_t> external_slots;
+    std::map<uint64_t, uint64_t> internal_slots;                // By target offset
+    std::unordered_map<std::string, uint32_t> name_offsets;
+    uint64_t code_size = 0;
+
+    bool fail(const std::string& message) {
+        diagnostics.report(DiagnosticSeverity::ERROR, message, SourceLocation(path));
+        return false;
+    }
+
+    bool isKept(const llvm::object::SectionRef& section) const;
+    bool resolve(const llvm::object::SymbolRef& symbol, Target& target);
+    bool forEachRelocation(const std::function<bool(uint64_t, const llvm::object::RelocationRef&)>& visit);
+    bool collectSlots(const llvm::object::RelocationRef& relocation);
+    bool applyRelocation(uint64_t place, const llvm::object::RelocationRef& relocation);
+    bool writePCRelative(uint64_t place, uint64_t target, int64_t addend);
+    uint32_t addName(const std::string& name);
+};
+
+bool ImageBuilder::isKept(const llvm::object::SectionRef& section) const {
+    return section_offsets.count(section.getIndex()) != 0;
+}
+
+bool ImageBuilder::resolve(const llvm::object::SymbolRef& symbol, Target& target) {
+    auto section = symbol.getSection();
+    if (!section) {
+        return fail(llvm::toString(section.takeError()));
+    }
+    if (*section == object.section_end()) {
+        auto name = symbol.getName();
+        if (!name) {
+            return fail(llvm::toString(name.takeError()));
+        }
+        target.external = true;
+        target.name = name->str();
+        return true;
+    }
+    if (!isKept(**section)) {
+        return fail("Code refers to a section bundles don't keep");
+    }
+    auto value = symbol.getValue();
+    if (!value) {
+        return fail(llvm::toString(value.takeError()));
+    }
+    target.address = section_offsets[(*section)->getIndex()] + *value;
+    return true;
+}
+
+bool ImageBuilder::forEachRelocation(
+    const std::function<bool(uint64_t, const llvm::object::RelocationRef&)>& visit) {
+    for (const llvm::object::SectionRef& section : object.sections()) {
+        auto relocated = section.getRelocatedSection();
+        if (!relocated) {
+            return fail(llvm::toString(relocated.takeError()));
+        }
+        if (*relocated == object.section_end() || !isKept(**relocated)) {
+            continue;
+        }
+        uint64_t base = section_offsets[(*relocated)->getIndex()];
+        for (const llvm::object::RelocationRef& relocation : section.relocations()) {
+            if (relocation.getSymbol() == object.symbol_end()) {
+                continue;
+            }
+            if (!visit(base + relocation.getOffset(), relocation)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool ImageBuilder::collectSlots(const llvm::object::RelocationRef& relocation) {
+    Target target;
+    if (!resolve(*relocation.getSymbol(), target)) {
+        return false;
+    }
+    switch (relocation.getType()) {
+        case llvm::ELF::R_X86_64_PC32:
+        case llvm::ELF::R_X86_64_PLT32:
+            if (target.external) {
+                stubs.emplace(target.name, 0);
+                external_slots.emplace(target.name, 0);
+            }
+            return true;
+        case llvm::ELF::R_X86_64_GOTPCREL:
+        case llvm::ELF::R_X86_64_GOTPCRELX:
+        case llvm::ELF::R_X86_64_REX_GOTPCRELX:
+            if (target.external) {
+                external_slots.emplace(target.name, 0);
+            } else {
+                internal_slots.emplace(target.address, 0);
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+bool ImageBuilder::writePCRelative(uint64_t place, uint64_t target, int64_t addend) {
+    int64_t value = static_cast<int64_t>(target) + addend - static_cast<int64_t>(place);
+    if (value < INT32_MIN || value > INT32_MAX) {
+        return fail("Bundle image is too large for 32-bit offsets");
+    }
+    int32_t value32 = static_cast<int32_t>(value);
+    std::memcpy(image.data() + place, &value32, sizeof(value32));
+    return true;
+}
+
+bool ImageBuilder::applyRelocation(uint64_t place, const llvm::object::RelocationRef& relocation) {
+    Target target;
+    if (!resolve(*relocation.getSymbol(), target)) {
+        return false;
+    }
+    auto addend = llvm::object::ELFRelocationRef(relocation).getAddend();
+    if (!addend) {
+        return fail(llvm::toString(addend.takeError()));
+    }
+    switch (relocation.getType()) {
+        case llvm::ELF::R_X86_64_PC32:
+        case llvm::ELF::R_X86_64_PLT32:
+            return writePCRelative(place, target.external ? stubs[target.name] : target.address, *addend);
+        case llvm::ELF::R_X86_64_GOTPCREL:
+        case llvm::ELF::R_X86_64_GOTPCRELX:
+        case llvm::ELF::R_X86_64_REX_GOTPCRELX:
+            return writePCRelative(place, target.external ? external_slots[target.name]
+                                                          : internal_slots[target.address], *addend);
+        case llvm::ELF::R_X86_64_PC64: {
+            if (target.external) {
+                return fail("Unsupported relocation to '" + target.name + "'");
+            }
+            int64_t value = static_cast<int64_t>(target.address) + *addend - static_cast<int64_t>(place);
+            std::memcpy(image.data() + place, &value, sizeof(value));
+            return true;
+        }
+        case llvm::ELF::R_X86_64_64:
+            // Code pages are never patched; absolute pointers only appear in data
+            if (place < code_size) {
+                return fail("Code needs an absolute address; it must be position-independent");
+            }
+            if (target.external) {
+                imports.push_back({addName(target.name), 0, place, *addend});
+            } else {
+                relocations.push_back({place, target.address + static_cast<uint64_t>(*addend)});
+            }
+            return true;
+        default: {
+            llvm::SmallString<32> type;
+            relocation.getTypeName(type);
+            return fail("Unsupported relocation " + type.str().str());
+        }
+    }
+}
+
+uint32_t ImageBuilder::addName(const std::string& name) {
+    auto [it, added] = name_offsets.emplace(name, static_cast<uint32_t>(names.size()));
+    if (added) {
+        names += name;
+        names += '\0';
+    }
+    return it->second;
+}
+
+bool ImageBuilder::build(const llvm::Module& module, BundleHeader& header) {
+    std::vector<llvm::object::SectionRef> code;
+    std::vector<llvm::object::SectionRef> data;
+    for (const llvm::object::SectionRef& section : object.sections()) {
+        llvm::object::ELFSectionRef elf_section(section);
+        if (!(elf_section.getFlags() & llvm::ELF::SHF_ALLOC)) {
+            continue;
+        }
+        auto name = section.getName();
+        if (!name) {
+            return fail(llvm::toString(name.takeError()));
+        }
+        // Unwind tables only matter to debuggers and C++ exceptions, neither of which reach bundles
+        if (*name == ".eh_frame") {
+            continue;
+        }
+        if (elf_section.getFlags() & llvm::ELF::SHF_TLS) {
+            return fail("Bundles can't hold thread-local data");
+        }
+        if (elf_section.getType() == llvm::ELF::SHT_INIT_ARRAY ||
+            elf_section.getType() == llvm::ELF::SHT_FINI_ARRAY || name->startswith(".ctors") ||
+            name->startswith(".dtors")) {
+            return fail("Bundles can't hold static constructors");
+        }
+        (section.isText() ? code : data).push_back(section);
+    }
+
+    // Code, then a stub per external function, then data and slots
+    uint64_t offset = 0;
+    auto place = [&](const std::vector<llvm::object::SectionRef>& sections) {
+        for (const llvm::object::SectionRef& section : sections) {
+            offset = alignTo(offset, section.getAlignment());
+            section_offsets[section.getIndex()] = offset;
+            offset += section.getSize();
+        }
+    };
+    place(code);
+    place(data);
+    if (!forEachRelocation([this](uint64_t, const llvm::object::RelocationRef& relocation) {
+            return collectSlots(relocation);
+        })) {
+        return false;
+    }
+
+    offset = 0;
+    section_offsets.clear();
+    place(code);
+    offset = alignTo(offset, STUB_SIZE);
+    for (auto& stub : stubs) {
+        stub.second = offset;
+        offset += STUB_SIZE;
+    }
+    code_size = alignTo(offset, BUNDLE_PAGE_SIZE);
+    offset = code_size;
+    place(data);
+    offset = alignTo(offset, 8);
+    for (auto& slot : external_slots) {
+        slot.second = offset;
+        offset += 8;
+    }
+    for (auto& slot : internal_slots) {
+        slot.second = offset;
+        offset += 8;
+    }
+    image.assign(alignTo(offset, BUNDLE_PAGE_SIZE), 0);
+
+    for (const llvm::object::SectionRef& section : object.sections()) {
+        if (!isKept(section) || section.isBSS()) {
+            continue;
+        }
+        auto contents = section.getContents();
+        if (!contents) {
+            return fail(llvm::toString(contents.takeError()));
+        }
+        std::memcpy(image.data() + section_offsets[section.getIndex()], contents->data(), contents->size());
+    }
+
+    // jmp *slot(%rip), padded with int3
+    for (const auto& [name, stub] : stubs) {
+        image[stub] = static_cast<char>(0xff);
+        image[stub + 1] = 0x25;
+        image[stub + 6] = image[stub + 7] = static_cast<char>(0xcc);
+        if (!writePCRelative(stub + 2, external_slots[name], -4)) {
+            return false;
+        }
+    }
+    for (const auto& [name, slot] : external_slots) {
+        imports.push_back({addName(name), 0, slot, 0});
+    }
+    for (const auto& [target, slot] : internal_slots) {
+        relocations.push_back({slot, target});
+    }
+
+    if (!forEachRelocation([this](uint64_t place, const llvm::object::RelocationRef& relocation) {
+            return applyRelocation(place, relocation);
+        })) {
+        return false;
+    }
+
+    // Every defined function is callable from the host under its mangled name
+    for (const llvm::object::SymbolRef& symbol : object.symbols()) {
+        llvm::object::ELFSymbolRef elf_symbol(symbol);
+        if (elf_symbol.getBinding() == llvm::ELF::STB_LOCAL || elf_symbol.getELFType() != llvm::ELF::STT_FUNC) {
+            continue;
+        }
+        Target target;
+        auto name = symbol.getName();
+        if (!name) {
+            return fail(llvm::toString(name.takeError()));
+        }
+        const llvm::Function* function = module.getFunction(*name);
+        if (!function || function->isDeclaration()) {
+            continue;
+        }
+        if (!resolve(symbol, target)) {
+            return false;
+        }
+        exports.push_back({addName(name->str()), static_cast<uint8_t>(resultType(*function)), {}, target.address});
+    }
+
+    header.image_size = image.size();
+    header.code_size = code_size;
+    header.export_count = static_cast<uint32_t>(exports.size());
+    header.import_count = static_cast<uint32_t>(imports.size());
+    header.relocation_count = static_cast<uint32_t>(relocations.size());
+    header.names_size = static_cast<uint32_t>(names.size());
+    return true;
+}
+
+} // namespace
+
+bool writeBundle(llvm::Module& module, unsigned opt_level, uint64_t source_hash, const std::string& path) {
+    auto fail = [&](const std::string& message) {
+        diagnostics.report(DiagnosticSeverity::ERROR, message, SourceLocation(path));
+        return false;
+    };
+
+    initializeNativeTarget();
+    llvm::Triple triple(llvm::sys::getProcessTriple());
+    if (triple.getArch() != llvm::Triple::x86_64 || !triple.isOSBinFormatELF()) {
+        return fail("Bundles are only supported on x86-64 ELF systems");
+    }
+    std::string error;
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple.str(), error);
+    if (!target) {
+        return fail(error);
+    }
+
+    // The baseline CPU, so a bundle runs on any machine of the architecture
+    std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(
+        triple.str(), "x86-64", "", llvm::TargetOptions(), llvm::Reloc::PIC_, llvm::CodeModel::Small,
+        opt_level > 0 ? llvm::CodeGenOpt::Default : llvm::CodeGenOpt::None));
+    if (!machine) {
+        return fail("Could not create a target machine for " + triple.str());
+    }
+    module.setTargetTriple(triple.str());
+    module.setDataLayout(machine->createDataLayout());
+
+    // The host reads a bool result as a whole byte
+    for (llvm::Function& function : module) {
+        if (!function.isDeclaration() && function.getReturnType()->isIntegerTy(1)) {
+            function.addRetAttr(llvm::Attribute::ZExt);
+        }
+    }
+
+    llvm::SmallVector<char, 0> buffer;
+    {
+        llvm::raw_svector_ostream stream(buffer);
+        llvm::legacy::PassManager passes;
+        if (machine->addPassesToEmitFile(passes, stream, nullptr, llvm::CGFT_ObjectFile)) {
+            return fail("Could not emit an object file for " + triple.str());
+        }
+        passes.run(module);
+    }
+
+    auto object = llvm::object::ObjectFile::createObjectFile(
+        llvm::MemoryBufferRef(llvm::StringRef(buffer.data(), buffer.size()), path));
+    if (!object) {
+        return fail(llvm::toString(object.takeError()));
+    }
+    auto* elf = llvm::dyn_cast<llvm::object::ELF64LEObjectFile>(object->get());
+    if (!elf) {
+        return fail("Compiled code is not a 64-bit ELF object");
+    }
+
+    BundleHeader header = {};
+    header.magic = BUNDLE_MAGIC;
+    header.version = BUNDLE_VERSION;
+    header.machine = llvm::ELF::EM_X86_64;
+    header.source_hash = source_hash;
+    ImageBuilder builder(*elf, path);
+    if (!builder.build(module, header)) {
+        return false;
+    }
+    uint64_t tables_end = sizeof(BundleHeader) + builder.exports.size() * sizeof(BundleExport) +
+                          builder.imports.size() * sizeof(BundleImport) +
+                          builder.relocations.size() * sizeof(BundleRelocation) + builder.names.size();
+    header.image_offset = alignTo(tables_end, BUNDLE_PAGE_SIZE);
+
+    // Written aside and renamed, so a running loader never sees half a bundle
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        auto write = [&](const void* data, size_t size) {
+            file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        };
+        write(&header, sizeof(header));
+        write(builder.exports.data(), builder.exports.size() * sizeof(BundleExport));
+        write(builder.imports.data(), builder.imports.size() * sizeof(BundleImport));
+        write(builder.relocations.data(), builder.relocations.size() * sizeof(BundleRelocation));
+        write(builder.names.data(), builder.names.size());
+        std::vector<char> padding(header.image_offset - tables_end, 0);
+        write(padding.data(), padding.size());
+        write(builder.image.data(), builder.image.size());
+        if (!file.good()) {
+            std::remove(temporary.c_str());
+            return fail("Could not write bundle");
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return fail("Could not write bundle: " + std::string(std::strerror(errno)));
+    }
+    return true;
+}
+
+} // namespace mana
@@ -0,0 +1,123 @@
+#include "bytecode.hpp"
+
+#include <iomanip>
+#include <sstream>
+
+namespace mana {
+
+const char* opCodeName(OpCode op) {
+    switch (op) {
+        case OpCode::LOADK:     return "LOADK";
+        case OpCode::LOADI:     return "LOADI";
+        case OpCode::LOADNIL:   return "LOADNIL";
+        case OpCode::LOADTRUE:  return "LOADTRUE";
+        case OpCode::LOADFALSE: return "LOADFALSE";
+        case OpCode::MOVE:      return "MOVE";
+        case OpCode::ADD:       return "ADD";
+        case OpCode::SUB:       return "SUB";
+        case OpCode::MUL:       return "MUL";
+        case OpCode::DIV:       return "DIV";
+        case OpCode::MOD:       return "MOD";
+        case OpCode::NEG:       return "NEG";
+        case OpCode::NOT:       return "NOT";
+        case OpCode::EQ:        return "EQ";
+        case OpCode::NE:        return "NE";
+        case OpCode::LT:        return "LT";
+        case OpCode::LE:        return "LE";
+        case OpCode::GT:        return "GT";
+        case OpCode::GE:        return "GE";
+        case OpCode::NEWARRAY:  return "NEWARRAY";
+        case OpCode::FILLARRAY: return "FILLARRAY";
+        case OpCode::GETINDEX:  return "GETINDEX";
+        case OpCode::SETINDEX:  return "SETINDEX";
+        case OpCode::SLICE:     return "SLICE";
+        case OpCode::LEN:       return "LEN";
+        case OpCode::TASK:      return "TASK";
+        case OpCode::JOIN:      return "JOIN";
+        case OpCode::JMP:       return "JMP";
+        case OpCode::JMPIF:     return "JMPIF";
+        case OpCode::JMPIFNOT:  return "JMPIFNOT";
+        case OpCode::LOOP:      return "LOOP";
+        case OpCode::CALL:      return "CALL";
+        case OpCode::TAILCALL:  return "TAILCALL";
+        case OpCode::PRINT:     return "PRINT";
+        case OpCode::RETURN:    return "RETURN";
+        case OpCode::RETURN0:   return "RETURN0";
+        default:                return "UNKNOWN";
+    }
+}
+
+std::string disassemble(const BytecodeProgram& program) {
+    std::stringstream ss;
+    
+    ss << "constants:\n";
+    for (size_t i = 0; i < program.constants.size(); ++i) {
+        ss << "  K" << i << " = " << program.constants[i].toString() << "\n";
+    }
+    
+    for (size_t f = 0; f < program.functions.size(); ++f) {
+        const FunctionProto& proto = program.functions[f];
+        ss << "\nfunction F" << f << " " << proto.name
+           << " (params " << static_cast<int>(proto.num_params)
+           << ", registers " << proto.num_registers << ")\n";
+        
+        for (size_t pc = 0; pc < proto.code.size(); ++pc) {
+            Instruction i = proto.code[pc];
+            OpCode op = decodeOp(i);
+            ss << "  " << std::setw(4) << pc << "  [" << std::setw(3) << proto.lines[pc] << "]  "
+               << std::left << std::setw(10) << opCodeName(op) << std::right;
+            
+            switch (op) {
+                case OpCode::LOADK:
+                    ss << "R" << +decodeA(i) << " K" << decodeBx(i);
+                    break;
+                case OpCode::LOADI:
+                    ss << "R" << +decodeA(i) << " " << decodeSBx(i);
+                    break;
+                case OpCode::JMP:
+                case OpCode::LOOP:
+                    ss << "-> " << static_cast<int64_t>(pc) + 1 + decodeSBx(i);
+                    break;
+                case OpCode::JMPIF:
+                case OpCode::JMPIFNOT:
+                    ss << "R" << +decodeA(i) << " -> " << static_cast<int64_t>(pc) + 1 + decodeSBx(i);
+                    break;
+                case OpCode::CALL:
+                case OpCode::TAILCALL:
+                    ss << "R" << +decodeA(i) << " F" << proto.code[pc + 1]
+                       << " args " << +decodeB(i);
+                    ss << "\n";
+                    ++pc;
+                    continue;
+                case OpCode::LOADNIL:
+                case OpCode::LOADTRUE:
+                case OpCode::LOADFALSE:
+                case OpCode::PRINT:
+                case OpCode::RETURN:
+                    ss << "R" << +decodeA(i);
+                    break;
+                case OpCode::NEWARRAY:
+                    ss << "R" << +decodeA(i) << " R" << +decodeB(i) << " count " << +decodeC(i);
+                    break;
+                case OpCode::MOVE:
+                case OpCode::NEG:
+                case OpCode::NOT:
+                case OpCode::LEN:
+                case OpCode::TASK:
+                case OpCode::JOIN:
+                    ss << "R" << +decodeA(i) << " R" << +decodeB(i);
+                    break;
+                case OpCode::RETURN0:
+                    break;
+                default:
+                    ss << "R" << +decodeA(i) << " R" << +decodeB(i) << " R" << +decodeC(i);
+                    break;
+            }
+            ss << "\n";
+        }
+    }
+    
+    return ss.str();
+}
+
+} // namespace mana
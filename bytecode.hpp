@@ -0,0 +1,131 @@
+#ifndef MANASCRIPT_BYTECODE_HPP
+#define MANASCRIPT_BYTECODE_HPP
+
+#include "value.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Register machine opcodes
+ *
+ * Instructions are 32 bits: an 8-bit opcode followed by either three 8-bit
+ * operands (A, B, C) or one 8-bit operand and a 16-bit operand (A, Bx/sBx).
+ * R[x] is register x of the current frame, K[x] is constant x.
+ */
+enum class OpCode : uint8_t {
+    LOADK,      // A Bx     R[A] = K[Bx]
+    LOADI,      // A sBx    R[A] = sBx
+    LOADNIL,    // A        R[A] = nil
+    LOADTRUE,   // A        R[A] = true
+    LOADFALSE,  // A        R[A] = false
+    MOVE,       // A B      R[A] = R[B]
+
+    ADD,        // A B C    R[A] = R[B] + R[C]
+    SUB,        // A B C    R[A] = R[B] - R[C]
+    MUL,        // A B C    R[A] = R[B] * R[C]
+    DIV,        // A B C    R[A] = R[B] / R[C]
+    MOD,        // A B C    R[A] = R[B] % R[C]
+    NEG,        // A B      R[A] = -R[B]
+    NOT,        // A B      R[A] = !R[B]
+
+    EQ,         // A B C    R[A] = R[B] == R[C]
+    NE,         // A B C    R[A] = R[B] != R[C]
+    LT,         // A B C    R[A] = R[B] < R[C]
+    LE,         // A B C    R[A] = R[B] <= R[C]
+    GT,         // A B C    R[A] = R[B] > R[C]
+    GE,         // A B C    R[A] = R[B] >= R[C]
+
+    NEWARRAY,   // A B C    R[A] = [R[B], .., R[B+C-1]]
+    FILLARRAY,  // A B C    R[A] = [R[B]; R[C]]
+    GETINDEX,   // A B C    R[A] = R[B][R[C]]
+    SETINDEX,   // A B C    R[A][R[B]] = R[C]
+    SLICE,      // A B C    R[A] = R[B][R[C]:R[C+1]] (nil bounds are defaults)
+    LEN,        // A B      R[A] = len(R[B])
+
+    TASK,       // A B      R[A] = task whose result is R[B] (spawned calls run eagerly)
+    JOIN,       // A B      R[A] = result of task R[B]
+
+    JMP,        // sBx      pc += sBx
+    JMPIF,      // A sBx    if R[A] is truthy: pc += sBx
+    JMPIFNOT,   // A sBx    if R[A] is falsy: pc += sBx
+    LOOP,       // sBx      pc += sBx (loop back-edge)
+
+    CALL,       // A B      R[A] = F[next word](R[A] .. R[A+B-1])
+    TAILCALL,   // A B      return F[next word](R[A] .. R[A+B-1]), reusing the frame
+    PRINT,      // A        print R[A]
+    RETURN,     // A        return R[A]
+    RETURN0,    //          return 0
+
+    COUNT
+};
+
+using Instruction = uint32_t;
+
+// Offset added to sBx so it can be stored unsigned in 16 bits
+const int32_t SBX_BIAS = 0x7fff;
+
+inline Instruction encodeABC(OpCode op, uint8_t a, uint8_t b = 0, uint8_t c = 0) {
+    return static_cast<uint32_t>(op) | (static_cast<uint32_t>(a) << 8) |
+           (static_cast<uint32_t>(b) << 16) | (static_cast<uint32_t>(c) << 24);
+}
+
+inline Instruction encodeABx(OpCode op, uint8_t a, uint16_t bx) {
+    return static_cast<uint32_t>(op) | (static_cast<uint32_t>(a) << 8) |
+           (static_cast<uint32_t>(bx) << 16);
+}
+
+inline Instruction encodeAsBx(OpCode op, uint8_t a, int32_t sbx) {
+    return encodeABx(op, a, static_cast<uint16_t>(sbx + SBX_BIAS));
+}
+
+inline OpCode decodeOp(Instruction i) { return static_cast<OpCode>(i & 0xff); }
+inline uint8_t decodeA(Instruction i) { return static_cast<uint8_t>((i >> 8) & 0xff); }
+inline uint8_t decodeB(Instruction i) { return static_cast<uint8_t>((i >> 16) & 0xff); }
+inline uint8_t decodeC(Instruction i) { return static_cast<uint8_t>((i >> 24) & 0xff); }
+inline uint16_t decodeBx(Instruction i) { return static_cast<uint16_t>(i >> 16); }
+inline int32_t decodeSBx(Instruction i) { return static_cast<int32_t>(decodeBx(i)) - SBX_BIAS; }
+
+/**
+ * @brief A compiled function
+ */
+struct FunctionProto {
+    std::string name;
+    std::string file;           // Script declaring the function
+    uint8_t num_params = 0;
+    uint16_t num_registers = 0;
+    std::vector<Instruction> code;
+    std::vector<int> lines;     // Source line of each instruction
+    std::vector<int> columns;   // Column of the token each instruction comes from
+};
+
+/**
+ * @brief A compiled program: functions plus a shared constant pool
+ *
+ * Strings referenced by constants are owned by the program, so a Program can
+ * be executed any number of times after the AST is gone.
+ */
+struct BytecodeProgram {
+    std::vector<FunctionProto> functions;
+    std::vector<Value> constants;
+    std::deque<std::string> strings;
+    uint32_t main_index = 0;
+};
+
+/**
+ * @brief Human-readable listing of a program, used by --dump-bytecode
+ */
+std::string disassemble(const BytecodeProgram& program);
+
+/**
+ * @brief Mnemonic of an opcode
+ */
+const char* opCodeName(OpCode op);
+
+} // namespace mana
+
+#endif // MANASCRIPT_BYTECODE_HPP
@@ -0,0 +1,796 @@
+#include "bytecode_compiler.hpp"
+
+#include <cstring>
+
+namespace mana {
+
+namespace {
+
+const uint16_t MAX_REGISTERS = 255;
+const size_t MAX_ARRAY_LITERAL = 255;
+const size_t MAX_CONSTANTS = 0xffff;
+
+/**
+ * @brief True if evaluating the expression may assign to a local
+ *
+ * A left operand can be read straight from its register only when the right
+ * operand can't change it in between.
+ */
+bool mayAssign(const ExprPtr& expr) {
+    if (!expr) {
+        return false;
+    }
+    if (dynamic_cast<AssignExpr*>(expr.get())) {
+        return true;
+    }
+    if (auto* index = dynamic_cast<IndexExpr*>(expr.get())) {
+        return mayAssign(index->getArray()) || mayAssign(index->getIndex());
+    }
+    if (auto* store = dynamic_cast<IndexAssignExpr*>(expr.get())) {
+        return mayAssign(store->getArray()) || mayAssign(store->getIndex()) ||
+               mayAssign(store->getValue());
+    }
+    if (auto* slice = dynamic_cast<SliceExpr*>(expr.get())) {
+        return mayAssign(slice->getArray()) || mayAssign(slice->getStart()) ||
+               mayAssign(slice->getEnd());
+    }
+    if (auto* array = dynamic_cast<ArrayExpr*>(expr.get())) {
+        for (const auto& element : array->getElements()) {
+            if (mayAssign(element)) {
+                return true;
+            }
+        }
+        return mayAssign(array->getCount());
+    }
+    if (auto* unary = dynamic_cast<UnaryExpr*>(expr.get())) {
+        return mayAssign(unary->getRight());
+    }
+    if (auto* binary = dynamic_cast<BinaryExpr*>(expr.get())) {
+        return mayAssign(binary->getLeft()) || mayAssign(binary->getRight());
+    }
+    if (auto* grouping = dynamic_cast<GroupingExpr*>(expr.get())) {
+        return mayAssign(grouping->getExpression());
+    }
+    if (auto* spawn = dynamic_cast<SpawnExpr*>(expr.get())) {
+        return mayAssign(spawn->getCall());
+    }
+    if (auto* call = dynamic_cast<CallExpr*>(expr.get())) {
+        for (const auto& arg : call->getArguments()) {
+            if (mayAssign(arg)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+BytecodeCompiler::BytecodeCompiler(const std::string& filename) : filename(filename) {}
+
+std::unique_ptr<BytecodeProgram> BytecodeCompiler::compile(const std::vector<StmtPtr>& statements) {
+    program = std::make_unique<BytecodeProgram>();
+    
+    try {
+        // Hoist top-level functions so calls may precede definitions
+        std::vector<FunctionStmt*> function_stmts;
+        for (const auto& stmt : statements) {
+            if (auto* func = dynamic_cast<FunctionStmt*>(stmt.get())) {
+                if (function_indices.count(func->getName().lexeme)) {
+                    error(func->getName(), "Redefinition of function: " + func->getName().lexeme);
+                }
+                function_indices[func->getName().lexeme] =
+                    static_cast<uint32_t>(program->functions.size());
+                program->functions.emplace_back();
+                function_stmts.push_back(func);
+            }
+        }
+        
+        for (FunctionStmt* func : function_stmts) {
+            compileFunction(*func, program->functions[function_indices[func->getName().lexeme]]);
+        }
+        
+        // Top-level statements form the main function
+        program->main_index = static_cast<uint32_t>(program->functions.size());
+        program->functions.emplace_back();
+        proto = &program->functions.back();
+        proto->name = "main";
+        proto->file = filename;
+        locals.clear();
+        scope_marks.clear();
+        next_reg = 0;
+        in_function = false;
+        
+        for (const auto& stmt : statements) {
+            if (stmt && !dynamic_cast<FunctionStmt*>(stmt.get())) {
+                compileStatement(stmt);
+            }
+        }
+        emit(encodeABC(OpCode::RETURN0, 0));
+    } catch (const BytecodeError&) {
+        return nullptr;
+    }
+    
+    return std::move(program);
+}
+
+void BytecodeCompiler::compileFunction(FunctionStmt& stmt, FunctionProto& out) {
+    // Save the enclosing function's state (nested declarations)
+    FunctionProto* saved_proto = proto;
+    std::vector<Local> saved_locals = std::move(locals);
+    std::vector<size_t> saved_marks = std::move(scope_marks);
+    std::vector<LoopJumps> saved_loops = std::move(loops);
+    uint16_t saved_next = next_reg;
+    bool saved_in_function = in_function;
+    
+    proto = &out;
+    proto->name = stmt.getName().lexeme;
+    auto file = source_files.find(&stmt);
+    proto->file = file == source_files.end() ? filename : file->second;
+    proto->num_params = static_cast<uint8_t>(stmt.getParams().size());
+    locals.clear();
+    scope_marks.clear();
+    loops.clear();
+    next_reg = 0;
+    in_function = true;
+    setPosition(stmt.getName());
+    
+    if (stmt.getParams().size() > MAX_REGISTERS) {
+        error(stmt.getName(), "Too many parameters");
+    }
+    
+    // Parameters occupy the first registers, where the caller left the arguments
+    for (const auto& param : stmt.getParams()) {
+        locals.push_back({param.lexeme, allocRegister()});
+    }
+    
+    for (const auto& s : stmt.getBody()) {
+        compileStatement(s);
+    }
+    emit(encodeABC(OpCode::RETURN0, 0));
+    
+    proto = saved_proto;
+    locals = std::move(saved_locals);
+    scope_marks = std::move(saved_marks);
+    loops = std::move(saved_loops);
+    next_reg = saved_next;
+    in_function = saved_in_function;
+}
+
+void BytecodeCompiler::compileStatement(const StmtPtr& stmt) {
+    if (!stmt) {
+        return;
+    }
+    
+    stmt->accept(*this);
+    
+    // Temporaries never outlive a statement
+    next_reg = locals.empty() ? 0 : static_cast<uint16_t>(locals.back().reg + 1);
+}
+
+void BytecodeCompiler::compileDiscarded(const ExprPtr& expr) {
+    // A bare assignment needs no copy of its result
+    if (auto* assign = dynamic_cast<AssignExpr*>(expr.get())) {
+        if (const Local* local = resolveLocal(assign->getName().lexeme)) {
+            compileExpr(expr, local->reg);
+            return;
+        }
+    }
+    compileExpr(expr, allocRegister());
+}
+
+void BytecodeCompiler::compileExpr(const ExprPtr& expr, uint8_t reg) {
+    target = reg;
+    expr->accept(*this);
+}
+
+uint8_t BytecodeCompiler::exprToRegister(const ExprPtr& expr, bool allow_local) {
+    // Locals are read in place instead of being copied to a temporary
+    if (allow_local) {
+        if (auto* var = dynamic_cast<VariableExpr*>(expr.get())) {
+            if (const Local* local = resolveLocal(var->getName().lexeme)) {
+                return local->reg;
+            }
+        }
+    }
+    
+    uint8_t reg = allocRegister();
+    compileExpr(expr, reg);
+    return reg;
+}
+
+uint8_t BytecodeCompiler::allocRegister() {
+    if (next_reg >= MAX_REGISTERS) {
+        error(Token(TokenType::ERROR, "", line, column), "Function needs too many registers");
+    }
+    
+    uint8_t reg = static_cast<uint8_t>(next_reg++);
+    if (next_reg > proto->num_registers) {
+        proto->num_registers = next_reg;
+    }
+    return reg;
+}
+
+const BytecodeCompiler::Local* BytecodeCompiler::resolveLocal(const std::string& name) const {
+    for (auto it = locals.rbegin(); it != locals.rend(); ++it) {
+        if (it->name == name) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+void BytecodeCompiler::enterScope() {
+    scope_marks.push_back(locals.size());
+}
+
+void BytecodeCompiler::exitScope() {
+    locals.resize(scope_marks.back());
+    scope_marks.pop_back();
+}
+
+size_t BytecodeCompiler::emit(Instruction instruction) {
+    proto->code.push_back(instruction);
+    proto->lines.push_back(line);
+    proto->columns.push_back(column);
+    return proto->code.size() - 1;
+}
+
+void BytecodeCompiler::setPosition(const Token& token) {
+    line = token.line;
+    column = token.column;
+}
+
+size_t BytecodeCompiler::emitJump(OpCode op, uint8_t a) {
+    return emit(encodeAsBx(op, a, 0));
+}
+
+void BytecodeCompiler::patchJump(size_t at) {
+    int64_t offset = static_cast<int64_t>(proto->code.size()) - static_cast<int64_t>(at) - 1;
+    if (offset > SBX_BIAS) {
+        error(Token(TokenType::ERROR, "", line, column), "Jump too large");
+    }
+    
+    Instruction i = proto->code[at];
+    proto->code[at] = encodeAsBx(decodeOp(i), decodeA(i), static_cast<int32_t>(offset));
+}
+
+void BytecodeCompiler::emitLoop(size_t loop_start) {
+    int64_t offset = static_cast<int64_t>(loop_start) - static_cast<int64_t>(proto->code.size()) - 1;
+    if (-offset > SBX_BIAS) {
+        error(Token(TokenType::ERROR, "", line, column), "Loop body too large");
+    }
+    emit(encodeAsBx(OpCode::LOOP, 0, static_cast<int32_t>(offset)));
+}
+
+uint16_t BytecodeCompiler::addConstant(const Value& value) {
+    if (program->constants.size() >= MAX_CONSTANTS) {
+        error(Token(TokenType::ERROR, "", line, column), "Too many constants");
+    }
+    program->constants.push_back(value);
+    return static_cast<uint16_t>(program->constants.size() - 1);
+}
+
+uint16_t BytecodeCompiler::addIntConstant(int32_t value) {
+    auto it = int_constants.find(value);
+    if (it != int_constants.end()) {
+        return it->second;
+    }
+    return int_constants[value] = addConstant(Value::fromInt(value));
+}
+
+uint16_t BytecodeCompiler::addDoubleConstant(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    
+    auto it = double_constants.find(bits);
+    if (it != double_constants.end()) {
+        return it->second;
+    }
+    return double_constants[bits] = addConstant(Value::fromDouble(value));
+}
+
+uint16_t BytecodeCompiler::addStringConstant(const std::string& text) {
+    auto it = string_constants.find(text);
+    if (it != string_constants.end()) {
+        return it->second;
+    }
+    program->strings.push_back(text);
+    return string_constants[text] = addConstant(Value::fromString(&program->strings.back()));
+}
+
+void BytecodeCompiler::error(const Token& token, const std::string& message) {
+    diagnostics.report(
+        DiagnosticSeverity::ERROR,
+        message,
+        SourceLocation(proto ? proto->file : filename, token.line, token.column)
+    );
+    throw BytecodeError(message);
+}
+
+// Expression visitors
+void BytecodeCompiler::visitLiteralExpr(LiteralExpr& expr) {
+    uint8_t reg = target;
+    const auto& value = expr.getValue();
+    
+    if (std::holds_alternative<int>(value)) {
+        int v = std::get<int>(value);
+        if (v >= -SBX_BIAS && v <= 0xffff - SBX_BIAS) {
+            emit(encodeAsBx(OpCode::LOADI, reg, v));
+        } else {
+            emit(encodeABx(OpCode::LOADK, reg, addIntConstant(v)));
+        }
+    }
+    else if (std::holds_alternative<double>(value)) {
+        emit(encodeABx(OpCode::LOADK, reg, addDoubleConstant(std::get<double>(value))));
+    }
+    else if (std::holds_alternative<bool>(value)) {
+        emit(encodeABC(std::get<bool>(value) ? OpCode::LOADTRUE : OpCode::LOADFALSE, reg));
+    }
+    else if (std::holds_alternative<std::string>(value)) {
+        emit(encodeABx(OpCode::LOADK, reg, addStringConstant(std::get<std::string>(value))));
+    }
+    else {
+        emit(encodeABC(OpCode::LOADNIL, reg));
+    }
+}
+
+void BytecodeCompiler::visitUnaryExpr(UnaryExpr& expr) {
+    uint8_t reg = target;
+    setPosition(expr.getOperator());
+    
+    uint16_t mark = next_reg;
+    uint8_t operand = exprToRegister(expr.getRight(), true);
+    next_reg = mark;
+    
+    OpCode op = expr.getOperator().type == TokenType::MINUS ? OpCode::NEG : OpCode::NOT;
+    emit(encodeABC(op, reg, operand));
+}
+
+void BytecodeCompiler::visitBinaryExpr(BinaryExpr& expr) {
+    uint8_t reg = target;
+    TokenType type = expr.getOperator().type;
+    setPosition(expr.getOperator());
+    
+    // Short-circuit evaluation producing a boolean
+    if (type == TokenType::AND || type == TokenType::OR) {
+        OpCode skip = type == TokenType::AND ? OpCode::JMPIFNOT : OpCode::JMPIF;
+        
+        // Don't clobber a local that the right operand may still read
+        uint16_t mark = next_reg;
+        uint8_t result_reg = reg;
+        if (!locals.empty() && reg <= locals.back().reg) {
+            reg = allocRegister();
+        }
+        
+        compileExpr(expr.getLeft(), reg);
+        size_t short_left = emitJump(skip, reg);
+        compileExpr(expr.getRight(), reg);
+        size_t short_right = emitJump(skip, reg);
+        
+        emit(encodeABC(type == TokenType::AND ? OpCode::LOADTRUE : OpCode::LOADFALSE, reg));
+        size_t done = emitJump(OpCode::JMP);
+        patchJump(short_left);
+        patchJump(short_right);
+        emit(encodeABC(type == TokenType::AND ? OpCode::LOADFALSE : OpCode::LOADTRUE, reg));
+        patchJump(done);
+        
+        if (result_reg != reg) {
+            emit(encodeABC(OpCode::MOVE, result_reg, reg));
+        }
+        next_reg = mark;
+        return;
+    }
+    
+    OpCode op;
+    switch (type) {
+        case TokenType::PLUS:          op = OpCode::ADD; break;
+        case TokenType::MINUS:         op = OpCode::SUB; break;
+        case TokenType::STAR:          op = OpCode::MUL; break;
+        case TokenType::SLASH:         op = OpCode::DIV; break;
+        case TokenType::PERCENT:       op = OpCode::MOD; break;
+        case TokenType::EQUAL_EQUAL:   op = OpCode::EQ; break;
+        case TokenType::BANG_EQUAL:    op = OpCode::NE; break;
+        case TokenType::LESS:          op = OpCode::LT; break;
+        case TokenType::LESS_EQUAL:    op = OpCode::LE; break;
+        case TokenType::GREATER:       op = OpCode::GT; break;
+        case TokenType::GREATER_EQUAL: op = OpCode::GE; break;
+        default:
+            error(expr.getOperator(), "Unknown binary operator");
+    }
+    
+    uint16_t mark = next_reg;
+    uint8_t left = exprToRegister(expr.getLeft(), !mayAssign(expr.getRight()));
+    uint8_t right = exprToRegister(expr.getRight(), true);
+    next_reg = mark;
+    
+    emit(encodeABC(op, reg, left, right));
+}
+
+void BytecodeCompiler::visitGroupingExpr(GroupingExpr& expr) {
+    compileExpr(expr.getExpression(), target);
+}
+
+void BytecodeCompiler::visitVariableExpr(VariableExpr& expr) {
+    uint8_t reg = target;
+    
+    const Local* local = resolveLocal(expr.getName().lexeme);
+    if (!local) {
+        error(expr.getName(), "Unknown variable name: " + expr.getName().lexeme);
+    }
+    if (local->reg != reg) {
+        emit(encodeABC(OpCode::MOVE, reg, local->reg));
+    }
+}
+
+void BytecodeCompiler::visitAssignExpr(AssignExpr& expr) {
+    uint8_t reg = target;
+    setPosition(expr.getName());
+    
+    const Local* local = resolveLocal(expr.getName().lexeme);
+    if (!local) {
+        error(expr.getName(), "Unknown variable name: " + expr.getName().lexeme);
+    }
+    
+    uint8_t local_reg = local->reg;
+    compileExpr(expr.getValue(), local_reg);
+    if (reg != local_reg) {
+        emit(encodeABC(OpCode::MOVE, reg, local_reg));
+    }
+}
+
+void BytecodeCompiler::visitCallExpr(CallExpr& expr) {
+    uint8_t reg = target;
+    setPosition(expr.getParen());
+    
+    auto* var_expr = dynamic_cast<VariableExpr*>(expr.getCallee().get());
+    if (!var_expr) {
+        error(expr.getParen(), "Expression is not callable");
+    }
+    
+    const std::string& name = var_expr->getName().lexeme;
+    auto it = function_indices.find(name);
+    uint16_t mark = next_reg;
+    
+    if (it == function_indices.end() && name == "len") {
+        if (expr.getArguments().size() != 1) {
+            error(expr.getParen(), "len expects exactly one argument");
+        }
+        
+        uint8_t arg = exprToRegister(expr.getArguments()[0], true);
+        next_reg = mark;
+        emit(encodeABC(OpCode::LEN, reg, arg));
+        return;
+    }
+    
+    if (it == function_indices.end() && name == "join") {
+        if (expr.getArguments().size() != 1) {
+            error(expr.getParen(), "join expects exactly one argument");
+        }
+        
+        uint8_t arg = exprToRegister(expr.getArguments()[0], true);
+        next_reg = mark;
+        emit(encodeABC(OpCode::JOIN, reg, arg));
+        return;
+    }
+    
+    if (it == function_indices.end()) {
+        if (name != "print") {
+            error(var_expr->getName(), "Unknown function name: " + name);
+        }
+        if (expr.getArguments().size() != 1) {
+            error(expr.getParen(), "print expects exactly one argument");
+        }
+        
+        uint8_t arg = exprToRegister(expr.getArguments()[0], true);
+        next_reg = mark;
+        emit(encodeABC(OpCode::PRINT, arg));
+        emit(encodeABC(OpCode::LOADNIL, reg));
+        return;
+    }
+    
+    // Arguments go to consecutive registers, which become the callee's parameters
+    uint8_t base = static_cast<uint8_t>(next_reg);
+    for (const auto& arg : expr.getArguments()) {
+        compileExpr(arg, allocRegister());
+    }
+    next_reg = mark;
+    
+    emit(encodeABC(OpCode::CALL, base, static_cast<uint8_t>(expr.getArguments().size())));
+    emit(it->second);
+    if (reg != base) {
+        emit(encodeABC(OpCode::MOVE, reg, base));
+    }
+}
+
+void BytecodeCompiler::visitSpawnExpr(SpawnExpr& expr) {
+    uint8_t reg = target;
+    setPosition(expr.getKeyword());
+    
+    auto* callee = dynamic_cast<VariableExpr*>(expr.getCall()->getCallee().get());
+    if (!callee || !function_indices.count(callee->getName().lexeme)) {
+        error(expr.getKeyword(), "spawn needs a call to a script function");
+    }
+    
+    // The call runs now; the task only carries its result
+    compileExpr(expr.getCall(), reg);
+    setPosition(expr.getKeyword());
+    emit(encodeABC(OpCode::TASK, reg, reg));
+}
+
+void BytecodeCompiler::visitArrayExpr(ArrayExpr& expr) {
+    uint8_t reg = target;
+    setPosition(expr.getBracket());
+    uint16_t mark = next_reg;
+    
+    if (expr.getCount()) {
+        uint8_t value = exprToRegister(expr.getElements()[0], !mayAssign(expr.getCount()));
+        uint8_t count = exprToRegister(expr.getCount(), true);
+        next_reg = mark;
+        emit(encodeABC(OpCode::FILLARRAY, reg, value, count));
+        return;
+    }
+    
+    if (expr.getElements().size() > MAX_ARRAY_LITERAL) {
+        error(expr.getBracket(), "Too many elements in array literal");
+    }
+    
+    // Elements go to consecutive registers, like call arguments
+    uint8_t base = static_cast<uint8_t>(next_reg);
+    for (const auto& element : expr.getElements()) {
+        compileExpr(element, allocRegister());
+    }
+    next_reg = mark;
+    
+    emit(encodeABC(OpCode::NEWARRAY, reg, base, static_cast<uint8_t>(expr.getElements().size())));
+}
+
+void BytecodeCompiler::visitIndexExpr(IndexExpr& expr) {
+    uint8_t reg = target;
+    setPosition(expr.getBracket());
+    
+    uint16_t mark = next_reg;
+    uint8_t array = exprToRegister(expr.getArray(), !mayAssign(expr.getIndex()));
+    uint8_t index = exprToRegister(expr.getIndex(), true);
+    next_reg = mark;
+    
+    emit(encodeABC(OpCode::GETINDEX, reg, array, index));
+}
+
+void BytecodeCompiler::visitIndexAssignExpr(IndexAssignExpr& expr) {
+    uint8_t reg = target;
+    setPosition(expr.getBracket());
+    
+    uint16_t mark = next_reg;
+    bool value_assigns = mayAssign(expr.getValue());
+    uint8_t array = exprToRegister(expr.getArray(), !value_assigns && !mayAssign(expr.getIndex()));
+    uint8_t index = exprToRegister(expr.getIndex(), !value_assigns);
+    uint8_t value = exprToRegister(expr.getValue(), true);
+    next_reg = mark;
+    
+    emit(encodeABC(OpCode::SETINDEX, array, index, value));
+    if (reg != value) {
+        emit(encodeABC(OpCode::MOVE, reg, value));
+    }
+}
+
+void BytecodeCompiler::visitSliceExpr(SliceExpr& expr) {
+    uint8_t reg = target;
+    setPosition(expr.getBracket());
+    
+    uint16_t mark = next_reg;
+    uint8_t array = exprToRegister(
+        expr.getArray(), !mayAssign(expr.getStart()) && !mayAssign(expr.getEnd())
+    );
+    
+    // Bounds go to two consecutive registers; nil selects the default
+    uint8_t bounds = allocRegister();
+    uint8_t end = allocRegister();
+    if (expr.getStart()) {
+        compileExpr(expr.getStart(), bounds);
+    } else {
+        emit(encodeABC(OpCode::LOADNIL, bounds));
+    }
+    if (expr.getEnd()) {
+        compileExpr(expr.getEnd(), end);
+    } else {
+        emit(encodeABC(OpCode::LOADNIL, end));
+    }
+    next_reg = mark;
+    
+    emit(encodeABC(OpCode::SLICE, reg, array, bounds));
+}
+
+// Statement visitors
+void BytecodeCompiler::visitExpressionStmt(ExpressionStmt& stmt) {
+    compileDiscarded(stmt.getExpression());
+}
+
+void BytecodeCompiler::visitVarDeclStmt(VarDeclStmt& stmt) {
+    setPosition(stmt.getName());
+    uint8_t reg = allocRegister();
+    
+    if (stmt.getInitializer()) {
+        compileExpr(stmt.getInitializer(), reg);
+    } else {
+        emit(encodeABC(OpCode::LOADNIL, reg));
+    }
+    
+    // Declared after the initializer so `var x = x;` sees the outer x
+    locals.push_back({stmt.getName().lexeme, reg});
+}
+
+void BytecodeCompiler::visitBlockStmt(BlockStmt& stmt) {
+    enterScope();
+    for (const auto& s : stmt.getStatements()) {
+        compileStatement(s);
+    }
+    exitScope();
+}
+
+void BytecodeCompiler::visitIfStmt(IfStmt& stmt) {
+    uint16_t mark = next_reg;
+    uint8_t cond = exprToRegister(stmt.getCondition(), true);
+    next_reg = mark;
+    
+    size_t to_else = emitJump(OpCode::JMPIFNOT, cond);
+    compileStatement(stmt.getThenBranch());
+    
+    if (stmt.getElseBranch()) {
+        size_t to_end = emitJump(OpCode::JMP);
+        patchJump(to_else);
+        compileStatement(stmt.getElseBranch());
+        patchJump(to_end);
+    } else {
+        patchJump(to_else);
+    }
+}
+
+void BytecodeCompiler::visitWhileStmt(WhileStmt& stmt) {
+    size_t loop_start = proto->code.size();
+    
+    uint16_t mark = next_reg;
+    uint8_t cond = exprToRegister(stmt.getCondition(), true);
+    next_reg = mark;
+    
+    size_t exit_jump = emitJump(OpCode::JMPIFNOT, cond);
+    loops.push_back({loop_start, false, {}, {}});
+    compileStatement(stmt.getBody());
+    emitLoop(loop_start);
+    patchJump(exit_jump);
+    
+    for (size_t jump : loops.back().breaks) {
+        patchJump(jump);
+    }
+    loops.pop_back();
+}
+
+void BytecodeCompiler::visitForStmt(ForStmt& stmt) {
+    setPosition(stmt.getKeyword());
+    enterScope();
+    compileStatement(stmt.getInitializer());
+    
+    // A parallel for evaluates its end once, into a register no name refers to
+    uint8_t limit = 0;
+    if (stmt.isParallel()) {
+        limit = allocRegister();
+        compileExpr(stmt.getLimit(), limit);
+        locals.push_back({"", limit});
+    }
+    
+    size_t loop_start = proto->code.size();
+    bool has_exit = stmt.isParallel() || stmt.getCondition();
+    size_t exit_jump = 0;
+    if (stmt.isParallel()) {
+        uint8_t variable = resolveLocal(stmt.getVariable().getName().lexeme)->reg;
+        uint8_t cond = allocRegister();
+        emit(encodeABC(stmt.isInclusive() ? OpCode::LE : OpCode::LT, cond, variable, limit));
+        exit_jump = emitJump(OpCode::JMPIFNOT, cond);
+    } else if (stmt.getCondition()) {
+        uint8_t cond = exprToRegister(stmt.getCondition(), true);
+        exit_jump = emitJump(OpCode::JMPIFNOT, cond);
+    }
+    next_reg = static_cast<uint16_t>(locals.empty() ? 0 : locals.back().reg + 1);
+    
+    loops.push_back({loop_start, true, {}, {}});
+    compileStatement(stmt.getBody());
+    
+    for (size_t jump : loops.back().continues) {
+        patchJump(jump);
+    }
+    // Leave an inclusive range before stepping past its end, which wraps at INT_MAX
+    if (stmt.isParallel() && stmt.isInclusive()) {
+        uint8_t variable = resolveLocal(stmt.getVariable().getName().lexeme)->reg;
+        uint8_t last = allocRegister();
+        emit(encodeABC(OpCode::EQ, last, variable, limit));
+        loops.back().breaks.push_back(emitJump(OpCode::JMPIF, last));
+        next_reg = static_cast<uint16_t>(locals.empty() ? 0 : locals.back().reg + 1);
+    }
+    if (stmt.getIncrement()) {
+        compileDiscarded(stmt.getIncrement());
+        next_reg = static_cast<uint16_t>(locals.empty() ? 0 : locals.back().reg + 1);
+    }
+    emitLoop(loop_start);
+    
+    if (has_exit) {
+        patchJump(exit_jump);
+    }
+    for (size_t jump : loops.back().breaks) {
+        patchJump(jump);
+    }
+    loops.pop_back();
+    exitScope();
+}
+
+void BytecodeCompiler::visitBreakStmt(BreakStmt& stmt) {
+    setPosition(stmt.getKeyword());
+    if (loops.empty()) {
+        error(stmt.getKeyword(), "Can't use 'break' outside of a loop");
+    }
+    loops.back().breaks.push_back(emitJump(OpCode::JMP));
+}
+
+void BytecodeCompiler::visitContinueStmt(ContinueStmt& stmt) {
+    setPosition(stmt.getKeyword());
+    if (loops.empty()) {
+        error(stmt.getKeyword(), "Can't use 'continue' outside of a loop");
+    }
+    if (loops.back().forward_continue) {
+        loops.back().continues.push_back(emitJump(OpCode::JMP));
+    } else {
+        emitLoop(loops.back().start);
+    }
+}
+
+void BytecodeCompiler::visitFunctionStmt(FunctionStmt& stmt) {
+    // Nested declarations are hoisted to program level when first seen
+    if (function_indices.count(stmt.getName().lexeme)) {
+        error(stmt.getName(), "Redefinition of function: " + stmt.getName().lexeme);
+    }
+    
+    uint32_t index = static_cast<uint32_t>(program->functions.size());
+    function_indices[stmt.getName().lexeme] = index;
+    program->functions.emplace_back();
+    
+    // Compile into a detached proto: emplace_back may move the current one
+    size_t current = static_cast<size_t>(proto - program->functions.data());
+    FunctionProto compiled;
+    compileFunction(stmt, compiled);
+    program->functions[index] = std::move(compiled);
+    proto = &program->functions[current];
+}
+
+void BytecodeCompiler::visitReturnStmt(ReturnStmt& stmt) {
+    setPosition(stmt.getKeyword());
+    
+    if (!in_function) {
+        error(stmt.getKeyword(), "Return statement outside of function");
+    }
+    
+    if (!stmt.getValue()) {
+        emit(encodeABC(OpCode::RETURN0, 0));
+        return;
+    }
+    
+    // A call in tail position reuses this frame instead of nesting a new one
+    if (CallExpr* call = stmt.getTailCall()) {
+        auto* var_expr = dynamic_cast<VariableExpr*>(call->getCallee().get());
+        auto it = var_expr ? function_indices.find(var_expr->getName().lexeme) : function_indices.end();
+        if (it != function_indices.end()) {
+            setPosition(call->getParen());
+            uint8_t base = static_cast<uint8_t>(next_reg);
+            for (const auto& arg : call->getArguments()) {
+                compileExpr(arg, allocRegister());
+            }
+            
+            emit(encodeABC(OpCode::TAILCALL, base, static_cast<uint8_t>(call->getArguments().size())));
+            emit(it->second);
+            return;
+        }
+    }
+    
+    uint8_t reg = exprToRegister(stmt.getValue(), true);
+    emit(encodeABC(OpCode::RETURN, reg));
+}
+
+} // namespace mana
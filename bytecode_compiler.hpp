@@ -0,0 +1,133 @@
+#ifndef MANASCRIPT_BYTECODE_COMPILER_HPP
+#define MANASCRIPT_BYTECODE_COMPILER_HPP
+
+#include "ast.hpp"
+#include "bytecode.hpp"
+#include "error.hpp"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Exception used to abandon compilation after a diagnostic was reported
+ */
+class BytecodeError : public std::runtime_error {
+public:
+    BytecodeError(const std::string& message) : std::runtime_error(message) {}
+};
+
+/**
+ * @brief Compiles the AST into register bytecode for the VM
+ *
+ * Locals live in fixed registers for their whole scope; temporaries are
+ * allocated above them with a stack discipline and released after each
+ * statement. Arguments are evaluated into consecutive registers so the callee's
+ * frame can start directly on top of them.
+ */
+class BytecodeCompiler : public AstVisitor {
+public:
+    BytecodeCompiler(const std::string& filename = "");
+    
+    /**
+     * @brief Compile a whole program
+     * @return The program, or nullptr if an error was reported
+     */
+    std::unique_ptr<BytecodeProgram> compile(const std::vector<StmtPtr>& statements);
+    
+    /**
+     * @brief Record the file of a function declared outside the main script
+     */
+    void setSourceFile(const FunctionStmt& stmt, const std::string& file) { source_files[&stmt] = file; }
+    
+    // Expression visitors
+    void visitLiteralExpr(LiteralExpr& expr) override;
+    void visitUnaryExpr(UnaryExpr& expr) override;
+    void visitBinaryExpr(BinaryExpr& expr) override;
+    void visitGroupingExpr(GroupingExpr& expr) override;
+    void visitVariableExpr(VariableExpr& expr) override;
+    void visitAssignExpr(AssignExpr& expr) override;
+    void visitCallExpr(CallExpr& expr) override;
+    void visitArrayExpr(ArrayExpr& expr) override;
+    void visitIndexExpr(IndexExpr& expr) override;
+    void visitIndexAssignExpr(IndexAssignExpr& expr) override;
+    void visitSliceExpr(SliceExpr& expr) override;
+    void visitSpawnExpr(SpawnExpr& expr) override;
+    
+    // Statement visitors
+    void visitExpressionStmt(ExpressionStmt& stmt) override;
+    void visitVarDeclStmt(VarDeclStmt& stmt) override;
+    void visitBlockStmt(BlockStmt& stmt) override;
+    void visitIfStmt(IfStmt& stmt) override;
+    void visitWhileStmt(WhileStmt& stmt) override;
+    void visitForStmt(ForStmt& stmt) override;
+    void visitBreakStmt(BreakStmt& stmt) override;
+    void visitContinueStmt(ContinueStmt& stmt) override;
+    void visitFunctionStmt(FunctionStmt& stmt) override;
+    void visitReturnStmt(ReturnStmt& stmt) override;
+    
+private:
+    struct Local {
+        std::string name;
+        uint8_t reg;
+    };
+    
+    // Jumps leaving a loop being compiled, patched once their targets are known
+    struct LoopJumps {
+        size_t start;                   // Where a while loop's continue goes back to
+        bool forward_continue;          // A for loop's continue jumps ahead to the increment
+        std::vector<size_t> breaks;
+        std::vector<size_t> continues;
+    };
+    
+    std::string filename;
+    std::unordered_map<const FunctionStmt*, std::string> source_files;
+    std::unique_ptr<BytecodeProgram> program;
+    std::unordered_map<std::string, uint32_t> function_indices;
+    std::unordered_map<std::string, uint16_t> string_constants;
+    std::unordered_map<int32_t, uint16_t> int_constants;
+    std::unordered_map<uint64_t, uint16_t> double_constants;
+    
+    // State of the function being compiled
+    FunctionProto* proto = nullptr;
+    std::vector<Local> locals;
+    std::vector<size_t> scope_marks;
+    std::vector<LoopJumps> loops;
+    uint16_t next_reg = 0;
+    uint8_t target = 0;
+    int line = 0;
+    int column = 0;
+    bool in_function = false;
+    
+    void compileFunction(FunctionStmt& stmt, FunctionProto& out);
+    void compileExpr(const ExprPtr& expr, uint8_t reg);
+    uint8_t exprToRegister(const ExprPtr& expr, bool allow_local);
+    void compileStatement(const StmtPtr& stmt);
+    void compileDiscarded(const ExprPtr& expr);
+    
+    uint8_t allocRegister();
+    const Local* resolveLocal(const std::string& name) const;
+    void enterScope();
+    void exitScope();
+    
+    size_t emit(Instruction instruction);
+    void setPosition(const Token& token);
+    size_t emitJump(OpCode op, uint8_t a = 0);
+    void patchJump(size_t at);
+    void emitLoop(size_t loop_start);
+    
+    uint16_t addConstant(const Value& value);
+    uint16_t addIntConstant(int32_t value);
+    uint16_t addDoubleConstant(double value);
+    uint16_t addStringConstant(const std::string& text);
+    
+    [[noreturn]] void error(const Token& token, const std::string& message);
+};
+
+} // namespace mana
+
+#endif // MANASCRIPT_BYTECODE_COMPILER_HPP
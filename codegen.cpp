@@ -1,23 +1,234 @@
 // Adding codegen.cpp from adnanis78612
 #include "codegen.hpp"
+#include "profile.hpp"
+#include "variable_scan.hpp"
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Support/Path.h>
+#include <algorithm>
 #include <iostream>
 #include <sstream>
+#include <unordered_set>
 #include <vector>
 
 namespace mana {
 
+namespace {
+
+/**
+ * @brief Finds loops worth handing to the vectorizer: they index arrays and call nothing but len()
+ *
+ * Forcing the vectorizer also lets it reorder floating-point reductions, so
+ * the scan records the variables a loop assigns but doesn't declare.
+ */
+class LoopScan : public StaticVisitor<LoopScan, void> {
+public:
+    bool indexes = false;
+    bool calls = false;
+    std::unordered_set<std::string> assigned;
+    std::unordered_set<std::string> declared;
+    
+    /**
+     * @brief Whether the loop carries a double from one iteration to the next
+     */
+    bool carriesDouble(const std::unordered_map<std::string, llvm::AllocaInst*>& named_values) const {
+        for (const auto& name : assigned) {
+            auto it = named_values.find(name);
+            if (!declared.count(name) && it != named_values.end() &&
+                it->second->getAllocatedType()->isFloatingPointTy()) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    void visitLiteralExpr(LiteralExpr&) {}
+    void visitUnaryExpr(UnaryExpr& expr) { visit(*expr.getRight()); }
+    void visitBinaryExpr(BinaryExpr& expr) { visit(*expr.getLeft()); visit(*expr.getRight()); }
+    void visitGroupingExpr(GroupingExpr& expr) { visit(*expr.getExpression()); }
+    void visitVariableExpr(VariableExpr&) {}
+    
+    void visitAssignExpr(AssignExpr& expr) {
+        assigned.insert(expr.getName().lexeme);
+        visit(*expr.getValue());
+    }
+    
+    void visitCallExpr(CallExpr& expr) {
+        auto* callee = dynamic_cast<VariableExpr*>(expr.getCallee().get());
+        if (!callee || callee->getName().lexeme != "len") {
+            calls = true;
+        }
+        for (const auto& arg : expr.getArguments()) {
+            visit(*arg);
+        }
+    }
+    
+    void visitArrayExpr(ArrayExpr&) {
+        // Allocates through the runtime
+        calls = true;
+    }
+    
+    void visitIndexExpr(IndexExpr& expr) {
+        indexes = true;
+        visit(*expr.getArray());
+        visit(*expr.getIndex());
+    }
+    
+    void visitIndexAssignExpr(IndexAssignExpr& expr) {
+        indexes = true;
+        visit(*expr.getArray());
+        visit(*expr.getIndex());
+        visit(*expr.getValue());
+    }
+    
+    void visitSliceExpr(SliceExpr& expr) {
+        visit(*expr.getArray());
+        if (expr.getStart()) visit(*expr.getStart());
+        if (expr.getEnd()) visit(*expr.getEnd());
+    }
+    
+    void visitSpawnExpr(SpawnExpr& expr) { visitCallExpr(*expr.getCall()); }
+    
+    void visitExpressionStmt(ExpressionStmt& stmt) { visit(*stmt.getExpression()); }
+    
+    void visitVarDeclStmt(VarDeclStmt& stmt) {
+        declared.insert(stmt.getName().lexeme);
+        if (stmt.getInitializer()) visit(*stmt.getInitializer());
+    }
+    
+    void visitBlockStmt(BlockStmt& stmt) {
+        for (const auto& s : stmt.getStatements()) {
+            if (s) visit(*s);
+        }
+    }
+    
+    void visitIfStmt(IfStmt& stmt) {
+        visit(*stmt.getCondition());
+        visit(*stmt.getThenBranch());
+        if (stmt.getElseBranch()) visit(*stmt.getElseBranch());
+    }
+    
+    void visitWhileStmt(WhileStmt& stmt) {
+        visit(*stmt.getCondition());
+        visit(*stmt.getBody());
+    }
+    
+    void visitForStmt(ForStmt& stmt) {
+        if (stmt.isParallel()) {
+            // Hands the range to the runtime
+            calls = true;
+        }
+        if (stmt.getInitializer()) visit(*stmt.getInitializer());
+        if (stmt.getCondition()) visit(*stmt.getCondition());
+        if (stmt.getIncrement()) visit(*stmt.getIncrement());
+        visit(*stmt.getBody());
+    }
+    
+    void visitBreakStmt(BreakStmt&) {}
+    void visitContinueStmt(ContinueStmt&) {}
+    void visitFunctionStmt(FunctionStmt&) {}
+    
+    void visitReturnStmt(ReturnStmt& stmt) {
+        if (stmt.getValue()) visit(*stmt.getValue());
+    }
+};
+
+/**
+ * @brief Collect the keywords of a function body's loops in source order
+ *
+ * Nested function declarations are skipped; their loops belong to them. So
+ * are the bodies of parallel for loops, which run on other threads.
+ */
+void collectLoops(const Statement& stmt, std::vector<const Token*>& loops) {
+    switch (stmt.getKind()) {
+        case NodeKind::BLOCK_STMT:
+            for (const auto& s : static_cast<const BlockStmt&>(stmt).getStatements()) {
+                if (s) {
+                    collectLoops(*s, loops);
+                }
+            }
+            break;
+        case NodeKind::IF_STMT: {
+            const auto& branch = static_cast<const IfStmt&>(stmt);
+            if (branch.getThenBranch()) {
+                collectLoops(*branch.getThenBranch(), loops);
+            }
+            if (branch.getElseBranch()) {
+                collectLoops(*branch.getElseBranch(), loops);
+            }
+            break;
+        }
+        case NodeKind::WHILE_STMT: {
+            const auto& loop = static_cast<const WhileStmt&>(stmt);
+            loops.push_back(&loop.getKeyword());
+            if (loop.getBody()) {
+                collectLoops(*loop.getBody(), loops);
+            }
+            break;
+        }
+        case NodeKind::FOR_STMT: {
+            const auto& loop = static_cast<const ForStmt&>(stmt);
+            loops.push_back(&loop.getKeyword());
+            if (loop.getBody() && !loop.isParallel()) {
+                collectLoops(*loop.getBody(), loops);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+} // namespace
+
 CodeGenerator::CodeGenerator() {}
 
 void CodeGenerator::initialize(const std::string& module_name) {
-    context = std::make_unique<llvm::LLVMContext>();
+    owned_context = std::make_unique<llvm::LLVMContext>();
+    initialize(*owned_context, module_name);
+}
+
+void CodeGenerator::initialize(llvm::LLVMContext& ctx, const std::string& module_name) {
+    context = &ctx;
     module = std::make_unique<llvm::Module>(module_name, *context);
     builder = std::make_unique<llvm::IRBuilder<>>(*context);
     
-    // Initialize built-in functions
-    createPrintFunction();
+    // Runtime functions called by generated code
+    string_pool.clear();
+    declareRuntimeFunctions();
 }
 
 void CodeGenerator::generate(const std::vector<StmtPtr>& statements) {
+    if (!types) {
+        PhaseTimer phase(stats, "resolve");
+        owned_types = std::make_unique<TypeInference>(module->getSourceFileName());
+        if (!owned_types->analyze(statements) || !owned_types->addExports(exports)) {
+            return;
+        }
+        types = owned_types.get();
+    }
+    
+    {
+        PhaseTimer phase(stats, "codegen");
+        
+        // Declare every specialization up front so calls may precede definitions
+        std::vector<const Specialization*> specs;
+        for (const auto& spec : types->getSpecializations()) {
+            declareSpecialization(*spec);
+            specs.push_back(spec.get());
+        }
+        
+        generateMain(statements);
+        generateSpecializations(specs);
+        if (!hot_version.empty()) {
+            generateHotStubs(specs);
+        }
+    }
+    
+    PhaseTimer phase(stats, "verify");
+    verify();
+}
+
+void CodeGenerator::generateMain(const std::vector<StmtPtr>& statements) {
     // Create main function
     llvm::FunctionType* main_type = llvm::FunctionType::get(
         getIntType(), false
@@ -33,18 +244,140 @@ void CodeGenerator::generate(const std::vector<StmtPtr>& statements) {
     
     // Set current function
     current_function = main_func;
+    current_spec = &types->getMain();
+    beginFunction(main_func, "main", 1);
+    beginProfile("main", 1, statements);
     
-    // Generate code for statements
+    // Generate code for statements (function bodies are emitted separately)
     for (const auto& stmt : statements) {
-        if (stmt) {
-            stmt->accept(*this);
+        if (stmt && !dynamic_cast<FunctionStmt*>(stmt.get())) {
+            visit(*stmt);
         }
     }
     
+    // Tasks nobody joined still finish before the program does
+    if (types->usesTasks()) {
+        builder->CreateCall(getRuntimeFunction(
+            "task_wait_all", llvm::FunctionType::get(getVoidType(), false)
+        ));
+    }
+    
     // Return 0 from main
+    endProfile();
     builder->CreateRet(llvm::ConstantInt::get(getIntType(), 0));
+    builder->SetCurrentDebugLocation(llvm::DebugLoc());
+    profile_state = ProfileState();
+    current_function = nullptr;
+    current_spec = nullptr;
+}
+
+void CodeGenerator::generateSpecializations(const std::vector<const Specialization*>& specs) {
+    for (const Specialization* spec : specs) {
+        generateSpecialization(*spec);
+    }
+}
+
+void CodeGenerator::generateAvailableExternally(const std::vector<const Specialization*>& specs) {
+    for (const Specialization* spec : specs) {
+        // A copy of a memoized function would inline its cache lookup, not its body
+        llvm::Function* function = declareSpecialization(*spec);
+        if (!function->empty() || shouldMemoize(*spec)) {
+            continue;
+        }
+        generateSpecialization(*spec);
+        if (!function->empty()) {
+            function->setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+        }
+    }
+}
+
+bool CodeGenerator::generateNativeEntry(const Specialization& spec) {
+    if (spec.return_type != StaticType::INT && spec.return_type != StaticType::DOUBLE &&
+        spec.return_type != StaticType::BOOL) {
+        return false;
+    }
+    
+    llvm::Function* callee = declareSpecialization(spec);
+    llvm::Type* slot_type = llvm::Type::getInt64Ty(*context);
+    llvm::FunctionType* entry_type = llvm::FunctionType::get(
+        slot_type, {llvm::PointerType::getUnqual(slot_type)}, false
+    );
+    llvm::Function* entry = llvm::Function::Create(
+        entry_type, llvm::Function::ExternalLinkage, spec.name + ".entry", module.get()
+    );
+    
+    llvm::IRBuilderBase::InsertPointGuard guard(*builder);
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", entry));
+    builder->SetCurrentDebugLocation(llvm::DebugLoc());
+    
+    // Array parameters are already a pointer and a length, one slot each
+    std::vector<llvm::Value*> args;
+    for (llvm::Argument& param : callee->args()) {
+        llvm::Value* slot = builder->CreateLoad(slot_type, builder->CreateConstInBoundsGEP1_32(
+            slot_type, entry->getArg(0), param.getArgNo()
+        ));
+        llvm::Type* type = param.getType();
+        if (type->isDoubleTy()) {
+            args.push_back(builder->CreateBitCast(slot, type));
+        } else if (type->isPointerTy()) {
+            args.push_back(builder->CreateIntToPtr(slot, type));
+        } else {
+            args.push_back(builder->CreateTrunc(slot, type));
+        }
+    }
+    
+    llvm::Value* result = builder->CreateCall(callee, args, "result");
+    if (spec.return_type == StaticType::DOUBLE) {
+        result = builder->CreateBitCast(result, slot_type);
+    } else if (spec.return_type == StaticType::BOOL) {
+        result = builder->CreateZExt(result, slot_type);
+    } else {
+        result = builder->CreateSExt(result, slot_type);
+    }
+    builder->CreateRet(result);
+    return true;
+}
+
+void CodeGenerator::generateHotStubs(const std::vector<const Specialization*>& specs) {
+    for (const Specialization* spec : specs) {
+        llvm::Function* stub = declareSpecialization(*spec);
+        if (!stub->empty()) {
+            continue;
+        }
+        
+        llvm::Function* body = declareHotBody(*spec);
+        llvm::PointerType* target_type = body->getType();
+        auto* impl = new llvm::GlobalVariable(
+            *module, target_type, false, llvm::GlobalValue::ExternalLinkage, body, spec->name + ".impl"
+        );
+        
+        builder->SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", stub));
+        builder->SetCurrentDebugLocation(llvm::DebugLoc());
+        llvm::LoadInst* target = builder->CreateLoad(target_type, impl, "target");
+        target->setAtomic(llvm::AtomicOrdering::Acquire);
+        
+        // The stub's frame is replaced by the body's, so it costs one jump
+        std::vector<llvm::Value*> args;
+        for (llvm::Argument& arg : stub->args()) {
+            args.push_back(&arg);
+        }
+        llvm::CallInst* call = builder->CreateCall(stub->getFunctionType(), target, args);
+        call->setAttributes(stub->getAttributes());
+        call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+        if (call->getType()->isVoidTy()) {
+            builder->CreateRetVoid();
+        } else {
+            builder->CreateRet(call);
+        }
+    }
+}
+
+bool CodeGenerator::verify() {
+    // Debug info must be complete before the module can be checked
+    if (di_builder) {
+        di_builder->finalize();
+    }
     
-    // Verify the module
     std::string error_info;
     llvm::raw_string_ostream error_stream(error_info);
     if (llvm::verifyModule(*module, &error_stream)) {
@@ -53,50 +386,106 @@ void CodeGenerator::generate(const std::vector<StmtPtr>& statements) {
             "LLVM IR verification failed: " + error_stream.str(),
             SourceLocation()
         );
+        return false;
     }
+    return true;
 }
 
-void CodeGenerator::createPrintFunction() {
-    // Declare printf function
-    std::vector<llvm::Type*> printf_args;
-    printf_args.push_back(llvm::Type::getInt8PtrTy(*context));
-    llvm::FunctionType* printf_type = llvm::FunctionType::get(
-        getIntType(), printf_args, true
+void CodeGenerator::declareRuntimeFunctions() {
+    // Implemented natively in runtime.cpp and resolved by the JIT
+    llvm::Type* void_type = getVoidType();
+    print_str = llvm::Function::Create(
+        llvm::FunctionType::get(void_type, {getStringType()}, false),
+        llvm::Function::ExternalLinkage, "print_str", module.get()
     );
-    llvm::Function::Create(
-        printf_type, llvm::Function::ExternalLinkage, "printf", module.get()
+    print_i64 = llvm::Function::Create(
+        llvm::FunctionType::get(void_type, {llvm::Type::getInt64Ty(*context)}, false),
+        llvm::Function::ExternalLinkage, "print_i64", module.get()
     );
-    
-    // Create print function that wraps printf
-    std::vector<llvm::Type*> print_args;
-    print_args.push_back(llvm::Type::getInt8PtrTy(*context));
-    llvm::FunctionType* print_type = llvm::FunctionType::get(
-        getVoidType(), print_args, false
-    );
-    llvm::Function* print_func = llvm::Function::Create(
-        print_type, llvm::Function::ExternalLinkage, "print", module.get()
+    print_f64 = llvm::Function::Create(
+        llvm::FunctionType::get(void_type, {getFloatType()}, false),
+        llvm::Function::ExternalLinkage, "print_f64", module.get()
     );
     
-    // Set argument name
-    print_func->arg_begin()->setName("format");
-    
-    // Create basic block
-    llvm::BasicBlock* entry = llvm::BasicBlock::Create(*context, "entry", print_func);
-    builder->SetInsertPoint(entry);
+    for (llvm::Function* function : {print_str, print_i64, print_f64}) {
+        function->setDoesNotThrow();
+    }
+}
+
+llvm::Function* CodeGenerator::getRuntimeFunction(const char* name, llvm::FunctionType* type) {
+    if (llvm::Function* existing = module->getFunction(name)) {
+        return existing;
+    }
+    return llvm::Function::Create(type, llvm::Function::ExternalLinkage, name, module.get());
+}
+
+llvm::Constant* CodeGenerator::getStringConstant(const std::string& text) {
+    auto it = string_pool.find(text);
+    if (it != string_pool.end()) {
+        return it->second;
+    }
     
-    // Get printf function
-    llvm::Function* printf_func = module->getFunction("printf");
+    llvm::Constant* data = llvm::ConstantDataArray::getString(*context, text);
+    llvm::GlobalVariable* global = new llvm::GlobalVariable(
+        *module, data->getType(), true,
+        llvm::GlobalValue::PrivateLinkage, data, ".str"
+    );
+    global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+    global->setAlignment(llvm::MaybeAlign(1));
     
-    // Call printf with the format string
-    std::vector<llvm::Value*> args;
-    args.push_back(print_func->arg_begin());
-    builder->CreateCall(printf_func, args);
+    // Pointer to the first character
+    llvm::Constant* zero = llvm::ConstantInt::get(getIntType(), 0);
+    llvm::Constant* pointer = llvm::ConstantExpr::getInBoundsGetElementPtr(
+        global->getValueType(), global, llvm::ArrayRef<llvm::Constant*>{zero, zero}
+    );
+    string_pool.emplace(text, pointer);
+    return pointer;
+}
+
+llvm::Value* CodeGenerator::emitPrint(llvm::Value* value) {
+    llvm::Type* type = value->getType();
+    
+    if (isArray(value)) {
+        llvm::Value* data = builder->CreateExtractValue(value, 0, "data");
+        llvm::Value* length = builder->CreateExtractValue(value, 1, "len");
+        bool doubles = getArrayElementType(value)->isDoubleTy();
+        llvm::Function* printer = getRuntimeFunction(
+            doubles ? "print_f64_array" : "print_i32_array",
+            llvm::FunctionType::get(getVoidType(), {data->getType(), getIntType()}, false)
+        );
+        return builder->CreateCall(printer, {data, length});
+    }
     
-    // Return from print
-    builder->CreateRetVoid();
+    if (type->isIntegerTy(1)) {
+        value = builder->CreateSelect(
+            value, getStringConstant("true"), getStringConstant("false"), "bool_str"
+        );
+        return builder->CreateCall(print_str, {value});
+    }
+    if (type->isIntegerTy()) {
+        value = builder->CreateSExt(value, llvm::Type::getInt64Ty(*context), "widen");
+        return builder->CreateCall(print_i64, {value});
+    }
+    if (type->isDoubleTy()) {
+        return builder->CreateCall(print_f64, {value});
+    }
+    if (type == getStringType()) {
+        // nil is a null string and prints as such
+        if (llvm::isa<llvm::ConstantPointerNull>(value)) {
+            value = getStringConstant("nil");
+        } else if (!llvm::isa<llvm::Constant>(value)) {
+            llvm::Value* is_nil = builder->CreateIsNull(value, "is_nil");
+            value = builder->CreateSelect(is_nil, getStringConstant("nil"), value, "print_str");
+        }
+        return builder->CreateCall(print_str, {value});
+    }
     
-    // Add to function map
-    functions["print"] = print_func;
+    diagnostics.report(
+        DiagnosticSeverity::ERROR,
+        "Cannot print a value of this type",
+        SourceLocation()
+    );
+    return nullptr;
 }
 
 llvm::Type* CodeGenerator::getIntType() {
@@ -119,37 +508,449 @@ llvm::Type* CodeGenerator::getStringType() {
     return llvm::Type::getInt8PtrTy(*context);
 }
 
-llvm::AllocaInst* CodeGenerator::createEntryBlockAlloca(
-    llvm::Function* function, const std::string& name, llvm::Type* type) {
+llvm::Type* CodeGenerator::getLLVMType(StaticType type) {
+    switch (type) {
+        case StaticType::BOOL:   return getBoolType();
+        case StaticType::DOUBLE: return getFloatType();
+        case StaticType::STRING: return getStringType();
+        case StaticType::VOID:   return getVoidType();
+        case StaticType::INT_ARRAY:    return getArrayType(getIntType());
+        case StaticType::DOUBLE_ARRAY: return getArrayType(getFloatType());
+        default:
+            if (isTaskType(type)) {
+                return llvm::PointerType::getUnqual(getTaskType(taskResultType(type)));
+            }
+            return getIntType();
+    }
+}
+
+llvm::StructType* CodeGenerator::getArrayType(llvm::Type* element) {
+    std::string name = element->isDoubleTy() ? "mana.array.f64" : "mana.array.i32";
+    if (llvm::StructType* existing = llvm::StructType::getTypeByName(*context, name)) {
+        return existing;
+    }
+    return llvm::StructType::create(
+        *context, {llvm::PointerType::getUnqual(element), getIntType()}, name
+    );
+}
+
+llvm::Type* CodeGenerator::getArrayElementType(const llvm::Value* array) {
+    // The two array types are named structs, so the element follows from which one it is
+    return array->getType() == getArrayType(getFloatType()) ? getFloatType() : getIntType();
+}
+
+bool CodeGenerator::isArray(const llvm::Value* value) const {
+    return value && value->getType()->isStructTy();
+}
+
+llvm::Value* CodeGenerator::makeArray(llvm::Value* data, llvm::Value* length, llvm::StructType* type) {
+    llvm::Value* array = llvm::UndefValue::get(type);
+    array = builder->CreateInsertValue(array, data, 0);
+    return builder->CreateInsertValue(array, length, 1, "array");
+}
+
+llvm::StructType* CodeGenerator::getTaskType(StaticType result) {
+    std::string name = std::string("mana.task.") + staticTypeSuffix(result);
+    if (llvm::StructType* existing = llvm::StructType::getTypeByName(*context, name)) {
+        return existing;
+    }
+    return llvm::StructType::create(*context, {getLLVMType(result)}, name);
+}
+
+llvm::StructType* CodeGenerator::getTaskEnvironmentType(llvm::Function* callee) {
+    std::vector<llvm::Type*> fields = {callee->getReturnType()};
+    for (llvm::Type* param : callee->getFunctionType()->params()) {
+        fields.push_back(param);
+    }
+    return llvm::StructType::get(*context, fields);
+}
+
+llvm::Function* CodeGenerator::getTaskThunk(const Specialization& target) {
+    std::string name = target.name + ".task";
+    if (llvm::Function* existing = module->getFunction(name)) {
+        return existing;
+    }
     
-    llvm::IRBuilder<> temp_builder(
-        &function->getEntryBlock(),
-        function->getEntryBlock().begin()
+    llvm::Function* callee = declareSpecialization(target);
+    llvm::StructType* env_type = getTaskEnvironmentType(callee);
+    llvm::Function* thunk = llvm::Function::Create(
+        llvm::FunctionType::get(getVoidType(), {getStringType()}, false),
+        llvm::Function::InternalLinkage, name, module.get()
     );
     
-    return temp_builder.CreateAlloca(type, nullptr, name);
+    // Emitted on the side while the caller is being generated
+    llvm::IRBuilderBase::InsertPointGuard guard(*builder);
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", thunk));
+    builder->SetCurrentDebugLocation(llvm::DebugLoc());
+    
+    llvm::Value* env = builder->CreateBitCast(thunk->getArg(0), env_type->getPointerTo(), "env");
+    std::vector<llvm::Value*> args;
+    for (unsigned i = 1; i < env_type->getNumElements(); ++i) {
+        args.push_back(builder->CreateLoad(
+            env_type->getElementType(i), builder->CreateStructGEP(env_type, env, i)
+        ));
+    }
+    llvm::Value* result = builder->CreateCall(callee, args, "result");
+    builder->CreateStore(result, builder->CreateStructGEP(env_type, env, 0));
+    builder->CreateRetVoid();
+    return thunk;
 }
 
-void CodeGenerator::pushValue(llvm::Value* value) {
-    value_stack.push_back(value);
+void CodeGenerator::emitRuntimeCheck(llvm::Value* ok, const Token& at, const char* handler,
+                                     const std::vector<llvm::Value*>& values) {
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock* fail_bb = llvm::BasicBlock::Create(*context, "check.fail", function);
+    llvm::BasicBlock* ok_bb = llvm::BasicBlock::Create(*context, "check.ok", function);
+    
+    llvm::MDBuilder md(*context);
+    builder->CreateCondBr(ok, ok_bb, fail_bb, md.createBranchWeights(1 << 20, 1));
+    
+    // Handlers take the source position followed by the offending values
+    std::vector<llvm::Value*> args = {
+        getStringConstant(getSourceFile()),
+        llvm::ConstantInt::get(getIntType(), at.line),
+        llvm::ConstantInt::get(getIntType(), at.column)
+    };
+    args.insert(args.end(), values.begin(), values.end());
+    
+    std::vector<llvm::Type*> arg_types;
+    for (llvm::Value* arg : args) {
+        arg_types.push_back(arg->getType());
+    }
+    llvm::Function* callee = getRuntimeFunction(
+        handler, llvm::FunctionType::get(getVoidType(), arg_types, false)
+    );
+    callee->setDoesNotReturn();
+    callee->addFnAttr(llvm::Attribute::Cold);
+    callee->setDoesNotThrow();
+    
+    builder->SetInsertPoint(fail_bb);
+    builder->CreateCall(callee, args);
+    builder->CreateUnreachable();
+    builder->SetInsertPoint(ok_bb);
 }
 
-llvm::Value* CodeGenerator::popValue() {
-    if (value_stack.empty()) {
-        return nullptr;
+llvm::Value* CodeGenerator::emitIntegerDivision(const Token& op, llvm::Value* left, llvm::Value* right) {
+    llvm::Type* type = left->getType();
+    llvm::Value* zero = llvm::ConstantInt::get(type, 0);
+    emitRuntimeCheck(builder->CreateICmpNE(right, zero, "div.ok"), op, "division_error", {});
+    
+    // INT_MIN / -1 overflows; like the interpreter, x / -1 wraps to -x and
+    // x % -1 is 0, and the divisor is replaced so the division is defined
+    llvm::Value* minus_one = llvm::ConstantInt::getSigned(type, -1);
+    llvm::Value* negating = builder->CreateICmpEQ(right, minus_one, "div.neg");
+    llvm::Value* divisor = builder->CreateSelect(negating, llvm::ConstantInt::get(type, 1), right, "divisor");
+    if (op.type == TokenType::SLASH) {
+        llvm::Value* quotient = builder->CreateSDiv(left, divisor, "div");
+        return builder->CreateSelect(negating, builder->CreateSub(zero, left, "neg"), quotient, "div.result");
+    }
+    llvm::Value* remainder = builder->CreateSRem(left, divisor, "rem");
+    return builder->CreateSelect(negating, zero, remainder, "rem.result");
+}
+
+llvm::Value* CodeGenerator::allocateArray(llvm::Type* element, llvm::Value* count, const Token& at) {
+    auto* constant = llvm::dyn_cast<llvm::ConstantInt>(count);
+    if (!constant || constant->isNegative()) {
+        emitRuntimeCheck(
+            builder->CreateICmpSGE(count, llvm::ConstantInt::get(getIntType(), 0), "len.ok"),
+            at, "array_length_error", {count}
+        );
+    }
+    
+    llvm::Function* alloc = module->getFunction("array_alloc");
+    if (!alloc) {
+        alloc = getRuntimeFunction(
+            "array_alloc",
+            llvm::FunctionType::get(getStringType(), {getIntType(), getIntType()}, false)
+        );
+        // Fresh, zeroed storage aligned for vector loads
+        alloc->addRetAttr(llvm::Attribute::NoAlias);
+        alloc->addRetAttr(llvm::Attribute::getWithAlignment(*context, llvm::Align(64)));
     }
     
-    llvm::Value* value = value_stack.back();
-    value_stack.pop_back();
+    llvm::Value* size = llvm::ConstantInt::get(
+        getIntType(), module->getDataLayout().getTypeAllocSize(element)
+    );
+    llvm::Value* storage = builder->CreateCall(alloc, {count, size}, "storage");
+    llvm::Value* data = builder->CreateBitCast(storage, llvm::PointerType::getUnqual(element), "data");
+    return makeArray(data, count, getArrayType(element));
+}
+
+llvm::Value* CodeGenerator::elementPointer(llvm::Value* array, llvm::Value* index, const Token& at) {
+    llvm::Value* data = builder->CreateExtractValue(array, 0, "data");
+    
+    // One unsigned compare also rejects negative indices
+    llvm::Value* length = builder->CreateExtractValue(array, 1, "len");
+    emitRuntimeCheck(
+        builder->CreateICmpULT(index, length, "in.bounds"),
+        at, "array_index_error", {index, length}
+    );
+    
+    llvm::Value* offset = builder->CreateSExt(index, llvm::Type::getInt64Ty(*context), "idx");
+    return builder->CreateInBoundsGEP(getArrayElementType(array), data, offset, "elem.ptr");
+}
+
+llvm::Value* CodeGenerator::convertValue(llvm::Value* value, llvm::Type* type) {
+    if (!value || value->getType() == type) {
+        return value;
+    }
+    
+    llvm::Type* from = value->getType();
+    if (from->isIntegerTy() && type->isFloatingPointTy()) {
+        // Booleans convert as 0 or 1, not as a signed i1
+        return from->isIntegerTy(1)
+            ? builder->CreateUIToFP(value, type, "bool2float")
+            : builder->CreateSIToFP(value, type, "int2float");
+    }
+    if (from->isIntegerTy(1) && type->isIntegerTy()) {
+        return builder->CreateZExt(value, type, "bool2int");
+    }
+    
+    // Not convertible; the verifier reports the mismatch
     return value;
 }
 
-llvm::Value* CodeGenerator::getCurrentValue() {
-    if (value_stack.empty()) {
+llvm::Value* CodeGenerator::toCondition(llvm::Value* value, const std::string& name) {
+    if (value->getType()->isIntegerTy(1)) {
+        return value;
+    }
+    if (isArray(value)) {
+        // Arrays are always truthy
+        return llvm::ConstantInt::getTrue(*context);
+    }
+    if (value->getType()->isFloatingPointTy()) {
+        return builder->CreateFCmpONE(
+            value, llvm::ConstantFP::get(value->getType(), 0.0), name
+        );
+    }
+    if (value->getType()->isPointerTy()) {
+        return builder->CreateIsNotNull(value, name);
+    }
+    return builder->CreateICmpNE(
+        value, llvm::ConstantInt::get(value->getType(), 0), name
+    );
+}
+
+void CodeGenerator::beginFunction(llvm::Function* function, const std::string& name, int line) {
+    if (frame_pointers) {
+        function->addFnAttr("frame-pointer", "all");
+    }
+    if (!debug_info) {
+        return;
+    }
+    
+    if (!di_builder) {
+        module->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+        module->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+        
+        di_builder = std::make_unique<llvm::DIBuilder>(*module);
+        llvm::StringRef path = module->getSourceFileName();
+        di_file = di_builder->createFile(llvm::sys::path::filename(path), llvm::sys::path::parent_path(path));
+        di_builder->createCompileUnit(
+            llvm::dwarf::DW_LANG_C, di_file, "manascript", false, "", 0, "",
+            llvm::DICompileUnit::LineTablesOnly
+        );
+    }
+    
+    // Functions imported from other files keep their own file in the line table
+    llvm::DIFile* file = di_file;
+    if (getSourceFile() != module->getSourceFileName()) {
+        llvm::StringRef path = getSourceFile();
+        file = di_builder->createFile(llvm::sys::path::filename(path), llvm::sys::path::parent_path(path));
+    }
+    
+    // Line tables only need the function's name and position
+    llvm::DISubprogram* subprogram = di_builder->createFunction(
+        file, name, function->getName(), file, line,
+        di_builder->createSubroutineType(di_builder->getOrCreateTypeArray({})),
+        line, llvm::DINode::FlagPrototyped, llvm::DISubprogram::SPFlagDefinition
+    );
+    function->setSubprogram(subprogram);
+    builder->SetCurrentDebugLocation(llvm::DILocation::get(*context, line, 0, subprogram));
+}
+
+int32_t CodeGenerator::registerProfileSites(const std::string& name, const std::string& file, int line,
+                                            const std::vector<StmtPtr>& body) {
+    int32_t slot = registerProfileFunction(name, file, line);
+    
+    std::vector<const Token*> loops;
+    for (const auto& stmt : body) {
+        if (stmt) {
+            collectLoops(*stmt, loops);
+        }
+    }
+    for (const Token* loop : loops) {
+        registerProfileLoop(name, file, loop->line, loop->column);
+    }
+    return slot;
+}
+
+llvm::StructType* CodeGenerator::getProfileThreadType() {
+    // Mirrors ProfileThread
+    if (llvm::StructType* existing = llvm::StructType::getTypeByName(*context, "mana.profile.thread")) {
+        return existing;
+    }
+    llvm::Type* i64 = llvm::Type::getInt64Ty(*context);
+    return llvm::StructType::create(
+        *context, {llvm::PointerType::getUnqual(i64), i64}, "mana.profile.thread"
+    );
+}
+
+llvm::Value* CodeGenerator::loadProfileThread() {
+    llvm::StructType* thread_type = getProfileThreadType();
+    llvm::Function* get_thread = getRuntimeFunction(
+        "profile_thread",
+        llvm::FunctionType::get(llvm::PointerType::getUnqual(thread_type), false)
+    );
+    get_thread->setDoesNotThrow();
+    if (!profileBlockIsThreadLocal()) {
+        return builder->CreateCall(get_thread, {}, "prof.thread");
+    }
+    
+    // The JIT binds this thread's block; the runtime is called only when it
+    // lacks a counter of the sites registered so far, i.e. once per thread
+    llvm::GlobalVariable* block = module->getNamedGlobal("profile_block");
+    if (!block) {
+        block = new llvm::GlobalVariable(
+            *module, thread_type, false, llvm::GlobalValue::ExternalLinkage, nullptr, "profile_block",
+            nullptr, llvm::GlobalValue::InitialExecTLSModel
+        );
+    }
+    llvm::Value* size = builder->CreateLoad(
+        builder->getInt64Ty(), builder->CreateStructGEP(thread_type, block, 1), "prof.size"
+    );
+    llvm::Value* attached = builder->CreateICmpUGE(
+        size, builder->getInt64(static_cast<uint64_t>(profileSlotCount())), "prof.attached"
+    );
+    
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock* attach = llvm::BasicBlock::Create(*context, "prof.attach", function);
+    llvm::BasicBlock* body = llvm::BasicBlock::Create(*context, "prof.body", function);
+    llvm::MDBuilder md(*context);
+    builder->CreateCondBr(attached, body, attach, md.createBranchWeights(1 << 20, 1));
+    
+    builder->SetInsertPoint(attach);
+    builder->CreateCall(get_thread);
+    builder->CreateBr(body);
+    
+    builder->SetInsertPoint(body);
+    return block;
+}
+
+llvm::Value* CodeGenerator::profileCounter(int32_t slot) {
+    // Reloaded on every use: the array moves when sites are registered later
+    llvm::Value* counters = builder->CreateLoad(
+        llvm::PointerType::getUnqual(builder->getInt64Ty()),
+        builder->CreateStructGEP(getProfileThreadType(), profile_state.thread, 0),
+        "prof.counters"
+    );
+    return builder->CreateInBoundsGEP(builder->getInt64Ty(), counters, builder->getInt64(slot));
+}
+
+void CodeGenerator::beginProfile(const std::string& name, int line, const std::vector<StmtPtr>& body) {
+    profile_state = ProfileState();
+    if (!profile) {
+        return;
+    }
+    
+    profile_state.name = name;
+    profile_state.slot = registerProfileSites(name, getSourceFile(), line, body);
+    profile_state.thread = loadProfileThread();
+    
+    // Time is sampled (see startProfileSampling), so a call only counts itself
+    llvm::Value* calls = profileCounter(profile_state.slot + PROFILE_CALLS);
+    builder->CreateStore(
+        builder->CreateAdd(builder->CreateLoad(builder->getInt64Ty(), calls), builder->getInt64(1)),
+        calls
+    );
+}
+
+void CodeGenerator::flushProfileLoops() {
+    for (const auto& [slot, count] : profile_state.loops) {
+        llvm::Value* counter = profileCounter(slot);
+        builder->CreateStore(
+            builder->CreateAdd(
+                builder->CreateLoad(builder->getInt64Ty(), counter),
+                builder->CreateLoad(builder->getInt64Ty(), count)
+            ),
+            counter
+        );
+    }
+}
+
+void CodeGenerator::endProfile() {
+    if (!profile_state.thread) {
+        return;
+    }
+    flushProfileLoops();
+}
+
+llvm::AllocaInst* CodeGenerator::beginProfileLoop(const Token& keyword, int32_t& slot) {
+    if (!profile_state.thread) {
         return nullptr;
     }
+    slot = registerProfileLoop(profile_state.name, getSourceFile(), keyword.line, keyword.column);
+    llvm::AllocaInst* iterations = createEntryBlockAlloca(
+        builder->GetInsertBlock()->getParent(), "loop.count", builder->getInt64Ty()
+    );
+    builder->CreateStore(builder->getInt64(0), iterations);
+    return iterations;
+}
+
+void CodeGenerator::endProfileLoop(int32_t slot, llvm::AllocaInst* iterations) {
+    if (!iterations) {
+        return;
+    }
+    llvm::Value* counter = profileCounter(slot);
+    builder->CreateStore(
+        builder->CreateAdd(
+            builder->CreateLoad(builder->getInt64Ty(), counter),
+            builder->CreateLoad(builder->getInt64Ty(), iterations)
+        ),
+        counter
+    );
+}
+
+void CodeGenerator::requestVectorization(llvm::BranchInst* latch) {
+    // Only a hint: the vectorizer still proves the loop safe before transforming it
+    llvm::LLVMContext& ctx = *context;
+    llvm::Metadata* enable[] = {
+        llvm::MDString::get(ctx, "llvm.loop.vectorize.enable"),
+        llvm::ConstantAsMetadata::get(llvm::ConstantInt::getTrue(ctx))
+    };
+    llvm::MDNode* loop_id = llvm::MDNode::getDistinct(
+        ctx, {nullptr, llvm::MDNode::get(ctx, enable)}
+    );
+    loop_id->replaceOperandWith(0, loop_id);
+    latch->setMetadata(llvm::LLVMContext::MD_loop, loop_id);
+}
+
+const std::string& CodeGenerator::getSourceFile() const {
+    if (current_spec && current_spec->stmt && types) {
+        if (const std::string* file = types->findSourceFile(*current_spec->stmt)) {
+            return *file;
+        }
+    }
+    return module->getSourceFileName();
+}
+
+void CodeGenerator::setDebugLocation(const Token& token) {
+    if (current_function && current_function->getSubprogram()) {
+        builder->SetCurrentDebugLocation(llvm::DILocation::get(
+            *context, token.line, token.column, current_function->getSubprogram()
+        ));
+    }
+}
+
+llvm::AllocaInst* CodeGenerator::createEntryBlockAlloca(
+    llvm::Function* function, const std::string& name, llvm::Type* type) {
     
-    return value_stack.back();
+    llvm::IRBuilder<> temp_builder(
+        &function->getEntryBlock(),
+        function->getEntryBlock().begin()
+    );
+    
+    return temp_builder.CreateAlloca(type, nullptr, name);
 }
 
 std::string CodeGenerator::dumpIR() const {
@@ -160,98 +961,128 @@ std::string CodeGenerator::dumpIR() const {
 }
 
 // Expression visitors
-void CodeGenerator::visitLiteralExpr(LiteralExpr& expr) {
+llvm::Value* CodeGenerator::visitLiteralExpr(LiteralExpr& expr) {
     const auto& value = expr.getValue();
     
     if (std::holds_alternative<int>(value)) {
-        pushValue(llvm::ConstantInt::get(getIntType(), std::get<int>(value)));
+        return llvm::ConstantInt::get(getIntType(), std::get<int>(value));
     }
     else if (std::holds_alternative<double>(value)) {
-        pushValue(llvm::ConstantFP::get(getFloatType(), std::get<double>(value)));
+        return llvm::ConstantFP::get(getFloatType(), std::get<double>(value));
     }
     else if (std::holds_alternative<bool>(value)) {
-        pushValue(llvm::ConstantInt::get(getBoolType(), std::get<bool>(value)));
+        return llvm::ConstantInt::get(getBoolType(), std::get<bool>(value));
     }
     else if (std::holds_alternative<std::string>(value)) {
-        // Create a global string constant
-        llvm::Constant* str_const = llvm::ConstantDataArray::getString(
-            *context, std::get<std::string>(value)
-        );
-        
-        llvm::GlobalVariable* global_str = new llvm::GlobalVariable(
-            *module, str_const->getType(), true,
-            llvm::GlobalValue::PrivateLinkage, str_const, ".str"
-        );
-        
-        // Get a pointer to the start of the string
-        std::vector<llvm::Value*> indices = {
-            llvm::ConstantInt::get(getIntType(), 0),
-            llvm::ConstantInt::get(getIntType(), 0)
-        };
-        
-        pushValue(builder->CreateInBoundsGEP(
-            global_str->getValueType(), global_str, indices, "str_ptr"
-        ));
-    }
-    else if (std::holds_alternative<std::nullptr_t>(value)) {
-        pushValue(llvm::ConstantPointerNull::get(
-            llvm::Type::getInt8PtrTy(*context)
-        ));
+        // Identical literals share one pooled constant per module
+        return getStringConstant(std::get<std::string>(value));
     }
+    
+    // nil
+    return llvm::ConstantPointerNull::get(
+        llvm::Type::getInt8PtrTy(*context)
+    );
 }
 
-void CodeGenerator::visitUnaryExpr(UnaryExpr& expr) {
-    expr.getRight()->accept(*this);
-    llvm::Value* operand = popValue();
+llvm::Value* CodeGenerator::visitUnaryExpr(UnaryExpr& expr) {
+    setDebugLocation(expr.getOperator());
+    SourceLocation at(getSourceFile(), expr.getOperator().line, expr.getOperator().column);
+    llvm::Value* operand = visit(*expr.getRight());
     
+    // A failed operand has already reported its own error
     if (!operand) {
-        diagnostics.report(
-            DiagnosticSeverity::ERROR,
-            "Invalid operand for unary operator",
-            SourceLocation()
-        );
-        pushValue(nullptr);
-        return;
+        return nullptr;
     }
     
     TokenType op = expr.getOperator().type;
     
     if (op == TokenType::MINUS) {
         if (operand->getType()->isIntegerTy()) {
-            pushValue(builder->CreateNeg(operand, "neg"));
+            operand = convertValue(operand, getIntType());
+            return builder->CreateNeg(operand, "neg");
         }
         else if (operand->getType()->isFloatingPointTy()) {
-            pushValue(builder->CreateFNeg(operand, "fneg"));
+            return builder->CreateFNeg(operand, "fneg");
         }
         else {
             diagnostics.report(
                 DiagnosticSeverity::ERROR,
                 "Invalid operand type for unary minus",
-                SourceLocation()
+                at
             );
-            pushValue(nullptr);
+            return nullptr;
         }
     }
-    else if (op == TokenType::BANG) {
-        if (operand->getType()->isIntegerTy()) {
-            // Convert any integer to bool first (0 = false, non-0 = true)
-            llvm::Value* bool_val = builder->CreateICmpNE(
-                operand, llvm::ConstantInt::get(operand->getType(), 0), "tobool"
-            );
-            pushValue(builder->CreateNot(bool_val, "not"));
-        }
-        else {
-            diagnostics.report(
-                DiagnosticSeverity::ERROR,
-                "Invalid operand type for logical not",
-                SourceLocation()
-            );
-            pushValue(nullptr);
-        }
+    
+    // Logical not
+    if (operand->getType()->isIntegerTy()) {
+        // Convert any integer to bool first (0 = false, non-0 = true)
+        llvm::Value* bool_val = builder->CreateICmpNE(
+            operand, llvm::ConstantInt::get(operand->getType(), 0), "tobool"
+        );
+        return builder->CreateNot(bool_val, "not");
     }
+    
+    diagnostics.report(
+        DiagnosticSeverity::ERROR,
+        "Invalid operand type for logical not",
+        at
+    );
+    return nullptr;
 }
 
-void CodeGenerator::visitBinaryExpr(BinaryExpr& expr) {
+llvm::Value* CodeGenerator::convertToString(llvm::Value* value) {
+    llvm::Type* type = value->getType();
+    if (type == getStringType()) {
+        return value;
+    }
+    if (type->isIntegerTy(1)) {
+        return builder->CreateSelect(value, getStringConstant("true"), getStringConstant("false"), "bool_str");
+    }
+    if (type->isIntegerTy()) {
+        llvm::Function* from_int = getRuntimeFunction("string_from_i64", llvm::FunctionType::get(
+            getStringType(), {llvm::Type::getInt64Ty(*context)}, false
+        ));
+        value = builder->CreateSExt(value, llvm::Type::getInt64Ty(*context), "widen");
+        return builder->CreateCall(from_int, {value}, "int_str");
+    }
+    llvm::Function* from_double = getRuntimeFunction("string_from_f64", llvm::FunctionType::get(
+        getStringType(), {getFloatType()}, false
+    ));
+    return builder->CreateCall(from_double, {value}, "double_str");
+}
+
+llvm::Value* CodeGenerator::emitStringBinary(const Token& op, llvm::Value* left, llvm::Value* right) {
+    if (op.type == TokenType::PLUS) {
+        llvm::Function* concat = getRuntimeFunction("string_concat", llvm::FunctionType::get(
+            getStringType(), {getStringType(), getStringType()}, false
+        ));
+        return builder->CreateCall(concat, {convertToString(left), convertToString(right)}, "concat");
+    }
+    
+    if (left->getType() != right->getType()) {
+        diagnostics.report(
+            DiagnosticSeverity::ERROR,
+            "Invalid operands for string comparison",
+            SourceLocation(getSourceFile(), op.line, op.column)
+        );
+        return nullptr;
+    }
+    
+    llvm::Function* equal = getRuntimeFunction("string_equal", llvm::FunctionType::get(
+        getIntType(), {getStringType(), getStringType()}, false
+    ));
+    llvm::Value* same = builder->CreateCall(equal, {left, right}, "str_eq");
+    llvm::Value* zero = llvm::ConstantInt::get(getIntType(), 0);
+    return op.type == TokenType::EQUAL_EQUAL
+        ? builder->CreateICmpNE(same, zero, "eq")
+        : builder->CreateICmpEQ(same, zero, "ne");
+}
+
+llvm::Value* CodeGenerator::visitBinaryExpr(BinaryExpr& expr) {
+    setDebugLocation(expr.getOperator());
+    SourceLocation at(getSourceFile(), expr.getOperator().line, expr.getOperator().column);
+    
     // Special case for logical AND/OR (short-circuit evaluation)
     if (expr.getOperator().type == TokenType::AND ||
         expr.getOperator().type == TokenType::OR) {
@@ -262,17 +1093,18 @@ void CodeGenerator::visitBinaryExpr(BinaryExpr& expr) {
         llvm::BasicBlock* merge_bb = llvm::BasicBlock::Create(*context, "merge", function);
         
         // Evaluate left operand
-        expr.getLeft()->accept(*this);
-        llvm::Value* left = popValue();
+        llvm::Value* left = visit(*expr.getLeft());
         
-        if (!left || !left->getType()->isIntegerTy()) {
+        if (!left) {
+            return nullptr;
+        }
+        if (!left->getType()->isIntegerTy()) {
             diagnostics.report(
                 DiagnosticSeverity::ERROR,
                 "Left operand of logical operator must be a boolean",
-                SourceLocation()
+                at
             );
-            pushValue(nullptr);
-            return;
+            return nullptr;
         }
         
         // Convert to boolean if needed
@@ -283,6 +1115,7 @@ void CodeGenerator::visitBinaryExpr(BinaryExpr& expr) {
         }
         
         // Short-circuit based on the operator
+        llvm::BasicBlock* left_bb = builder->GetInsertBlock();
         if (expr.getOperator().type == TokenType::AND) {
             // AND: if left is false, skip right and use false
             builder->CreateCondBr(left, right_bb, merge_bb);
@@ -293,17 +1126,18 @@ void CodeGenerator::visitBinaryExpr(BinaryExpr& expr) {
         
         // Evaluate right operand in right_bb
         builder->SetInsertPoint(right_bb);
-        expr.getRight()->accept(*this);
-        llvm::Value* right = popValue();
+        llvm::Value* right = visit(*expr.getRight());
         
-        if (!right || !right->getType()->isIntegerTy()) {
+        if (!right) {
+            return nullptr;
+        }
+        if (!right->getType()->isIntegerTy()) {
             diagnostics.report(
                 DiagnosticSeverity::ERROR,
                 "Right operand of logical operator must be a boolean",
-                SourceLocation()
+                at
             );
-            pushValue(nullptr);
-            return;
+            return nullptr;
         }
         
         // Convert to boolean if needed
@@ -321,229 +1155,221 @@ void CodeGenerator::visitBinaryExpr(BinaryExpr& expr) {
         llvm::PHINode* phi = builder->CreatePHI(getBoolType(), 2, "logical");
         
         if (expr.getOperator().type == TokenType::AND) {
-            phi->addIncoming(llvm::ConstantInt::getFalse(*context), builder->GetInsertBlock()->getParent()->getEntryBlock().getTerminator()->getParent());
+            phi->addIncoming(llvm::ConstantInt::getFalse(*context), left_bb);
             phi->addIncoming(right, right_bb);
         } else {
-            phi->addIncoming(llvm::ConstantInt::getTrue(*context), builder->GetInsertBlock()->getParent()->getEntryBlock().getTerminator()->getParent());
+            phi->addIncoming(llvm::ConstantInt::getTrue(*context), left_bb);
             phi->addIncoming(right, right_bb);
         }
         
-        pushValue(phi);
-        return;
+        return phi;
     }
     
     // Regular binary operators
-    expr.getLeft()->accept(*this);
-    llvm::Value* left = popValue();
-    
-    expr.getRight()->accept(*this);
-    llvm::Value* right = popValue();
+    llvm::Value* left = visit(*expr.getLeft());
+    llvm::Value* right = visit(*expr.getRight());
     
+    // A failed operand has already reported its own error
     if (!left || !right) {
-        diagnostics.report(
-            DiagnosticSeverity::ERROR,
-            "Invalid operands for binary operation",
-            SourceLocation()
-        );
-        pushValue(nullptr);
-        return;
+        return nullptr;
     }
     
     TokenType op = expr.getOperator().type;
+    if (left->getType() == getStringType() || right->getType() == getStringType()) {
+        return emitStringBinary(expr.getOperator(), left, right);
+    }
+    
+    // A bool never equals a number, as in the interpreter; type inference
+    // rejects bools in every other operator
+    if ((op == TokenType::EQUAL_EQUAL || op == TokenType::BANG_EQUAL) &&
+        (left->getType() == getBoolType()) != (right->getType() == getBoolType())) {
+        return builder->getInt1(op == TokenType::BANG_EQUAL);
+    }
+    
     bool is_integer_op = left->getType()->isIntegerTy() && right->getType()->isIntegerTy();
     bool is_float_op = left->getType()->isFloatingPointTy() || right->getType()->isFloatingPointTy();
     
     // Promote ints to floats if mixed types
-    if (is_float_op && left->getType()->isIntegerTy()) {
-        left = builder->CreateSIToFP(left, getFloatType(), "int2float");
+    if (is_float_op) {
+        left = convertValue(left, getFloatType());
+        right = convertValue(right, getFloatType());
     }
-    else if (is_float_op && right->getType()->isIntegerTy()) {
-        right = builder->CreateSIToFP(right, getFloatType(), "int2float");
+    // Integers of different widths meet as ints
+    else if (is_integer_op && left->getType() != right->getType()) {
+        left = convertValue(left, getIntType());
+        right = convertValue(right, getIntType());
     }
     
     // Generate code based on operator type
     switch (op) {
         case TokenType::PLUS:
             if (is_float_op) {
-                pushValue(builder->CreateFAdd(left, right, "fadd"));
+                return builder->CreateFAdd(left, right, "fadd");
             } else if (is_integer_op) {
-                pushValue(builder->CreateAdd(left, right, "add"));
+                return builder->CreateAdd(left, right, "add");
             } else {
                 diagnostics.report(
                     DiagnosticSeverity::ERROR,
                     "Invalid operands for addition",
-                    SourceLocation()
+                    at
                 );
-                pushValue(nullptr);
+                return nullptr;
             }
-            break;
             
         case TokenType::MINUS:
             if (is_float_op) {
-                pushValue(builder->CreateFSub(left, right, "fsub"));
+                return builder->CreateFSub(left, right, "fsub");
             } else if (is_integer_op) {
-                pushValue(builder->CreateSub(left, right, "sub"));
+                return builder->CreateSub(left, right, "sub");
             } else {
                 diagnostics.report(
                     DiagnosticSeverity::ERROR,
                     "Invalid operands for subtraction",
-                    SourceLocation()
+                    at
                 );
-                pushValue(nullptr);
+                return nullptr;
             }
-            break;
             
         case TokenType::STAR:
             if (is_float_op) {
-                pushValue(builder->CreateFMul(left, right, "fmul"));
+                return builder->CreateFMul(left, right, "fmul");
             } else if (is_integer_op) {
-                pushValue(builder->CreateMul(left, right, "mul"));
+                return builder->CreateMul(left, right, "mul");
             } else {
                 diagnostics.report(
                     DiagnosticSeverity::ERROR,
                     "Invalid operands for multiplication",
-                    SourceLocation()
+                    at
                 );
-                pushValue(nullptr);
+                return nullptr;
             }
-            break;
             
         case TokenType::SLASH:
             if (is_float_op) {
-                pushValue(builder->CreateFDiv(left, right, "fdiv"));
+                return builder->CreateFDiv(left, right, "fdiv");
             } else if (is_integer_op) {
-                pushValue(builder->CreateSDiv(left, right, "div"));
+                return emitIntegerDivision(expr.getOperator(), left, right);
             } else {
                 diagnostics.report(
                     DiagnosticSeverity::ERROR,
                     "Invalid operands for division",
-                    SourceLocation()
+                    at
                 );
-                pushValue(nullptr);
+                return nullptr;
             }
-            break;
             
         case TokenType::PERCENT:
             if (is_integer_op) {
-                pushValue(builder->CreateSRem(left, right, "rem"));
+                return emitIntegerDivision(expr.getOperator(), left, right);
             } else {
                 diagnostics.report(
                     DiagnosticSeverity::ERROR,
                     "Modulo operator requires integer operands",
-                    SourceLocation()
+                    at
                 );
-                pushValue(nullptr);
+                return nullptr;
             }
-            break;
             
         // Comparison operators
         case TokenType::EQUAL_EQUAL:
             if (is_float_op) {
-                pushValue(builder->CreateFCmpOEQ(left, right, "feq"));
+                return builder->CreateFCmpOEQ(left, right, "feq");
             } else if (is_integer_op) {
-                pushValue(builder->CreateICmpEQ(left, right, "eq"));
+                return builder->CreateICmpEQ(left, right, "eq");
             } else {
                 diagnostics.report(
                     DiagnosticSeverity::ERROR,
                     "Invalid operands for equality comparison",
-                    SourceLocation()
+                    at
                 );
-                pushValue(nullptr);
+                return nullptr;
             }
-            break;
             
         case TokenType::BANG_EQUAL:
             if (is_float_op) {
-                pushValue(builder->CreateFCmpONE(left, right, "fne"));
+                return builder->CreateFCmpONE(left, right, "fne");
             } else if (is_integer_op) {
-                pushValue(builder->CreateICmpNE(left, right, "ne"));
+                return builder->CreateICmpNE(left, right, "ne");
             } else {
                 diagnostics.report(
                     DiagnosticSeverity::ERROR,
                     "Invalid operands for inequality comparison",
-                    SourceLocation()
+                    at
                 );
-                pushValue(nullptr);
+                return nullptr;
             }
-            break;
             
         case TokenType::LESS:
             if (is_float_op) {
-                pushValue(builder->CreateFCmpOLT(left, right, "flt"));
+                return builder->CreateFCmpOLT(left, right, "flt");
             } else if (is_integer_op) {
-                pushValue(builder->CreateICmpSLT(left, right, "lt"));
+                return builder->CreateICmpSLT(left, right, "lt");
             } else {
                 diagnostics.report(
                     DiagnosticSeverity::ERROR,
                     "Invalid operands for less-than comparison",
-                    SourceLocation()
+                    at
                 );
-                pushValue(nullptr);
+                return nullptr;
             }
-            break;
             
         case TokenType::LESS_EQUAL:
             if (is_float_op) {
-                pushValue(builder->CreateFCmpOLE(left, right, "fle"));
+                return builder->CreateFCmpOLE(left, right, "fle");
             } else if (is_integer_op) {
-                pushValue(builder->CreateICmpSLE(left, right, "le"));
+                return builder->CreateICmpSLE(left, right, "le");
             } else {
                 diagnostics.report(
                     DiagnosticSeverity::ERROR,
                     "Invalid operands for less-than-or-equal comparison",
-                    SourceLocation()
+                    at
                 );
-                pushValue(nullptr);
+                return nullptr;
             }
-            break;
             
         case TokenType::GREATER:
             if (is_float_op) {
-                pushValue(builder->CreateFCmpOGT(left, right, "fgt"));
+                return builder->CreateFCmpOGT(left, right, "fgt");
             } else if (is_integer_op) {
-                pushValue(builder->CreateICmpSGT(left, right, "gt"));
+                return builder->CreateICmpSGT(left, right, "gt");
             } else {
                 diagnostics.report(
                     DiagnosticSeverity::ERROR,
                     "Invalid operands for greater-than comparison",
-                    SourceLocation()
+                    at
                 );
-                pushValue(nullptr);
+                return nullptr;
             }
-            break;
             
         case TokenType::GREATER_EQUAL:
             if (is_float_op) {
-                pushValue(builder->CreateFCmpOGE(left, right, "fge"));
+                return builder->CreateFCmpOGE(left, right, "fge");
             } else if (is_integer_op) {
-                pushValue(builder->CreateICmpSGE(left, right, "ge"));
+                return builder->CreateICmpSGE(left, right, "ge");
             } else {
                 diagnostics.report(
                     DiagnosticSeverity::ERROR,
                     "Invalid operands for greater-than-or-equal comparison",
-                    SourceLocation()
+                    at
                 );
-                pushValue(nullptr);
+                return nullptr;
             }
-            break;
             
         default:
             diagnostics.report(
                 DiagnosticSeverity::ERROR,
                 "Unknown binary operator",
-                SourceLocation()
+                at
             );
-            pushValue(nullptr);
-            break;
+            return nullptr;
     }
 }
 
-void CodeGenerator::visitGroupingExpr(GroupingExpr& expr) {
-    expr.getExpression()->accept(*this);
-    // Value is already on the stack
+llvm::Value* CodeGenerator::visitGroupingExpr(GroupingExpr& expr) {
+    return visit(*expr.getExpression());
 }
 
-void CodeGenerator::visitVariableExpr(VariableExpr& expr) {
+llvm::Value* CodeGenerator::visitVariableExpr(VariableExpr& expr) {
     std::string name = expr.getName().lexeme;
     auto it = named_values.find(name);
     
@@ -551,21 +1377,23 @@ void CodeGenerator::visitVariableExpr(VariableExpr& expr) {
         diagnostics.report(
             DiagnosticSeverity::ERROR,
             "Unknown variable name: " + name,
-            SourceLocation()
+            SourceLocation(getSourceFile(), expr.getName().line, expr.getName().column)
         );
-        pushValue(nullptr);
-        return;
+        return nullptr;
     }
     
     llvm::Value* value = builder->CreateLoad(
         it->second->getAllocatedType(), it->second, name
     );
-    pushValue(value);
+    return value;
 }
 
-void CodeGenerator::visitAssignExpr(AssignExpr& expr) {
-    expr.getValue()->accept(*this);
-    llvm::Value* value = popValue();
+llvm::Value* CodeGenerator::visitAssignExpr(AssignExpr& expr) {
+    setDebugLocation(expr.getName());
+    llvm::Value* value = visit(*expr.getValue());
+    if (!value) {
+        return nullptr;
+    }
     
     std::string name = expr.getName().lexeme;
     auto it = named_values.find(name);
@@ -574,23 +1402,108 @@ void CodeGenerator::visitAssignExpr(AssignExpr& expr) {
         diagnostics.report(
             DiagnosticSeverity::ERROR,
             "Unknown variable name: " + name,
-            SourceLocation()
+            SourceLocation(getSourceFile(), expr.getName().line, expr.getName().column)
         );
-        pushValue(nullptr);
-        return;
+        return nullptr;
     }
     
+    value = convertValue(value, it->second->getAllocatedType());
     builder->CreateStore(value, it->second);
-    pushValue(value);
+    return value;
 }
 
-void CodeGenerator::visitCallExpr(CallExpr& expr) {
+llvm::Value* CodeGenerator::visitCallExpr(CallExpr& expr) {
+    setDebugLocation(expr.getParen());
     llvm::Function* callee = nullptr;
     
     // Handle direct function calls
     if (auto* var_expr = dynamic_cast<VariableExpr*>(expr.getCallee().get())) {
         std::string func_name = var_expr->getName().lexeme;
-        callee = module->getFunction(func_name);
+        
+        // User functions call the specialization chosen by type inference
+        const Specialization* target = nullptr;
+        if (current_spec) {
+            auto it = current_spec->calls.find(&expr);
+            if (it != current_spec->calls.end()) {
+                target = it->second;
+            }
+        }
+        
+        // print is lowered to the runtime function for the argument's type
+        if (!target && func_name == "print") {
+            if (expr.getArguments().size() != 1) {
+                diagnostics.report(
+                    DiagnosticSeverity::ERROR,
+                    "print expects exactly one argument",
+                    SourceLocation(getSourceFile(), expr.getParen().line,
+                                   expr.getParen().column)
+                );
+                return nullptr;
+            }
+            llvm::Value* value = visit(*expr.getArguments()[0]);
+            return value ? emitPrint(value) : nullptr;
+        }
+        
+        // len reads the length half of the array
+        if (!target && func_name == "len") {
+            if (expr.getArguments().size() != 1) {
+                diagnostics.report(
+                    DiagnosticSeverity::ERROR,
+                    "len expects exactly one argument",
+                    SourceLocation(getSourceFile(), expr.getParen().line,
+                                   expr.getParen().column)
+                );
+                return nullptr;
+            }
+            llvm::Value* array = visit(*expr.getArguments()[0]);
+            if (!array || !isArray(array)) {
+                return nullptr;
+            }
+            return builder->CreateExtractValue(array, 1, "len");
+        }
+        
+        // join waits for the task, then reads the result it left in its environment
+        if (!target && func_name == "join" && !(types && types->findNative(func_name))) {
+            if (expr.getArguments().size() != 1) {
+                diagnostics.report(
+                    DiagnosticSeverity::ERROR,
+                    "join expects exactly one argument",
+                    SourceLocation(getSourceFile(), expr.getParen().line,
+                                   expr.getParen().column)
+                );
+                return nullptr;
+            }
+            llvm::Value* handle = visit(*expr.getArguments()[0]);
+            if (!handle || !handle->getType()->isPointerTy()) {
+                return nullptr;
+            }
+            StaticType result = StaticType::UNKNOWN;
+            if (current_spec) {
+                auto it = current_spec->joins.find(&expr);
+                if (it != current_spec->joins.end()) {
+                    result = it->second;
+                }
+            }
+            if (result == StaticType::UNKNOWN) {
+                return nullptr;
+            }
+            llvm::StructType* task_type = getTaskType(result);
+            llvm::Function* join = getRuntimeFunction(
+                "task_join", llvm::FunctionType::get(getVoidType(), {getStringType()}, false)
+            );
+            builder->CreateCall(join, {builder->CreateBitCast(handle, getStringType())});
+            return builder->CreateLoad(
+                task_type->getElementType(0), builder->CreateStructGEP(task_type, handle, 0), "joined"
+            );
+        }
+        
+        if (target) {
+            return emitSpecializationCall(expr, *target);
+        }
+        
+        // Host functions are called through the C ABI and bound by the JIT
+        const NativeFunction* native = types ? types->findNative(func_name) : nullptr;
+        callee = native ? declareNative(*native) : module->getFunction(func_name);
         
         if (!callee) {
             diagnostics.report(
@@ -598,64 +1511,305 @@ void CodeGenerator::visitCallExpr(CallExpr& expr) {
                 "Unknown function name: " + func_name,
                 SourceLocation()
             );
-            pushValue(nullptr);
-            return;
+            return nullptr;
+        }
+    }
+    else {
+        // Functions aren't values, so only a name can be called
+        diagnostics.report(
+            DiagnosticSeverity::ERROR,
+            "Expression is not callable",
+            SourceLocation(getSourceFile(), expr.getParen().line, expr.getParen().column)
+        );
+        return nullptr;
+    }
+    
+    llvm::FunctionType* callee_type = callee->getFunctionType();
+    if (callee_type->isVarArg() ? expr.getArguments().size() < callee_type->getNumParams()
+                                : expr.getArguments().size() != callee_type->getNumParams()) {
+        diagnostics.report(
+            DiagnosticSeverity::ERROR,
+            "Expected " + std::to_string(callee_type->getNumParams()) + " arguments but got " +
+                std::to_string(expr.getArguments().size()),
+            SourceLocation(getSourceFile(), expr.getParen().line, expr.getParen().column)
+        );
+        return nullptr;
+    }
+    
+    // Evaluate arguments
+    std::vector<llvm::Value*> args;
+    for (const auto& arg : expr.getArguments()) {
+        llvm::Value* value = visit(*arg);
+        if (!value) {
+            return nullptr;
+        }
+        if (args.size() < callee_type->getNumParams()) {
+            value = convertValue(value, callee_type->getParamType(args.size()));
+        }
+        args.push_back(value);
+    }
+    
+    // Create call (void results cannot be named)
+    llvm::Value* call = builder->CreateCall(
+        callee, args, callee->getReturnType()->isVoidTy() ? "" : "call"
+    );
+    return call;
+}
+
+std::string CodeGenerator::getNativeSymbol(const std::string& name) {
+    return "mana.native." + name;
+}
+
+llvm::Function* CodeGenerator::declareNative(const NativeFunction& native) {
+    std::vector<llvm::Type*> params;
+    for (StaticType type : native.param_types) {
+        params.push_back(getLLVMType(type));
+    }
+    llvm::Function* function = getRuntimeFunction(
+        getNativeSymbol(native.name).c_str(),
+        llvm::FunctionType::get(getLLVMType(native.return_type), params, false)
+    );
+    
+    // C++ expects a bool argument widened to a full byte
+    for (size_t i = 0; i < native.param_types.size(); ++i) {
+        if (native.param_types[i] == StaticType::BOOL) {
+            function->addParamAttr(static_cast<unsigned>(i), llvm::Attribute::ZExt);
+        }
+    }
+    return function;
+}
+
+llvm::Value* CodeGenerator::emitSpecializationCall(CallExpr& expr, const Specialization& target) {
+    llvm::Function* callee = declareSpecialization(target);
+    std::vector<llvm::Value*> args;
+    if (!emitSpecializationArgs(expr, target, callee, args)) {
+        return nullptr;
+    }
+    
+    return builder->CreateCall(
+        callee, args, callee->getReturnType()->isVoidTy() ? "" : "call"
+    );
+}
+
+bool CodeGenerator::emitSpecializationArgs(CallExpr& expr, const Specialization& target,
+                                           llvm::Function* callee, std::vector<llvm::Value*>& args) {
+    if (expr.getArguments().size() != target.param_types.size()) {
+        diagnostics.report(
+            DiagnosticSeverity::ERROR,
+            "Expected " + std::to_string(target.param_types.size()) + " arguments but got " +
+                std::to_string(expr.getArguments().size()),
+            SourceLocation(getSourceFile(), expr.getParen().line, expr.getParen().column)
+        );
+        return false;
+    }
+    
+    // Arrays are passed as separate pointer and length arguments
+    for (size_t i = 0; i < expr.getArguments().size(); ++i) {
+        llvm::Value* value = visit(*expr.getArguments()[i]);
+        if (!value) {
+            return false;
+        }
+        if (isArray(value)) {
+            args.push_back(builder->CreateExtractValue(value, 0));
+            args.push_back(builder->CreateExtractValue(value, 1));
+        } else {
+            args.push_back(convertValue(value, callee->getFunctionType()->getParamType(args.size())));
+        }
+    }
+    return true;
+}
+
+llvm::Value* CodeGenerator::visitSpawnExpr(SpawnExpr& expr) {
+    CallExpr& call = *expr.getCall();
+    const Specialization* target = nullptr;
+    if (current_spec) {
+        auto it = current_spec->calls.find(&call);
+        if (it != current_spec->calls.end()) {
+            target = it->second;
+        }
+    }
+    if (!target) {
+        diagnostics.report(
+            DiagnosticSeverity::ERROR,
+            "spawn needs a call to a script function",
+            SourceLocation(getSourceFile(), expr.getKeyword().line, expr.getKeyword().column)
+        );
+        return nullptr;
+    }
+    
+    // Arguments are evaluated now, by the spawning thread
+    llvm::Function* callee = declareSpecialization(*target);
+    std::vector<llvm::Value*> args;
+    if (!emitSpecializationArgs(call, *target, callee, args)) {
+        return nullptr;
+    }
+    setDebugLocation(expr.getKeyword());
+    
+    llvm::StructType* env_type = getTaskEnvironmentType(callee);
+    llvm::Type* size_type = llvm::Type::getInt64Ty(*context);
+    llvm::Function* alloc = getRuntimeFunction(
+        "task_alloc", llvm::FunctionType::get(getStringType(), {size_type}, false)
+    );
+    // Sized as a constant expression, since the target's data layout may not be set yet
+    llvm::Value* raw = builder->CreateCall(alloc, {
+        llvm::ConstantExpr::getSizeOf(env_type)
+    }, "task");
+    
+    llvm::Value* env = builder->CreateBitCast(raw, env_type->getPointerTo(), "env");
+    for (size_t i = 0; i < args.size(); ++i) {
+        builder->CreateStore(args[i], builder->CreateStructGEP(env_type, env, static_cast<unsigned>(i + 1)));
+    }
+    
+    llvm::Function* thunk = getTaskThunk(*target);
+    llvm::Function* spawn = getRuntimeFunction(
+        "task_spawn",
+        llvm::FunctionType::get(getVoidType(), {getStringType(), thunk->getType()}, false)
+    );
+    builder->CreateCall(spawn, {raw, thunk});
+    return builder->CreateBitCast(raw, getLLVMType(taskType(target->return_type)), "handle");
+}
+
+llvm::Value* CodeGenerator::visitArrayExpr(ArrayExpr& expr) {
+    setDebugLocation(expr.getBracket());
+    
+    // Evaluate every element before allocating
+    std::vector<llvm::Value*> values;
+    llvm::Type* element = getIntType();
+    for (const auto& element_expr : expr.getElements()) {
+        llvm::Value* value = visit(*element_expr);
+        if (!value) {
+            return nullptr;
+        }
+        if (value->getType()->isDoubleTy()) {
+            element = getFloatType();
         }
+        values.push_back(value);
     }
-    else {
-        // Handle function pointers
-        expr.getCallee()->accept(*this);
-        llvm::Value* callee_val = popValue();
-        
-        if (!callee_val || !callee_val->getType()->isPointerTy()) {
-            diagnostics.report(
-                DiagnosticSeverity::ERROR,
-                "Expression is not callable",
-                SourceLocation()
-            );
-            pushValue(nullptr);
-            return;
+    for (llvm::Value*& value : values) {
+        value = convertValue(value, element);
+    }
+    
+    // [value; count] fills a fresh array
+    if (expr.getCount()) {
+        llvm::Value* value = values[0];
+        llvm::Value* count = convertValue(visit(*expr.getCount()), getIntType());
+        if (!count) {
+            return nullptr;
         }
         
-        // Try to cast to a function pointer
-        llvm::PointerType* ptr_type = llvm::dyn_cast<llvm::PointerType>(callee_val->getType());
-        if (ptr_type->getElementType()->isFunctionTy()) {
-            // Cast to an appropriate function type
-            callee_val = builder->CreateBitCast(
-                callee_val, 
-                llvm::PointerType::get(llvm::dyn_cast<llvm::FunctionType>(ptr_type->getElementType()), 0),
-                "callee"
-            );
-        } else {
-            diagnostics.report(
-                DiagnosticSeverity::ERROR,
-                "Expression is not callable",
-                SourceLocation()
-            );
-            pushValue(nullptr);
-            return;
+        llvm::Value* array = allocateArray(element, count, expr.getBracket());
+        
+        // Storage starts out zeroed
+        if (auto* constant = llvm::dyn_cast<llvm::Constant>(value)) {
+            if (constant->isNullValue()) {
+                return array;
+            }
         }
+        
+        llvm::Value* data = builder->CreateExtractValue(array, 0, "data");
+        llvm::Function* function = builder->GetInsertBlock()->getParent();
+        llvm::BasicBlock* before_bb = builder->GetInsertBlock();
+        llvm::BasicBlock* loop_bb = llvm::BasicBlock::Create(*context, "fill.loop", function);
+        llvm::BasicBlock* exit_bb = llvm::BasicBlock::Create(*context, "fill.exit", function);
+        
+        llvm::Value* zero = llvm::ConstantInt::get(getIntType(), 0);
+        builder->CreateCondBr(builder->CreateICmpSGT(count, zero), loop_bb, exit_bb);
+        
+        builder->SetInsertPoint(loop_bb);
+        llvm::PHINode* i = builder->CreatePHI(getIntType(), 2, "i");
+        i->addIncoming(zero, before_bb);
+        llvm::Value* offset = builder->CreateZExt(i, llvm::Type::getInt64Ty(*context));
+        builder->CreateStore(value, builder->CreateInBoundsGEP(element, data, offset));
+        llvm::Value* next = builder->CreateNUWAdd(i, llvm::ConstantInt::get(getIntType(), 1), "i.next");
+        i->addIncoming(next, loop_bb);
+        builder->CreateCondBr(builder->CreateICmpSLT(next, count), loop_bb, exit_bb);
+        
+        builder->SetInsertPoint(exit_bb);
+        return array;
     }
     
-    // Evaluate arguments
-    std::vector<llvm::Value*> args;
-    for (const auto& arg : expr.getArguments()) {
-        arg->accept(*this);
-        args.push_back(popValue());
+    llvm::Value* array = allocateArray(
+        element, llvm::ConstantInt::get(getIntType(), values.size()), expr.getBracket()
+    );
+    llvm::Value* data = builder->CreateExtractValue(array, 0, "data");
+    for (size_t i = 0; i < values.size(); ++i) {
+        builder->CreateStore(values[i], builder->CreateConstInBoundsGEP1_64(element, data, i));
+    }
+    return array;
+}
+
+llvm::Value* CodeGenerator::visitIndexExpr(IndexExpr& expr) {
+    setDebugLocation(expr.getBracket());
+    llvm::Value* array = visit(*expr.getArray());
+    llvm::Value* index = visit(*expr.getIndex());
+    if (!array || !index || !isArray(array)) {
+        return nullptr;
+    }
+    
+    llvm::Value* pointer = elementPointer(array, convertValue(index, getIntType()), expr.getBracket());
+    llvm::Type* element = getArrayElementType(array);
+    return builder->CreateAlignedLoad(
+        element, pointer, module->getDataLayout().getABITypeAlign(element), "elem"
+    );
+}
+
+llvm::Value* CodeGenerator::visitIndexAssignExpr(IndexAssignExpr& expr) {
+    setDebugLocation(expr.getBracket());
+    llvm::Value* array = visit(*expr.getArray());
+    llvm::Value* index = visit(*expr.getIndex());
+    llvm::Value* value = visit(*expr.getValue());
+    if (!array || !index || !value || !isArray(array)) {
+        return nullptr;
+    }
+    
+    llvm::Value* pointer = elementPointer(array, convertValue(index, getIntType()), expr.getBracket());
+    llvm::Type* element = getArrayElementType(array);
+    value = convertValue(value, element);
+    builder->CreateAlignedStore(value, pointer, module->getDataLayout().getABITypeAlign(element));
+    return value;
+}
+
+llvm::Value* CodeGenerator::visitSliceExpr(SliceExpr& expr) {
+    setDebugLocation(expr.getBracket());
+    llvm::Value* array = visit(*expr.getArray());
+    if (!array || !isArray(array)) {
+        return nullptr;
+    }
+    llvm::Value* data = builder->CreateExtractValue(array, 0, "data");
+    llvm::Value* length = builder->CreateExtractValue(array, 1, "len");
+    
+    llvm::Value* start = expr.getStart()
+        ? convertValue(visit(*expr.getStart()), getIntType())
+        : llvm::ConstantInt::get(getIntType(), 0);
+    llvm::Value* end = expr.getEnd() ? convertValue(visit(*expr.getEnd()), getIntType()) : length;
+    if (!start || !end) {
+        return nullptr;
     }
     
-    // Create call
-    llvm::Value* call = builder->CreateCall(callee, args, "call");
-    pushValue(call);
+    llvm::Value* ok = builder->CreateAnd(
+        builder->CreateICmpULE(start, end),
+        builder->CreateICmpULE(end, length),
+        "slice.ok"
+    );
+    emitRuntimeCheck(ok, expr.getBracket(), "array_slice_error", {start, end, length});
+    
+    // Slices share storage with the array they are taken from
+    
+    llvm::Value* offset = builder->CreateSExt(start, llvm::Type::getInt64Ty(*context));
+    llvm::Value* begin = builder->CreateInBoundsGEP(getArrayElementType(array), data, offset, "slice.data");
+    return makeArray(
+        begin, builder->CreateSub(end, start, "slice.len"),
+        llvm::cast<llvm::StructType>(array->getType())
+    );
 }
 
 // Statement visitors
 void CodeGenerator::visitExpressionStmt(ExpressionStmt& stmt) {
-    stmt.getExpression()->accept(*this);
-    popValue(); // Discard the result
+    visit(*stmt.getExpression()); // Discard the result
 }
 
 void CodeGenerator::visitVarDeclStmt(VarDeclStmt& stmt) {
+    setDebugLocation(stmt.getName());
     std::string name = stmt.getName().lexeme;
     
     // Determine type (default to int)
@@ -664,13 +1818,25 @@ void CodeGenerator::visitVarDeclStmt(VarDeclStmt& stmt) {
     // Evaluate initializer if present
     llvm::Value* init_val = nullptr;
     if (stmt.getInitializer()) {
-        stmt.getInitializer()->accept(*this);
-        init_val = popValue();
-        
-        if (init_val) {
-            var_type = init_val->getType();
+        init_val = visit(*stmt.getInitializer());
+        if (!init_val) {
+            return;
+        }
+        var_type = init_val->getType();
+    }
+    
+    // The inferred type covers every value later assigned to the variable
+    if (current_spec) {
+        auto it = current_spec->locals.find(&stmt);
+        if (it != current_spec->locals.end()) {
+            var_type = getLLVMType(it->second);
         }
     }
+    init_val = convertValue(init_val, var_type);
+    if (!init_val && var_type->isStructTy()) {
+        // An array declared without a value starts out empty
+        init_val = llvm::Constant::getNullValue(var_type);
+    }
     
     // Create variable in current scope
     llvm::AllocaInst* alloca = createEntryBlockAlloca(
@@ -688,35 +1854,36 @@ void CodeGenerator::visitVarDeclStmt(VarDeclStmt& stmt) {
 }
 
 void CodeGenerator::visitBlockStmt(BlockStmt& stmt) {
-    // Create a new scope
+    // Create a new scope; declarations inside it must not leak out
     symbol_table.enterScope();
+    auto outer_values = named_values;
     
-    // Process statements in the block
+    // Process statements in the block; any after a return, break or
+    // continue are unreachable
     for (const auto& s : stmt.getStatements()) {
+        if (builder->GetInsertBlock()->getTerminator()) {
+            break;
+        }
         if (s) {
-            s->accept(*this);
+            visit(*s);
         }
     }
     
     // Exit the scope
+    named_values = std::move(outer_values);
     symbol_table.exitScope();
 }
 
 void CodeGenerator::visitIfStmt(IfStmt& stmt) {
     // Evaluate condition
-    stmt.getCondition()->accept(*this);
-    llvm::Value* cond_val = popValue();
+    llvm::Value* cond_val = visit(*stmt.getCondition());
     
     if (!cond_val) {
         return;
     }
     
     // Convert to boolean if needed
-    if (!cond_val->getType()->isIntegerTy(1)) {
-        cond_val = builder->CreateICmpNE(
-            cond_val, llvm::ConstantInt::get(cond_val->getType(), 0), "ifcond"
-        );
-    }
+    cond_val = toCondition(cond_val, "ifcond");
     
     // Create basic blocks for the then, else, and merge points
     llvm::Function* function = builder->GetInsertBlock()->getParent();
@@ -729,8 +1896,10 @@ void CodeGenerator::visitIfStmt(IfStmt& stmt) {
     
     // Emit then block
     builder->SetInsertPoint(then_bb);
-    stmt.getThenBranch()->accept(*this);
-    builder->CreateBr(merge_bb);
+    visit(*stmt.getThenBranch());
+    if (!builder->GetInsertBlock()->getTerminator()) {
+        builder->CreateBr(merge_bb);
+    }
     
     // Get the updated then block in case of nested blocks
     then_bb = builder->GetInsertBlock();
@@ -740,10 +1909,12 @@ void CodeGenerator::visitIfStmt(IfStmt& stmt) {
     builder->SetInsertPoint(else_bb);
     
     if (stmt.getElseBranch()) {
-        stmt.getElseBranch()->accept(*this);
+        visit(*stmt.getElseBranch());
     }
     
-    builder->CreateBr(merge_bb);
+    if (!builder->GetInsertBlock()->getTerminator()) {
+        builder->CreateBr(merge_bb);
+    }
     
     // Get the updated else block in case of nested blocks
     else_bb = builder->GetInsertBlock();
@@ -760,24 +1931,22 @@ void CodeGenerator::visitWhileStmt(WhileStmt& stmt) {
     llvm::BasicBlock* body_bb = llvm::BasicBlock::Create(*context, "while.body");
     llvm::BasicBlock* exit_bb = llvm::BasicBlock::Create(*context, "while.exit");
     
+    int32_t loop_slot = -1;
+    llvm::AllocaInst* iterations = beginProfileLoop(stmt.getKeyword(), loop_slot);
+    
     // Branch to condition
     builder->CreateBr(cond_bb);
     
     // Emit condition block
     builder->SetInsertPoint(cond_bb);
-    stmt.getCondition()->accept(*this);
-    llvm::Value* cond_val = popValue();
+    llvm::Value* cond_val = visit(*stmt.getCondition());
     
     if (!cond_val) {
         return;
     }
     
     // Convert to boolean if needed
-    if (!cond_val->getType()->isIntegerTy(1)) {
-        cond_val = builder->CreateICmpNE(
-            cond_val, llvm::ConstantInt::get(cond_val->getType(), 0), "whilecond"
-        );
-    }
+    cond_val = toCondition(cond_val, "whilecond");
     
     // Create conditional branch
     builder->CreateCondBr(cond_val, body_bb, exit_bb);
@@ -786,22 +1955,328 @@ void CodeGenerator::visitWhileStmt(WhileStmt& stmt) {
     function->getBasicBlockList().push_back(body_bb);
     builder->SetInsertPoint(body_bb);
     
-    stmt.getBody()->accept(*this);
+    if (iterations) {
+        builder->CreateStore(
+            builder->CreateAdd(builder->CreateLoad(builder->getInt64Ty(), iterations), builder->getInt64(1)),
+            iterations
+        );
+        profile_state.loops.emplace_back(loop_slot, iterations);
+    }
+    
+    loop_targets.push_back({exit_bb, cond_bb});
+    visit(*stmt.getBody());
+    loop_targets.pop_back();
+    
+    if (iterations) {
+        profile_state.loops.pop_back();
+    }
     
     // Branch back to condition
-    builder->CreateBr(cond_bb);
+    if (!builder->GetInsertBlock()->getTerminator()) {
+        llvm::BranchInst* latch = builder->CreateBr(cond_bb);
+        
+        LoopScan scan;
+        scan.visit(*stmt.getCondition());
+        scan.visit(*stmt.getBody());
+        if (scan.indexes && !scan.calls && !scan.carriesDouble(named_values)) {
+            requestVectorization(latch);
+        }
+    }
     
     // Emit exit block
     function->getBasicBlockList().push_back(exit_bb);
     builder->SetInsertPoint(exit_bb);
+    endProfileLoop(loop_slot, iterations);
 }
 
-void CodeGenerator::visitFunctionStmt(FunctionStmt& stmt) {
-    std::string name = stmt.getName().lexeme;
+void CodeGenerator::visitForStmt(ForStmt& stmt) {
+    // The initializer's variable is scoped to the loop
+    symbol_table.enterScope();
+    auto outer_values = named_values;
+    
+    if (stmt.getInitializer()) {
+        visit(*stmt.getInitializer());
+    }
+    if (stmt.isParallel()) {
+        emitParallelFor(stmt);
+    } else {
+        emitForLoop(stmt);
+    }
+    
+    named_values = std::move(outer_values);
+    symbol_table.exitScope();
+}
+
+void CodeGenerator::emitForLoop(ForStmt& stmt) {
+    // Canonical loop form: the block holding the initializer is the preheader,
+    // and every iteration that goes on, continue included, passes through the
+    // step block, the single latch
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock* cond_bb = llvm::BasicBlock::Create(*context, "for.cond", function);
+    llvm::BasicBlock* body_bb = llvm::BasicBlock::Create(*context, "for.body");
+    llvm::BasicBlock* step_bb = llvm::BasicBlock::Create(*context, "for.step");
+    llvm::BasicBlock* exit_bb = llvm::BasicBlock::Create(*context, "for.exit");
+    
+    int32_t loop_slot = -1;
+    llvm::AllocaInst* iterations = beginProfileLoop(stmt.getKeyword(), loop_slot);
+    builder->CreateBr(cond_bb);
+    
+    // A missing condition is always true
+    builder->SetInsertPoint(cond_bb);
+    if (stmt.getCondition()) {
+        llvm::Value* cond_val = visit(*stmt.getCondition());
+        if (!cond_val) {
+            return;
+        }
+        builder->CreateCondBr(toCondition(cond_val, "forcond"), body_bb, exit_bb);
+    } else {
+        builder->CreateBr(body_bb);
+    }
+    
+    function->getBasicBlockList().push_back(body_bb);
+    builder->SetInsertPoint(body_bb);
+    
+    if (iterations) {
+        builder->CreateStore(
+            builder->CreateAdd(builder->CreateLoad(builder->getInt64Ty(), iterations), builder->getInt64(1)),
+            iterations
+        );
+        profile_state.loops.emplace_back(loop_slot, iterations);
+    }
+    
+    loop_targets.push_back({exit_bb, step_bb});
+    visit(*stmt.getBody());
+    loop_targets.pop_back();
+    
+    if (iterations) {
+        profile_state.loops.pop_back();
+    }
+    if (!builder->GetInsertBlock()->getTerminator()) {
+        builder->CreateBr(step_bb);
+    }
+    
+    function->getBasicBlockList().push_back(step_bb);
+    builder->SetInsertPoint(step_bb);
+    if (stmt.getIncrement()) {
+        visit(*stmt.getIncrement());
+    }
+    llvm::BranchInst* latch = builder->CreateBr(cond_bb);
+    
+    LoopScan scan;
+    if (stmt.getCondition()) scan.visit(*stmt.getCondition());
+    if (stmt.getIncrement()) scan.visit(*stmt.getIncrement());
+    scan.visit(*stmt.getBody());
+    if (scan.indexes && !scan.calls && !scan.carriesDouble(named_values)) {
+        requestVectorization(latch);
+    }
+    
+    function->getBasicBlockList().push_back(exit_bb);
+    builder->SetInsertPoint(exit_bb);
+    endProfileLoop(loop_slot, iterations);
+}
+
+void CodeGenerator::emitParallelFor(ForStmt& stmt) {
+    setDebugLocation(stmt.getKeyword());
+    llvm::Type* i64 = builder->getInt64Ty();
+    
+    auto variable = named_values.find(stmt.getVariable().getName().lexeme);
+    if (variable == named_values.end() || variable->second->getAllocatedType() != getIntType()) {
+        return;
+    }
+    
+    // The range [start, end), evaluated once
+    llvm::Value* start = builder->CreateSExt(
+        builder->CreateLoad(getIntType(), variable->second), i64, "pfor.start"
+    );
+    llvm::Value* limit = visit(*stmt.getLimit());
+    if (!limit) {
+        return;
+    }
+    llvm::Value* end = builder->CreateSExt(convertValue(limit, getIntType()), i64, "pfor.end");
+    if (stmt.isInclusive()) {
+        end = builder->CreateAdd(end, builder->getInt64(1));
+    }
+    
+    // The body gets a copy of every variable it uses. It can't assign them,
+    // and this frame outlives the loop, so the copies live on its stack.
+    VariableScan scan;
+    scan.scan(stmt.getBody());
+    std::vector<std::string> captured;
+    std::vector<llvm::Type*> fields;
+    for (const auto& [name, alloca] : named_values) {
+        if (scan.names.count(name) && alloca != variable->second) {
+            captured.push_back(name);
+        }
+    }
+    std::sort(captured.begin(), captured.end());
+    for (const std::string& name : captured) {
+        fields.push_back(named_values[name]->getAllocatedType());
+    }
+    llvm::StructType* env_type = llvm::StructType::get(*context, fields);
+    llvm::AllocaInst* env = createEntryBlockAlloca(current_function, "pfor.env", env_type);
+    for (size_t i = 0; i < captured.size(); ++i) {
+        llvm::AllocaInst* alloca = named_values[captured[i]];
+        builder->CreateStore(
+            builder->CreateLoad(alloca->getAllocatedType(), alloca),
+            builder->CreateStructGEP(env_type, env, static_cast<unsigned>(i))
+        );
+    }
+    
+    llvm::Function* body = emitParallelBody(stmt, captured, env_type);
+    llvm::Function* parallel_for = getRuntimeFunction(
+        "task_parallel_for",
+        llvm::FunctionType::get(getVoidType(), {i64, i64, getStringType(), body->getType()}, false)
+    );
+    builder->CreateCall(parallel_for, {start, end, builder->CreateBitCast(env, getStringType()), body});
+    
+    // Every iteration has run once the call returns
+    int32_t loop_slot = -1;
+    if (llvm::AllocaInst* iterations = beginProfileLoop(stmt.getKeyword(), loop_slot)) {
+        llvm::Value* count = builder->CreateSub(end, start);
+        builder->CreateStore(
+            builder->CreateSelect(builder->CreateICmpSGT(count, builder->getInt64(0)), count, builder->getInt64(0)),
+            iterations
+        );
+        endProfileLoop(loop_slot, iterations);
+    }
+}
+
+llvm::Function* CodeGenerator::emitParallelBody(ForStmt& stmt, const std::vector<std::string>& captured,
+                                                llvm::StructType* env_type) {
+    llvm::Type* i64 = builder->getInt64Ty();
+    llvm::Function* body = llvm::Function::Create(
+        llvm::FunctionType::get(getVoidType(), {getStringType(), i64, i64}, false),
+        llvm::Function::InternalLinkage, current_function->getName() + ".pfor", module.get()
+    );
+    
+    // Emitted on the side, like a nested function
+    llvm::IRBuilderBase::InsertPointGuard guard(*builder);
+    llvm::Function* prev_function = current_function;
+    llvm::BasicBlock* prev_tail_recurse = tail_recurse;
+    auto prev_named_values = std::move(named_values);
+    auto prev_loop_targets = std::move(loop_targets);
+    ProfileState prev_profile = std::move(profile_state);
+    current_function = body;
+    tail_recurse = nullptr;
+    named_values.clear();
+    loop_targets.clear();
+    profile_state = ProfileState();
+    
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", body));
+    beginFunction(body, prev_function->getName().str() + " (parallel for)", stmt.getKeyword().line);
+    symbol_table.enterScope();
+    
+    // Uncounted, but the worker running it must be known to the sampler
+    if (profile) {
+        loadProfileThread();
+    }
+    
+    llvm::Value* env = builder->CreateBitCast(body->getArg(0), env_type->getPointerTo(), "env");
+    for (size_t i = 0; i < captured.size(); ++i) {
+        llvm::Type* type = env_type->getElementType(static_cast<unsigned>(i));
+        llvm::AllocaInst* alloca = createEntryBlockAlloca(body, captured[i], type);
+        builder->CreateStore(
+            builder->CreateLoad(type, builder->CreateStructGEP(env_type, env, static_cast<unsigned>(i))),
+            alloca
+        );
+        named_values[captured[i]] = alloca;
+        symbol_table.define(captured[i], Symbol::Kind::VARIABLE);
+    }
+    
+    const std::string& name = stmt.getVariable().getName().lexeme;
+    llvm::AllocaInst* variable = createEntryBlockAlloca(body, name, getIntType());
+    named_values[name] = variable;
+    symbol_table.define(name, Symbol::Kind::VARIABLE);
+    
+    // This call's share of the range, counted in 64 bits so `i <= end` stops
+    // at the largest int
+    llvm::AllocaInst* index = createEntryBlockAlloca(body, "pfor.i", i64);
+    builder->CreateStore(body->getArg(1), index);
+    
+    llvm::BasicBlock* cond_bb = llvm::BasicBlock::Create(*context, "pfor.cond", body);
+    llvm::BasicBlock* body_bb = llvm::BasicBlock::Create(*context, "pfor.body", body);
+    llvm::BasicBlock* step_bb = llvm::BasicBlock::Create(*context, "pfor.step");
+    llvm::BasicBlock* exit_bb = llvm::BasicBlock::Create(*context, "pfor.exit");
+    builder->CreateBr(cond_bb);
+    
+    builder->SetInsertPoint(cond_bb);
+    llvm::Value* current = builder->CreateLoad(i64, index, "pfor.index");
+    builder->CreateCondBr(builder->CreateICmpSLT(current, body->getArg(2)), body_bb, exit_bb);
+    
+    builder->SetInsertPoint(body_bb);
+    builder->CreateStore(builder->CreateTrunc(current, getIntType()), variable);
+    loop_targets.push_back({exit_bb, step_bb});
+    visit(*stmt.getBody());
+    loop_targets.pop_back();
+    if (!builder->GetInsertBlock()->getTerminator()) {
+        builder->CreateBr(step_bb);
+    }
+    
+    body->getBasicBlockList().push_back(step_bb);
+    builder->SetInsertPoint(step_bb);
+    builder->CreateStore(
+        builder->CreateNSWAdd(builder->CreateLoad(i64, index), builder->getInt64(1)), index
+    );
+    llvm::BranchInst* latch = builder->CreateBr(cond_bb);
+    LoopScan scan;
+    scan.visit(*stmt.getBody());
+    if (scan.indexes && !scan.calls && !scan.carriesDouble(named_values)) {
+        requestVectorization(latch);
+    }
+    
+    body->getBasicBlockList().push_back(exit_bb);
+    builder->SetInsertPoint(exit_bb);
+    builder->CreateRetVoid();
+    
+    symbol_table.exitScope();
+    if (di_builder && body->getSubprogram()) {
+        di_builder->finalizeSubprogram(body->getSubprogram());
+    }
+    current_function = prev_function;
+    tail_recurse = prev_tail_recurse;
+    named_values = std::move(prev_named_values);
+    loop_targets = std::move(prev_loop_targets);
+    profile_state = std::move(prev_profile);
+    return body;
+}
+
+void CodeGenerator::visitBreakStmt(BreakStmt& stmt) {
+    if (loop_targets.empty()) {
+        diagnostics.report(DiagnosticSeverity::ERROR, "Break statement outside of a loop", SourceLocation());
+        return;
+    }
+    setDebugLocation(stmt.getKeyword());
+    builder->CreateBr(loop_targets.back().exit);
+}
+
+void CodeGenerator::visitContinueStmt(ContinueStmt& stmt) {
+    if (loop_targets.empty()) {
+        diagnostics.report(DiagnosticSeverity::ERROR, "Continue statement outside of a loop", SourceLocation());
+        return;
+    }
+    setDebugLocation(stmt.getKeyword());
+    builder->CreateBr(loop_targets.back().next);
+}
+
+llvm::Function* CodeGenerator::declareSpecialization(const Specialization& spec) {
+    if (llvm::Function* existing = module->getFunction(spec.name)) {
+        return existing;
+    }
     
-    // Create function type
-    std::vector<llvm::Type*> param_types(stmt.getParams().size(), getIntType());
-    llvm::Type* return_type = getIntType(); // Default to int return type
+    // Create function type from the inferred signature
+    std::vector<llvm::Type*> param_types;
+    size_t array_params = 0;
+    for (StaticType type : spec.param_types) {
+        if (isArrayType(type)) {
+            // Passed as pointer and length so the pointer can carry attributes
+            param_types.push_back(llvm::PointerType::getUnqual(getLLVMType(elementType(type))));
+            param_types.push_back(getIntType());
+            array_params++;
+        } else {
+            param_types.push_back(getLLVMType(type));
+        }
+    }
+    llvm::Type* return_type = getLLVMType(spec.return_type);
     
     llvm::FunctionType* func_type = llvm::FunctionType::get(
         return_type, param_types, false
@@ -809,17 +2284,173 @@ void CodeGenerator::visitFunctionStmt(FunctionStmt& stmt) {
     
     // Create function
     llvm::Function* function = llvm::Function::Create(
-        func_type, llvm::Function::ExternalLinkage, name, module.get()
+        func_type, llvm::Function::ExternalLinkage, spec.name, module.get()
     );
+    function->addFnAttr(RESULT_TYPE_ATTRIBUTE, staticTypeSuffix(spec.return_type));
+    
+    // Array storage never overlaps unless the same array is passed twice, so
+    // pointers are noalias when this function only reads them or is the only
+    // one it can write through
+    bool writes = spec.stores_arrays || spec.passes_arrays;
+    bool no_alias = !writes || (array_params == 1 && !spec.passes_arrays);
     
     // Set parameter names
-    unsigned idx = 0;
-    for (auto& arg : function->args()) {
-        arg.setName(stmt.getParams()[idx++].lexeme);
+    unsigned arg_no = 0;
+    for (size_t i = 0; i < spec.param_types.size(); ++i) {
+        const std::string& name = spec.stmt->getParams()[i].lexeme;
+        if (!isArrayType(spec.param_types[i])) {
+            function->getArg(arg_no++)->setName(name);
+            continue;
+        }
+        
+        llvm::Argument* data = function->getArg(arg_no++);
+        data->setName(name + ".data");
+        llvm::Type* element = getLLVMType(elementType(spec.param_types[i]));
+        data->addAttr(llvm::Attribute::getWithAlignment(
+            *context, module->getDataLayout().getABITypeAlign(element)
+        ));
+        if (no_alias) {
+            data->addAttr(llvm::Attribute::NoAlias);
+        }
+        if (!writes) {
+            data->addAttr(llvm::Attribute::ReadOnly);
+        }
+        function->getArg(arg_no++)->setName(name + ".len");
     }
     
     // Add to functions map
-    functions[name] = function;
+    functions[spec.name] = function;
+    return function;
+}
+
+bool CodeGenerator::shouldMemoize(const Specialization& spec) const {
+    return spec.stmt && (spec.stmt->isMemo() || auto_memo) && canMemoize(spec);
+}
+
+std::string CodeGenerator::getBodyName(const Specialization& spec) const {
+    return hot_version.empty() ? spec.name : spec.name + "." + hot_version;
+}
+
+llvm::Function* CodeGenerator::declareHotBody(const Specialization& spec) {
+    std::string name = getBodyName(spec);
+    if (llvm::Function* existing = module->getFunction(name)) {
+        return existing;
+    }
+    
+    // Same prototype and attributes, so the stub can jump straight in
+    llvm::Function* stub = declareSpecialization(spec);
+    llvm::Function* body = llvm::Function::Create(
+        stub->getFunctionType(), llvm::Function::ExternalLinkage, name, module.get()
+    );
+    body->setAttributes(stub->getAttributes());
+    for (unsigned i = 0; i < stub->arg_size(); ++i) {
+        body->getArg(i)->setName(stub->getArg(i)->getName());
+    }
+    return body;
+}
+
+llvm::Function* CodeGenerator::declareMemoBody(const Specialization& spec) {
+    std::string name = getBodyName(spec) + ".memo";
+    if (llvm::Function* existing = module->getFunction(name)) {
+        return existing;
+    }
+    
+    llvm::Function* function = declareSpecialization(spec);
+    llvm::Function* body = llvm::Function::Create(
+        function->getFunctionType(), llvm::Function::ExternalLinkage, name, module.get()
+    );
+    for (unsigned i = 0; i < function->arg_size(); ++i) {
+        body->getArg(i)->setName(function->getArg(i)->getName());
+    }
+    return body;
+}
+
+llvm::Function* CodeGenerator::emitMemoWrapper(llvm::Function* function, const Specialization& spec) {
+    llvm::Function* body = declareMemoBody(spec);
+    
+    // Emitted before the body, whose generation sets the insert point itself
+    llvm::IRBuilderBase::InsertPointGuard guard(*builder);
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", function));
+    builder->SetCurrentDebugLocation(llvm::DebugLoc());
+    if (frame_pointers) {
+        function->addFnAttr("frame-pointer", "all");
+    }
+    
+    // Arguments and the result are widened to i64 words
+    llvm::Type* i64 = builder->getInt64Ty();
+    auto widen = [&](llvm::Value* value) -> llvm::Value* {
+        if (value->getType()->isDoubleTy()) {
+            return builder->CreateBitCast(value, i64);
+        }
+        if (value->getType()->isIntegerTy(1)) {
+            return builder->CreateZExt(value, i64);
+        }
+        return builder->CreateSExt(value, i64);
+    };
+    
+    unsigned arity = function->arg_size();
+    llvm::ArrayType* key_type = llvm::ArrayType::get(i64, std::max(arity, 1u));
+    llvm::AllocaInst* key = builder->CreateAlloca(key_type, nullptr, "memo.key");
+    llvm::AllocaInst* cached = builder->CreateAlloca(i64, nullptr, "memo.result");
+    std::vector<llvm::Value*> args;
+    for (unsigned i = 0; i < arity; ++i) {
+        args.push_back(function->getArg(i));
+        builder->CreateStore(widen(function->getArg(i)), builder->CreateConstInBoundsGEP2_32(key_type, key, 0, i));
+    }
+    llvm::Value* key_words = builder->CreateConstInBoundsGEP2_32(key_type, key, 0, 0, "memo.words");
+    
+    // The runtime finds the cache by name on the first call and keeps it here;
+    // every version of a function in watch mode starts with a cache of its own
+    std::string cache_name = getBodyName(spec);
+    llvm::Type* cache_type = getStringType();
+    auto* cache = new llvm::GlobalVariable(
+        *module, cache_type, false, llvm::GlobalValue::InternalLinkage,
+        llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(cache_type)), cache_name + ".memo.cache"
+    );
+    llvm::Function* lookup = getRuntimeFunction("memo_lookup", llvm::FunctionType::get(
+        getIntType(),
+        {cache_type->getPointerTo(), getStringType(), getIntType(), i64->getPointerTo(), i64->getPointerTo()},
+        false
+    ));
+    llvm::Value* found = builder->CreateCall(lookup, {
+        cache, getStringConstant(cache_name), builder->getInt32(arity), key_words, cached
+    }, "memo.found");
+    
+    llvm::BasicBlock* hit = llvm::BasicBlock::Create(*context, "memo.hit", function);
+    llvm::BasicBlock* miss = llvm::BasicBlock::Create(*context, "memo.miss", function);
+    builder->CreateCondBr(builder->CreateICmpNE(found, builder->getInt32(0)), hit, miss);
+    
+    llvm::Type* return_type = function->getReturnType();
+    builder->SetInsertPoint(hit);
+    llvm::Value* word = builder->CreateLoad(i64, cached);
+    builder->CreateRet(return_type->isDoubleTy()
+        ? builder->CreateBitCast(word, return_type)
+        : builder->CreateTrunc(word, return_type));
+    
+    builder->SetInsertPoint(miss);
+    llvm::Value* result = builder->CreateCall(body, args, "result");
+    llvm::Function* store = getRuntimeFunction("memo_store", llvm::FunctionType::get(
+        getVoidType(), {cache_type, i64->getPointerTo(), i64}, false
+    ));
+    builder->CreateCall(store, {builder->CreateLoad(cache_type, cache), key_words, widen(result)});
+    builder->CreateRet(result);
+    return body;
+}
+
+void CodeGenerator::generateSpecialization(const Specialization& spec) {
+    llvm::Function* function = hot_version.empty() ? declareSpecialization(spec) : declareHotBody(spec);
+    if (!function->empty()) {
+        return;
+    }
+    if (shouldMemoize(spec)) {
+        function = emitMemoWrapper(function, spec);
+    }
+    
+    // Remember where we were so nested declarations don't hijack the caller
+    llvm::BasicBlock* prev_block = builder->GetInsertBlock();
+    llvm::DebugLoc prev_location = builder->getCurrentDebugLocation();
+    auto prev_named_values = std::move(named_values);
+    named_values.clear();
     
     // Create a new basic block for the function body
     llvm::BasicBlock* entry = llvm::BasicBlock::Create(*context, "entry", function);
@@ -827,33 +2458,61 @@ void CodeGenerator::visitFunctionStmt(FunctionStmt& stmt) {
     
     // Store the previous function and set the current one
     llvm::Function* prev_function = current_function;
+    const Specialization* prev_spec = current_spec;
+    llvm::BasicBlock* prev_tail_recurse = tail_recurse;
+    auto prev_param_allocas = std::move(param_allocas);
+    ProfileState prev_profile = std::move(profile_state);
     current_function = function;
+    current_spec = &spec;
+    param_allocas.clear();
+    beginFunction(function, spec.stmt->getName().lexeme, spec.stmt->getName().line);
+    beginProfile(spec.name, spec.stmt->getName().line, spec.stmt->getBody());
     
     // Create a new scope for the function
     symbol_table.enterScope();
     
-    // Create allocas for parameters and add to symbol table
-    for (auto& arg : function->args()) {
+    // Create allocas for parameters and add to symbol table; a parameter
+    // that is later assigned a wider value is widened on entry
+    unsigned arg_no = 0;
+    for (size_t i = 0; i < spec.param_slots.size(); ++i) {
+        const std::string& name = spec.stmt->getParams()[i].lexeme;
         llvm::AllocaInst* alloca = createEntryBlockAlloca(
-            function, arg.getName().str(), arg.getType()
+            function, name, getLLVMType(spec.param_slots[i])
         );
         
-        builder->CreateStore(&arg, alloca);
-        named_values[arg.getName().str()] = alloca;
-        symbol_table.define(arg.getName().str(), Symbol::Kind::PARAMETER);
+        llvm::Value* value = function->getArg(arg_no++);
+        if (isArrayType(spec.param_types[i])) {
+            value = makeArray(
+                value, function->getArg(arg_no++),
+                llvm::cast<llvm::StructType>(alloca->getAllocatedType())
+            );
+        }
+        
+        builder->CreateStore(convertValue(value, alloca->getAllocatedType()), alloca);
+        named_values[name] = alloca;
+        param_allocas.push_back(alloca);
+        symbol_table.define(name, Symbol::Kind::PARAMETER);
     }
     
-    // Generate code for function body
-    for (const auto& s : stmt.getBody()) {
+    // Self tail calls loop back here with new parameter values
+    tail_recurse = llvm::BasicBlock::Create(*context, "tailrecurse", function);
+    builder->CreateBr(tail_recurse);
+    builder->SetInsertPoint(tail_recurse);
+    
+    // Generate code for function body, up to the first return at its top level
+    for (const auto& s : spec.stmt->getBody()) {
+        if (builder->GetInsertBlock()->getTerminator()) {
+            break;
+        }
         if (s) {
-            s->accept(*this);
+            visit(*s);
         }
     }
     
     // Add a default return if there isn't one already
     if (builder->GetInsertBlock()->getTerminator() == nullptr) {
-        // Default return 0 for int functions
-        builder->CreateRet(llvm::ConstantInt::get(getIntType(), 0));
+        endProfile();
+        builder->CreateRet(llvm::Constant::getNullValue(function->getReturnType()));
     }
     
     // Exit the function scope
@@ -861,21 +2520,108 @@ void CodeGenerator::visitFunctionStmt(FunctionStmt& stmt) {
     
     // Restore the previous function
     current_function = prev_function;
+    current_spec = prev_spec;
+    tail_recurse = prev_tail_recurse;
+    param_allocas = std::move(prev_param_allocas);
+    profile_state = std::move(prev_profile);
+    named_values = std::move(prev_named_values);
+    if (prev_block) {
+        builder->SetInsertPoint(prev_block);
+    }
+    builder->SetCurrentDebugLocation(prev_location);
+    if (di_builder) {
+        di_builder->finalizeSubprogram(function->getSubprogram());
+    }
     
     // Verify the function
-    if (llvm::verifyFunction(*function, &llvm::errs())) {
-        // Function verification failed
-        function->eraseFromParent();
-        functions.erase(name);
+    std::string error_info;
+    llvm::raw_string_ostream error_stream(error_info);
+    if (llvm::verifyFunction(*function, &error_stream)) {
+        // Function verification failed; keep the prototype since other
+        // functions may already reference it
+        function->deleteBody();
         
         diagnostics.report(
             DiagnosticSeverity::ERROR,
-            "Function verification failed: " + name,
+            "Function verification failed: " + spec.name + "\n" + error_stream.str(),
             SourceLocation()
         );
     }
 }
 
+bool CodeGenerator::emitTailCall(CallExpr& expr) {
+    auto it = current_spec->calls.find(&expr);
+    if (it == current_spec->calls.end()) {
+        return false;
+    }
+    const Specialization* target = it->second;
+    
+    // Self recursion becomes a loop: rebind the parameters and start over
+    if (target == current_spec && tail_recurse) {
+        if (expr.getArguments().size() != param_allocas.size()) {
+            return false;
+        }
+        
+        // Every argument is evaluated before any parameter is overwritten
+        std::vector<llvm::Value*> values;
+        for (size_t i = 0; i < param_allocas.size(); ++i) {
+            llvm::Value* value = visit(*expr.getArguments()[i]);
+            if (!value) {
+                return true;
+            }
+            values.push_back(convertValue(value, param_allocas[i]->getAllocatedType()));
+        }
+        for (size_t i = 0; i < param_allocas.size(); ++i) {
+            builder->CreateStore(values[i], param_allocas[i]);
+        }
+        flushProfileLoops();
+        builder->CreateBr(tail_recurse);
+        return true;
+    }
+    
+    // Storing a memoized callee's result would keep this frame alive, so tail
+    // calls go straight to its body and leave the cache alone. In watch mode
+    // only the stub knows the current version.
+    llvm::Function* callee = shouldMemoize(*target) && hot_version.empty()
+        ? declareMemoBody(*target) : declareSpecialization(*target);
+    llvm::Type* return_type = current_function->getReturnType();
+    std::vector<llvm::Value*> args;
+    if (!emitSpecializationArgs(expr, *target, callee, args)) {
+        return true;
+    }
+    
+    // Identical prototypes guarantee the caller's frame can be reused;
+    // otherwise the backend may still turn the call into a jump
+    llvm::CallInst* call = builder->CreateCall(
+        callee, args, callee->getReturnType()->isVoidTy() ? "" : "call"
+    );
+    llvm::Value* result = call;
+    if (callee->getFunctionType() == current_function->getFunctionType() &&
+        callee->getCallingConv() == current_function->getCallingConv()) {
+        call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+    } else if (callee->getReturnType() == return_type) {
+        call->setTailCall();
+    }
+    
+    // Loops left by the jump are counted before the frame is gone
+    if (profile_state.thread) {
+        builder->SetInsertPoint(call);
+        endProfile();
+        builder->SetInsertPoint(call->getParent());
+    }
+    
+    if (return_type->isVoidTy()) {
+        builder->CreateRetVoid();
+    } else {
+        builder->CreateRet(convertValue(result, return_type));
+    }
+    return true;
+}
+
+void CodeGenerator::visitFunctionStmt(FunctionStmt&) {
+    // Bodies are emitted once per specialization by generateSpecializations()
+}
+
 void CodeGenerator::visitReturnStmt(ReturnStmt& stmt) {
     if (!current_function) {
         diagnostics.report(
@@ -885,17 +2631,25 @@ void CodeGenerator::visitReturnStmt(ReturnStmt& stmt) {
         );
         return;
     }
+    setDebugLocation(stmt.getKeyword());
+    
+    if (CallExpr* call = stmt.getTailCall()) {
+        if (emitTailCall(*call)) {
+            return;
+        }
+    }
     
     llvm::Value* return_val = nullptr;
     
+    llvm::Type* return_type = current_function->getReturnType();
     if (stmt.getValue()) {
-        stmt.getValue()->accept(*this);
-        return_val = popValue();
+        return_val = convertValue(visit(*stmt.getValue()), return_type);
     } else {
-        // Default return value is 0 for int functions
-        return_val = llvm::ConstantInt::get(getIntType(), 0);
+        // A bare return yields the zero value of the function's type
+        return_val = llvm::Constant::getNullValue(return_type);
     }
     
+    endProfile();
     if (return_val) {
         builder->CreateRet(return_val);
     } else {
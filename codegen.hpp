@@ -0,0 +1,393 @@
+#ifndef MANASCRIPT_CODEGEN_HPP
+#define MANASCRIPT_CODEGEN_HPP
+
+#include "ast.hpp"
+#include "static_visitor.hpp"
+#include "compile_stats.hpp"
+#include "error.hpp"
+#include "symbol_table.hpp"
+#include "type_inference.hpp"
+
+#include <llvm/IR/DIBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mana {
+
+// Function attribute naming the static result type of a specialization (see
+// staticTypeSuffix()), for readers of the module that can't tell a string
+// from another pointer
+const char* const RESULT_TYPE_ATTRIBUTE = "mana-result";
+
+/**
+ * @brief Generates LLVM IR from the Manascript AST
+ *
+ * Top-level statements are emitted into a synthesized `main` function.
+ * Functions are monomorphized: every signature found by TypeInference
+ * becomes its own LLVM function working on native types.
+ */
+class CodeGenerator : public StaticVisitor<CodeGenerator, llvm::Value*> {
+private:
+    std::unique_ptr<llvm::LLVMContext> owned_context;
+    llvm::LLVMContext* context = nullptr;
+    std::unique_ptr<llvm::Module> module;
+    std::unique_ptr<llvm::IRBuilder<>> builder;
+
+    std::unordered_map<std::string, llvm::Function*> functions;
+    std::unordered_map<std::string, llvm::AllocaInst*> named_values;
+    SymbolTable symbol_table;
+
+    llvm::Function* current_function = nullptr;
+
+    // Inferred types; owned unless supplied with setTypeInference()
+    std::unique_ptr<TypeInference> owned_types;
+    const TypeInference* types = nullptr;
+    const Specialization* current_spec = nullptr;
+
+    // Self tail calls store into the parameters and branch back to this block
+    llvm::BasicBlock* tail_recurse = nullptr;
+    std::vector<llvm::AllocaInst*> param_allocas;
+
+    // Where break and continue go in the loops around the code being generated
+    struct LoopTargets {
+        llvm::BasicBlock* exit;
+        llvm::BasicBlock* next;
+    };
+    std::vector<LoopTargets> loop_targets;
+
+    // Runtime functions (see runtime.hpp); only ever declared
+    llvm::Function* print_str = nullptr;
+    llvm::Function* print_i64 = nullptr;
+    llvm::Function* print_f64 = nullptr;
+
+    // Profiling support; debug info is created with the first function
+    bool frame_pointers = false;
+    bool debug_info = false;
+    std::unique_ptr<llvm::DIBuilder> di_builder;
+    llvm::DIFile* di_file = nullptr;
+
+    // Call and loop counters of the function being generated (see profile.hpp)
+    struct ProfileState {
+        std::string name;
+        int32_t slot = -1;
+        llvm::Value* thread = nullptr;
+
+        // Iterations of the enclosing loops, added to their counters when
+        // control leaves the loop
+        std::vector<std::pair<int32_t, llvm::AllocaInst*>> loops;
+    };
+    bool profile = false;
+    ProfileState profile_state;
+
+    // Memoize every pure function, not only those declared `memo function`
+    bool auto_memo = false;
+
+    // Signatures compiled for the host whether or not the program calls them
+    std::vector<ExportedFunction> exports;
+
+    // Version suffix of function bodies in watch mode; empty otherwise
+    std::string hot_version;
+
+    // Phase timings of generate(); optional
+    CompileStats* stats = nullptr;
+
+    // String literals pooled per module
+    std::unordered_map<std::string, llvm::Constant*> string_pool;
+
+    void declareRuntimeFunctions();
+    llvm::Function* getRuntimeFunction(const char* name, llvm::FunctionType* type);
+    llvm::Constant* getStringConstant(const std::string& text);
+    llvm::Value* emitPrint(llvm::Value* value);
+    llvm::Value* emitSpecializationCall(CallExpr& expr, const Specialization& target);
+    bool emitSpecializationArgs(CallExpr& expr, const Specialization& target, llvm::Function* callee,
+                                std::vector<llvm::Value*>& args);
+    llvm::Function* declareNative(const NativeFunction& native);
+    bool emitTailCall(CallExpr& expr);
+
+    // Arrays are {element*, i32 length} structs passed around by value
+    llvm::StructType* getArrayType(llvm::Type* element);
+    llvm::Type* getArrayElementType(const llvm::Value* array);
+    bool isArray(const llvm::Value* value) const;
+    llvm::Value* makeArray(llvm::Value* data, llvm::Value* length, llvm::StructType* type);
+    llvm::Value* allocateArray(llvm::Type* element, llvm::Value* count, const Token& at);
+    llvm::Value* elementPointer(llvm::Value* array, llvm::Value* index, const Token& at);
+    void emitRuntimeCheck(llvm::Value* ok, const Token& at, const char* handler,
+                          const std::vector<llvm::Value*>& values);
+
+    // Integer `/` and `%`; dividing by zero calls division_error
+    llvm::Value* emitIntegerDivision(const Token& op, llvm::Value* left, llvm::Value* right);
+
+    // A task handle points to the task's environment: the callee's result,
+    // then its arguments. A thunk runs the call on the environment.
+    llvm::StructType* getTaskType(StaticType result);
+    llvm::StructType* getTaskEnvironmentType(llvm::Function* callee);
+    llvm::Function* getTaskThunk(const Specialization& target);
+
+    // Type helpers
+    llvm::Type* getIntType();
+    llvm::Type* getFloatType();
+    llvm::Type* getBoolType();
+    llvm::Type* getVoidType();
+    llvm::Type* getStringType();
+    llvm::Type* getLLVMType(StaticType type);
+
+    // Convert between native types where the language allows it
+    llvm::Value* convertValue(llvm::Value* value, llvm::Type* type);
+    llvm::Value* convertToString(llvm::Value* value);
+
+    // Concatenation and equality; type inference rejects other string operators
+    llvm::Value* emitStringBinary(const Token& op, llvm::Value* left, llvm::Value* right);
+    llvm::Value* toCondition(llvm::Value* value, const std::string& name);
+
+    llvm::AllocaInst* createEntryBlockAlloca(
+        llvm::Function* function, const std::string& name, llvm::Type* type);
+
+    // File of the function being generated, for messages, profiles and line tables
+    const std::string& getSourceFile() const;
+
+    // Attach frame pointer and debug info settings to a function being defined
+    void beginFunction(llvm::Function* function, const std::string& name, int line);
+    void setDebugLocation(const Token& token);
+
+    // Profile instrumentation; all are no-ops unless profiling
+    llvm::StructType* getProfileThreadType();
+    llvm::Value* loadProfileThread();
+    llvm::Value* profileCounter(int32_t slot);
+    void beginProfile(const std::string& name, int line, const std::vector<StmtPtr>& body);
+    void flushProfileLoops();
+    void endProfile();
+
+    // Iterations of a loop are counted in a local and added to its counter
+    // when control leaves the loop
+    llvm::AllocaInst* beginProfileLoop(const Token& keyword, int32_t& slot);
+    void endProfileLoop(int32_t slot, llvm::AllocaInst* iterations);
+
+    // Loops; `latch` is the loop's back-edge
+    void requestVectorization(llvm::BranchInst* latch);
+    void emitForLoop(ForStmt& stmt);
+
+    // A parallel for's body becomes a function running part of the range,
+    // which the runtime calls from its worker threads
+    void emitParallelFor(ForStmt& stmt);
+    llvm::Function* emitParallelBody(ForStmt& stmt, const std::vector<std::string>& captured,
+                                     llvm::StructType* env_type);
+
+    // A memoized specialization's body moves to an internal function, and the
+    // specialization itself consults the result cache before calling it
+    bool shouldMemoize(const Specialization& spec) const;
+    llvm::Function* declareMemoBody(const Specialization& spec);
+    llvm::Function* emitMemoWrapper(llvm::Function* function, const Specialization& spec);
+
+    // In watch mode a specialization's body is `<name>.<version>`, entered
+    // through the stub `<name>`
+    std::string getBodyName(const Specialization& spec) const;
+    llvm::Function* declareHotBody(const Specialization& spec);
+
+    void generateSpecialization(const Specialization& spec);
+
+public:
+    CodeGenerator();
+
+    /**
+     * @brief Create a fresh context and module
+     * @param module_name Name of the LLVM module
+     */
+    void initialize(const std::string& module_name);
+
+    /**
+     * @brief Create a module in a context owned by the caller
+     * @param context Context the module will live in (must outlive the generator's module)
+     * @param module_name Name of the LLVM module
+     */
+    void initialize(llvm::LLVMContext& context, const std::string& module_name);
+
+    /**
+     * @brief Use types inferred by the caller instead of running inference
+     *
+     * Lets several generators share one analysis. Must outlive the generator.
+     */
+    void setTypeInference(const TypeInference* inference) { types = inference; }
+
+    /**
+     * @brief Name the source file the module is generated from
+     *
+     * Used in runtime error messages and debug info. Defaults to the module name.
+     */
+    void setSourceFile(const std::string& path) { module->setSourceFileName(path); }
+
+    /**
+     * @brief Keep frame pointers in every function so profilers can unwind JIT code
+     */
+    void setFramePointers(bool enabled) { frame_pointers = enabled; }
+
+    /**
+     * @brief Emit line tables mapping generated code back to source lines
+     */
+    void setDebugInfo(bool enabled) { debug_info = enabled; }
+
+    /**
+     * @brief Count calls and loop iterations of every function
+     *
+     * Counters are reserved in the profile registry while generating and
+     * reported by printProfile() once the program has run; time is sampled
+     * while it runs.
+     */
+    void setProfile(bool enabled) { profile = enabled; }
+
+    /**
+     * @brief Cache the results of every pure function, as if declared `memo function`
+     *
+     * Only functions taking and returning numbers and bools qualify. Caches
+     * are reported by printMemoStats() once the program has run.
+     */
+    void setAutoMemo(bool enabled) { auto_memo = enabled; }
+
+    /**
+     * @brief Also compile these signatures when generate() infers the types itself
+     */
+    void setExports(const std::vector<ExportedFunction>& signatures) { exports = signatures; }
+
+    /**
+     * @brief Emit function bodies as a version that running code can switch to
+     *
+     * The body of a specialization becomes `<name>.<version>`, and `<name>`
+     * itself is left to generateHotStubs(). Used by watch mode, which loads
+     * new versions of functions while older ones may still be running.
+     */
+    void setHotReload(const std::string& version) { hot_version = version; }
+
+    /**
+     * @brief Record the resolve, codegen and verify phases of generate()
+     */
+    void setStats(CompileStats* compile_stats) { stats = compile_stats; }
+
+    /**
+     * @brief Reserve the profile counters of a function and its loops
+     *
+     * Counters are numbered in registration order, so generators running on
+     * several threads register every function up front to produce the same
+     * code regardless of which thread generates which function.
+     * @return First counter slot of the function
+     */
+    static int32_t registerProfileSites(const std::string& name, const std::string& file, int line,
+                                        const std::vector<StmtPtr>& body);
+
+    /**
+     * @brief Symbol a host function is bound to in generated code
+     */
+    static std::string getNativeSymbol(const std::string& name);
+
+    /**
+     * @brief Generate code for a whole program
+     * @param statements Top-level statements
+     */
+    void generate(const std::vector<StmtPtr>& statements);
+
+    /**
+     * @brief Generate the synthesized `main` from the non-function top-level statements
+     *
+     * Requires setTypeInference().
+     */
+    void generateMain(const std::vector<StmtPtr>& statements);
+
+    /**
+     * @brief Declare the prototype of a specialization without emitting its body
+     * @return The declared (or previously declared) LLVM function
+     */
+    llvm::Function* declareSpecialization(const Specialization& spec);
+
+    /**
+     * @brief Emit the bodies of the given specializations only
+     *
+     * Callees outside this set are declared on demand and must be defined in
+     * another module. Requires setTypeInference().
+     */
+    void generateSpecializations(const std::vector<const Specialization*>& specs);
+
+    /**
+     * @brief Define `<name>.entry`, which calls a specialization with its
+     * arguments read from an array of 64-bit slots
+     *
+     * Ints and bools take the low bits of a slot, doubles its bits, and an
+     * array two slots: its data pointer and its length. The result comes back
+     * in a slot the same way. Lets the tiered engine call any specialization
+     * with one function pointer type.
+     * @return False if the result isn't an int, double or bool
+     */
+    bool generateNativeEntry(const Specialization& spec);
+
+    /**
+     * @brief Emit copies of specializations owned by another module, for inlining
+     *
+     * The copies get available_externally linkage: the optimizer may inline
+     * them, but they are never emitted, so calls left in place still bind to
+     * the owning module's definition. Call after generateSpecializations().
+     */
+    void generateAvailableExternally(const std::vector<const Specialization*>& specs);
+
+    /**
+     * @brief Define the call stubs of the given specializations
+     *
+     * A stub jumps to the address held in the global `<name>.impl`, which
+     * starts out at this version's body. Storing the address of a later
+     * version there redirects every call made from then on. generate() emits
+     * the stubs itself. Requires setHotReload().
+     */
+    void generateHotStubs(const std::vector<const Specialization*>& specs);
+
+    /**
+     * @brief Verify the module and report failures as diagnostics
+     * @return True if the module is valid
+     */
+    bool verify();
+
+    llvm::Module& getModule() { return *module; }
+
+    /**
+     * @brief Transfer ownership of the generated module to the caller
+     */
+    std::unique_ptr<llvm::Module> takeModule() { return std::move(module); }
+
+    /**
+     * @brief Returns the textual LLVM IR of the module
+     */
+    std::string dumpIR() const;
+
+    // Expression visitors; called through StaticVisitor::visit()
+    llvm::Value* visitLiteralExpr(LiteralExpr& expr);
+    llvm::Value* visitUnaryExpr(UnaryExpr& expr);
+    llvm::Value* visitBinaryExpr(BinaryExpr& expr);
+    llvm::Value* visitGroupingExpr(GroupingExpr& expr);
+    llvm::Value* visitVariableExpr(VariableExpr& expr);
+    llvm::Value* visitAssignExpr(AssignExpr& expr);
+    llvm::Value* visitCallExpr(CallExpr& expr);
+    llvm::Value* visitArrayExpr(ArrayExpr& expr);
+    llvm::Value* visitIndexExpr(IndexExpr& expr);
+    llvm::Value* visitIndexAssignExpr(IndexAssignExpr& expr);
+    llvm::Value* visitSliceExpr(SliceExpr& expr);
+    llvm::Value* visitSpawnExpr(SpawnExpr& expr);
+
+    // Statement visitors
+    void visitExpressionStmt(ExpressionStmt& stmt);
+    void visitVarDeclStmt(VarDeclStmt& stmt);
+    void visitBlockStmt(BlockStmt& stmt);
+    void visitIfStmt(IfStmt& stmt);
+    void visitWhileStmt(WhileStmt& stmt);
+    void visitForStmt(ForStmt& stmt);
+    void visitBreakStmt(BreakStmt& stmt);
+    void visitContinueStmt(ContinueStmt& stmt);
+    void visitFunctionStmt(FunctionStmt& stmt);
+    void visitReturnStmt(ReturnStmt& stmt);
+};
+
+} // namespace mana
+
+#endif // MANASCRIPT_CODEGEN_HPP
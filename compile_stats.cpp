@@ -0,0 +1,259 @@
+#include "compile_stats.hpp"
+#include "static_visitor.hpp"
+
+#include <llvm/IR/Module.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/raw_os_ostream.h>
+
+#include <iomanip>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace mana {
+
+namespace {
+
+double cpuMilliseconds() {
+    llvm::sys::TimePoint<> elapsed;
+    std::chrono::nanoseconds user;
+    std::chrono::nanoseconds system;
+    llvm::sys::Process::GetTimeUsage(elapsed, user, system);
+    return std::chrono::duration<double, std::milli>(user + system).count();
+}
+
+uint64_t peakResidentKilobytes() {
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        // Kilobytes on Linux
+        return static_cast<uint64_t>(usage.ru_maxrss);
+    }
+#endif
+    return 0;
+}
+
+/**
+ * @brief Counts every expression and statement node
+ */
+class NodeCounter : public StaticVisitor<NodeCounter, void> {
+public:
+    uint64_t count = 0;
+
+    void visitExpr(const ExprPtr& expr) {
+        if (expr) {
+            visit(*expr);
+        }
+    }
+
+    void visitStmt(const StmtPtr& stmt) {
+        if (stmt) {
+            visit(*stmt);
+        }
+    }
+
+    void visitLiteralExpr(LiteralExpr&) { count++; }
+    void visitVariableExpr(VariableExpr&) { count++; }
+    void visitUnaryExpr(UnaryExpr& expr) { count++; visitExpr(expr.getRight()); }
+    void visitBinaryExpr(BinaryExpr& expr) { count++; visitExpr(expr.getLeft()); visitExpr(expr.getRight()); }
+    void visitGroupingExpr(GroupingExpr& expr) { count++; visitExpr(expr.getExpression()); }
+    void visitAssignExpr(AssignExpr& expr) { count++; visitExpr(expr.getValue()); }
+
+    void visitCallExpr(CallExpr& expr) {
+        count++;
+        visitExpr(expr.getCallee());
+        for (const auto& arg : expr.getArguments()) {
+            visitExpr(arg);
+        }
+    }
+
+    void visitArrayExpr(ArrayExpr& expr) {
+        count++;
+        for (const auto& element : expr.getElements()) {
+            visitExpr(element);
+        }
+        visitExpr(expr.getCount());
+    }
+
+    void visitIndexExpr(IndexExpr& expr) {
+        count++;
+        visitExpr(expr.getArray());
+        visitExpr(expr.getIndex());
+    }
+
+    void visitIndexAssignExpr(IndexAssignExpr& expr) {
+        count++;
+        visitExpr(expr.getArray());
+        visitExpr(expr.getIndex());
+        visitExpr(expr.getValue());
+    }
+
+    void visitSliceExpr(SliceExpr& expr) {
+        count++;
+        visitExpr(expr.getArray());
+        visitExpr(expr.getStart());
+        visitExpr(expr.getEnd());
+    }
+
+    void visitSpawnExpr(SpawnExpr& expr) { count++; visitExpr(expr.getCall()); }
+
+    void visitExpressionStmt(ExpressionStmt& stmt) { count++; visitExpr(stmt.getExpression()); }
+    void visitVarDeclStmt(VarDeclStmt& stmt) { count++; visitExpr(stmt.getInitializer()); }
+    void visitReturnStmt(ReturnStmt& stmt) { count++; visitExpr(stmt.getValue()); }
+
+    void visitBlockStmt(BlockStmt& stmt) {
+        count++;
+        for (const auto& s : stmt.getStatements()) {
+            visitStmt(s);
+        }
+    }
+
+    void visitIfStmt(IfStmt& stmt) {
+        count++;
+        visitExpr(stmt.getCondition());
+        visitStmt(stmt.getThenBranch());
+        visitStmt(stmt.getElseBranch());
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) {
+        count++;
+        visitExpr(stmt.getCondition());
+        visitStmt(stmt.getBody());
+    }
+
+    void visitForStmt(ForStmt& stmt) {
+        count++;
+        visitStmt(stmt.getInitializer());
+        visitExpr(stmt.getCondition());
+        visitExpr(stmt.getIncrement());
+        visitStmt(stmt.getBody());
+    }
+
+    void visitBreakStmt(BreakStmt&) { count++; }
+    void visitContinueStmt(ContinueStmt&) { count++; }
+
+    void visitFunctionStmt(FunctionStmt& stmt) {
+        count++;
+        for (const auto& s : stmt.getBody()) {
+            visitStmt(s);
+        }
+    }
+};
+
+} // namespace
+
+void CompileStats::addPhase(PhaseStats phase) {
+    phases.push_back(std::move(phase));
+}
+
+void CompileStats::setCount(const std::string& name, uint64_t value) {
+    for (auto& count : counts) {
+        if (count.first == name) {
+            count.second = value;
+            return;
+        }
+    }
+    counts.emplace_back(name, value);
+}
+
+void CompileStats::addCount(const std::string& name, uint64_t value) {
+    for (auto& count : counts) {
+        if (count.first == name) {
+            count.second += value;
+            return;
+        }
+    }
+    counts.emplace_back(name, value);
+}
+
+void CompileStats::print(std::ostream& out) const {
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << std::left << std::setw(12) << "phase" << std::right << std::setw(12) << "wall ms"
+        << std::setw(12) << "cpu ms" << std::setw(14) << "peak rss KB" << "\n";
+
+    double wall = 0;
+    double cpu = 0;
+    for (const PhaseStats& phase : phases) {
+        out << std::left << std::setw(12) << phase.name << std::right
+            << std::setw(12) << phase.wall_ms << std::setw(12) << phase.cpu_ms
+            << std::setw(14) << phase.peak_rss_kb << "\n";
+        wall += phase.wall_ms;
+        cpu += phase.cpu_ms;
+    }
+    out << std::left << std::setw(12) << "total" << std::right
+        << std::setw(12) << wall << std::setw(12) << cpu << "\n";
+
+    for (const auto& [name, value] : counts) {
+        out << std::left << std::setw(16) << name << std::right << value << "\n";
+    }
+    out.flags(flags);
+}
+
+void CompileStats::writeJson(std::ostream& out) const {
+    llvm::raw_os_ostream stream(out);
+    llvm::json::OStream json(stream, 2);
+    json.object([&]() {
+        json.attributeArray("phases", [&]() {
+            for (const PhaseStats& phase : phases) {
+                json.object([&]() {
+                    json.attribute("name", phase.name);
+                    json.attribute("wall_ms", phase.wall_ms);
+                    json.attribute("cpu_ms", phase.cpu_ms);
+                    json.attribute("peak_rss_kb", static_cast<int64_t>(phase.peak_rss_kb));
+                });
+            }
+        });
+        json.attributeObject("counts", [&]() {
+            for (const auto& [name, value] : counts) {
+                json.attribute(name, static_cast<int64_t>(value));
+            }
+        });
+    });
+    stream << "\n";
+}
+
+PhaseTimer::PhaseTimer(CompileStats* stats, const char* name) : stats(stats), name(name) {
+    if (stats) {
+        start_wall = std::chrono::steady_clock::now();
+        start_cpu_ms = cpuMilliseconds();
+    }
+}
+
+PhaseTimer::~PhaseTimer() {
+    if (!stats) {
+        return;
+    }
+
+    PhaseStats phase;
+    phase.name = name;
+    phase.wall_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start_wall
+    ).count();
+    phase.cpu_ms = cpuMilliseconds() - start_cpu_ms;
+    phase.peak_rss_kb = peakResidentKilobytes();
+    stats->addPhase(std::move(phase));
+}
+
+uint64_t countAstNodes(const std::vector<StmtPtr>& statements) {
+    NodeCounter counter;
+    for (const auto& stmt : statements) {
+        counter.visitStmt(stmt);
+    }
+    return counter.count;
+}
+
+void countModule(CompileStats& stats, const llvm::Module& module) {
+    uint64_t functions = 0;
+    for (const llvm::Function& function : module) {
+        if (!function.isDeclaration()) {
+            functions++;
+        }
+    }
+    stats.addCount("functions", functions);
+    stats.addCount("ir_instructions", module.getInstructionCount());
+}
+
+} // namespace mana
@@ -0,0 +1,90 @@
+#ifndef MANASCRIPT_COMPILE_STATS_HPP
+#define MANASCRIPT_COMPILE_STATS_HPP
+
+#include "ast.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class Module;
+}
+
+namespace mana {
+
+/**
+ * @brief Time and memory of one compiler phase
+ */
+struct PhaseStats {
+    std::string name;
+    double wall_ms = 0;
+    double cpu_ms = 0;          // User plus system time of every thread
+    uint64_t peak_rss_kb = 0;   // Peak resident set size of the process so far
+};
+
+/**
+ * @brief Phase timings and size counts of one compilation
+ *
+ * Filled in by the driver for --time-phases and --stats-json. Not thread-safe;
+ * phases are recorded from the thread that drives the compilation.
+ */
+class CompileStats {
+public:
+    void addPhase(PhaseStats phase);
+
+    /**
+     * @brief Set a count, e.g. "tokens"; counts keep the order they were first set in
+     */
+    void setCount(const std::string& name, uint64_t value);
+
+    void addCount(const std::string& name, uint64_t value);
+
+    const std::vector<PhaseStats>& getPhases() const { return phases; }
+
+    /**
+     * @brief Print a table of phases followed by the counts
+     */
+    void print(std::ostream& out) const;
+
+    void writeJson(std::ostream& out) const;
+
+private:
+    std::vector<PhaseStats> phases;
+    std::vector<std::pair<std::string, uint64_t>> counts;
+};
+
+/**
+ * @brief Records the enclosing scope as a phase; does nothing without stats
+ */
+class PhaseTimer {
+public:
+    PhaseTimer(CompileStats* stats, const char* name);
+    ~PhaseTimer();
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    CompileStats* stats;
+    const char* name;
+    std::chrono::steady_clock::time_point start_wall;
+    double start_cpu_ms = 0;
+};
+
+/**
+ * @brief Number of expression and statement nodes in a program
+ */
+uint64_t countAstNodes(const std::vector<StmtPtr>& statements);
+
+/**
+ * @brief Add a module's defined functions and IR instructions to the counts
+ */
+void countModule(CompileStats& stats, const llvm::Module& module);
+
+} // namespace mana
+
+#endif // MANASCRIPT_COMPILE_STATS_HPP
@@ -0,0 +1,379 @@
+#include "daemon.hpp"
+#include "daemon_protocol.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace mana {
+
+namespace {
+
+const int STREAM_COUNT = 3;
+
+// Bytes of cache report a worker passes back; less than a pipe holds, so
+// writing it never waits for the daemon
+const size_t MAX_REPORT_SIZE = 60000;
+
+// Written by the signal handlers to wake up the main loop
+int wake_pipe[2] = {-1, -1};
+volatile sig_atomic_t stopping = 0;
+
+void onSignal(int signal) {
+    int saved = errno;
+    if (signal != SIGCHLD) {
+        stopping = 1;
+    }
+    char byte = 0;
+    (void)!write(wake_pipe[1], &byte, 1);
+    errno = saved;
+}
+
+/**
+ * @brief A request read from a client
+ */
+struct Request {
+    std::string cwd;
+    std::vector<std::string> args;
+    std::vector<std::string> env;
+    int streams[STREAM_COUNT] = {-1, -1, -1};
+
+    ~Request() {
+        for (int fd : streams) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+};
+
+bool readFully(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t count = read(fd, data, size);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        data += count;
+        size -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+bool readRequest(int connection, Request& request) {
+    DaemonRequest header;
+    char control[CMSG_SPACE(sizeof(int) * STREAM_COUNT)];
+    struct iovec iov = {&header, sizeof(header)};
+    struct msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    // The descriptors arrive with the first bytes of the header
+    ssize_t count = recvmsg(connection, &message, MSG_CMSG_CLOEXEC);
+    if (count <= 0) {
+        return false;
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(int) * STREAM_COUNT)) {
+            std::memcpy(request.streams, CMSG_DATA(cmsg), sizeof(int) * STREAM_COUNT);
+        }
+    }
+    if (static_cast<size_t>(count) < sizeof(header) &&
+        !readFully(connection, reinterpret_cast<char*>(&header) + count, sizeof(header) - count)) {
+        return false;
+    }
+    if (header.magic != DAEMON_MAGIC || header.version != DAEMON_PROTOCOL_VERSION ||
+        request.streams[STREAM_COUNT - 1] < 0 || header.length > (16u << 20)) {
+        return false;
+    }
+
+    std::string payload(header.length, '\0');
+    if (!readFully(connection, payload.data(), payload.size())) {
+        return false;
+    }
+
+    // Split the NUL-terminated strings
+    std::vector<std::string> strings;
+    size_t start = 0;
+    for (size_t i = 0; i < payload.size(); ++i) {
+        if (payload[i] == '\0') {
+            strings.push_back(payload.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+    if (strings.size() != 1 + static_cast<size_t>(header.argc) + header.envc) {
+        return false;
+    }
+    request.cwd = strings[0];
+    request.args.assign(strings.begin() + 1, strings.begin() + 1 + header.argc);
+    request.env.assign(strings.begin() + 1 + header.argc, strings.end());
+    return true;
+}
+
+void sendStatus(int connection, int32_t status) {
+    // The client may be gone; that only loses the status
+    (void)!send(connection, &status, sizeof(status), MSG_NOSIGNAL);
+    close(connection);
+}
+
+/**
+ * @brief A forked worker
+ */
+struct Worker {
+    int connection = -1;    // To the client, for the exit status
+    int report = -1;        // Read end of the worker's cache report
+};
+
+[[noreturn]] void runWorker(int connection, int report, uint64_t number, const DaemonOptions& options,
+                            const DaemonHandler& handler, const DaemonWarmer& warmer) {
+    // A client that connects and goes quiet only holds up its own worker
+    struct timeval timeout = {5, 0};
+    setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    Request request;
+    if (!readRequest(connection, request)) {
+        _exit(1);
+    }
+    close(connection);
+
+    if (options.log) {
+        std::cerr << "[daemon] request " << number << ": worker " << getpid() << " in " << request.cwd << ":";
+        for (const std::string& arg : request.args) {
+            std::cerr << " " << arg;
+        }
+        std::cerr << "\n";
+    }
+
+    for (int i = 0; i < STREAM_COUNT; ++i) {
+        dup2(request.streams[i], i);
+    }
+    if (chdir(request.cwd.c_str()) != 0) {
+        std::cerr << "Error: Could not change to directory '" << request.cwd << "'\n";
+        std::exit(1);
+    }
+    for (const std::string& entry : request.env) {
+        size_t equals = entry.find('=');
+        if (equals != std::string::npos) {
+            setenv(entry.substr(0, equals).c_str(), entry.substr(equals + 1).c_str(), 1);
+        }
+    }
+
+    // exit() rather than _exit() so buffered program output is flushed
+    int status = handler(request.args);
+    std::cout.flush();
+
+    if (warmer.collect) {
+        std::string text = warmer.collect();
+        if (text.size() > MAX_REPORT_SIZE) {
+            size_t end = text.rfind('\n', MAX_REPORT_SIZE - 1);
+            text.resize(end == std::string::npos ? 0 : end + 1);
+        }
+        (void)!write(report, text.data(), text.size());
+    }
+    close(report);
+    std::exit(status);
+}
+
+std::string readReport(int fd) {
+    std::string text;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+        text.append(buffer, static_cast<size_t>(count));
+    }
+    return text;
+}
+
+int openSocket(const std::string& path) {
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: Socket path '" << path << "' is too long\n";
+        return -1;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "Error: Could not create socket: " << std::strerror(errno) << "\n";
+        return -1;
+    }
+
+    // A socket file nobody answers on is left over from a daemon that died;
+    // anything else at the path isn't ours to remove
+    struct stat status;
+    if (lstat(path.c_str(), &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+            std::cerr << "Error: '" << path << "' exists and is not a socket\n";
+            close(fd);
+            return -1;
+        }
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+            std::cerr << "Error: A daemon is already listening on '" << path << "'\n";
+            close(fd);
+            return -1;
+        }
+        unlink(path.c_str());
+    }
+
+    // Only the owner may run code through the daemon
+    mode_t mask = umask(0077);
+    int bound = bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    umask(mask);
+    if (bound != 0 || listen(fd, SOMAXCONN) != 0) {
+        std::cerr << "Error: Could not listen on '" << path << "': " << std::strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+int runDaemon(const DaemonOptions& options, const DaemonHandler& handler, const DaemonWarmer& warmer) {
+    unsigned workers = options.workers;
+    if (workers == 0) {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    int listener = openSocket(options.socket_path);
+    if (listener < 0) {
+        return 1;
+    }
+    if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        std::cerr << "Error: Could not create pipe: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::cerr << "manascript daemon listening on " << options.socket_path
+              << " with " << workers << " workers\n";
+
+    std::unordered_map<pid_t, Worker> running;
+    uint64_t served = 0;
+
+    while (!stopping || !running.empty()) {
+        // Reap first so finished workers free their slots
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            auto it = running.find(pid);
+            if (it == running.end()) {
+                continue;
+            }
+            int32_t code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            if (options.log) {
+                std::cerr << "[daemon] worker " << pid << " exited with " << code << "\n";
+            }
+            sendStatus(it->second.connection, code);
+
+            // Loaded before the next fork, so every later worker starts with it
+            std::string report = readReport(it->second.report);
+            close(it->second.report);
+            if (warmer.load && !report.empty()) {
+                warmer.load(report);
+            }
+            running.erase(it);
+        }
+        if (stopping && running.empty()) {
+            break;
+        }
+
+        struct pollfd fds[2] = {{wake_pipe[0], POLLIN, 0}, {listener, POLLIN, 0}};
+        bool accepting = !stopping && running.size() < workers;
+        if (poll(fds, accepting ? 2 : 1, -1) < 0 && errno != EINTR) {
+            std::cerr << "Error: poll failed: " << std::strerror(errno) << "\n";
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            char buffer[64];
+            while (read(wake_pipe[0], buffer, sizeof(buffer)) > 0) {}
+        }
+        if (!accepting || !(fds[1].revents & POLLIN)) {
+            continue;
+        }
+
+        int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection < 0) {
+            continue;
+        }
+        if (!isPeerSameUser(connection)) {
+            if (options.log) {
+                std::cerr << "[daemon] refused a connection from another user\n";
+            }
+            close(connection);
+            continue;
+        }
+
+        // The worker reads the request, so a slow client never stalls this loop
+        int report[2];
+        if (pipe2(report, O_CLOEXEC | O_NONBLOCK) != 0) {
+            std::cerr << "Error: Could not create pipe: " << std::strerror(errno) << "\n";
+            sendStatus(connection, 1);
+            continue;
+        }
+        std::cout.flush();
+        std::cerr.flush();
+        pid = fork();
+        if (pid == 0) {
+            signal(SIGCHLD, SIG_DFL);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            signal(SIGPIPE, SIG_DFL);
+            close(listener);
+            close(wake_pipe[0]);
+            close(wake_pipe[1]);
+            close(report[0]);
+            for (const auto& [other, worker] : running) {
+                close(worker.connection);
+                close(worker.report);
+            }
+            runWorker(connection, report[1], served + 1, options, handler, warmer);
+        }
+        close(report[1]);
+        if (pid < 0) {
+            std::cerr << "Error: fork failed: " << std::strerror(errno) << "\n";
+            close(report[0]);
+            sendStatus(connection, 1);
+            continue;
+        }
+
+        served++;
+        running[pid] = {connection, report[0]};
+    }
+
+    close(listener);
+    unlink(options.socket_path.c_str());
+    std::cerr << "manascript daemon stopped after " << served << " requests\n";
+    return 0;
+}
+
+} // namespace mana
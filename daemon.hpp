@@ -0,0 +1,53 @@
+#ifndef MANASCRIPT_DAEMON_HPP
+#define MANASCRIPT_DAEMON_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Options of `manascript --daemon`
+ */
+struct DaemonOptions {
+    std::string socket_path;    // Unix domain socket to listen on
+    unsigned workers = 0;       // Requests run at once, 0 = one per hardware thread
+    bool log = false;           // Report every request on stderr
+};
+
+/**
+ * @brief Runs one request's arguments as if they were given on the command line
+ * @return The exit status for the client
+ */
+using DaemonHandler = std::function<int(const std::vector<std::string>& args)>;
+
+/**
+ * @brief Caches the daemon fills with what its workers loaded
+ */
+struct DaemonWarmer {
+    // In a worker after the handler: what it loaded itself, as lines of text
+    std::function<std::string()> collect;
+    // In the daemon once that worker exited: load the same into memory
+    std::function<void(const std::string& report)> load;
+};
+
+/**
+ * @brief Serve compile-and-run requests from mana-client until SIGINT or SIGTERM
+ *
+ * The daemon stays single-threaded and forks a worker per connection from its
+ * warm state: LLVM initialized, the host target detected, the compiler
+ * already loaded and relocated, and whatever `warmer` loaded for earlier
+ * requests. The worker reads the request, takes over the client's standard
+ * streams and working directory, runs `handler` and exits with its status,
+ * which is relayed to the client. Running each script in its own process
+ * keeps runtime state and runtime errors (which exit) from leaking between
+ * requests; at most `workers` run at once and further clients wait in the
+ * listen backlog.
+ * @return Exit status of the daemon
+ */
+int runDaemon(const DaemonOptions& options, const DaemonHandler& handler, const DaemonWarmer& warmer = {});
+
+} // namespace mana
+
+#endif // MANASCRIPT_DAEMON_HPP
@@ -0,0 +1,74 @@
+#ifndef MANASCRIPT_DAEMON_PROTOCOL_HPP
+#define MANASCRIPT_DAEMON_PROTOCOL_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace mana {
+
+// Wire format shared by `manascript --daemon` and mana-client; kept free of
+// LLVM so the client stays small and starts fast
+
+const uint32_t DAEMON_MAGIC = 0x414e414d;     // "MANA"
+const uint32_t DAEMON_PROTOCOL_VERSION = 1;
+
+/**
+ * @brief Fixed part of a request
+ *
+ * Followed by `length` bytes of NUL-terminated strings: the client's working
+ * directory, `argc` manascript arguments and `envc` MANA_* environment
+ * entries. The client's stdin, stdout and stderr are attached to the header
+ * as SCM_RIGHTS, so the script reads and writes the client's own streams.
+ * The reply is the script's exit status as an int32_t, sent once it exits.
+ */
+struct DaemonRequest {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t length;
+};
+
+/**
+ * @brief $MANA_DAEMON_SOCKET, else mana.sock in $XDG_RUNTIME_DIR, else /tmp/mana-<uid>.sock
+ */
+inline std::string getDefaultDaemonSocket() {
+    if (const char* path = std::getenv("MANA_DAEMON_SOCKET")) {
+        return path;
+    }
+    if (const char* dir = std::getenv("XDG_RUNTIME_DIR")) {
+        return std::string(dir) + "/mana.sock";
+    }
+    return "/tmp/mana-" + std::to_string(getuid()) + ".sock";
+}
+
+/**
+ * @brief Whether the process at the other end of a Unix socket runs as this user
+ *
+ * The default socket may sit in world-writable /tmp, where another user could
+ * create it first. Both ends check, so neither hands its streams, arguments
+ * or environment to, nor runs code for, anyone else.
+ */
+inline bool isPeerSameUser(int fd) {
+#ifdef SO_PEERCRED
+    struct ucred credentials;
+    socklen_t size = sizeof(credentials);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0) {
+        return false;
+    }
+    return credentials.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(fd, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+} // namespace mana
+
+#endif // MANASCRIPT_DAEMON_PROTOCOL_HPP
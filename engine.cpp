@@ -0,0 +1,281 @@
+#include "engine.hpp"
+#include "codegen.hpp"
+#include "jit.hpp"
+#include "lexer.hpp"
+#include "module_graph.hpp"
+#include "object_cache.hpp"
+#include "optimizer.hpp"
+#include "parser.hpp"
+#include "runtime.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace mana {
+
+struct Program::State {
+    std::string name;
+    unsigned opt_level = 2;
+    bool debug_info = false;
+
+    // The types refer into the statements, so both live as long as the program
+    std::vector<StmtPtr> statements;
+    std::unique_ptr<TypeInference> types;
+    std::unique_ptr<ManaJIT> jit;
+
+    std::mutex mutex;
+    std::unordered_set<std::string> defined;
+    std::unordered_map<std::string, void*> entries;     // By signature
+    size_t module_counter = 0;
+
+    bool addCode(const std::vector<const Specialization*>& specs, bool with_main);
+    void* compileEntry(const std::string& name, const std::vector<StaticType>& params, StaticType result);
+};
+
+namespace {
+
+// Diagnostics of one call into the engine, passed on only once it's done so
+// a compile failure reports everything in one piece
+class ReportScope {
+public:
+    ReportScope() : capture(reports) {}
+    ~ReportScope() {
+        capture.reset();
+        for (const Diagnostic& diagnostic : reports.getDiagnostics()) {
+            diagnostics.report(diagnostic);
+        }
+    }
+
+    bool hasErrors() const { return reports.hasErrors(); }
+
+private:
+    DiagnosticManager reports;
+    std::optional<DiagnosticCapture> capture;
+};
+
+void collectReachable(const Specialization& root, std::vector<const Specialization*>& out) {
+    std::vector<const Specialization*> worklist = {&root};
+    std::unordered_set<const Specialization*> seen = {&root};
+    while (!worklist.empty()) {
+        const Specialization* spec = worklist.back();
+        worklist.pop_back();
+        out.push_back(spec);
+        for (const auto& call : spec->calls) {
+            if (seen.insert(call.second).second) {
+                worklist.push_back(call.second);
+            }
+        }
+    }
+}
+
+std::string describeSignature(const std::string& name, const std::vector<StaticType>& params) {
+    return describeExport({name, params});
+}
+
+} // namespace
+
+bool Program::State::addCode(const std::vector<const Specialization*>& specs, bool with_main) {
+    llvm::orc::ThreadSafeContext context(std::make_unique<llvm::LLVMContext>());
+    CodeGenerator generator;
+    generator.setTypeInference(types.get());
+    generator.initialize(*context.getContext(),
+                         module_counter == 0 ? name : name + ".entry" + std::to_string(module_counter));
+    generator.setSourceFile(name);
+    generator.setDebugInfo(debug_info);
+    module_counter++;
+
+    if (with_main) {
+        generator.generateMain(statements);
+    }
+    generator.generateSpecializations(specs);
+    if (diagnostics.hasErrors() || !generator.verify()) {
+        return false;
+    }
+
+    // The host reads a bool result as a whole byte
+    for (const Specialization* spec : specs) {
+        if (spec->return_type == StaticType::BOOL) {
+            generator.getModule().getFunction(spec->name)->addRetAttr(llvm::Attribute::ZExt);
+        }
+    }
+
+    std::unique_ptr<llvm::Module> module = generator.takeModule();
+    optimizeModule(*module, opt_level);
+    if (auto err = jit->addModule(llvm::orc::ThreadSafeModule(std::move(module), context))) {
+        diagnostics.report(DiagnosticSeverity::ERROR, llvm::toString(std::move(err)), SourceLocation(name));
+        return false;
+    }
+
+    for (const Specialization* spec : specs) {
+        defined.insert(spec->name);
+    }
+    return true;
+}
+
+void* Program::State::compileEntry(const std::string& name, const std::vector<StaticType>& params,
+                                   StaticType result) {
+    const Specialization* spec = types->specialize(name, params);
+    if (!spec) {
+        if (!diagnostics.hasErrors()) {
+            diagnostics.report(DiagnosticSeverity::ERROR,
+                               "No function " + describeSignature(name, params),
+                               SourceLocation(this->name));
+        }
+        return nullptr;
+    }
+
+    // A void handle may discard any result
+    if (result != StaticType::VOID && spec->return_type != result) {
+        diagnostics.report(DiagnosticSeverity::ERROR,
+                           describeSignature(name, params) + " returns " +
+                               staticTypeName(spec->return_type) + ", not " + staticTypeName(result),
+                           SourceLocation(this->name));
+        return nullptr;
+    }
+
+    // Compile what the script never called this way; the rest is already in the JIT
+    std::vector<const Specialization*> reachable;
+    collectReachable(*spec, reachable);
+    std::vector<const Specialization*> bodies;
+    for (const Specialization* callee : reachable) {
+        if (!defined.count(callee->name)) {
+            bodies.push_back(callee);
+        }
+    }
+    if (!bodies.empty() && !addCode(bodies, false)) {
+        return nullptr;
+    }
+
+    auto address = jit->lookup(spec->name);
+    if (!address) {
+        diagnostics.report(DiagnosticSeverity::ERROR, llvm::toString(address.takeError()),
+                           SourceLocation(this->name));
+        return nullptr;
+    }
+    return reinterpret_cast<void*>(static_cast<uintptr_t>(*address));
+}
+
+Program::Program(std::unique_ptr<State> state) : state(std::move(state)) {}
+
+Program::~Program() = default;
+
+const std::string& Program::getName() const {
+    return state->name;
+}
+
+void* Program::lookup(const std::string& name, const std::vector<StaticType>& params, StaticType result) {
+    // Keyed by result type too, so a cached entry is never handed out with the wrong type
+    std::string mangled = TypeInference::mangle(name, params) + "->" + staticTypeName(result);
+    std::lock_guard<std::mutex> lock(state->mutex);
+    auto it = state->entries.find(mangled);
+    if (it != state->entries.end()) {
+        return it->second;
+    }
+
+    ReportScope scope;
+    void* address = state->compileEntry(name, params, result);
+    if (address) {
+        state->entries[mangled] = address;
+    }
+    return address;
+}
+
+int Program::run() {
+    auto address = state->jit->lookup("main");
+    if (!address) {
+        flushOutput();
+        diagnostics.report(DiagnosticSeverity::ERROR, llvm::toString(address.takeError()),
+                           SourceLocation(state->name));
+        return 1;
+    }
+
+    auto* main_func = reinterpret_cast<int (*)()>(static_cast<uintptr_t>(*address));
+    int code = 1;
+    bool completed = trapRuntimeErrors([&] { code = main_func(); });
+    flushOutput();
+    return completed ? code : 1;
+}
+
+Engine::Engine(const EngineOptions& options) : options(options) {
+    initializeNativeTarget();
+    if (!options.cache_dir.empty()) {
+        cache = std::make_unique<DiskObjectCache>(options.cache_dir, options.cache_max_size);
+    }
+}
+
+Engine::~Engine() = default;
+
+void Engine::addNative(const NativeFunction& native, void* address) {
+    natives.emplace_back(native, address);
+}
+
+std::unique_ptr<Program> Engine::compile(const std::string& source, const std::string& name) {
+    ReportScope scope;
+
+    Lexer lexer(source, name);
+    std::vector<Token> tokens = lexer.scanTokens();
+    Parser parser(tokens, name);
+    std::vector<StmtPtr> statements = parser.parse();
+    if (scope.hasErrors()) {
+        return nullptr;
+    }
+
+    ModuleGraph graph(name, std::move(statements), parser.getImports());
+    if (!graph.getModules()[0].import_decls.empty() && !graph.load()) {
+        return nullptr;
+    }
+
+    auto state = std::make_unique<Program::State>();
+    state->name = name;
+    state->opt_level = options.opt_level;
+    state->debug_info = options.debug_info;
+    state->statements = graph.link();
+    state->types = std::make_unique<TypeInference>(name);
+    graph.annotate(*state->types);
+
+    std::vector<std::pair<std::string, void*>> symbols;
+    for (const auto& [native, address] : natives) {
+        state->types->addNative(native);
+        symbols.emplace_back(CodeGenerator::getNativeSymbol(native.name), address);
+    }
+    if (!state->types->analyze(state->statements)) {
+        return nullptr;
+    }
+
+    auto jit = ManaJIT::create(cache.get());
+    if (!jit) {
+        diagnostics.report(DiagnosticSeverity::ERROR, llvm::toString(jit.takeError()), SourceLocation(name));
+        return nullptr;
+    }
+    state->jit = std::move(*jit);
+    if (auto err = state->jit->defineSymbols(symbols)) {
+        diagnostics.report(DiagnosticSeverity::ERROR, llvm::toString(std::move(err)), SourceLocation(name));
+        return nullptr;
+    }
+
+    // Everything the script uses is compiled together, as the driver would
+    std::vector<const Specialization*> specs;
+    for (const auto& spec : state->types->getSpecializations()) {
+        specs.push_back(spec.get());
+    }
+    if (!state->addCode(specs, true)) {
+        return nullptr;
+    }
+    return std::unique_ptr<Program>(new Program(std::move(state)));
+}
+
+std::unique_ptr<Program> Engine::compileFile(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        diagnostics.report(DiagnosticSeverity::ERROR, "Could not open file", SourceLocation(path));
+        return nullptr;
+    }
+    std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return compile(source, path);
+}
+
+} // namespace mana
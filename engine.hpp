@@ -0,0 +1,204 @@
+#ifndef MANASCRIPT_ENGINE_HPP
+#define MANASCRIPT_ENGINE_HPP
+
+#include "error.hpp"
+#include "runtime.hpp"
+#include "type_inference.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mana {
+
+class DiskObjectCache;
+
+/**
+ * @brief Static type of a C++ type passed to or returned from compiled code
+ *
+ * Only types with the same native representation on both sides are allowed:
+ * int32_t, double, bool and const char* (and void results).
+ */
+template <typename T>
+struct NativeType;
+
+template <> struct NativeType<int32_t> { static constexpr StaticType value = StaticType::INT; };
+template <> struct NativeType<double> { static constexpr StaticType value = StaticType::DOUBLE; };
+template <> struct NativeType<bool> { static constexpr StaticType value = StaticType::BOOL; };
+template <> struct NativeType<const char*> { static constexpr StaticType value = StaticType::STRING; };
+template <> struct NativeType<void> { static constexpr StaticType value = StaticType::VOID; };
+
+/**
+ * @brief Typed entry point of a compiled function
+ *
+ * Calling it jumps straight into the function's native code, with no
+ * marshalling. Valid while the Program it came from is alive; empty if the
+ * lookup failed.
+ */
+template <typename Signature>
+class FunctionHandle;
+
+template <typename R, typename... Args>
+class FunctionHandle<R(Args...)> {
+public:
+    // What call() returns: the result, or whether the call completed for void
+    using Result = std::conditional_t<std::is_void_v<R>, bool, std::optional<R>>;
+
+    FunctionHandle() = default;
+    explicit FunctionHandle(void* address) : entry(reinterpret_cast<R (*)(Args...)>(address)) {}
+
+    /**
+     * @brief Call the function; a runtime error ends the process
+     */
+    R operator()(Args... args) const { return entry(args...); }
+
+    /**
+     * @brief Call the function, returning no result on a runtime error
+     *
+     * The error, e.g. an index out of bounds, is reported to `diagnostics`
+     * and the host carries on. Errors inside tasks the call starts still end
+     * the process; see trapRuntimeErrors().
+     */
+    Result call(Args... args) const {
+        if constexpr (std::is_void_v<R>) {
+            return trapRuntimeErrors([&] { entry(args...); });
+        } else {
+            std::optional<R> result;
+            trapRuntimeErrors([&] { result = entry(args...); });
+            return result;
+        }
+    }
+
+    explicit operator bool() const { return entry != nullptr; }
+
+private:
+    R (*entry)(Args...) = nullptr;
+};
+
+/**
+ * @brief Options of an Engine
+ */
+struct EngineOptions {
+    unsigned opt_level = 2;     // Optimization level of compiled code
+    std::string cache_dir;      // Object cache shared across processes; none if empty
+    uint64_t cache_max_size = 256ull << 20;
+    bool debug_info = false;    // Emit line tables for debuggers and profilers
+};
+
+/**
+ * @brief A compiled script
+ *
+ * Holds the script's code and type information. Functions can be looked up
+ * for any signature; one the script never used is specialized and compiled
+ * on first lookup. Lookups may come from several threads.
+ */
+class Program {
+public:
+    ~Program();
+
+    /**
+     * @brief Typed handle to a script function, e.g. `get<int32_t(int32_t, int32_t)>("add")`
+     *
+     * Errors, such as a missing function or a result type the function can't
+     * produce, are reported to `diagnostics` and give an empty handle.
+     */
+    template <typename Signature>
+    FunctionHandle<Signature> get(const std::string& name);
+
+    /**
+     * @brief Run the top-level statements
+     *
+     * A runtime error is reported to `diagnostics` as by FunctionHandle::call().
+     * @return Exit code of the script; 1 after a runtime error
+     */
+    int run();
+
+    const std::string& getName() const;
+
+private:
+    friend class Engine;
+    struct State;
+
+    std::unique_ptr<State> state;
+
+    explicit Program(std::unique_ptr<State> state);
+    void* lookup(const std::string& name, const std::vector<StaticType>& params, StaticType result);
+};
+
+/**
+ * @brief Compiles scripts for a host program
+ *
+ * The embedding counterpart of the manascript driver: scripts are compiled
+ * once into a Program whose functions the host then calls directly, and may
+ * call back into functions the host registers. Compilation reports errors to
+ * `diagnostics`; wrap calls in a DiagnosticCapture to collect them per
+ * script. Programs may be compiled on several threads at once.
+ *
+ * Compiled code shares the process-wide runtime with the driver: output of
+ * print is buffered until flushOutput(). Runtime errors such as an index out
+ * of bounds end the process when a function is called directly, and are
+ * reported to `diagnostics` by Program::run() and FunctionHandle::call().
+ */
+class Engine {
+public:
+    explicit Engine(const EngineOptions& options = EngineOptions());
+    ~Engine();
+
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    /**
+     * @brief Let scripts call a host function, e.g. `registerFunction("clamp", &clamp)`
+     *
+     * Applies to programs compiled afterwards. Script functions of the same
+     * name take precedence.
+     */
+    template <typename R, typename... Args>
+    void registerFunction(const std::string& name, R (*function)(Args...)) {
+        addNative({name, {NativeType<Args>::value...}, NativeType<R>::value},
+                  reinterpret_cast<void*>(function));
+    }
+
+    /**
+     * @brief Compile a script
+     * @param name File name for messages; imports are resolved relative to it
+     * @return Null if the script has errors
+     */
+    std::unique_ptr<Program> compile(const std::string& source, const std::string& name = "script.mana");
+
+    /**
+     * @brief Compile a script file
+     * @return Null if the file can't be read or has errors
+     */
+    std::unique_ptr<Program> compileFile(const std::string& path);
+
+private:
+    EngineOptions options;
+    std::unique_ptr<DiskObjectCache> cache;
+    std::vector<std::pair<NativeFunction, void*>> natives;
+
+    void addNative(const NativeFunction& native, void* address);
+};
+
+template <typename Signature>
+struct SignatureTypes;
+
+template <typename R, typename... Args>
+struct SignatureTypes<R(Args...)> {
+    static std::vector<StaticType> params() { return {NativeType<Args>::value...}; }
+    static constexpr StaticType result = NativeType<R>::value;
+};
+
+template <typename Signature>
+FunctionHandle<Signature> Program::get(const std::string& name) {
+    using Types = SignatureTypes<Signature>;
+    return FunctionHandle<Signature>(lookup(name, Types::params(), Types::result));
+}
+
+} // namespace mana
+
+#endif // MANASCRIPT_ENGINE_HPP
@@ -7,9 +7,29 @@ namespace mana {
 // Initialize the global diagnostic manager
 DiagnosticManager diagnostics;
 
+// Target of the innermost DiagnosticCapture on this thread
+static thread_local DiagnosticManager* capture_target = nullptr;
+
+DiagnosticCapture::DiagnosticCapture(DiagnosticManager& target)
+    : previous(capture_target) {
+    capture_target = &target;
+}
+
+DiagnosticCapture::~DiagnosticCapture() {
+    capture_target = previous;
+}
+
+DiagnosticManager& DiagnosticCapture::getTarget() {
+    return capture_target ? *capture_target : diagnostics;
+}
+
 std::string SourceLocation::toString() const {
     std::stringstream ss;
     if (!filename.empty()) {
+        // Line 0 marks a problem with the file as a whole
+        if (line == 0) {
+            return filename;
+        }
         ss << filename << ":";
     }
     ss << line << ":" << column;
@@ -42,6 +62,12 @@ std::string Diagnostic::toString() const {
 }
 
 void DiagnosticManager::report(const Diagnostic& diagnostic) {
+    if (this == &mana::diagnostics && capture_target && capture_target != this) {
+        capture_target->report(diagnostic);
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
     diagnostics.push_back(diagnostic);
     
     if (diagnostic.getSeverity() == DiagnosticSeverity::ERROR || 
@@ -57,7 +83,15 @@ void DiagnosticManager::report(DiagnosticSeverity severity,
     report(Diagnostic(severity, message, location, code_context));
 }
 
+bool DiagnosticManager::hasErrors() const {
+    if (this == &mana::diagnostics && capture_target && capture_target != this) {
+        return capture_target->hasErrors();
+    }
+    return has_errors;
+}
+
 void DiagnosticManager::printDiagnostics(std::ostream& os) const {
+    std::lock_guard<std::mutex> lock(mutex);
     for (const auto& diagnostic : diagnostics) {
         os << diagnostic.toString() << std::endl;
     }
@@ -7,6 +7,7 @@
 #include <iostream>
 #include <memory>
 #include <exception>
+#include <mutex>
 
 namespace mana {
 
@@ -85,6 +86,9 @@ private:
     std::vector<Diagnostic> diagnostics;
     bool has_errors = false;
     
+    // Code generation may report from several worker threads at once
+    mutable std::mutex mutex;
+    
 public:
     void report(const Diagnostic& diagnostic);
     void report(DiagnosticSeverity severity, 
@@ -92,16 +96,49 @@ public:
                 const SourceLocation& location,
                 const std::string& code_context = "");
     
-    bool hasErrors() const { return has_errors; }
+    /**
+     * @brief Whether an error was reported; asked of `diagnostics`, answers for
+     * the capture active on this thread
+     */
+    bool hasErrors() const;
     const std::vector<Diagnostic>& getDiagnostics() const { return diagnostics; }
     
     void printDiagnostics(std::ostream& os = std::cerr) const;
-    void clear() { diagnostics.clear(); has_errors = false; }
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        diagnostics.clear();
+        has_errors = false;
+    }
 };
 
 // Global diagnostic manager instance
 extern DiagnosticManager diagnostics;
 
+/**
+ * @brief Redirects reports made to the global manager on the current thread
+ *
+ * While an instance is alive, everything reported to `diagnostics` from this
+ * thread goes to the target manager instead, and `diagnostics.hasErrors()`
+ * checks the target. Captures nest.
+ */
+class DiagnosticCapture {
+public:
+    explicit DiagnosticCapture(DiagnosticManager& target);
+    ~DiagnosticCapture();
+    
+    /**
+     * @brief Where `diagnostics` reports from this thread go, for handing
+     * over to worker threads
+     */
+    static DiagnosticManager& getTarget();
+    
+    DiagnosticCapture(const DiagnosticCapture&) = delete;
+    DiagnosticCapture& operator=(const DiagnosticCapture&) = delete;
+    
+private:
+    DiagnosticManager* previous;
+};
+
 } // namespace mana
 
 #endif // MANASCRIPT_ERROR_HPP// Adding error.hpp from adnanis78612
@@ -0,0 +1,640 @@
+#include "interpreter.hpp"
+#include "runtime.hpp"
+
+namespace mana {
+
+namespace {
+
+// Deep enough for real recursion, shallow enough to stay inside the native stack
+const size_t MAX_CALL_DEPTH = 10000;
+
+int32_t wrapInt(int64_t value) {
+    return static_cast<int32_t>(static_cast<uint32_t>(value));
+}
+
+} // namespace
+
+Interpreter::Interpreter(const std::string& filename) : filename(filename) {}
+
+void Interpreter::setTierController(TierController* controller,
+                                    uint32_t call_threshold,
+                                    uint32_t loop_threshold) {
+    tier = controller;
+    this->call_threshold = call_threshold;
+    this->loop_threshold = loop_threshold;
+}
+
+int Interpreter::run(const std::vector<StmtPtr>& statements) {
+    // Hoist every top-level function so calls may precede definitions
+    for (const auto& stmt : statements) {
+        if (auto* func = dynamic_cast<FunctionStmt*>(stmt.get())) {
+            func->accept(*this);
+        }
+    }
+
+    frames.emplace_back();
+
+    try {
+        for (const auto& stmt : statements) {
+            if (stmt && !dynamic_cast<FunctionStmt*>(stmt.get())) {
+                execute(stmt);
+            }
+        }
+    } catch (const RuntimeError& error) {
+        frames.clear();
+        return 1;
+    }
+
+    frames.clear();
+    return 0;
+}
+
+FunctionEntry* Interpreter::findFunction(const std::string& name) {
+    auto it = functions.find(name);
+    return it == functions.end() ? nullptr : it->second.get();
+}
+
+Value Interpreter::evaluate(const ExprPtr& expr) {
+    expr->accept(*this);
+    return result;
+}
+
+void Interpreter::execute(const StmtPtr& stmt) {
+    if (stmt) {
+        stmt->accept(*this);
+    }
+}
+
+Value* Interpreter::lookup(const std::string& name) {
+    auto& locals = frames.back().locals;
+    for (auto it = locals.rbegin(); it != locals.rend(); ++it) {
+        if (it->first == name) {
+            return &it->second;
+        }
+    }
+    return nullptr;
+}
+
+const std::string* Interpreter::intern(std::string text) {
+    strings.push_back(std::move(text));
+    return &strings.back();
+}
+
+const Array* Interpreter::newArray(Array::Element element, int32_t length, const Token& at) {
+    if (length < 0) {
+        runtimeError(at, arrayLengthError(length));
+    }
+    arrays.push_back(Array{element, length, allocateArrayStorage(length, elementSize(element))});
+    return &arrays.back();
+}
+
+const Array& Interpreter::expectArray(const Value& value, const Token& at) {
+    if (!value.isArray()) {
+        runtimeError(at, "Expected an array but got " + value.toString());
+    }
+    return value.asArray();
+}
+
+int32_t Interpreter::expectInt(const Value& value, const Token& at, const char* what) {
+    if (!value.isInt()) {
+        runtimeError(at, std::string(what) + " must be an int, not " + value.toString());
+    }
+    return value.asInt();
+}
+
+void Interpreter::enterScope() {
+    Frame& frame = frames.back();
+    frame.scope_marks.push_back(frame.locals.size());
+}
+
+void Interpreter::exitScope() {
+    Frame& frame = frames.back();
+    frame.locals.resize(frame.scope_marks.back());
+    frame.scope_marks.pop_back();
+}
+
+void Interpreter::runtimeError(const Token& token, const std::string& message) {
+    const FunctionEntry* function = frames.empty() ? nullptr : frames.back().function;
+    diagnostics.report(
+        DiagnosticSeverity::ERROR,
+        message,
+        SourceLocation(function ? function->file : filename, token.line, token.column)
+    );
+    throw RuntimeError(message);
+}
+
+// Expression visitors
+void Interpreter::visitLiteralExpr(LiteralExpr& expr) {
+    const auto& value = expr.getValue();
+
+    if (std::holds_alternative<int>(value)) {
+        result = Value::fromInt(std::get<int>(value));
+    }
+    else if (std::holds_alternative<double>(value)) {
+        result = Value::fromDouble(std::get<double>(value));
+    }
+    else if (std::holds_alternative<bool>(value)) {
+        result = Value::fromBool(std::get<bool>(value));
+    }
+    else if (std::holds_alternative<std::string>(value)) {
+        // The AST outlives the run, so its strings can be referenced directly
+        result = Value::fromString(&std::get<std::string>(value));
+    }
+    else {
+        result = Value::nil();
+    }
+}
+
+void Interpreter::visitUnaryExpr(UnaryExpr& expr) {
+    Value operand = evaluate(expr.getRight());
+
+    if (expr.getOperator().type == TokenType::MINUS) {
+        if (operand.isInt()) {
+            result = Value::fromInt(wrapInt(-static_cast<int64_t>(operand.asInt())));
+        }
+        else if (operand.isDouble()) {
+            result = Value::fromDouble(-operand.asDouble());
+        }
+        else {
+            runtimeError(expr.getOperator(), "Invalid operand type for unary minus");
+        }
+        return;
+    }
+
+    result = Value::fromBool(!operand.isTruthy());
+}
+
+void Interpreter::visitBinaryExpr(BinaryExpr& expr) {
+    const Token& op = expr.getOperator();
+
+    // Short-circuit evaluation
+    if (op.type == TokenType::AND || op.type == TokenType::OR) {
+        bool left = evaluate(expr.getLeft()).isTruthy();
+        if (op.type == TokenType::AND ? !left : left) {
+            result = Value::fromBool(left);
+            return;
+        }
+        result = Value::fromBool(evaluate(expr.getRight()).isTruthy());
+        return;
+    }
+
+    Value left = evaluate(expr.getLeft());
+    Value right = evaluate(expr.getRight());
+
+    if (op.type == TokenType::EQUAL_EQUAL) {
+        result = Value::fromBool(left == right);
+        return;
+    }
+    if (op.type == TokenType::BANG_EQUAL) {
+        result = Value::fromBool(left != right);
+        return;
+    }
+
+    if (op.type == TokenType::PLUS && (left.isString() || right.isString())) {
+        result = Value::fromString(intern(left.toString() + right.toString()));
+        return;
+    }
+
+    if (!left.isNumber() || !right.isNumber()) {
+        runtimeError(op, "Invalid operands for binary operation");
+    }
+
+    if (Value::bothInt(left, right)) {
+        int64_t a = left.asInt();
+        int64_t b = right.asInt();
+
+        switch (op.type) {
+            case TokenType::PLUS:  result = Value::fromInt(wrapInt(a + b)); return;
+            case TokenType::MINUS: result = Value::fromInt(wrapInt(a - b)); return;
+            case TokenType::STAR:  result = Value::fromInt(wrapInt(a * b)); return;
+            case TokenType::SLASH:
+            case TokenType::PERCENT:
+                if (b == 0) {
+                    runtimeError(op, "Division by zero");
+                }
+                result = Value::fromInt(wrapInt(op.type == TokenType::SLASH ? a / b : a % b));
+                return;
+            case TokenType::LESS:          result = Value::fromBool(a < b); return;
+            case TokenType::LESS_EQUAL:    result = Value::fromBool(a <= b); return;
+            case TokenType::GREATER:       result = Value::fromBool(a > b); return;
+            case TokenType::GREATER_EQUAL: result = Value::fromBool(a >= b); return;
+            default: break;
+        }
+    }
+    else {
+        // Mixed operands are promoted to double, as in the code generator
+        double a = left.toDouble();
+        double b = right.toDouble();
+
+        switch (op.type) {
+            case TokenType::PLUS:  result = Value::fromDouble(a + b); return;
+            case TokenType::MINUS: result = Value::fromDouble(a - b); return;
+            case TokenType::STAR:  result = Value::fromDouble(a * b); return;
+            case TokenType::SLASH: result = Value::fromDouble(a / b); return;
+            case TokenType::PERCENT:
+                runtimeError(op, "Modulo operator requires integer operands");
+            case TokenType::LESS:          result = Value::fromBool(a < b); return;
+            case TokenType::LESS_EQUAL:    result = Value::fromBool(a <= b); return;
+            case TokenType::GREATER:       result = Value::fromBool(a > b); return;
+            case TokenType::GREATER_EQUAL: result = Value::fromBool(a >= b); return;
+            default: break;
+        }
+    }
+
+    runtimeError(op, "Unknown binary operator");
+}
+
+void Interpreter::visitGroupingExpr(GroupingExpr& expr) {
+    expr.getExpression()->accept(*this);
+}
+
+void Interpreter::visitVariableExpr(VariableExpr& expr) {
+    Value* slot = lookup(expr.getName().lexeme);
+    if (!slot) {
+        runtimeError(expr.getName(), "Unknown variable name: " + expr.getName().lexeme);
+    }
+    result = *slot;
+}
+
+void Interpreter::visitAssignExpr(AssignExpr& expr) {
+    Value value = evaluate(expr.getValue());
+
+    Value* slot = lookup(expr.getName().lexeme);
+    if (!slot) {
+        runtimeError(expr.getName(), "Unknown variable name: " + expr.getName().lexeme);
+    }
+    *slot = value;
+    result = value;
+}
+
+void Interpreter::visitCallExpr(CallExpr& expr) {
+    auto* var_expr = dynamic_cast<VariableExpr*>(expr.getCallee().get());
+    if (!var_expr) {
+        runtimeError(expr.getParen(), "Expression is not callable");
+    }
+
+    std::vector<Value> args;
+    args.reserve(expr.getArguments().size());
+    for (const auto& arg : expr.getArguments()) {
+        args.push_back(evaluate(arg));
+    }
+
+    const std::string& name = var_expr->getName().lexeme;
+    if (FunctionEntry* entry = findFunction(name)) {
+        result = callFunction(*entry, args, expr.getParen());
+        return;
+    }
+
+    bool handled = false;
+    result = callBuiltin(name, args, expr.getParen(), handled);
+    if (!handled) {
+        runtimeError(var_expr->getName(), "Unknown function name: " + name);
+    }
+}
+
+void Interpreter::visitSpawnExpr(SpawnExpr& expr) {
+    // Spawned calls run to completion right away; join only hands back the result
+    auto* callee = dynamic_cast<VariableExpr*>(expr.getCall()->getCallee().get());
+    if (!callee || !findFunction(callee->getName().lexeme)) {
+        runtimeError(expr.getKeyword(), "spawn needs a call to a script function");
+    }
+
+    task_results.push_back(evaluate(expr.getCall()));
+    result = Value::fromTask(&task_results.back());
+}
+
+void Interpreter::visitArrayExpr(ArrayExpr& expr) {
+    const Token& bracket = expr.getBracket();
+    if (expr.getElements().empty()) {
+        runtimeError(bracket, "Empty array literal has no element type");
+    }
+
+    std::vector<Value> values;
+    values.reserve(expr.getElements().size());
+    Array::Element element = Array::Element::INT;
+    for (const auto& element_expr : expr.getElements()) {
+        Value value = evaluate(element_expr);
+        if (!value.isNumber()) {
+            runtimeError(bracket, "Array elements must be numbers, not " + value.toString());
+        }
+        if (value.isDouble()) {
+            element = Array::Element::DOUBLE;
+        }
+        values.push_back(value);
+    }
+
+    // [value; count] repeats its single value
+    if (expr.getCount()) {
+        int32_t count = expectInt(evaluate(expr.getCount()), bracket, "Array length");
+        const Array* array = newArray(element, count, bracket);
+        for (int32_t i = 0; i < count; ++i) {
+            storeElement(*array, i, values[0]);
+        }
+        result = Value::fromArray(array);
+        return;
+    }
+
+    const Array* array = newArray(element, static_cast<int32_t>(values.size()), bracket);
+    for (size_t i = 0; i < values.size(); ++i) {
+        storeElement(*array, static_cast<int32_t>(i), values[i]);
+    }
+    result = Value::fromArray(array);
+}
+
+void Interpreter::visitIndexExpr(IndexExpr& expr) {
+    Value array_value = evaluate(expr.getArray());
+    const Array& array = expectArray(array_value, expr.getBracket());
+    int32_t index = expectInt(evaluate(expr.getIndex()), expr.getBracket(), "Array index");
+
+    if (index < 0 || index >= array.length) {
+        runtimeError(expr.getBracket(), arrayIndexError(index, array.length));
+    }
+    result = loadElement(array, index);
+}
+
+void Interpreter::visitIndexAssignExpr(IndexAssignExpr& expr) {
+    Value array_value = evaluate(expr.getArray());
+    const Array& array = expectArray(array_value, expr.getBracket());
+    int32_t index = expectInt(evaluate(expr.getIndex()), expr.getBracket(), "Array index");
+    Value value = evaluate(expr.getValue());
+
+    if (index < 0 || index >= array.length) {
+        runtimeError(expr.getBracket(), arrayIndexError(index, array.length));
+    }
+    if (!value.isNumber() && !value.isBool()) {
+        runtimeError(expr.getBracket(), "Cannot store " + value.toString() + " in an array");
+    }
+    if (value.isDouble() && array.element == Array::Element::INT) {
+        runtimeError(expr.getBracket(), "Cannot store double in [int]");
+    }
+    storeElement(array, index, value);
+    result = loadElement(array, index);
+}
+
+void Interpreter::visitSliceExpr(SliceExpr& expr) {
+    Value array_value = evaluate(expr.getArray());
+    const Array& array = expectArray(array_value, expr.getBracket());
+    int32_t start = expr.getStart() ? expectInt(evaluate(expr.getStart()), expr.getBracket(), "Slice bound") : 0;
+    int32_t end = expr.getEnd() ? expectInt(evaluate(expr.getEnd()), expr.getBracket(), "Slice bound") : array.length;
+
+    if (start < 0 || start > end || end > array.length) {
+        runtimeError(expr.getBracket(), arraySliceError(start, end, array.length));
+    }
+
+    // Slices share storage with the array they are taken from
+    arrays.push_back(Array{
+        array.element, end - start, static_cast<char*>(array.data) + start * elementSize(array.element)
+    });
+    result = Value::fromArray(&arrays.back());
+}
+
+Value Interpreter::callBuiltin(const std::string& name, std::vector<Value>& args,
+                               const Token& paren, bool& handled) {
+    handled = true;
+
+    if (name == "print") {
+        if (args.size() != 1) {
+            runtimeError(paren, "print expects exactly one argument");
+        }
+        printValue(args[0]);
+        return Value::nil();
+    }
+
+    if (name == "len") {
+        if (args.size() != 1) {
+            runtimeError(paren, "len expects exactly one argument");
+        }
+        return Value::fromInt(expectArray(args[0], paren).length);
+    }
+
+    if (name == "join") {
+        if (args.size() != 1) {
+            runtimeError(paren, "join expects exactly one argument");
+        }
+        if (!args[0].isTask()) {
+            runtimeError(paren, "Expected a task but got " + args[0].toString());
+        }
+        return args[0].asTask();
+    }
+
+    handled = false;
+    return Value::nil();
+}
+
+Value Interpreter::callFunction(FunctionEntry& first, std::vector<Value>& first_args,
+                                const Token& first_paren) {
+    FunctionEntry* entry = &first;
+    std::vector<Value>* args = &first_args;
+    const Token* paren = &first_paren;
+    std::vector<Value> next_args;
+
+    // Tail calls replace the current frame instead of nesting inside it
+    for (;;) {
+        uint32_t calls = entry->calls.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        if (tier) {
+            Value native_result;
+            if (entry->native.load(std::memory_order_acquire) &&
+                tier->callNative(*entry, *args, native_result)) {
+                return native_result;
+            }
+            if (calls == call_threshold) {
+                tier->notifyHot(*entry, *args);
+            }
+        }
+
+        const auto& params = entry->stmt->getParams();
+        if (args->size() != params.size()) {
+            runtimeError(*paren, "Expected " + std::to_string(params.size()) +
+                         " arguments but got " + std::to_string(args->size()));
+        }
+        if (frames.size() >= MAX_CALL_DEPTH) {
+            runtimeError(*paren, "Stack overflow");
+        }
+
+        frames.emplace_back();
+        Frame& frame = frames.back();
+        frame.function = entry;
+        frame.locals.reserve(params.size() + 8);
+        for (size_t i = 0; i < params.size(); ++i) {
+            frame.locals.emplace_back(params[i].lexeme, (*args)[i]);
+        }
+
+        for (const auto& stmt : entry->stmt->getBody()) {
+            execute(stmt);
+            if (returning) {
+                break;
+            }
+        }
+
+        // Falling off the end returns 0, matching compiled code
+        Value ret = returning ? result : Value::fromInt(0);
+        returning = false;
+        frames.pop_back();
+
+        if (!tail_callee) {
+            return ret;
+        }
+        entry = tail_callee;
+        tail_callee = nullptr;
+        next_args = std::move(tail_args);
+        args = &next_args;
+        paren = tail_paren;
+    }
+}
+
+// Statement visitors
+void Interpreter::visitExpressionStmt(ExpressionStmt& stmt) {
+    evaluate(stmt.getExpression());
+}
+
+void Interpreter::visitVarDeclStmt(VarDeclStmt& stmt) {
+    Value value;
+    if (stmt.getInitializer()) {
+        value = evaluate(stmt.getInitializer());
+    }
+    frames.back().locals.emplace_back(stmt.getName().lexeme, value);
+}
+
+void Interpreter::visitBlockStmt(BlockStmt& stmt) {
+    enterScope();
+
+    for (const auto& s : stmt.getStatements()) {
+        execute(s);
+        if (returning || breaking || continuing) {
+            break;
+        }
+    }
+
+    exitScope();
+}
+
+void Interpreter::visitIfStmt(IfStmt& stmt) {
+    if (evaluate(stmt.getCondition()).isTruthy()) {
+        execute(stmt.getThenBranch());
+    } else if (stmt.getElseBranch()) {
+        execute(stmt.getElseBranch());
+    }
+}
+
+void Interpreter::visitWhileStmt(WhileStmt& stmt) {
+    while (evaluate(stmt.getCondition()).isTruthy()) {
+        execute(stmt.getBody());
+        if (returning) {
+            break;
+        }
+        if (breaking) {
+            breaking = false;
+            break;
+        }
+        continuing = false;
+        countBackEdge();
+    }
+}
+
+void Interpreter::visitForStmt(ForStmt& stmt) {
+    enterScope();
+    execute(stmt.getInitializer());
+
+    if (stmt.isParallel()) {
+        // Iterations run in order here. As in compiled code, the end is
+        // evaluated once and the body can't change the loop variable.
+        size_t variable = frames.back().locals.size() - 1;
+        Value start = frames.back().locals[variable].second;
+        Value limit = evaluate(stmt.getLimit());
+        if (!start.isInt() || !limit.isInt()) {
+            runtimeError(stmt.getKeyword(), "A parallel for must count through a range of ints");
+        }
+
+        int64_t end = static_cast<int64_t>(limit.asInt()) + (stmt.isInclusive() ? 1 : 0);
+        for (int64_t i = start.asInt(); i < end; ++i) {
+            frames.back().locals[variable].second = Value::fromInt(static_cast<int32_t>(i));
+            execute(stmt.getBody());
+            continuing = false;
+            countBackEdge();
+        }
+        exitScope();
+        return;
+    }
+
+    while (!stmt.getCondition() || evaluate(stmt.getCondition()).isTruthy()) {
+        execute(stmt.getBody());
+        if (returning) {
+            break;
+        }
+        if (breaking) {
+            breaking = false;
+            break;
+        }
+        continuing = false;
+        if (stmt.getIncrement()) {
+            evaluate(stmt.getIncrement());
+        }
+        countBackEdge();
+    }
+    exitScope();
+}
+
+void Interpreter::visitBreakStmt(BreakStmt&) {
+    breaking = true;
+}
+
+void Interpreter::visitContinueStmt(ContinueStmt&) {
+    continuing = true;
+}
+
+void Interpreter::countBackEdge() {
+    FunctionEntry* function = frames.back().function;
+    if (tier && function) {
+        uint32_t edges = function->back_edges.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (edges == loop_threshold) {
+            // Parameters are the first locals of a frame
+            const auto& locals = frames.back().locals;
+            std::vector<Value> args;
+            for (size_t i = 0; i < function->stmt->getParams().size() && i < locals.size(); ++i) {
+                args.push_back(locals[i].second);
+            }
+            tier->notifyHot(*function, args);
+        }
+    }
+}
+
+void Interpreter::visitFunctionStmt(FunctionStmt& stmt) {
+    auto& entry = functions[stmt.getName().lexeme];
+    if (!entry) {
+        entry = std::make_unique<FunctionEntry>();
+    }
+    entry->stmt = &stmt;
+    auto file = source_files.find(&stmt);
+    entry->file = file == source_files.end() ? filename : file->second;
+}
+
+void Interpreter::visitReturnStmt(ReturnStmt& stmt) {
+    if (frames.size() <= 1) {
+        runtimeError(stmt.getKeyword(), "Return statement outside of function");
+    }
+
+    // A call to a user function in tail position is left for callFunction()
+    if (CallExpr* call = stmt.getTailCall()) {
+        auto* var_expr = dynamic_cast<VariableExpr*>(call->getCallee().get());
+        FunctionEntry* callee = var_expr ? findFunction(var_expr->getName().lexeme) : nullptr;
+        if (callee) {
+            std::vector<Value> args;
+            args.reserve(call->getArguments().size());
+            for (const auto& arg : call->getArguments()) {
+                args.push_back(evaluate(arg));
+            }
+            tail_callee = callee;
+            tail_args = std::move(args);
+            tail_paren = &call->getParen();
+            result = Value::nil();
+            returning = true;
+            return;
+        }
+    }
+
+    result = stmt.getValue() ? evaluate(stmt.getValue()) : Value::fromInt(0);
+    returning = true;
+}
+
+} // namespace mana
@@ -0,0 +1,202 @@
+#ifndef MANASCRIPT_INTERPRETER_HPP
+#define MANASCRIPT_INTERPRETER_HPP
+
+#include "ast.hpp"
+#include "error.hpp"
+#include "type_inference.hpp"
+#include "value.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Exception used to unwind the interpreter on a runtime error
+ */
+class RuntimeError : public std::runtime_error {
+public:
+    RuntimeError(const std::string& message) : std::runtime_error(message) {}
+};
+
+/**
+ * @brief Per-function execution state shared between the interpreter and the JIT tier
+ */
+struct FunctionEntry {
+    FunctionStmt* stmt = nullptr;
+    std::string file;           // Script declaring the function, for runtime errors
+
+    // Profiling counters, bumped by the interpreter
+    std::atomic<uint32_t> calls{0};
+    std::atomic<uint32_t> back_edges{0};
+
+    // Set once a compile has been requested, so it is only requested once
+    std::atomic<bool> queued{false};
+
+    // Native entry point (see CodeGenerator::generateNativeEntry()); null
+    // until the function has been compiled
+    std::atomic<void*> native{nullptr};
+
+    // Signature the native entry was compiled for; written before native is
+    // published
+    std::vector<StaticType> native_params;
+    StaticType native_result = StaticType::INT;
+};
+
+/**
+ * @brief Hooks used by the interpreter to hand hot functions to a faster tier
+ */
+class TierController {
+public:
+    virtual ~TierController() = default;
+
+    /**
+     * @brief Called once a function crosses a call or back-edge threshold
+     * @param args The arguments of the call that crossed it, or the current
+     * values of the parameters when a loop did
+     */
+    virtual void notifyHot(FunctionEntry& entry, const std::vector<Value>& args) = 0;
+
+    /**
+     * @brief Run a function through its native entry point
+     * @return False if these arguments can't be passed natively
+     */
+    virtual bool callNative(FunctionEntry& entry, const std::vector<Value>& args, Value& result) = 0;
+};
+
+/**
+ * @brief Tree-walking interpreter for Manascript
+ *
+ * Needs no LLVM setup, which makes it the fastest way to start short scripts.
+ * Every call and loop back-edge is counted per function so a TierController can
+ * move hot functions to compiled code.
+ */
+class Interpreter : public AstVisitor {
+public:
+    Interpreter(const std::string& filename = "");
+
+    /**
+     * @brief Attach a tier controller
+     * @param call_threshold Calls before a function is reported hot
+     * @param loop_threshold Loop back-edges before a function is reported hot
+     */
+    void setTierController(TierController* controller,
+                           uint32_t call_threshold,
+                           uint32_t loop_threshold);
+
+    /**
+     * @brief Record the file of a function declared outside the main script
+     */
+    void setSourceFile(const FunctionStmt& stmt, const std::string& file) { source_files[&stmt] = file; }
+
+    /**
+     * @brief Register the functions and execute the top-level statements
+     * @return Exit code (0 on success, 1 after a runtime error)
+     */
+    int run(const std::vector<StmtPtr>& statements);
+
+    /**
+     * @brief Lookup a function registered by run()
+     */
+    FunctionEntry* findFunction(const std::string& name);
+
+    // Expression visitors
+    void visitLiteralExpr(LiteralExpr& expr) override;
+    void visitUnaryExpr(UnaryExpr& expr) override;
+    void visitBinaryExpr(BinaryExpr& expr) override;
+    void visitGroupingExpr(GroupingExpr& expr) override;
+    void visitVariableExpr(VariableExpr& expr) override;
+    void visitAssignExpr(AssignExpr& expr) override;
+    void visitCallExpr(CallExpr& expr) override;
+    void visitArrayExpr(ArrayExpr& expr) override;
+    void visitIndexExpr(IndexExpr& expr) override;
+    void visitIndexAssignExpr(IndexAssignExpr& expr) override;
+    void visitSliceExpr(SliceExpr& expr) override;
+    void visitSpawnExpr(SpawnExpr& expr) override;
+
+    // Statement visitors
+    void visitExpressionStmt(ExpressionStmt& stmt) override;
+    void visitVarDeclStmt(VarDeclStmt& stmt) override;
+    void visitBlockStmt(BlockStmt& stmt) override;
+    void visitIfStmt(IfStmt& stmt) override;
+    void visitWhileStmt(WhileStmt& stmt) override;
+    void visitForStmt(ForStmt& stmt) override;
+    void visitBreakStmt(BreakStmt& stmt) override;
+    void visitContinueStmt(ContinueStmt& stmt) override;
+    void visitFunctionStmt(FunctionStmt& stmt) override;
+    void visitReturnStmt(ReturnStmt& stmt) override;
+
+private:
+    /**
+     * @brief Locals of one activation; scopes are marks into the locals vector
+     */
+    struct Frame {
+        FunctionEntry* function = nullptr;
+        std::vector<std::pair<std::string, Value>> locals;
+        std::vector<size_t> scope_marks;
+    };
+
+    std::unordered_map<std::string, std::unique_ptr<FunctionEntry>> functions;
+
+    // Main script, and the scripts of imported functions
+    std::string filename;
+    std::unordered_map<const FunctionStmt*, std::string> source_files;
+    std::vector<Frame> frames;
+
+    // Strings created at runtime; a deque keeps pointers stable
+    std::deque<std::string> strings;
+
+    // Array headers; element storage comes from allocateArrayStorage()
+    std::deque<Array> arrays;
+
+    // Results of spawned calls, which task values point to
+    std::deque<Value> task_results;
+
+    Value result;
+    bool returning = false;
+
+    // Set by break and continue until the innermost loop sees them
+    bool breaking = false;
+    bool continuing = false;
+
+    // Call left pending by a return in tail position, made by callFunction()
+    // after the returning frame is gone
+    FunctionEntry* tail_callee = nullptr;
+    std::vector<Value> tail_args;
+    const Token* tail_paren = nullptr;
+
+    TierController* tier = nullptr;
+    uint32_t call_threshold = 0;
+    uint32_t loop_threshold = 0;
+
+    Value evaluate(const ExprPtr& expr);
+    void execute(const StmtPtr& stmt);
+
+    // Count a loop back-edge so long-running loops can trigger a tier-up
+    void countBackEdge();
+
+    Value callFunction(FunctionEntry& entry, std::vector<Value>& args, const Token& paren);
+    Value callBuiltin(const std::string& name, std::vector<Value>& args, const Token& paren, bool& handled);
+
+    Value* lookup(const std::string& name);
+    const std::string* intern(std::string text);
+    const Array* newArray(Array::Element element, int32_t length, const Token& at);
+    const Array& expectArray(const Value& value, const Token& at);
+    int32_t expectInt(const Value& value, const Token& at, const char* what);
+
+    void enterScope();
+    void exitScope();
+
+    [[noreturn]] void runtimeError(const Token& token, const std::string& message);
+};
+
+} // namespace mana
+
+#endif // MANASCRIPT_INTERPRETER_HPP
@@ -0,0 +1,263 @@
+#include "jit.hpp"
+#include "profile.hpp"
+#include "runtime.hpp"
+
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/Mangling.h>
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/Object/SymbolSize.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include <cstdio>
+#include <mutex>
+
+namespace mana {
+
+namespace {
+
+/**
+ * @brief Call `visit(name, address, size)` for every function of a loaded object
+ */
+template <typename Visitor>
+void forEachFunction(const llvm::object::ObjectFile& object,
+                     const llvm::RuntimeDyld::LoadedObjectInfo& info, Visitor visit) {
+    // The debug copy of the object has its sections at their load addresses
+    llvm::object::OwningBinary<llvm::object::ObjectFile> loaded = info.getObjectForDebug(object);
+    if (!loaded.getBinary()) {
+        return;
+    }
+    
+    for (const auto& [symbol, size] : llvm::object::computeSymbolSizes(*loaded.getBinary())) {
+        llvm::Expected<llvm::object::SymbolRef::Type> type = symbol.getType();
+        if (!type) {
+            llvm::consumeError(type.takeError());
+            continue;
+        }
+        if (*type != llvm::object::SymbolRef::ST_Function || size == 0) {
+            continue;
+        }
+        
+        llvm::Expected<llvm::StringRef> name = symbol.getName();
+        llvm::Expected<uint64_t> address = symbol.getAddress();
+        if (!name || !address) {
+            llvm::consumeError(name.takeError());
+            llvm::consumeError(address.takeError());
+            continue;
+        }
+        visit(*name, *address, size);
+    }
+}
+
+/**
+ * @brief Writes /tmp/perf-<pid>.map so perf can name samples in JIT code
+ *
+ * perf reads one "start size name" line per function. Objects are appended as
+ * they are loaded, from whichever thread loads them.
+ */
+class PerfMapListener : public llvm::JITEventListener {
+public:
+    PerfMapListener() {
+        std::string path = "/tmp/perf-" + std::to_string(llvm::sys::Process::getProcessId()) + ".map";
+        file = std::fopen(path.c_str(), "a");
+    }
+    
+    ~PerfMapListener() override {
+        if (file) {
+            std::fclose(file);
+        }
+    }
+    
+    void notifyObjectLoaded(ObjectKey, const llvm::object::ObjectFile& object,
+                            const llvm::RuntimeDyld::LoadedObjectInfo& info) override {
+        if (!file) {
+            return;
+        }
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        forEachFunction(object, info, [this](llvm::StringRef name, uint64_t address, uint64_t size) {
+            std::fprintf(file, "%llx %llx %s\n", static_cast<unsigned long long>(address),
+                         static_cast<unsigned long long>(size), name.str().c_str());
+        });
+        std::fflush(file);
+    }
+    
+private:
+    std::FILE* file = nullptr;
+    std::mutex mutex;
+};
+
+/**
+ * @brief Hands the address range of every loaded function to the --profile sampler
+ */
+class ProfileCodeListener : public llvm::JITEventListener {
+public:
+    void notifyObjectLoaded(ObjectKey, const llvm::object::ObjectFile& object,
+                            const llvm::RuntimeDyld::LoadedObjectInfo& info) override {
+        forEachFunction(object, info, [](llvm::StringRef name, uint64_t address, uint64_t size) {
+            addProfileCode(name.str(), address, size);
+        });
+    }
+};
+
+} // namespace
+
+void initializeNativeTarget() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+    });
+}
+
+std::string getHostTargetFingerprint() {
+    // Detection reads /proc/cpuinfo; the host doesn't change while we run
+    static const std::string fingerprint = []() -> std::string {
+        initializeNativeTarget();
+        
+        auto builder = llvm::orc::JITTargetMachineBuilder::detectHost();
+        if (!builder) {
+            llvm::consumeError(builder.takeError());
+            return "unknown";
+        }
+        
+        return builder->getTargetTriple().str() + ";" +
+               builder->getCPU() + ";" +
+               builder->getFeatures().getString();
+    }();
+    return fingerprint;
+}
+
+llvm::Expected<std::unique_ptr<ManaJIT>> ManaJIT::create(llvm::ObjectCache* cache, bool perf, bool profile) {
+    initializeNativeTarget();
+    
+    std::unique_ptr<ManaJIT> result(new ManaJIT());
+    llvm::orc::LLJITBuilder builder;
+    
+    // Profiled code reads its counters from real thread-local storage
+    auto target = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!target) {
+        return target.takeError();
+    }
+    target->getOptions().EmulatedTLS = false;
+    builder.setJITTargetMachineBuilder(std::move(*target));
+    
+    if (perf) {
+        result->perf_map = std::make_unique<PerfMapListener>();
+        result->listeners.push_back(result->perf_map.get());
+        
+        // Null when LLVM was built without perf support
+        if (llvm::JITEventListener* jitdump = llvm::JITEventListener::createPerfJITEventListener()) {
+            result->listeners.push_back(jitdump);
+        }
+        result->listeners.push_back(llvm::JITEventListener::createGDBRegistrationListener());
+    }
+    if (profile) {
+        result->profile_code = std::make_unique<ProfileCodeListener>();
+        result->listeners.push_back(result->profile_code.get());
+    }
+    
+    if (!result->listeners.empty()) {
+        std::vector<llvm::JITEventListener*> listeners = result->listeners;
+        builder.setObjectLinkingLayerCreator(
+            [listeners](llvm::orc::ExecutionSession& session, const llvm::Triple&)
+                -> llvm::Expected<std::unique_ptr<llvm::orc::ObjectLayer>> {
+                auto layer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(
+                    session, []() { return std::make_unique<llvm::SectionMemoryManager>(); }
+                );
+                for (llvm::JITEventListener* listener : listeners) {
+                    layer->registerJITEventListener(*listener);
+                }
+                return std::unique_ptr<llvm::orc::ObjectLayer>(std::move(layer));
+            }
+        );
+    }
+    
+    builder.setCompileFunctionCreator(
+        [cache](llvm::orc::JITTargetMachineBuilder target_builder)
+            -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+            auto target_machine = target_builder.createTargetMachine();
+            if (!target_machine) {
+                return target_machine.takeError();
+            }
+            return std::make_unique<llvm::orc::TMOwningSimpleCompiler>(
+                std::move(*target_machine), cache
+            );
+        }
+    );
+    
+    auto jit = builder.create();
+    if (!jit) {
+        return jit.takeError();
+    }
+    
+    // The print runtime and other natives are bound directly
+    llvm::orc::MangleAndInterner mangle((*jit)->getExecutionSession(), (*jit)->getDataLayout());
+    llvm::orc::SymbolMap runtime_symbols;
+    for (const RuntimeSymbol& symbol : getRuntimeSymbols()) {
+        runtime_symbols[mangle(symbol.name)] = llvm::JITEvaluatedSymbol(
+            llvm::pointerToJITTargetAddress(symbol.address), llvm::JITSymbolFlags::Exported
+        );
+    }
+    
+    // A thread-local symbol resolves to its offset from the thread pointer
+    if (profileBlockIsThreadLocal()) {
+        runtime_symbols[mangle("profile_block")] = llvm::JITEvaluatedSymbol(
+            profileBlockOffset(), llvm::JITSymbolFlags::Exported
+        );
+    }
+    if (auto err = (*jit)->getMainJITDylib().define(llvm::orc::absoluteSymbols(std::move(runtime_symbols)))) {
+        return err;
+    }
+    
+    // Resolve C library functions from the host process
+    auto generator = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+        (*jit)->getDataLayout().getGlobalPrefix()
+    );
+    if (!generator) {
+        return generator.takeError();
+    }
+    (*jit)->getMainJITDylib().addGenerator(std::move(*generator));
+    
+    result->jit = std::move(*jit);
+    return result;
+}
+
+llvm::Error ManaJIT::defineSymbols(const std::vector<std::pair<std::string, void*>>& symbols) {
+    llvm::orc::MangleAndInterner mangle(jit->getExecutionSession(), jit->getDataLayout());
+    llvm::orc::SymbolMap map;
+    for (const auto& [name, address] : symbols) {
+        map[mangle(name)] = llvm::JITEvaluatedSymbol(
+            llvm::pointerToJITTargetAddress(address), llvm::JITSymbolFlags::Exported
+        );
+    }
+    return jit->getMainJITDylib().define(llvm::orc::absoluteSymbols(std::move(map)));
+}
+
+llvm::Error ManaJIT::addModule(llvm::orc::ThreadSafeModule module) {
+    return jit->addIRModule(std::move(module));
+}
+
+llvm::Expected<llvm::JITTargetAddress> ManaJIT::lookup(const std::string& name) {
+    auto symbol = jit->lookup(name);
+    if (!symbol) {
+        return symbol.takeError();
+    }
+    return symbol->getAddress();
+}
+
+llvm::Expected<int> ManaJIT::runMain() {
+    auto address = lookup("main");
+    if (!address) {
+        return address.takeError();
+    }
+    
+    auto* main_func = reinterpret_cast<int (*)()>(static_cast<uintptr_t>(*address));
+    return main_func();
+}
+
+} // namespace mana
@@ -0,0 +1,79 @@
+#ifndef MANASCRIPT_JIT_HPP
+#define MANASCRIPT_JIT_HPP
+
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/Error.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Initialize the native target, asm printer and parser exactly once
+ */
+void initializeNativeTarget();
+
+/**
+ * @brief Describes the host target (triple, CPU and features)
+ *
+ * Used to key caches so that objects are never reused on a different machine.
+ */
+std::string getHostTargetFingerprint();
+
+/**
+ * @brief Thin wrapper around ORC's LLJIT used to run Manascript programs
+ */
+class ManaJIT {
+public:
+    /**
+     * @brief Create a JIT for the host
+     * @param cache Optional object cache consulted before compiling each module
+     * @param perf Announce loaded code to perf (a /tmp/perf-<pid>.map and a
+     *             jitdump file for `perf inject --jit`) and to debuggers
+     * @param profile Tell the --profile sampler where functions are loaded
+     */
+    static llvm::Expected<std::unique_ptr<ManaJIT>> create(llvm::ObjectCache* cache = nullptr,
+                                                          bool perf = false, bool profile = false);
+    
+    /**
+     * @brief Bind symbols to addresses in the host, such as native callbacks
+     */
+    llvm::Error defineSymbols(const std::vector<std::pair<std::string, void*>>& symbols);
+    
+    /**
+     * @brief Add a module; it is compiled lazily on first lookup
+     */
+    llvm::Error addModule(llvm::orc::ThreadSafeModule module);
+    
+    /**
+     * @brief Look up the address of a symbol, compiling its module if needed
+     */
+    llvm::Expected<llvm::JITTargetAddress> lookup(const std::string& name);
+    
+    /**
+     * @brief Run the synthesized `main` function
+     * @return Exit code of the script
+     */
+    llvm::Expected<int> runMain();
+    
+    const llvm::DataLayout& getDataLayout() const { return jit->getDataLayout(); }
+    
+private:
+    ManaJIT() = default;
+    
+    // Listeners must outlive the object layer they are registered with
+    std::unique_ptr<llvm::JITEventListener> perf_map;
+    std::unique_ptr<llvm::JITEventListener> profile_code;
+    std::vector<llvm::JITEventListener*> listeners;
+    std::unique_ptr<llvm::orc::LLJIT> jit;
+};
+
+} // namespace mana
+
+#endif // MANASCRIPT_JIT_HPP
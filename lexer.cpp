@@ -0,0 +1,221 @@
+#include "lexer.hpp"
+
+#include <cctype>
+
+namespace mana {
+
+Lexer::Lexer(const std::string& source, const std::string& filename)
+    : source(source), filename(filename) {}
+
+std::vector<Token> Lexer::scanTokens() {
+    tokens.clear();
+    start = current = 0;
+    line = column = 1;
+
+    while (!isAtEnd()) {
+        start = current;
+        scanToken();
+    }
+
+    tokens.emplace_back(TokenType::END_OF_FILE, "", line, column);
+    return tokens;
+}
+
+bool Lexer::isAtEnd() const {
+    return current >= static_cast<int>(source.size());
+}
+
+char Lexer::advance() {
+    char c = source[current++];
+    if (c == '\n') {
+        line++;
+        column = 1;
+    } else {
+        column++;
+    }
+    return c;
+}
+
+char Lexer::peek() const {
+    return isAtEnd() ? '\0' : source[current];
+}
+
+char Lexer::peekNext() const {
+    return current + 1 >= static_cast<int>(source.size()) ? '\0' : source[current + 1];
+}
+
+bool Lexer::match(char expected) {
+    if (isAtEnd() || source[current] != expected) {
+        return false;
+    }
+    advance();
+    return true;
+}
+
+void Lexer::addToken(TokenType type) {
+    addToken(type, source.substr(start, current - start));
+}
+
+void Lexer::addToken(TokenType type, const std::string& lexeme) {
+    // Tokens never span lines except strings, which record where they begin
+    int token_line = line;
+    int token_column = column - (current - start);
+    if (type == TokenType::STRING_LITERAL) {
+        token_line = string_line;
+        token_column = string_column;
+    }
+    tokens.emplace_back(type, lexeme, token_line, token_column);
+}
+
+void Lexer::scanToken() {
+    char c = advance();
+    switch (c) {
+        case '(': addToken(TokenType::LEFT_PAREN); break;
+        case ')': addToken(TokenType::RIGHT_PAREN); break;
+        case '{': addToken(TokenType::LEFT_BRACE); break;
+        case '}': addToken(TokenType::RIGHT_BRACE); break;
+        case '[': addToken(TokenType::LEFT_BRACKET); break;
+        case ']': addToken(TokenType::RIGHT_BRACKET); break;
+        case ',': addToken(TokenType::COMMA); break;
+        case '.': addToken(TokenType::DOT); break;
+        case ';': addToken(TokenType::SEMICOLON); break;
+        case ':': addToken(TokenType::COLON); break;
+        case '+': addToken(TokenType::PLUS); break;
+        case '-': addToken(TokenType::MINUS); break;
+        case '*': addToken(TokenType::STAR); break;
+        case '%': addToken(TokenType::PERCENT); break;
+        case '!': addToken(match('=') ? TokenType::BANG_EQUAL : TokenType::BANG); break;
+        case '=': addToken(match('=') ? TokenType::EQUAL_EQUAL : TokenType::EQUAL); break;
+        case '<': addToken(match('=') ? TokenType::LESS_EQUAL : TokenType::LESS); break;
+        case '>': addToken(match('=') ? TokenType::GREATER_EQUAL : TokenType::GREATER); break;
+        case '&':
+            if (match('&')) {
+                addToken(TokenType::AND);
+            } else {
+                reportError("Unexpected character '&'; did you mean '&&'?");
+            }
+            break;
+        case '|':
+            if (match('|')) {
+                addToken(TokenType::OR);
+            } else {
+                reportError("Unexpected character '|'; did you mean '||'?");
+            }
+            break;
+        case '/':
+            if (match('/')) {
+                while (peek() != '\n' && !isAtEnd()) {
+                    advance();
+                }
+            } else if (match('*')) {
+                while (!isAtEnd() && !(peek() == '*' && peekNext() == '/')) {
+                    advance();
+                }
+                if (isAtEnd()) {
+                    reportError("Unterminated comment");
+                } else {
+                    advance();
+                    advance();
+                }
+            } else {
+                addToken(TokenType::SLASH);
+            }
+            break;
+        case ' ':
+        case '\r':
+        case '\t':
+        case '\n':
+            break;
+        case '"':
+            scanString();
+            break;
+        default:
+            if (std::isdigit(static_cast<unsigned char>(c))) {
+                scanNumber();
+            } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+                scanIdentifier();
+            } else {
+                reportError(std::string("Unexpected character '") + c + "'");
+            }
+            break;
+    }
+}
+
+void Lexer::scanString() {
+    string_line = line;
+    string_column = column - 1;
+
+    std::string value;
+    while (peek() != '"' && !isAtEnd()) {
+        char c = advance();
+        if (c != '\\' || isAtEnd()) {
+            value += c;
+            continue;
+        }
+
+        char escaped = advance();
+        switch (escaped) {
+            case 'n': value += '\n'; break;
+            case 't': value += '\t'; break;
+            case 'r': value += '\r'; break;
+            case '0': value += '\0'; break;
+            case '"': value += '"'; break;
+            case '\\': value += '\\'; break;
+            default:
+                reportError(std::string("Unknown escape sequence '\\") + escaped + "'");
+                break;
+        }
+    }
+
+    if (isAtEnd()) {
+        reportError("Unterminated string");
+        return;
+    }
+
+    advance();  // Closing quote
+    addToken(TokenType::STRING_LITERAL, value);
+}
+
+void Lexer::scanNumber() {
+    while (std::isdigit(static_cast<unsigned char>(peek()))) {
+        advance();
+    }
+
+    if (peek() == '.' && std::isdigit(static_cast<unsigned char>(peekNext()))) {
+        advance();
+        while (std::isdigit(static_cast<unsigned char>(peek()))) {
+            advance();
+        }
+        addToken(TokenType::FLOAT_LITERAL);
+        return;
+    }
+
+    addToken(TokenType::INTEGER_LITERAL);
+}
+
+void Lexer::scanIdentifier() {
+    while (std::isalnum(static_cast<unsigned char>(peek())) || peek() == '_') {
+        advance();
+    }
+
+    addToken(Keywords::getKeyword(source.substr(start, current - start)));
+}
+
+void Lexer::reportError(const std::string& message) {
+    diagnostics.report(DiagnosticSeverity::ERROR, message, getCurrentLocation(), getLineContext());
+}
+
+SourceLocation Lexer::getCurrentLocation() const {
+    return SourceLocation(filename, line, column - 1);
+}
+
+std::string Lexer::getLineContext() const {
+    int begin = current;
+    while (begin > 0 && source[begin - 1] != '\n') {
+        begin--;
+    }
+    size_t end = source.find('\n', begin);
+    return source.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+}
+
+} // namespace mana
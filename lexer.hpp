@@ -24,7 +24,11 @@ private:
     int current = 0;
     int line = 1;
     int column = 1;
-    
+
+    // Where the string being scanned opened; strings may span lines
+    int string_line = 1;
+    int string_column = 1;
+
     // Helper methods
     bool isAtEnd() const;
     char advance();
@@ -64,3 +68,5 @@ public:
 };
 
 } // namespace mana
+
+#endif // MANASCRIPT_LEXER_HPP
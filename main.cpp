@@ -6,10 +6,30 @@
 #include "lexer.hpp"
 #include "parser.hpp"
 #include "ast.hpp"
-#include "transpiler.hpp"
 #include "error.hpp"
 #include "token.hpp"
+#include "codegen.hpp"
+#include "optimizer.hpp"
+#include "parallel_codegen.hpp"
+#include "module_graph.hpp"
+#include "jit.hpp"
+#include "object_cache.hpp"
+#include "source_cache.hpp"
+#include "compile_stats.hpp"
+#include "profile.hpp"
+#include "memo.hpp"
+#include "interpreter.hpp"
+#include "tiered_engine.hpp"
+#include "bytecode_compiler.hpp"
+#include "vm.hpp"
+#include "runtime.hpp"
+#include "daemon.hpp"
+#include "daemon_protocol.hpp"
+#include "batch.hpp"
+#include "bundle.hpp"
+#include "watch.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -17,22 +37,118 @@
 #include <memory>
 #include <vector>
 #include <filesystem>
+#include <cstdio>
+#include <limits>
+#include <charconv>
 
 namespace mana {
 
+/**
+ * @brief Command-line options for compiling a script
+ */
+enum class EngineKind {
+    JIT,
+    INTERPRETER,
+    TIERED,
+    VM
+};
+
+struct DriverOptions {
+    std::string filename;
+    EngineKind engine = EngineKind::JIT;
+    uint32_t tier_call_threshold = 100;
+    uint32_t tier_loop_threshold = 10000;
+    bool tier_log = false;
+    bool show_tokens = false;
+    bool emit_ir = false;
+    bool dump_bytecode = false;
+    bool parallel = false;
+    unsigned jobs = 0;
+    unsigned opt_level = 0;
+    bool use_cache = true;
+    bool cache_stats = false;
+    std::string cache_dir;
+    uint64_t cache_max_size = 256ull << 20;
+    bool perf = false;
+    bool debug_info = false;
+    bool profile = false;
+    std::string profile_path;   // JSON output; the table goes to stderr when empty
+    bool time_phases = false;
+    bool auto_memo = false;
+    size_t memo_capacity = 0;   // Results per memo cache; 0 keeps the default
+    bool memo_stats = false;
+    bool report_dead = false;
+    bool watch = false;         // Reload edited functions while the script runs
+    std::string stats_json;
+    std::string bundle_path;    // Write a .manac bundle instead of running
+    std::vector<ExportedFunction> exports;  // Compiled for the host even if never called
+};
+
 void printUsage() {
     std::cout << "ManaScript Interpreter v0.1.0\n"
               << "Usage:\n"
-              << "  manascript [options] [file]\n\n"
+              << "  manascript [options] [file]\n"
+              << "  manascript --check [options] path...\n"
+              << "  manascript build [options] path...\n\n"
               << "Options:\n"
               << "  -h, --help     Show this help message\n"
               << "  -v, --version  Show version information\n"
               << "  -i, --interactive  Start interactive mode\n"
-              << "  -t, --tokenize Show tokenized output\n\n"
+              << "  -t, --tokenize Show tokenized output\n"
+              << "  --emit-ir      Print the generated LLVM IR\n"
+              << "  --bundle FILE  Compile to a .manac bundle instead of running; running\n"
+              << "                 a .manac file maps it and needs no compiler or LLVM\n"
+              << "  --export SIG   Compile a function for the host, e.g. 'scale([double], double)',\n"
+              << "                 even if the script never calls it (repeatable)\n"
+              << "  --dump-bytecode  Print the VM bytecode listing\n"
+              << "  -O<level>      Optimization level (0-3, default 0)\n"
+              << "  -j, --jobs N   Generate functions in parallel shards on N threads\n"
+              << "                 (0 = all cores); output is identical for any N\n"
+              << "  --cache-dir DIR      Object cache location (default $MANA_CACHE_DIR\n"
+              << "                       or the user cache directory)\n"
+              << "  --cache-max-size MB  Evict least recently used objects above this size\n"
+              << "  --no-cache           Always compile, never read or write the cache\n"
+              << "  --cache-stats        Print object cache statistics on exit\n"
+              << "  --perf         Keep frame pointers and publish JIT code to perf\n"
+              << "                 (/tmp/perf-<pid>.map and a jitdump for perf inject)\n"
+              << "  -g             Emit line tables mapping JIT code to script lines\n"
+              << "  --profile[=FILE]  Count calls and loop iterations per function and sample\n"
+              << "                    their time; print on stderr at exit or write JSON to FILE\n"
+              << "  --auto-memo       Cache results of every pure function taking and returning\n"
+              << "                    numbers and bools, as `memo function` does for one\n"
+              << "  --memo-capacity N Results kept per memoized function (default 4096, at most 2^24)\n"
+              << "  --memo-stats      Print calls and hit rates of memoized functions on exit\n"
+              << "  --report-dead     List the functions dropped because nothing calls them\n"
+              << "  --watch           Keep running and swap in functions edited in the script\n"
+              << "                    or its imports; top-level code is not reloaded\n"
+              << "  --time-phases     Print time and peak memory of each compiler phase\n"
+              << "  --stats-json FILE Write phase timings and size counts as JSON\n"
+              << "  --engine=<name>      Execution engine:\n"
+              << "                         jit     compile everything up front (default)\n"
+              << "                         interp  interpret only, no LLVM setup\n"
+              << "                         tiered  interpret, JIT hot functions in the background\n"
+              << "                         vm      compile to register bytecode, no LLVM setup\n"
+              << "  --tier-threshold N       Calls before a function is compiled (default 100)\n"
+              << "  --tier-loop-threshold N  Loop iterations before a function is compiled\n"
+              << "                           (default 10000)\n"
+              << "  --tier-log               Report tier-ups on stderr\n"
+              << "  --daemon[=SOCKET]  Serve scripts sent by mana-client over a Unix socket\n"
+              << "                     (default $MANA_DAEMON_SOCKET, $XDG_RUNTIME_DIR/mana.sock\n"
+              << "                     or /tmp/mana-<uid>.sock)\n"
+              << "  --workers N        Scripts the daemon runs at once (default: all cores)\n"
+              << "  --daemon-log       Report every daemon request on stderr\n"
+              << "  --check            Report diagnostics of every script without running any;\n"
+              << "                     directories are searched for *.mana and *.ms files\n"
+              << "  build              Like --check, and compile each script into the object\n"
+              << "                     cache; with either, -j N processes N scripts at once\n\n"
               << "Examples:\n"
               << "  manascript script.ms        Run a script file\n"
               << "  manascript -i              Start interactive mode\n"
-              << "  manascript -t script.ms    Show tokenized output\n";
+              << "  manascript -t script.ms    Show tokenized output\n"
+              << "  manascript -O2 -j 8 --emit-ir script.ms\n"
+              << "  manascript -O2 --bundle script.manac script.ms && manascript script.manac\n"
+              << "  manascript --daemon & mana-client -O2 script.ms\n"
+              << "  manascript --check scripts/\n";
 }
 
 void printVersion() {
@@ -93,68 +209,903 @@ void runInteractiveMode() {
     }
 }
 
-void runFile(const std::string& filename, bool showTokens) {
-    try {
-        std::ifstream file(filename);
-        if (!file.is_open()) {
-            std::cerr << "Error: Could not open file '" << filename << "'\n";
-            return;
+// Largest callee, in statements, copied into other modules for inlining
+const size_t IMPORT_WEIGHT = 16;
+
+ParallelCodegenOptions getCodegenOptions(const DriverOptions& options, const ModuleGraph& graph,
+                                         CompileStats* stats) {
+    ParallelCodegenOptions codegen_options;
+    codegen_options.jobs = options.jobs;
+    codegen_options.opt_level = options.opt_level;
+    codegen_options.frame_pointers = options.perf;
+    codegen_options.debug_info = options.debug_info;
+    codegen_options.profile = options.profile;
+    codegen_options.auto_memo = options.auto_memo;
+    codegen_options.exports = options.exports;
+    codegen_options.stats = stats;
+    if (options.opt_level > 0) {
+        codegen_options.import_weight = IMPORT_WEIGHT;
+    }
+    
+    // Every imported file is compiled in parallel as a module of its own;
+    // -j additionally splits large files
+    if (graph.hasImports()) {
+        codegen_options.modules = &graph;
+        if (!options.parallel) {
+            codegen_options.shard_weight = std::numeric_limits<size_t>::max();
         }
+    }
+    return codegen_options;
+}
+
+std::unique_ptr<llvm::Module> compileModule(const std::vector<StmtPtr>& statements,
+                                            const ModuleGraph& graph,
+                                            const DriverOptions& options,
+                                            llvm::LLVMContext& context,
+                                            CompileStats* stats) {
+    if (options.parallel || graph.hasImports()) {
+        ParallelCodeGenerator generator(getCodegenOptions(options, graph, stats));
+        return generator.generate(statements, context, options.filename);
+    }
+    
+    CodeGenerator generator;
+    generator.initialize(context, options.filename);
+    generator.setFramePointers(options.perf);
+    generator.setDebugInfo(options.debug_info);
+    generator.setProfile(options.profile);
+    generator.setAutoMemo(options.auto_memo);
+    generator.setExports(options.exports);
+    generator.setStats(stats);
+    generator.generate(statements);
+    
+    std::unique_ptr<llvm::Module> module = generator.takeModule();
+    PhaseTimer phase(stats, "optimize");
+    optimizeModule(*module, options.opt_level);
+    return module;
+}
 
-        std::string content((std::istreambuf_iterator<char>(file)),
-                           std::istreambuf_iterator<char>());
+std::vector<llvm::orc::ThreadSafeModule> compileModules(const std::vector<StmtPtr>& statements,
+                                                        const ModuleGraph& graph,
+                                                        const DriverOptions& options,
+                                                        CompileStats* stats) {
+    std::vector<llvm::orc::ThreadSafeModule> modules;
+    
+    if (options.parallel || graph.hasImports()) {
+        ParallelCodeGenerator generator(getCodegenOptions(options, graph, stats));
+        return generator.generateShards(statements, options.filename);
+    }
+    
+    llvm::orc::ThreadSafeContext context(std::make_unique<llvm::LLVMContext>());
+    CodeGenerator generator;
+    generator.initialize(*context.getContext(), options.filename);
+    generator.setFramePointers(options.perf);
+    generator.setDebugInfo(options.debug_info);
+    generator.setProfile(options.profile);
+    generator.setAutoMemo(options.auto_memo);
+    generator.setExports(options.exports);
+    generator.setStats(stats);
+    generator.generate(statements);
+    
+    std::unique_ptr<llvm::Module> module = generator.takeModule();
+    PhaseTimer phase(stats, "optimize");
+    optimizeModule(*module, options.opt_level);
+    modules.emplace_back(std::move(module), context);
+    return modules;
+}
+
+std::unique_ptr<DiskObjectCache> createObjectCache(const DriverOptions& options) {
+    if (!options.use_cache) {
+        return nullptr;
+    }
+    
+    std::string dir = options.cache_dir.empty()
+        ? DiskObjectCache::getDefaultDirectory() : options.cache_dir;
+    return std::make_unique<DiskObjectCache>(dir, options.cache_max_size);
+}
+
+int executeModules(std::vector<llvm::orc::ThreadSafeModule> modules, const DriverOptions& options,
+                   CompileStats* stats) {
+    std::unique_ptr<DiskObjectCache> cache = createObjectCache(options);
+    
+    std::unique_ptr<ManaJIT> jit;
+    {
+        // Looking up main compiles every module
+        PhaseTimer phase(stats, "jit");
+        auto created = ManaJIT::create(cache.get(), options.perf, options.profile);
+        if (!created) {
+            std::cerr << "Error: " << llvm::toString(created.takeError()) << "\n";
+            return 1;
+        }
+        jit = std::move(*created);
+        
+        for (auto& module : modules) {
+            if (auto err = jit->addModule(std::move(module))) {
+                std::cerr << "Error: " << llvm::toString(std::move(err)) << "\n";
+                return 1;
+            }
+        }
         
-        Lexer lexer(content, filename);
-        auto tokens = lexer.scanTokens();
+        // The profiler maps samples to functions once all of them are loaded
+        if (stats || options.profile) {
+            auto main = jit->lookup("main");
+            if (!main) {
+                std::cerr << "Error: " << llvm::toString(main.takeError()) << "\n";
+                return 1;
+            }
+        }
+    }
+    
+    if (options.memo_capacity > 0) {
+        setMemoCapacity(options.memo_capacity);
+    }
+    if (options.profile) {
+        startProfileSampling();
+    }
+    auto result = jit->runMain();
+    if (options.profile) {
+        stopProfileSampling();
+    }
+    flushOutput();
+    
+    if (options.memo_stats) {
+        printMemoStats(std::cerr);
+    }
+    
+    if (options.profile) {
+        if (options.profile_path.empty()) {
+            printProfile(std::cerr);
+        } else {
+            std::ofstream out(options.profile_path);
+            if (!out) {
+                std::cerr << "Error: Could not write profile to '" << options.profile_path << "'\n";
+                return 1;
+            }
+            writeProfileJson(out);
+        }
+    }
+    
+    if (cache && options.cache_stats) {
+        cache->printStats();
+    }
+    
+    if (!result) {
+        std::cerr << "Error: " << llvm::toString(result.takeError()) << "\n";
+        return 1;
+    }
+    return *result;
+}
 
-        if (showTokens) {
-            printTokens(tokens);
+int interpretProgram(const std::vector<StmtPtr>& statements, const ModuleGraph& graph,
+                     const DriverOptions& options, CompileStats* stats) {
+    int exit_code = 0;
+    
+    if (options.engine == EngineKind::VM || options.dump_bytecode) {
+        std::unique_ptr<BytecodeProgram> program;
+        {
+            PhaseTimer phase(stats, "codegen");
+            BytecodeCompiler compiler(options.filename);
+            graph.annotate(compiler);
+            program = compiler.compile(statements);
+        }
+        if (!program) {
+            diagnostics.printDiagnostics();
+            return 1;
+        }
+        
+        if (options.dump_bytecode) {
+            std::cout << disassemble(*program);
+            return 0;
+        }
+        
+        VM vm(*program);
+        exit_code = vm.run();
+        flushOutput();
+    } else if (options.engine == EngineKind::TIERED) {
+        std::unique_ptr<DiskObjectCache> cache = createObjectCache(options);
+        
+        TieredOptions tiered_options;
+        tiered_options.call_threshold = options.tier_call_threshold;
+        tiered_options.loop_threshold = options.tier_loop_threshold;
+        tiered_options.opt_level = options.opt_level;
+        tiered_options.log = options.tier_log;
+        tiered_options.cache = cache.get();
+        tiered_options.filename = options.filename;
+        tiered_options.modules = &graph;
+        tiered_options.perf = options.perf;
+        tiered_options.debug_info = options.debug_info;
+        
+        TieredEngine engine(tiered_options);
+        exit_code = engine.run(statements);
+        flushOutput();
+        
+        if (cache && options.cache_stats) {
+            cache->printStats();
+        }
+    } else {
+        Interpreter interpreter(options.filename);
+        graph.annotate(interpreter);
+        exit_code = interpreter.run(statements);
+        flushOutput();
+    }
+    
+    if (diagnostics.hasErrors()) {
+        diagnostics.printDiagnostics();
+    }
+    return exit_code;
+}
+
+int watchProgram(ModuleGraph graph, const DriverOptions& options) {
+    WatchOptions watch_options;
+    watch_options.filename = options.filename;
+    watch_options.opt_level = options.opt_level;
+    watch_options.perf = options.perf;
+    watch_options.debug_info = options.debug_info;
+    watch_options.auto_memo = options.auto_memo;
+    watch_options.exports = options.exports;
+    
+    if (options.memo_capacity > 0) {
+        setMemoCapacity(options.memo_capacity);
+    }
+    WatchSession session(watch_options);
+    int exit_code = session.run(std::move(graph));
+    flushOutput();
+    
+    if (options.memo_stats) {
+        printMemoStats(std::cerr);
+    }
+    return exit_code;
+}
+
+/**
+ * @brief Hash of the script and every file it imports, stored in bundles
+ */
+uint64_t hashProgram(const std::string& content, const ModuleGraph& graph) {
+    uint64_t hash = hashSource(content);
+    const std::vector<SourceModule>& modules = graph.getModules();
+    for (size_t i = 1; i < modules.size(); ++i) {
+        std::ifstream file(modules[i].path);
+        hash = hashSource(std::string((std::istreambuf_iterator<char>(file)),
+                                      std::istreambuf_iterator<char>()), hash);
+    }
+    return hash;
+}
+
+/**
+ * @brief Run a bundle written by --bundle; neither the compiler nor LLVM is set up
+ */
+int runBundle(const std::string& filename) {
+    std::unique_ptr<Bundle> bundle = Bundle::load(filename);
+    if (!bundle) {
+        diagnostics.printDiagnostics();
+        return 1;
+    }
+    int exit_code = bundle->run();
+    if (diagnostics.hasErrors()) {
+        diagnostics.printDiagnostics();
+    }
+    return exit_code;
+}
+
+int runProgram(const DriverOptions& options, CompileStats* stats) {
+    const std::string& filename = options.filename;
+    try {
+        std::string content;
+        size_t token_count = 0;
+        std::vector<StmtPtr> statements;
+        std::vector<Import> imports;
+        
+        // A daemon worker starts with the files the daemon parsed for earlier requests
+        std::shared_ptr<const ParsedSource> cached = options.show_tokens ? nullptr : findParsedSource(filename);
+        if (cached) {
+            content = cached->content;
+            token_count = cached->tokens;
+            statements = cached->statements;
+            imports = cached->imports;
         } else {
-            // TODO: Add parser and interpreter here
-            std::cout << "Running script: " << filename << "\n";
+            {
+                PhaseTimer phase(stats, "read");
+                std::ifstream file(filename);
+                if (!file.is_open()) {
+                    std::cerr << "Error: Could not open file '" << filename << "'\n";
+                    return 1;
+                }
+                content.assign((std::istreambuf_iterator<char>(file)),
+                               std::istreambuf_iterator<char>());
+            }
+            
+            std::vector<Token> tokens;
+            {
+                PhaseTimer phase(stats, "lex");
+                Lexer lexer(content, filename);
+                tokens = lexer.scanTokens();
+            }
+            token_count = tokens.size();
+            
+            if (options.show_tokens) {
+                printTokens(tokens);
+                return 0;
+            }
+            
+            {
+                PhaseTimer phase(stats, "parse");
+                Parser parser(tokens, filename);
+                statements = parser.parse();
+                imports = parser.getImports();
+            }
+            if (diagnostics.hasErrors()) {
+                diagnostics.printDiagnostics();
+                return 1;
+            }
+        }
+        
+        ModuleGraph graph(filename, std::move(statements), std::move(imports));
+        if (!graph.getModules()[0].import_decls.empty()) {
+            PhaseTimer phase(stats, "imports");
+            if (!graph.load(options.jobs)) {
+                diagnostics.printDiagnostics();
+                return 1;
+            }
+        }
+        
+        std::vector<DeadFunction> dead;
+        {
+            PhaseTimer phase(stats, "dead-functions");
+            dead = graph.removeDeadFunctions(options.exports);
+        }
+        if (options.report_dead) {
+            for (const DeadFunction& func : dead) {
+                std::cerr << func.path << ":" << func.line << ": function '" << func.name
+                          << "' is never called\n";
+            }
+        }
+        statements = graph.link();
+        
+        if (stats) {
+            size_t source_bytes = content.size();
+            for (const SourceModule& module : graph.getModules()) {
+                source_bytes += module.source_bytes;
+                token_count += module.tokens;
+            }
+            stats->setCount("modules", graph.getModules().size());
+            stats->setCount("source_bytes", source_bytes);
+            stats->setCount("tokens", token_count);
+            stats->setCount("ast_nodes", countAstNodes(statements));
+            stats->setCount("dead_functions", dead.size());
+        }
+        
+        if ((options.engine != EngineKind::JIT || options.dump_bytecode) && !options.emit_ir) {
+            return interpretProgram(statements, graph, options, stats);
+        }
+        
+        if (options.watch) {
+            return watchProgram(std::move(graph), options);
+        }
+        
+        if (options.emit_ir) {
+            llvm::LLVMContext context;
+            std::unique_ptr<llvm::Module> module = compileModule(statements, graph, options, context, stats);
+            if (!module || diagnostics.hasErrors()) {
+                diagnostics.printDiagnostics();
+                return 1;
+            }
+            if (stats) {
+                countModule(*stats, *module);
+            }
+            
+            PhaseTimer phase(stats, "emit");
+            module->print(llvm::outs(), nullptr);
+            llvm::outs().flush();
+            return 0;
+        }
+        
+        if (!options.bundle_path.empty()) {
+            // A library only a host calls into would otherwise compile to main alone
+            bool has_functions = std::any_of(statements.begin(), statements.end(), [](const StmtPtr& stmt) {
+                return dynamic_cast<FunctionStmt*>(stmt.get()) != nullptr;
+            });
+            if (!has_functions && !dead.empty()) {
+                diagnostics.report(DiagnosticSeverity::ERROR,
+                                   "Bundle would export no functions since nothing calls them; "
+                                   "name the ones the host calls with --export 'name(types)'",
+                                   SourceLocation(options.filename));
+                diagnostics.printDiagnostics();
+                return 1;
+            }
+            
+            llvm::LLVMContext context;
+            std::unique_ptr<llvm::Module> module = compileModule(statements, graph, options, context, stats);
+            if (!module || diagnostics.hasErrors()) {
+                diagnostics.printDiagnostics();
+                return 1;
+            }
+            
+            PhaseTimer phase(stats, "bundle");
+            if (!writeBundle(*module, options.opt_level, hashProgram(content, graph), options.bundle_path)) {
+                diagnostics.printDiagnostics();
+                return 1;
+            }
+            return 0;
+        }
+        
+        auto modules = compileModules(statements, graph, options, stats);
+        if (diagnostics.hasErrors()) {
+            diagnostics.printDiagnostics();
+            return 1;
+        }
+        if (stats) {
+            for (auto& module : modules) {
+                module.withModuleDo([&](llvm::Module& m) { countModule(*stats, m); });
+            }
         }
+        
+        return executeModules(std::move(modules), options, stats);
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
+        return 1;
     }
 }
 
-} // namespace mana
+int runFile(const DriverOptions& options) {
+    bool want_stats = options.time_phases || !options.stats_json.empty();
+    CompileStats stats;
+    int exit_code = runProgram(options, want_stats ? &stats : nullptr);
+    
+    if (options.time_phases) {
+        stats.print(std::cerr);
+    }
+    if (!options.stats_json.empty()) {
+        std::ofstream out(options.stats_json);
+        if (!out) {
+            std::cerr << "Error: Could not write statistics to '" << options.stats_json << "'\n";
+            return 1;
+        }
+        stats.writeJson(out);
+    }
+    return exit_code;
+}
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        mana::printUsage();
+/**
+ * @brief Read and parse one script of a batch and load its imports
+ * @return Null once errors have been reported to diagnostics
+ */
+std::unique_ptr<ModuleGraph> loadScript(const std::string& filename) {
+    if (std::shared_ptr<const ParsedSource> cached = findParsedSource(filename)) {
+        auto graph = std::make_unique<ModuleGraph>(filename, cached->statements, cached->imports);
+        if (!graph->getModules()[0].import_decls.empty() && !graph->load(1)) {
+            return nullptr;
+        }
+        return graph;
+    }
+    
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        diagnostics.report(DiagnosticSeverity::ERROR, "Could not open file", SourceLocation(filename));
+        return nullptr;
+    }
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    
+    Lexer lexer(content, filename);
+    std::vector<Token> tokens = lexer.scanTokens();
+    Parser parser(tokens, filename);
+    std::vector<StmtPtr> statements = parser.parse();
+    if (diagnostics.hasErrors()) {
+        return nullptr;
+    }
+    
+    auto graph = std::make_unique<ModuleGraph>(filename, std::move(statements), parser.getImports());
+    if (!graph->getModules()[0].import_decls.empty() && !graph->load(1)) {
+        return nullptr;
+    }
+    return graph;
+}
+
+/**
+ * @brief Check or build one script of a batch
+ *
+ * Checking stops once code is generated; building also compiles it to
+ * native code, which lands in the object cache for later runs.
+ */
+bool compileScript(const std::string& filename, const DriverOptions& batch_options,
+                   DiskObjectCache* cache, bool build) {
+    std::unique_ptr<ModuleGraph> graph = loadScript(filename);
+    if (!graph) {
+        return false;
+    }
+    
+    DriverOptions options = batch_options;
+    options.filename = filename;
+    auto modules = compileModules(graph->link(), *graph, options, nullptr);
+    if (diagnostics.hasErrors() || !build) {
+        return !diagnostics.hasErrors();
+    }
+    
+    auto jit = ManaJIT::create(cache);
+    if (!jit) {
+        diagnostics.report(DiagnosticSeverity::ERROR, llvm::toString(jit.takeError()), SourceLocation(filename));
+        return false;
+    }
+    for (auto& module : modules) {
+        if (auto err = (*jit)->addModule(std::move(module))) {
+            diagnostics.report(DiagnosticSeverity::ERROR, llvm::toString(std::move(err)), SourceLocation(filename));
+            return false;
+        }
+    }
+    
+    // Looking up main compiles every module without running anything
+    auto main = (*jit)->lookup("main");
+    if (!main) {
+        diagnostics.report(DiagnosticSeverity::ERROR, llvm::toString(main.takeError()), SourceLocation(filename));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief `--check PATH...` and `build PATH...`: many scripts in one process
+ *
+ * -j sets the number of scripts processed at once; each script is compiled
+ * on a single thread. Diagnostics are grouped per script in a stable order.
+ */
+int runScripts(const DriverOptions& options, const std::vector<std::string>& paths, bool build) {
+    std::vector<std::string> scripts;
+    if (!collectScripts(paths, scripts)) {
+        return 1;
+    }
+    if (scripts.empty()) {
+        std::cerr << "Error: No scripts to " << (build ? "build" : "check") << "\n";
         return 1;
     }
+    
+    DriverOptions script_options = options;
+    script_options.parallel = false;
+    script_options.jobs = 1;
+    if (!build) {
+        script_options.opt_level = 0;
+    }
+    
+    // Shared by every worker, like the native target set up here
+    std::unique_ptr<DiskObjectCache> cache;
+    if (build) {
+        initializeNativeTarget();
+        cache = createObjectCache(options);
+    }
+    
+    BatchResult result = runBatch(scripts, options.jobs, [&](const std::string& path) {
+        return compileScript(path, script_options, cache.get(), build);
+    });
+    
+    std::cerr << (build ? "Built " : "Checked ") << result.scripts << " scripts";
+    if (result.failed > 0) {
+        std::cerr << ", " << result.failed << " failed";
+    }
+    if (cache) {
+        ObjectCacheStats stats = cache->getStats();
+        std::cerr << " (" << stats.misses << " objects compiled, " << stats.hits << " from cache)";
+    }
+    std::cerr << "\n";
+    
+    if (cache && options.cache_stats) {
+        cache->printStats();
+    }
+    return result.failed > 0 ? 1 : 0;
+}
+
+int runCommand(const std::vector<std::string>& args);
 
-    std::string arg = argv[1];
+// Parses the value of a numeric option; prints a usage error when it isn't a
+// whole number in [0, max]
+bool parseCount(const std::string& opt, const std::string& text, uint64_t max, uint64_t& value) {
+    uint64_t result = 0;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), result);
+    if (text.empty() || ec != std::errc() || end != text.data() + text.size() || result > max) {
+        std::cerr << "Error: " << opt << " expects a number from 0 to " << max << ", not '" << text << "'\n";
+        return false;
+    }
+    value = result;
+    return true;
+}
+
+int serveRequests(const DaemonOptions& options) {
+    // Workers start from this state instead of a fresh process
+    initializeNativeTarget();
+    getHostTargetFingerprint();
+    keepParsedSources();
+    DiskObjectCache::keepResident();
+    
+    // Files a worker parsed or objects it read from disk are loaded by the
+    // daemon in turn, so later requests for the same scripts find them in memory
+    DaemonWarmer warmer;
+    warmer.collect = []() {
+        std::string report;
+        auto add = [&](const std::string& line) {
+            if (line.find('\n') == std::string::npos) {
+                report += line + "\n";
+            }
+        };
+        for (const auto& [path, name] : takeMissedSources()) {
+            if (path.find('\t') == std::string::npos && name.find('\t') == std::string::npos) {
+                add("source\t" + path + "\t" + name);
+            }
+        }
+        for (const std::string& path : DiskObjectCache::takeLoadedEntries()) {
+            add("object\t" + path);
+        }
+        return report;
+    };
+    warmer.load = [](const std::string& report) {
+        std::istringstream lines(report);
+        std::string line;
+        while (std::getline(lines, line)) {
+            size_t tab = line.find('\t');
+            std::string kind = line.substr(0, tab);
+            std::string rest = tab == std::string::npos ? "" : line.substr(tab + 1);
+            size_t name = rest.find('\t');
+            if (kind == "source" && name != std::string::npos) {
+                loadParsedSource(rest.substr(0, name), rest.substr(name + 1));
+            } else if (kind == "object") {
+                DiskObjectCache::loadResident(rest);
+            }
+        }
+    };
+    
+    return runDaemon(options, [](const std::vector<std::string>& args) {
+        for (const std::string& arg : args) {
+            if (arg.rfind("--daemon", 0) == 0) {
+                std::cerr << "Error: " << arg << " can't be sent to a daemon\n";
+                return 1;
+            }
+        }
+        return runCommand(args);
+    }, warmer);
+}
+
+int runCommand(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    const std::string& arg = args[0];
     
     if (arg == "-h" || arg == "--help") {
-        mana::printUsage();
+        printUsage();
         return 0;
     }
     
     if (arg == "-v" || arg == "--version") {
-        mana::printVersion();
+        printVersion();
         return 0;
     }
     
     if (arg == "-i" || arg == "--interactive") {
-        mana::runInteractiveMode();
+        runInteractiveMode();
         return 0;
     }
     
-    bool showTokens = false;
-    if (arg == "-t" || arg == "--tokenize") {
-        showTokens = true;
-        if (argc < 3) {
-            std::cerr << "Error: No input file specified\n";
+    DriverOptions options;
+    DaemonOptions daemon_options;
+    bool daemon = false;
+    bool build = arg == "build";
+    bool check = false;
+    std::vector<std::string> paths;
+    size_t argc = args.size();
+    for (size_t i = build ? 1 : 0; i < argc; ++i) {
+        const std::string& opt = args[i];
+        
+        if (opt == "-t" || opt == "--tokenize") {
+            options.show_tokens = true;
+        } else if (opt == "--emit-ir") {
+            options.emit_ir = true;
+        } else if (opt == "--bundle") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << opt << " requires an output file\n";
+                return 1;
+            }
+            options.bundle_path = args[++i];
+        } else if (opt == "--export") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << opt << " requires a signature\n";
+                return 1;
+            }
+            ExportedFunction exported;
+            if (!parseExport(args[++i], exported)) {
+                std::cerr << "Error: Invalid signature '" << args[i]
+                          << "', expected e.g. 'scale([double], double)'\n";
+                return 1;
+            }
+            options.exports.push_back(exported);
+        } else if (opt == "--dump-bytecode") {
+            options.dump_bytecode = true;
+        } else if (opt.size() == 3 && opt.rfind("-O", 0) == 0 && opt[2] >= '0' && opt[2] <= '3') {
+            options.opt_level = static_cast<unsigned>(opt[2] - '0');
+        } else if (opt == "-j" || opt == "--jobs") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << opt << " requires a thread count\n";
+                return 1;
+            }
+            uint64_t jobs = 0;
+            if (!parseCount(opt, args[++i], std::numeric_limits<unsigned>::max(), jobs)) {
+                return 1;
+            }
+            options.parallel = true;
+            options.jobs = static_cast<unsigned>(jobs);
+        } else if (opt == "--cache-dir" || opt == "--cache-max-size") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << opt << " requires a value\n";
+                return 1;
+            }
+            if (opt == "--cache-dir") {
+                options.cache_dir = args[++i];
+            } else {
+                uint64_t megabytes = 0;
+                if (!parseCount(opt, args[++i], std::numeric_limits<uint64_t>::max() >> 20, megabytes)) {
+                    return 1;
+                }
+                options.cache_max_size = megabytes << 20;
+            }
+        } else if (opt.rfind("--engine=", 0) == 0) {
+            std::string name = opt.substr(9);
+            if (name == "jit") {
+                options.engine = EngineKind::JIT;
+            } else if (name == "interp") {
+                options.engine = EngineKind::INTERPRETER;
+            } else if (name == "tiered") {
+                options.engine = EngineKind::TIERED;
+            } else if (name == "vm") {
+                options.engine = EngineKind::VM;
+            } else {
+                std::cerr << "Error: Unknown engine '" << name << "'\n";
+                return 1;
+            }
+        } else if (opt == "--tier-threshold" || opt == "--tier-loop-threshold") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << opt << " requires a value\n";
+                return 1;
+            }
+            uint64_t value = 0;
+            if (!parseCount(opt, args[++i], std::numeric_limits<uint32_t>::max(), value)) {
+                return 1;
+            }
+            if (opt == "--tier-threshold") {
+                options.tier_call_threshold = static_cast<uint32_t>(value);
+            } else {
+                options.tier_loop_threshold = static_cast<uint32_t>(value);
+            }
+        } else if (opt == "--tier-log") {
+            options.tier_log = true;
+        } else if (opt == "--no-cache") {
+            options.use_cache = false;
+        } else if (opt == "--cache-stats") {
+            options.cache_stats = true;
+        } else if (opt == "--perf") {
+            options.perf = true;
+        } else if (opt == "-g") {
+            options.debug_info = true;
+        } else if (opt == "--time-phases") {
+            options.time_phases = true;
+        } else if (opt == "--auto-memo") {
+            options.auto_memo = true;
+        } else if (opt == "--memo-stats") {
+            options.memo_stats = true;
+        } else if (opt == "--report-dead") {
+            options.report_dead = true;
+        } else if (opt == "--watch") {
+            options.watch = true;
+        } else if (opt == "--memo-capacity") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << opt << " requires a value\n";
+                return 1;
+            }
+            uint64_t capacity = 0;
+            if (!parseCount(opt, args[++i], MAX_MEMO_CAPACITY, capacity)) {
+                return 1;
+            }
+            options.memo_capacity = static_cast<size_t>(capacity);
+        } else if (opt == "--stats-json") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << opt << " requires a value\n";
+                return 1;
+            }
+            options.stats_json = args[++i];
+        } else if (opt == "--profile" || opt.rfind("--profile=", 0) == 0) {
+            options.profile = true;
+            if (opt.size() > 10) {
+                options.profile_path = opt.substr(10);
+            }
+        } else if (opt == "--daemon" || opt.rfind("--daemon=", 0) == 0) {
+            daemon = true;
+            daemon_options.socket_path = opt.size() > 9 ? opt.substr(9) : getDefaultDaemonSocket();
+        } else if (opt == "--workers") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << opt << " requires a value\n";
+                return 1;
+            }
+            uint64_t workers = 0;
+            if (!parseCount(opt, args[++i], std::numeric_limits<unsigned>::max(), workers)) {
+                return 1;
+            }
+            daemon_options.workers = static_cast<unsigned>(workers);
+        } else if (opt == "--daemon-log") {
+            daemon_options.log = true;
+        } else if (opt == "--check") {
+            check = true;
+        } else if (!opt.empty() && opt[0] == '-') {
+            std::cerr << "Error: Unknown option '" << opt << "'\n";
             return 1;
+        } else {
+            options.filename = opt;
+            paths.push_back(opt);
         }
-        mana::runFile(argv[2], showTokens);
-        return 0;
     }
     
-    // If no special flags, treat as a file
-    mana::runFile(arg, showTokens);
-    return 0;
-}// Adding main.cpp from manu-r12
+    if (daemon) {
+        return serveRequests(daemon_options);
+    }
+    
+    if (build || check) {
+        if (build && check) {
+            std::cerr << "Error: --check can't be combined with build\n";
+            return 1;
+        }
+        if (options.show_tokens || options.emit_ir || options.dump_bytecode || options.profile ||
+            !options.bundle_path.empty()) {
+            std::cerr << "Error: " << (build ? "build" : "--check") << " only reports diagnostics\n";
+            return 1;
+        }
+        if (paths.empty()) {
+            std::cerr << "Error: No input files specified\n";
+            return 1;
+        }
+        return runScripts(options, paths, build);
+    }
+    
+    if (options.filename.empty()) {
+        std::cerr << "Error: No input file specified\n";
+        return 1;
+    }
+    
+    if (options.profile && options.engine != EngineKind::JIT) {
+        std::cerr << "Error: --profile requires --engine=jit\n";
+        return 1;
+    }
+    
+    if (!options.exports.empty() && options.engine != EngineKind::JIT) {
+        std::cerr << "Error: --export requires --engine=jit\n";
+        return 1;
+    }
+    
+    if ((options.auto_memo || options.memo_stats || options.memo_capacity > 0) &&
+        options.engine != EngineKind::JIT) {
+        std::cerr << "Error: Memoization requires --engine=jit\n";
+        return 1;
+    }
+    
+    if (!options.bundle_path.empty() &&
+        (options.engine != EngineKind::JIT || options.emit_ir || options.dump_bytecode || options.profile)) {
+        std::cerr << "Error: --bundle compiles with the JIT engine and takes no other output\n";
+        return 1;
+    }
+    
+    if (options.watch &&
+        (options.engine != EngineKind::JIT || options.emit_ir || options.dump_bytecode || options.profile ||
+         !options.bundle_path.empty())) {
+        std::cerr << "Error: --watch runs the script in the JIT engine and takes no other output\n";
+        return 1;
+    }
+    
+    const std::string bundle_extension = ".manac";
+    if (options.filename.size() > bundle_extension.size() &&
+        options.filename.compare(options.filename.size() - bundle_extension.size(),
+                                 bundle_extension.size(), bundle_extension) == 0) {
+        return runBundle(options.filename);
+    }
+    
+    return runFile(options);
+}
+
+} // namespace mana
+
+int main(int argc, char* argv[]) {
+    mana::installCrashHandler();
+    return mana::runCommand(std::vector<std::string>(argv + 1, argv + argc));
+}// Adding main.cpp from manu-r12
\ No newline at end of file
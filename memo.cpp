@@ -0,0 +1,204 @@
+#include "memo.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mana {
+
+namespace {
+
+// Slots tried for a key before giving up on a lookup or evicting on insert
+const size_t PROBE_LIMIT = 8;
+
+std::atomic<size_t> capacity_setting{4096};
+std::atomic<bool> shared{false};
+
+/**
+ * @brief Open-addressing table of the results of one memoized function
+ *
+ * Every slot is a run of words: a hash of the key (0 marks an empty slot),
+ * the key and the result. Keys probe linearly from their home slot. When the
+ * probe window is full the home slot is overwritten, so the table never grows
+ * and never needs deletion.
+ */
+class MemoCache {
+public:
+    MemoCache(std::string name, int32_t arity, size_t capacity)
+        : name(std::move(name)), arity(static_cast<size_t>(arity)), stride(this->arity + 2),
+          mask(capacity - 1), words(capacity * stride, 0) {}
+
+    bool find(const int64_t* key, int64_t& result) {
+        std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+        if (shared.load(std::memory_order_relaxed)) {
+            lock.lock();
+        }
+
+        uint64_t hash = hashKey(key);
+        for (size_t probe = 0; probe < PROBE_LIMIT; ++probe) {
+            uint64_t* slot = slotAt(hash + probe);
+            if (slot[0] == 0) {
+                break;
+            }
+            if (slot[0] == hash && matches(slot, key)) {
+                hits++;
+                result = static_cast<int64_t>(slot[stride - 1]);
+                return true;
+            }
+        }
+        misses++;
+        return false;
+    }
+
+    void insert(const int64_t* key, int64_t result) {
+        std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+        if (shared.load(std::memory_order_relaxed)) {
+            lock.lock();
+        }
+
+        uint64_t hash = hashKey(key);
+        uint64_t* target = nullptr;
+        for (size_t probe = 0; probe < PROBE_LIMIT && !target; ++probe) {
+            uint64_t* slot = slotAt(hash + probe);
+            if (slot[0] == 0) {
+                entries++;
+                target = slot;
+            } else if (slot[0] == hash && matches(slot, key)) {
+                target = slot;
+            }
+        }
+        if (!target) {
+            evictions++;
+            target = slotAt(hash);
+        }
+
+        target[0] = hash;
+        for (size_t i = 0; i < arity; ++i) {
+            target[1 + i] = static_cast<uint64_t>(key[i]);
+        }
+        target[stride - 1] = static_cast<uint64_t>(result);
+    }
+
+    std::string name;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    std::mutex mutex;
+    size_t arity;
+    size_t stride;
+    size_t mask;
+    std::vector<uint64_t> words;
+
+    uint64_t hashKey(const int64_t* key) const {
+        uint64_t hash = 0x9e3779b97f4a7c15ull;
+        for (size_t i = 0; i < arity; ++i) {
+            hash = (hash ^ static_cast<uint64_t>(key[i])) * 0xbf58476d1ce4e5b9ull;
+            hash ^= hash >> 31;
+        }
+        return hash | 1;
+    }
+
+    uint64_t* slotAt(uint64_t hash) { return &words[(hash & mask) * stride]; }
+
+    bool matches(const uint64_t* slot, const int64_t* key) const {
+        for (size_t i = 0; i < arity; ++i) {
+            if (slot[1 + i] != static_cast<uint64_t>(key[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Every cache, found by the mangled name of its function
+ *
+ * Modules compiled separately, or cached on disk, reach the same cache for
+ * the same function.
+ */
+class MemoRegistry {
+public:
+    MemoCache* get(const std::string& name, int32_t arity) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = by_name.find(name);
+        if (it != by_name.end()) {
+            return it->second;
+        }
+
+        size_t capacity = 1;
+        while (capacity < capacity_setting.load(std::memory_order_relaxed)) {
+            capacity <<= 1;
+        }
+        caches.push_back(std::make_unique<MemoCache>(name, arity, capacity));
+        by_name[name] = caches.back().get();
+        return caches.back().get();
+    }
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<MemoCache>> caches;
+
+private:
+    std::map<std::string, MemoCache*> by_name;
+};
+
+MemoRegistry& registry() {
+    static MemoRegistry instance;
+    return instance;
+}
+
+} // namespace
+
+void setMemoCapacity(size_t entries) {
+    capacity_setting.store(std::min(std::max<size_t>(entries, 1), MAX_MEMO_CAPACITY));
+}
+
+void shareMemoCaches() {
+    shared.store(true);
+}
+
+void printMemoStats(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(registry().mutex);
+
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(1);
+    out << "Memo caches\n"
+        << std::setw(12) << "calls" << std::setw(12) << "hits" << std::setw(10) << "hit rate"
+        << std::setw(18) << "entries" << std::setw(12) << "evictions" << "  function\n";
+    for (const auto& cache : registry().caches) {
+        uint64_t calls = cache->hits + cache->misses;
+        double rate = calls == 0 ? 0.0 : 100.0 * static_cast<double>(cache->hits) / static_cast<double>(calls);
+        out << std::setw(12) << calls << std::setw(12) << cache->hits << std::setw(9) << rate << "%"
+            << std::setw(18) << (std::to_string(cache->entries) + "/" + std::to_string(cache->capacity()))
+            << std::setw(12) << cache->evictions << "  " << cache->name << "\n";
+    }
+    out.flags(flags);
+}
+
+} // namespace mana
+
+extern "C" {
+
+int32_t memo_lookup(void** cache, const char* name, int32_t arity, const int64_t* key, int64_t* result) {
+    auto* memo = static_cast<mana::MemoCache*>(__atomic_load_n(cache, __ATOMIC_ACQUIRE));
+    if (!memo) {
+        memo = mana::registry().get(name, arity);
+        __atomic_store_n(cache, memo, __ATOMIC_RELEASE);
+    }
+    return memo->find(key, *result) ? 1 : 0;
+}
+
+void memo_store(void* cache, const int64_t* key, int64_t result) {
+    static_cast<mana::MemoCache*>(cache)->insert(key, result);
+}
+
+} // extern "C"
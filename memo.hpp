@@ -0,0 +1,48 @@
+#ifndef MANASCRIPT_MEMO_HPP
+#define MANASCRIPT_MEMO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace mana {
+
+// Largest number of results a memo cache can be set to hold
+const size_t MAX_MEMO_CAPACITY = size_t(1) << 24;
+
+/**
+ * @brief Set how many results each memo cache holds
+ *
+ * Rounded up to a power of two and clamped to MAX_MEMO_CAPACITY. Applies to
+ * caches created afterwards, which happens on the first call of each
+ * memoized function.
+ */
+void setMemoCapacity(size_t entries);
+
+/**
+ * @brief Print calls, hits and evictions of every memo cache
+ */
+void printMemoStats(std::ostream& out);
+
+/**
+ * @brief Lock the memo caches on every access from now on; cannot be undone
+ *
+ * Until then caches are used by a single thread and skip the lock. Called
+ * before the task runtime starts its worker threads.
+ */
+void shareMemoCaches();
+
+} // namespace mana
+
+// Entry points called from compiled code. Arguments and results are widened
+// to 64-bit words; a memoized function's cache is created on its first call
+// and remembered in `*cache`, a global of the calling module.
+extern "C" {
+// Look up the result cached for key[0..arity); returns 1 and sets *result on a hit
+int32_t memo_lookup(void** cache, const char* name, int32_t arity, const int64_t* key, int64_t* result);
+
+// Remember the result of a call that missed; cache is the one memo_lookup set
+void memo_store(void* cache, const int64_t* key, int64_t result);
+}
+
+#endif // MANASCRIPT_MEMO_HPP
@@ -0,0 +1,311 @@
+#include "module_graph.hpp"
+#include "error.hpp"
+#include "lexer.hpp"
+#include "source_cache.hpp"
+#include "variable_scan.hpp"
+
+#include <llvm/Support/ThreadPool.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <unordered_set>
+
+namespace mana {
+
+namespace {
+
+// Identity of a file, however it was reached
+std::string canonicalPath(const std::filesystem::path& path) {
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    return error ? path.lexically_normal().string() : canonical.string();
+}
+
+// Every function declared in `statements`, nested ones included, by name
+void collectDeclarations(const std::vector<StmtPtr>& statements,
+                         std::unordered_map<std::string, std::vector<const FunctionStmt*>>& declared) {
+    for (const auto& stmt : statements) {
+        if (auto* func = dynamic_cast<FunctionStmt*>(stmt.get())) {
+            declared[func->getName().lexeme].push_back(func);
+            collectDeclarations(func->getBody(), declared);
+        }
+        else if (auto* block = dynamic_cast<BlockStmt*>(stmt.get())) {
+            collectDeclarations(block->getStatements(), declared);
+        }
+        else if (auto* if_stmt = dynamic_cast<IfStmt*>(stmt.get())) {
+            collectDeclarations({if_stmt->getThenBranch(), if_stmt->getElseBranch()}, declared);
+        }
+        else if (auto* while_stmt = dynamic_cast<WhileStmt*>(stmt.get())) {
+            collectDeclarations({while_stmt->getBody()}, declared);
+        }
+        else if (auto* for_stmt = dynamic_cast<ForStmt*>(stmt.get())) {
+            collectDeclarations({for_stmt->getBody()}, declared);
+        }
+    }
+}
+
+} // namespace
+
+ModuleGraph::ModuleGraph(const std::string& path, std::vector<StmtPtr> statements, std::vector<Import> imports) {
+    SourceModule root;
+    root.path = path;
+    root.statements = std::move(statements);
+    root.import_decls = std::move(imports);
+    modules.push_back(std::move(root));
+}
+
+bool ModuleGraph::load(unsigned jobs) {
+    bool ok = true;
+    std::unordered_map<std::string, size_t> loaded;
+    const std::string root = canonicalPath(modules[0].path);
+    loaded[root] = 0;
+
+    // Where each file was first imported, for errors about the whole file
+    std::vector<SourceLocation> sites(1);
+
+    llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+    std::vector<size_t> frontier = {0};
+    while (!frontier.empty()) {
+        // Files first imported by the previous wave make up the next one
+        std::vector<size_t> wave;
+        for (size_t index : frontier) {
+            std::filesystem::path dir = std::filesystem::path(modules[index].path).parent_path();
+            std::vector<Import> decls = modules[index].import_decls;
+
+            for (const Import& decl : decls) {
+                SourceLocation site(modules[index].path, decl.keyword.line, decl.keyword.column);
+                std::filesystem::path path = (dir / decl.path).lexically_normal();
+                std::string key = canonicalPath(path);
+                if (key == root) {
+                    diagnostics.report(DiagnosticSeverity::ERROR, "Cannot import the main script", site);
+                    ok = false;
+                    continue;
+                }
+
+                auto [it, inserted] = loaded.emplace(key, modules.size());
+                if (inserted) {
+                    SourceModule module;
+                    module.path = path.string();
+                    modules.push_back(std::move(module));
+                    sites.push_back(site);
+                    wave.push_back(it->second);
+                }
+
+                std::vector<size_t>& imports = modules[index].imports;
+                if (std::find(imports.begin(), imports.end(), it->second) == imports.end()) {
+                    imports.push_back(it->second);
+                }
+            }
+        }
+
+        // Each file reports into its own manager so the output doesn't depend on scheduling
+        std::vector<DiagnosticManager> reports(wave.size());
+        std::vector<uint8_t> opened(wave.size(), 0);
+        for (size_t i = 0; i < wave.size(); ++i) {
+            pool.async([&, i]() {
+                DiagnosticCapture capture(reports[i]);
+                SourceModule& module = modules[wave[i]];
+
+                if (std::shared_ptr<const ParsedSource> cached = findParsedSource(module.path)) {
+                    opened[i] = 1;
+                    module.source_bytes = cached->content.size();
+                    module.tokens = cached->tokens;
+                    module.statements = cached->statements;
+                    module.import_decls = cached->imports;
+                    return;
+                }
+
+                std::ifstream file(module.path);
+                if (!file.is_open()) {
+                    return;
+                }
+                opened[i] = 1;
+                std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+                module.source_bytes = content.size();
+
+                Lexer lexer(content, module.path);
+                std::vector<Token> tokens = lexer.scanTokens();
+                module.tokens = tokens.size();
+                Parser parser(tokens, module.path);
+                module.statements = parser.parse();
+                module.import_decls = parser.getImports();
+            });
+        }
+        pool.wait();
+
+        for (size_t i = 0; i < wave.size(); ++i) {
+            const SourceModule& module = modules[wave[i]];
+            if (!opened[i]) {
+                diagnostics.report(
+                    DiagnosticSeverity::ERROR,
+                    "Could not open imported file '" + module.path + "'",
+                    sites[wave[i]]
+                );
+                ok = false;
+                continue;
+            }
+            for (const Diagnostic& diagnostic : reports[i].getDiagnostics()) {
+                diagnostics.report(diagnostic);
+            }
+            ok = ok && !reports[i].hasErrors();
+
+            for (const StmtPtr& stmt : module.statements) {
+                if (stmt && !dynamic_cast<FunctionStmt*>(stmt.get())) {
+                    diagnostics.report(
+                        DiagnosticSeverity::ERROR,
+                        "Imported file '" + module.path + "' may only declare functions",
+                        sites[wave[i]]
+                    );
+                    ok = false;
+                    break;
+                }
+            }
+        }
+        frontier = std::move(wave);
+    }
+    if (!ok) {
+        return false;
+    }
+
+    // Order by a depth-first walk so imports precede their importers
+    std::vector<size_t> order;
+    std::vector<uint8_t> visited(modules.size(), 0);
+    std::function<void(size_t)> visit = [&](size_t index) {
+        visited[index] = 1;
+        for (size_t imported : modules[index].imports) {
+            if (!visited[imported]) {
+                visit(imported);
+            }
+        }
+        order.push_back(index);
+    };
+    visit(0);
+
+    std::vector<size_t> position(modules.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        position[order[i]] = i;
+    }
+    std::vector<SourceModule> sorted;
+    for (size_t index : order) {
+        sorted.push_back(std::move(modules[index]));
+        for (size_t& imported : sorted.back().imports) {
+            imported = position[imported];
+        }
+    }
+    modules = std::move(sorted);
+
+    // One namespace for the whole program
+    std::unordered_map<std::string, size_t> names;
+    function_modules.clear();
+    for (size_t i = 0; i < modules.size(); ++i) {
+        collectFunctions(modules[i].statements, i, names);
+    }
+    return !diagnostics.hasErrors();
+}
+
+void ModuleGraph::collectFunctions(const std::vector<StmtPtr>& statements, size_t module,
+                                   std::unordered_map<std::string, size_t>& names) {
+    for (const auto& stmt : statements) {
+        if (auto* func = dynamic_cast<FunctionStmt*>(stmt.get())) {
+            const Token& name = func->getName();
+            auto [it, inserted] = names.emplace(name.lexeme, module);
+            if (!inserted && it->second != module) {
+                diagnostics.report(
+                    DiagnosticSeverity::ERROR,
+                    "Function '" + name.lexeme + "' is already declared in '" + modules[it->second].path + "'",
+                    SourceLocation(modules[module].path, name.line, name.column)
+                );
+            }
+            function_modules[func] = module;
+            collectFunctions(func->getBody(), module, names);
+        }
+        else if (auto* block = dynamic_cast<BlockStmt*>(stmt.get())) {
+            collectFunctions(block->getStatements(), module, names);
+        }
+        else if (auto* if_stmt = dynamic_cast<IfStmt*>(stmt.get())) {
+            collectFunctions({if_stmt->getThenBranch(), if_stmt->getElseBranch()}, module, names);
+        }
+        else if (auto* while_stmt = dynamic_cast<WhileStmt*>(stmt.get())) {
+            collectFunctions({while_stmt->getBody()}, module, names);
+        }
+        else if (auto* for_stmt = dynamic_cast<ForStmt*>(stmt.get())) {
+            collectFunctions({for_stmt->getBody()}, module, names);
+        }
+    }
+}
+
+std::vector<DeadFunction> ModuleGraph::removeDeadFunctions(const std::vector<ExportedFunction>& exports) {
+    std::unordered_map<std::string, std::vector<const FunctionStmt*>> declared;
+    VariableScan roots;
+    for (const SourceModule& module : modules) {
+        collectDeclarations(module.statements, declared);
+        for (const auto& stmt : module.statements) {
+            roots.scan(stmt);
+        }
+    }
+    for (const ExportedFunction& exported : exports) {
+        roots.names.insert(exported.name);
+    }
+
+    // Names are marked once; the bodies of their declarations name more
+    std::unordered_set<std::string> reachable;
+    std::vector<std::string> worklist(roots.names.begin(), roots.names.end());
+    while (!worklist.empty()) {
+        std::string name = std::move(worklist.back());
+        worklist.pop_back();
+        auto it = declared.find(name);
+        if (it == declared.end() || !reachable.insert(name).second) {
+            continue;
+        }
+
+        VariableScan body;
+        for (const FunctionStmt* func : it->second) {
+            for (const auto& stmt : func->getBody()) {
+                body.scan(stmt);
+            }
+        }
+        worklist.insert(worklist.end(), body.names.begin(), body.names.end());
+    }
+
+    std::vector<DeadFunction> dead;
+    for (SourceModule& module : modules) {
+        auto& statements = module.statements;
+        auto kept = std::remove_if(statements.begin(), statements.end(), [&](const StmtPtr& stmt) {
+            auto* func = dynamic_cast<FunctionStmt*>(stmt.get());
+            if (!func || reachable.count(func->getName().lexeme)) {
+                return false;
+            }
+            dead.push_back({func->getName().lexeme, module.path, func->getName().line});
+            return true;
+        });
+        statements.erase(kept, statements.end());
+    }
+
+    // Forget the dropped declarations, nested ones included
+    if (!dead.empty() && !function_modules.empty()) {
+        std::unordered_map<std::string, size_t> names;
+        function_modules.clear();
+        for (size_t i = 0; i < modules.size(); ++i) {
+            collectFunctions(modules[i].statements, i, names);
+        }
+    }
+    return dead;
+}
+
+std::vector<StmtPtr> ModuleGraph::link() const {
+    std::vector<StmtPtr> statements;
+    for (const SourceModule& module : modules) {
+        statements.insert(statements.end(), module.statements.begin(), module.statements.end());
+    }
+    return statements;
+}
+
+size_t ModuleGraph::getModuleOf(const FunctionStmt& stmt) const {
+    auto it = function_modules.find(&stmt);
+    return it == function_modules.end() ? modules.size() - 1 : it->second;
+}
+
+} // namespace mana
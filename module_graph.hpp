@@ -0,0 +1,120 @@
+#ifndef MANASCRIPT_MODULE_GRAPH_HPP
+#define MANASCRIPT_MODULE_GRAPH_HPP
+
+#include "ast.hpp"
+#include "parser.hpp"
+#include "type_inference.hpp"
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief One source file of a program
+ */
+struct SourceModule {
+    std::string path;                   // As reached from the main script
+    std::vector<StmtPtr> statements;
+    std::vector<Import> import_decls;
+    std::vector<size_t> imports;        // Indices of the imported modules
+    size_t source_bytes = 0;
+    size_t tokens = 0;
+};
+
+/**
+ * @brief A function removeDeadFunctions() dropped
+ */
+struct DeadFunction {
+    std::string name;
+    std::string path;
+    int line = 0;
+};
+
+/**
+ * @brief The main script and every file it imports, directly or not
+ *
+ * Imported files are libraries: they may only declare functions (and import
+ * other files), so importing has no side effects and files may import each
+ * other in cycles. Function names share one namespace across the program;
+ * declaring a name in two files is an error. Paths are relative to the
+ * importing file, and a file reached through several paths is loaded once.
+ */
+class ModuleGraph {
+public:
+    /**
+     * @brief Start from the parsed main script
+     */
+    ModuleGraph(const std::string& path, std::vector<StmtPtr> statements, std::vector<Import> imports);
+
+    /**
+     * @brief Load every file reachable through imports
+     *
+     * Files are read and parsed in waves, one wave per import depth, with the
+     * files of a wave parsed in parallel. Diagnostics are reported in a fixed
+     * order whatever the scheduling.
+     * @param jobs Worker threads, 0 = one per hardware thread
+     * @return False if a file could not be read or is not a valid library
+     */
+    bool load(unsigned jobs = 0);
+
+    /**
+     * @brief Modules ordered so that imported files come before the files
+     * importing them (except within cycles); the main script is last
+     */
+    const std::vector<SourceModule>& getModules() const { return modules; }
+
+    bool hasImports() const { return modules.size() > 1; }
+
+    /**
+     * @brief Drop the top-level functions nothing can call
+     *
+     * A function is reachable when the top-level statements or one of
+     * `exports` name it, or a reachable function's body does. Any mention of
+     * the name counts, and all declarations of a reachable name are kept.
+     * Engines then never analyze or compile the dropped functions.
+     * @return The dropped functions, in module order
+     */
+    std::vector<DeadFunction> removeDeadFunctions(const std::vector<ExportedFunction>& exports = {});
+
+    /**
+     * @brief Statements of the whole program, in module order
+     *
+     * This is what engines that don't compile modules separately run.
+     */
+    std::vector<StmtPtr> link() const;
+
+    /**
+     * @brief Index of the module declaring a function, including nested functions
+     */
+    size_t getModuleOf(const FunctionStmt& stmt) const;
+
+    /**
+     * @brief Record the file of every imported function for error messages
+     *
+     * The target is anything with setSourceFile(const FunctionStmt&, const
+     * std::string&): TypeInference, Interpreter or BytecodeCompiler.
+     */
+    template <typename Target>
+    void annotate(Target& target) const {
+        const std::string& main = modules.back().path;
+        for (const auto& [stmt, module] : function_modules) {
+            if (modules[module].path != main) {
+                target.setSourceFile(*stmt, modules[module].path);
+            }
+        }
+    }
+
+private:
+    std::vector<SourceModule> modules;
+    std::unordered_map<const FunctionStmt*, size_t> function_modules;
+
+    void collectFunctions(const std::vector<StmtPtr>& statements, size_t module,
+                          std::unordered_map<std::string, size_t>& names);
+};
+
+} // namespace mana
+
+#endif // MANASCRIPT_MODULE_GRAPH_HPP
@@ -0,0 +1,299 @@
+#include "object_cache.hpp"
+#include "jit.hpp"
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+namespace mana {
+
+namespace {
+
+const char* const COMPILER_VERSION = "manascript-0.1.0";
+const char* const ENTRY_EXTENSION = ".o";
+
+struct CacheEntry {
+    std::string path;
+    uint64_t size;
+    llvm::sys::TimePoint<> last_used;
+};
+
+// Objects the daemon holds for its workers, by key; workers only read them
+const uint64_t MAX_RESIDENT_BYTES = 128ull << 20;
+std::mutex resident_mutex;
+bool keeping_resident = false;
+std::unordered_map<std::string, std::unique_ptr<llvm::MemoryBuffer>> resident;
+uint64_t resident_bytes = 0;
+std::vector<std::string> loaded_entries;
+
+void recordLoaded(const std::string& path) {
+    std::lock_guard<std::mutex> lock(resident_mutex);
+    if (keeping_resident) {
+        loaded_entries.push_back(path);
+    }
+}
+
+void touchEntry(const std::string& path) {
+    int fd = -1;
+    if (llvm::sys::fs::openFileForReadWrite(path, fd, llvm::sys::fs::CD_OpenExisting,
+                                            llvm::sys::fs::OF_None)) {
+        return;
+    }
+    llvm::sys::fs::setLastAccessAndModificationTime(fd, std::chrono::system_clock::now());
+    llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+}
+
+} // namespace
+
+DiskObjectCache::DiskObjectCache(const std::string& directory, uint64_t max_size_bytes)
+    : directory(directory), max_size_bytes(max_size_bytes) {
+    fingerprint = getHostTargetFingerprint() + ";" + COMPILER_VERSION +
+                  ";llvm-" + LLVM_VERSION_STRING;
+    llvm::sys::fs::create_directories(directory);
+}
+
+std::string DiskObjectCache::getDefaultDirectory() {
+    if (const char* env = std::getenv("MANA_CACHE_DIR")) {
+        return env;
+    }
+    
+    llvm::SmallString<256> path;
+    if (!llvm::sys::path::cache_directory(path)) {
+        llvm::sys::path::system_temp_directory(true, path);
+    }
+    llvm::sys::path::append(path, "mana", "objects");
+    return std::string(path.str());
+}
+
+std::string DiskObjectCache::computeKey(const llvm::Module& module) const {
+    llvm::SmallVector<char, 0> bitcode;
+    llvm::raw_svector_ostream os(bitcode);
+    llvm::WriteBitcodeToFile(module, os);
+    
+    llvm::SHA1 hasher;
+    hasher.update(fingerprint);
+    hasher.update(llvm::StringRef(bitcode.data(), bitcode.size()));
+    return llvm::toHex(hasher.final(), true);
+}
+
+std::string DiskObjectCache::getEntryPath(const std::string& key) const {
+    llvm::SmallString<256> path(directory);
+    llvm::sys::path::append(path, key + ENTRY_EXTENSION);
+    return std::string(path.str());
+}
+
+void DiskObjectCache::keepResident() {
+    std::lock_guard<std::mutex> lock(resident_mutex);
+    keeping_resident = true;
+}
+
+std::vector<std::string> DiskObjectCache::takeLoadedEntries() {
+    std::lock_guard<std::mutex> lock(resident_mutex);
+    return std::move(loaded_entries);
+}
+
+void DiskObjectCache::loadResident(const std::string& path) {
+    std::string key = llvm::sys::path::stem(path).str();
+    {
+        std::lock_guard<std::mutex> lock(resident_mutex);
+        if (llvm::sys::path::extension(path) != ENTRY_EXTENSION || resident.count(key)) {
+            return;
+        }
+    }
+    auto buffer = llvm::MemoryBuffer::getFile(path, false, false);
+    if (!buffer) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(resident_mutex);
+    uint64_t size = (*buffer)->getBufferSize();
+    if (resident_bytes + size > MAX_RESIDENT_BYTES || !resident.emplace(key, std::move(*buffer)).second) {
+        return;
+    }
+    resident_bytes += size;
+}
+
+std::unique_ptr<llvm::MemoryBuffer> DiskObjectCache::getObject(const llvm::Module* module) {
+    std::string key = computeKey(*module);
+    std::string path = getEntryPath(key);
+    
+    // Keys name the content, so an object the daemon loaded from any directory will do
+    std::unique_ptr<llvm::MemoryBuffer> buffer_in_memory;
+    {
+        std::lock_guard<std::mutex> lock(resident_mutex);
+        auto it = resident.find(key);
+        if (it != resident.end()) {
+            buffer_in_memory = llvm::MemoryBuffer::getMemBuffer(it->second->getMemBufferRef(), false);
+        }
+    }
+    if (buffer_in_memory) {
+        touchEntry(path);
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.hits++;
+        stats.bytes_loaded += buffer_in_memory->getBufferSize();
+        return buffer_in_memory;
+    }
+    
+    auto buffer = llvm::MemoryBuffer::getFile(path, false, false);
+    if (buffer) {
+        recordLoaded(path);
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!buffer) {
+        stats.misses++;
+        pending_keys[module] = key;
+        return nullptr;
+    }
+    
+    // Refresh the timestamp so LRU eviction sees this entry as recently used
+    touchEntry(path);
+    
+    stats.hits++;
+    stats.bytes_loaded += (*buffer)->getBufferSize();
+    return std::move(*buffer);
+}
+
+void DiskObjectCache::notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) {
+    std::string key;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = pending_keys.find(module);
+        if (it != pending_keys.end()) {
+            key = std::move(it->second);
+            pending_keys.erase(it);
+        }
+    }
+    if (key.empty()) {
+        key = computeKey(*module);
+    }
+    
+    // Write to a unique temporary first so concurrent processes never see partial files
+    llvm::SmallString<256> temp_path;
+    int fd = -1;
+    if (llvm::sys::fs::createUniqueFile(getEntryPath(key) + ".tmp-%%%%%%", fd, temp_path)) {
+        return;
+    }
+    {
+        llvm::raw_fd_ostream os(fd, true);
+        os << object.getBuffer();
+        if (os.has_error()) {
+            os.clear_error();
+            llvm::sys::fs::remove(temp_path);
+            return;
+        }
+    }
+    if (llvm::sys::fs::rename(temp_path, getEntryPath(key))) {
+        llvm::sys::fs::remove(temp_path);
+        return;
+    }
+    recordLoaded(getEntryPath(key));
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.stores++;
+    stats.bytes_stored += object.getBufferSize();
+    
+    // Scanning the directory on every store would serialize batch builds
+    if (!size_known) {
+        known_size = getDirectorySize(nullptr);
+        size_known = true;
+    } else {
+        known_size += object.getBufferSize();
+    }
+    if (known_size > max_size_bytes) {
+        evict();
+    }
+}
+
+uint64_t DiskObjectCache::getDirectorySize(size_t* entries) const {
+    uint64_t total = 0;
+    size_t count = 0;
+    std::error_code ec;
+    
+    for (llvm::sys::fs::directory_iterator it(directory, ec), end; it != end && !ec; it.increment(ec)) {
+        if (llvm::sys::path::extension(it->path()) != ENTRY_EXTENSION) {
+            continue;
+        }
+        
+        llvm::sys::fs::file_status status;
+        if (!llvm::sys::fs::status(it->path(), status)) {
+            total += status.getSize();
+            count++;
+        }
+    }
+    
+    if (entries) {
+        *entries = count;
+    }
+    return total;
+}
+
+void DiskObjectCache::evict() {
+    std::vector<CacheEntry> entries;
+    uint64_t total = 0;
+    std::error_code ec;
+    
+    for (llvm::sys::fs::directory_iterator it(directory, ec), end; it != end && !ec; it.increment(ec)) {
+        if (llvm::sys::path::extension(it->path()) != ENTRY_EXTENSION) {
+            continue;
+        }
+        
+        llvm::sys::fs::file_status status;
+        if (llvm::sys::fs::status(it->path(), status)) {
+            continue;
+        }
+        
+        entries.push_back({it->path(), status.getSize(), status.getLastModificationTime()});
+        total += status.getSize();
+    }
+    
+    known_size = total;
+    if (total <= max_size_bytes) {
+        return;
+    }
+    
+    // Oldest first
+    std::sort(entries.begin(), entries.end(), [](const CacheEntry& a, const CacheEntry& b) {
+        return a.last_used < b.last_used;
+    });
+    
+    for (const auto& entry : entries) {
+        if (total <= max_size_bytes) {
+            break;
+        }
+        if (!llvm::sys::fs::remove(entry.path)) {
+            total -= entry.size;
+            stats.evictions++;
+        }
+    }
+    known_size = total;
+}
+
+ObjectCacheStats DiskObjectCache::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void DiskObjectCache::printStats(std::ostream& os) const {
+    ObjectCacheStats current = getStats();
+    size_t entries = 0;
+    uint64_t size = getDirectorySize(&entries);
+    
+    os << "Object cache: " << directory << "\n"
+       << "  hits:       " << current.hits << " (" << current.bytes_loaded << " bytes loaded)\n"
+       << "  misses:     " << current.misses << "\n"
+       << "  stores:     " << current.stores << " (" << current.bytes_stored << " bytes written)\n"
+       << "  evictions:  " << current.evictions << "\n"
+       << "  entries:    " << entries << " (" << size << " / " << max_size_bytes << " bytes)\n";
+}
+
+} // namespace mana
@@ -0,0 +1,105 @@
+#ifndef MANASCRIPT_OBJECT_CACHE_HPP
+#define MANASCRIPT_OBJECT_CACHE_HPP
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Counters reported by --cache-stats
+ */
+struct ObjectCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t stores = 0;
+    uint64_t evictions = 0;
+    uint64_t bytes_loaded = 0;
+    uint64_t bytes_stored = 0;
+};
+
+/**
+ * @brief Persistent on-disk cache of JIT-compiled objects
+ *
+ * Objects are keyed by a SHA1 of the optimized module's bitcode, the host
+ * target fingerprint and the compiler version, so a hit is only possible when
+ * the generated code would be identical. Entries are plain `<key>.o` files;
+ * their modification time records the last use, and the least recently used
+ * entries are evicted once the directory exceeds its size limit.
+ */
+class DiskObjectCache : public llvm::ObjectCache {
+public:
+    /**
+     * @param directory Cache directory (created on demand)
+     * @param max_size_bytes Upper bound on the total size of cached objects
+     */
+    DiskObjectCache(const std::string& directory, uint64_t max_size_bytes);
+    
+    void notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) override;
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* module) override;
+    
+    /**
+     * @brief Default cache location ($MANA_CACHE_DIR or the user cache directory)
+     */
+    static std::string getDefaultDirectory();
+    
+    /**
+     * @brief Keep objects in memory for the processes forked from this one
+     *
+     * Called by the daemon. A worker forked afterwards gets every object the
+     * daemon loaded with loadResident() without reading the directory, and
+     * records the entries it read or stored itself for takeLoadedEntries().
+     */
+    static void keepResident();
+    
+    /**
+     * @brief Entry files this process read or stored since the last call
+     */
+    static std::vector<std::string> takeLoadedEntries();
+    
+    /**
+     * @brief Read an entry file into memory for the processes forked later
+     */
+    static void loadResident(const std::string& path);
+    
+    const std::string& getDirectory() const { return directory; }
+    ObjectCacheStats getStats() const;
+    
+    /**
+     * @brief Print hit/miss counters and the current cache size
+     */
+    void printStats(std::ostream& os = std::cerr) const;
+    
+private:
+    std::string directory;
+    uint64_t max_size_bytes;
+    std::string fingerprint;
+    
+    mutable std::mutex mutex;
+    ObjectCacheStats stats;
+    
+    // Directory size as of the last scan plus what we stored since; the
+    // directory is only rescanned once this exceeds the limit
+    uint64_t known_size = 0;
+    bool size_known = false;
+    
+    // Keys computed by getObject, reused when the same module is stored
+    std::unordered_map<const llvm::Module*, std::string> pending_keys;
+    
+    std::string computeKey(const llvm::Module& module) const;
+    std::string getEntryPath(const std::string& key) const;
+    void evict();
+    uint64_t getDirectorySize(size_t* entries) const;
+};
+
+} // namespace mana
+
+#endif // MANASCRIPT_OBJECT_CACHE_HPP
@@ -0,0 +1,104 @@
+#include "optimizer.hpp"
+#include "jit.hpp"
+
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Passes/PassBuilder.h>
+
+namespace mana {
+
+namespace {
+
+/**
+ * @brief Drops "loop not vectorized" warnings
+ *
+ * Code generation asks for vectorization of every loop over arrays; the
+ * vectorizer declining one of them is expected, not worth a warning.
+ */
+class OptimizerDiagnostics : public llvm::DiagnosticHandler {
+public:
+    explicit OptimizerDiagnostics(std::unique_ptr<llvm::DiagnosticHandler> previous)
+        : previous(std::move(previous)) {}
+    
+    bool handleDiagnostics(const llvm::DiagnosticInfo& info) override {
+        // Loops marked for vectorization report every loop they could not
+        // vectorize, as failures or as analysis remarks
+        if (llvm::isa<llvm::DiagnosticInfoOptimizationBase>(info)) {
+            return true;
+        }
+        return previous && previous->handleDiagnostics(info);
+    }
+    
+    std::unique_ptr<llvm::DiagnosticHandler> previous;
+};
+
+/**
+ * @brief Target machine for the host, or null if it can't be created
+ *
+ * Gives the optimizer the real cost model; without it the vectorizer assumes
+ * there are no vector registers. TargetMachine is not thread-safe, so each
+ * thread optimizing modules gets its own.
+ */
+llvm::TargetMachine* hostTargetMachine() {
+    thread_local std::unique_ptr<llvm::TargetMachine> machine = []() {
+        initializeNativeTarget();
+        
+        std::unique_ptr<llvm::TargetMachine> result;
+        auto builder = llvm::orc::JITTargetMachineBuilder::detectHost();
+        if (!builder) {
+            llvm::consumeError(builder.takeError());
+            return result;
+        }
+        auto created = builder->createTargetMachine();
+        if (!created) {
+            llvm::consumeError(created.takeError());
+            return result;
+        }
+        result = std::move(*created);
+        return result;
+    }();
+    return machine.get();
+}
+
+} // namespace
+
+void optimizeModule(llvm::Module& module, unsigned opt_level) {
+    llvm::LoopAnalysisManager loop_am;
+    llvm::FunctionAnalysisManager function_am;
+    llvm::CGSCCAnalysisManager cgscc_am;
+    llvm::ModuleAnalysisManager module_am;
+    
+    llvm::TargetMachine* target = opt_level > 0 ? hostTargetMachine() : nullptr;
+    if (target && module.getTargetTriple().empty()) {
+        module.setTargetTriple(target->getTargetTriple().str());
+        module.setDataLayout(target->createDataLayout());
+    }
+    
+    llvm::PassBuilder pass_builder(target);
+    pass_builder.registerModuleAnalyses(module_am);
+    pass_builder.registerCGSCCAnalyses(cgscc_am);
+    pass_builder.registerFunctionAnalyses(function_am);
+    pass_builder.registerLoopAnalyses(loop_am);
+    pass_builder.crossRegisterProxies(loop_am, function_am, cgscc_am, module_am);
+    
+    llvm::OptimizationLevel level;
+    switch (opt_level) {
+        case 0:  level = llvm::OptimizationLevel::O0; break;
+        case 1:  level = llvm::OptimizationLevel::O1; break;
+        case 2:  level = llvm::OptimizationLevel::O2; break;
+        default: level = llvm::OptimizationLevel::O3; break;
+    }
+    
+    llvm::ModulePassManager pass_manager = (opt_level == 0)
+        ? pass_builder.buildO0DefaultPipeline(level)
+        : pass_builder.buildPerModuleDefaultPipeline(level);
+    
+    llvm::LLVMContext& context = module.getContext();
+    auto* handler = new OptimizerDiagnostics(context.getDiagnosticHandler());
+    context.setDiagnosticHandler(std::unique_ptr<llvm::DiagnosticHandler>(handler));
+    pass_manager.run(module, module_am);
+    context.setDiagnosticHandler(std::move(handler->previous));
+}
+
+} // namespace mana
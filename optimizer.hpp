@@ -0,0 +1,17 @@
+#ifndef MANASCRIPT_OPTIMIZER_HPP
+#define MANASCRIPT_OPTIMIZER_HPP
+
+#include <llvm/IR/Module.h>
+
+namespace mana {
+
+/**
+ * @brief Run the standard LLVM module pipeline for the given level
+ * @param module Module to optimize in place
+ * @param opt_level Optimization level (0-3)
+ */
+void optimizeModule(llvm::Module& module, unsigned opt_level);
+
+} // namespace mana
+
+#endif // MANASCRIPT_OPTIMIZER_HPP
@@ -0,0 +1,306 @@
+#include "parallel_codegen.hpp"
+#include "codegen.hpp"
+#include "optimizer.hpp"
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/ThreadPool.h>
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+namespace mana {
+
+namespace {
+
+// Rough size estimate used to balance shards
+size_t countStatements(const StmtPtr& stmt) {
+    if (!stmt) {
+        return 0;
+    }
+    
+    size_t count = 1;
+    if (auto* block = dynamic_cast<BlockStmt*>(stmt.get())) {
+        for (const auto& s : block->getStatements()) {
+            count += countStatements(s);
+        }
+    }
+    else if (auto* if_stmt = dynamic_cast<IfStmt*>(stmt.get())) {
+        count += countStatements(if_stmt->getThenBranch());
+        count += countStatements(if_stmt->getElseBranch());
+    }
+    else if (auto* while_stmt = dynamic_cast<WhileStmt*>(stmt.get())) {
+        count += countStatements(while_stmt->getBody());
+    }
+    else if (auto* for_stmt = dynamic_cast<ForStmt*>(stmt.get())) {
+        count += countStatements(for_stmt->getInitializer());
+        count += countStatements(for_stmt->getBody());
+    }
+    else if (auto* func = dynamic_cast<FunctionStmt*>(stmt.get())) {
+        for (const auto& s : func->getBody()) {
+            count += countStatements(s);
+        }
+    }
+    return count;
+}
+
+size_t functionWeight(const Specialization& func) {
+    size_t weight = 0;
+    for (const auto& s : func.stmt->getBody()) {
+        weight += countStatements(s);
+    }
+    return weight;
+}
+
+} // namespace
+
+ParallelCodeGenerator::ParallelCodeGenerator(const ParallelCodegenOptions& options)
+    : options(options) {}
+
+std::vector<ParallelCodeGenerator::Shard> ParallelCodeGenerator::partition(
+    const std::vector<const Specialization*>& functions, const std::string& module_name) const {
+    
+    // Without a module graph the whole program counts as one source file
+    size_t files = options.modules ? options.modules->getModules().size() : 1;
+    std::vector<std::vector<const Specialization*>> by_file(files);
+    for (const Specialization* func : functions) {
+        by_file[options.modules ? options.modules->getModuleOf(*func->stmt) : 0].push_back(func);
+    }
+    
+    std::vector<Shard> shards;
+    for (size_t file = 0; file < files; ++file) {
+        // Files none of whose functions are called produce no code; main always does
+        bool main = file == files - 1;
+        if (by_file[file].empty() && !main) {
+            continue;
+        }
+        
+        size_t first = shards.size();
+        shards.emplace_back();
+        size_t weight = 0;
+        for (const Specialization* func : by_file[file]) {
+            size_t func_weight = functionWeight(*func);
+            
+            // Start a new shard once the current one is full, keeping source order
+            if (weight > 0 && weight + func_weight > options.shard_weight) {
+                shards.emplace_back();
+                weight = 0;
+            }
+            
+            shards.back().functions.push_back(func);
+            weight += func_weight + 1;
+        }
+        
+        const std::string& path = options.modules ? options.modules->getModules()[file].path : module_name;
+        for (size_t i = first; i < shards.size(); ++i) {
+            shards[i].file = path;
+            shards[i].name = options.modules && shards.size() - first == 1
+                ? path : path + ".shard" + std::to_string(i - first);
+        }
+        shards[first].main = main;
+    }
+    
+    return shards;
+}
+
+void ParallelCodeGenerator::selectImports(std::vector<Shard>& shards, const Specialization& main,
+                                          size_t main_weight) const {
+    // The summary: owning shard and discovery order of every function
+    std::unordered_map<const Specialization*, std::pair<size_t, size_t>> summary;
+    size_t order = 0;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        for (const Specialization* func : shards[i].functions) {
+            summary[func] = {i, order++};
+        }
+    }
+    
+    for (size_t i = 0; i < shards.size(); ++i) {
+        std::vector<const Specialization*> callers = shards[i].functions;
+        size_t own_weight = shards[i].main ? main_weight : 0;
+        for (const Specialization* func : shards[i].functions) {
+            own_weight += functionWeight(*func);
+        }
+        if (shards[i].main) {
+            callers.push_back(&main);
+        }
+        
+        // Sorted by discovery order, so the result doesn't depend on hashing
+        std::map<size_t, const Specialization*> picked;
+        for (const Specialization* caller : callers) {
+            for (const auto& [call, target] : caller->calls) {
+                auto it = summary.find(target);
+                if (it != summary.end() && it->second.first != i &&
+                    functionWeight(*target) <= options.import_weight) {
+                    picked[it->second.second] = target;
+                }
+            }
+        }
+        
+        // Every copy is compiled again here and inlined into its callers, so
+        // a shard calling many small functions would redo most of the program
+        size_t budget = std::min(own_weight, options.import_budget);
+        size_t imported_weight = 0;
+        for (const auto& [position, target] : picked) {
+            size_t weight = functionWeight(*target);
+            if (imported_weight + weight > budget) {
+                break;
+            }
+            shards[i].imported.push_back(target);
+            imported_weight += weight;
+        }
+    }
+}
+
+std::vector<ParallelCodeGenerator::ShardResult> ParallelCodeGenerator::runShards(
+    const std::vector<StmtPtr>& statements,
+    const std::string& module_name,
+    bool serialize) {
+    
+    // Types are inferred once for the whole program and shared read-only
+    TypeInference types(module_name);
+    if (options.modules) {
+        options.modules->annotate(types);
+    }
+    {
+        PhaseTimer phase(options.stats, "resolve");
+        if (!types.analyze(statements) || !types.addExports(options.exports)) {
+            return {};
+        }
+    }
+    
+    std::vector<const Specialization*> functions;
+    for (const auto& spec : types.getSpecializations()) {
+        functions.push_back(spec.get());
+    }
+    
+    std::vector<Shard> shards = partition(functions, module_name);
+    shard_count = shards.size();
+    if (options.import_weight > 0) {
+        size_t main_weight = 0;
+        for (const auto& stmt : statements) {
+            if (!dynamic_cast<FunctionStmt*>(stmt.get())) {
+                main_weight += countStatements(stmt);
+            }
+        }
+        selectImports(shards, types.getMain(), main_weight);
+    }
+    
+    // Profile counters are numbered in registration order, which must not
+    // depend on thread scheduling
+    if (options.profile) {
+        CodeGenerator::registerProfileSites("main", module_name, 1, statements);
+        for (const Specialization* func : functions) {
+            const std::string* file = types.findSourceFile(*func->stmt);
+            CodeGenerator::registerProfileSites(func->name, file ? *file : module_name,
+                                                func->stmt->getName().line, func->stmt->getBody());
+        }
+    }
+    
+    PhaseTimer phase(options.stats, "codegen");
+    std::vector<ShardResult> results(shards.size());
+    DiagnosticManager& reports = DiagnosticCapture::getTarget();
+    llvm::ThreadPool pool(llvm::hardware_concurrency(options.jobs));
+    
+    for (size_t i = 0; i < shards.size(); ++i) {
+        pool.async([&, i]() {
+            DiagnosticCapture capture(reports);
+            llvm::orc::ThreadSafeContext ts_context(std::make_unique<llvm::LLVMContext>());
+            
+            CodeGenerator generator;
+            generator.setTypeInference(&types);
+            generator.initialize(*ts_context.getContext(), shards[i].name);
+            generator.setSourceFile(shards[i].file);
+            generator.setFramePointers(options.frame_pointers);
+            generator.setDebugInfo(options.debug_info);
+            generator.setProfile(options.profile);
+            generator.setAutoMemo(options.auto_memo);
+            
+            // Functions of other shards are declared when first called and
+            // resolve at link time
+            if (shards[i].main) {
+                generator.generateMain(statements);
+            }
+            generator.generateSpecializations(shards[i].functions);
+            generator.generateAvailableExternally(shards[i].imported);
+            generator.verify();
+            
+            std::unique_ptr<llvm::Module> module = generator.takeModule();
+            optimizeModule(*module, options.opt_level);
+            
+            if (serialize) {
+                llvm::raw_svector_ostream os(results[i].bitcode);
+                llvm::WriteBitcodeToFile(*module, os);
+            }
+            
+            results[i].module = llvm::orc::ThreadSafeModule(std::move(module), ts_context);
+        });
+    }
+    
+    pool.wait();
+    return results;
+}
+
+std::vector<llvm::orc::ThreadSafeModule> ParallelCodeGenerator::generateShards(
+    const std::vector<StmtPtr>& statements, const std::string& module_name) {
+    
+    std::vector<ShardResult> results = runShards(statements, module_name, false);
+    
+    std::vector<llvm::orc::ThreadSafeModule> modules;
+    modules.reserve(results.size());
+    for (auto& result : results) {
+        modules.push_back(std::move(result.module));
+    }
+    return modules;
+}
+
+std::unique_ptr<llvm::Module> ParallelCodeGenerator::generate(
+    const std::vector<StmtPtr>& statements,
+    llvm::LLVMContext& context,
+    const std::string& module_name) {
+    
+    std::vector<ShardResult> results = runShards(statements, module_name, true);
+    
+    // Link in shard order so the result does not depend on scheduling
+    std::unique_ptr<llvm::Module> linked;
+    for (size_t i = 0; i < results.size(); ++i) {
+        llvm::StringRef data(results[i].bitcode.data(), results[i].bitcode.size());
+        auto shard = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(data, module_name + ".shard" + std::to_string(i)), context
+        );
+        
+        if (!shard) {
+            diagnostics.report(
+                DiagnosticSeverity::ERROR,
+                "Failed to read shard " + std::to_string(i) + ": " +
+                    llvm::toString(shard.takeError()),
+                SourceLocation()
+            );
+            return nullptr;
+        }
+        
+        if (!linked) {
+            linked = std::move(*shard);
+            continue;
+        }
+        
+        if (llvm::Linker::linkModules(*linked, std::move(*shard))) {
+            diagnostics.report(
+                DiagnosticSeverity::ERROR,
+                "Failed to link shard " + std::to_string(i),
+                SourceLocation()
+            );
+            return nullptr;
+        }
+    }
+    
+    if (linked) {
+        linked->setModuleIdentifier(module_name);
+        linked->setSourceFileName(module_name);
+    }
+    return linked;
+}
+
+} // namespace mana
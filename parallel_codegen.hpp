@@ -0,0 +1,114 @@
+#ifndef MANASCRIPT_PARALLEL_CODEGEN_HPP
+#define MANASCRIPT_PARALLEL_CODEGEN_HPP
+
+#include "ast.hpp"
+#include "compile_stats.hpp"
+#include "module_graph.hpp"
+#include "type_inference.hpp"
+
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Options for sharded code generation
+ */
+struct ParallelCodegenOptions {
+    unsigned jobs = 0;            // Worker threads, 0 = one per hardware thread
+    unsigned opt_level = 2;       // Optimization level applied to every shard
+    size_t shard_weight = 512;    // Target number of statements per shard
+    bool frame_pointers = false;  // Keep frame pointers for profilers
+    bool debug_info = false;      // Emit line tables
+    bool profile = false;         // Instrument for --profile
+    bool auto_memo = false;       // Memoize every pure function (--auto-memo)
+    size_t import_weight = 0;     // Copy callees of up to this many statements into
+                                  // calling shards for inlining, 0 = never
+    size_t import_budget = 64;    // Statements copied into one shard at most, and
+                                  // never more than the shard's own
+    std::vector<ExportedFunction> exports;  // Compiled whether or not the program calls them
+    const ModuleGraph* modules = nullptr;  // Keep each source file in shards of its own
+    CompileStats* stats = nullptr;  // Records resolve and codegen (including shard
+                                    // verification and optimization) phases
+};
+
+/**
+ * @brief Generates top-level functions in independent shards on a thread pool
+ *
+ * Function specializations are partitioned into contiguous shards by statement
+ * count. Each shard is generated and optimized in its own ThreadSafeContext, so
+ * shards never share LLVM state. The partition depends only on the program, never on the number of
+ * worker threads, which keeps the output bit-identical for any `jobs` value.
+ * The first shard of the main script additionally holds `main` and the
+ * definitions of the built-ins.
+ *
+ * Shards only know each other through a summary of every function: its
+ * signature, owning shard and size. Calls into other shards are declared from
+ * the signature, and small callees are copied in as available_externally
+ * bodies the optimizer may inline, as ThinLTO imports do, up to a budget that
+ * keeps a shard from compiling more imported code than code of its own. A shard's object
+ * therefore changes only when its own functions, the signatures it calls or
+ * the bodies it imported change, and the object cache reuses the rest.
+ */
+class ParallelCodeGenerator {
+public:
+    explicit ParallelCodeGenerator(const ParallelCodegenOptions& options = ParallelCodegenOptions());
+    
+    /**
+     * @brief Generate and optimize every shard as a separate module
+     * @return One module per shard, in source order, ready to hand to a JIT
+     */
+    std::vector<llvm::orc::ThreadSafeModule> generateShards(
+        const std::vector<StmtPtr>& statements, const std::string& module_name);
+    
+    /**
+     * @brief Generate all shards and link them into a single module
+     * @param context Context that will own the linked module
+     * @return The linked module, or nullptr if linking failed
+     */
+    std::unique_ptr<llvm::Module> generate(
+        const std::vector<StmtPtr>& statements,
+        llvm::LLVMContext& context,
+        const std::string& module_name);
+    
+    /**
+     * @brief Number of shards produced by the last generate call
+     */
+    size_t getShardCount() const { return shard_count; }
+    
+private:
+    struct Shard {
+        std::string name;
+        std::string file;       // Source file of the functions
+        std::vector<const Specialization*> functions;
+        std::vector<const Specialization*> imported;
+        bool main = false;
+    };
+    
+    struct ShardResult {
+        llvm::orc::ThreadSafeModule module;
+        llvm::SmallVector<char, 0> bitcode;
+    };
+    
+    ParallelCodegenOptions options;
+    size_t shard_count = 0;
+    
+    std::vector<Shard> partition(
+        const std::vector<const Specialization*>& functions, const std::string& module_name) const;
+    
+    void selectImports(std::vector<Shard>& shards, const Specialization& main, size_t main_weight) const;
+    
+    std::vector<ShardResult> runShards(
+        const std::vector<StmtPtr>& statements,
+        const std::string& module_name,
+        bool serialize);
+};
+
+} // namespace mana
+
+#endif // MANASCRIPT_PARALLEL_CODEGEN_HPP
@@ -1,8 +1,30 @@
 // Adding parser.cpp from Ayush-Debnath
 #include "parser.hpp"
 
+#include <algorithm>
+
 namespace mana {
 
+namespace {
+
+/**
+ * @brief Sets a field of the parser until the end of a scope, also when a ParseError leaves it
+ */
+template <typename T>
+class ScopedValue {
+public:
+    ScopedValue(T& target, T value) : target(target), saved(std::move(target)) {
+        target = std::move(value);
+    }
+    ~ScopedValue() { target = std::move(saved); }
+    
+private:
+    T& target;
+    T saved;
+};
+
+} // namespace
+
 Parser::Parser(const std::vector<Token>& tokens, const std::string& filename)
     : tokens(tokens), filename(filename) {}
 
@@ -11,6 +33,10 @@ std::vector<StmtPtr> Parser::parse() {
     
     try {
         while (!isAtEnd()) {
+            if (checkImport()) {
+                importDeclaration();
+                continue;
+            }
             statements.push_back(declaration());
         }
     } catch (const ParseError& error) {
@@ -115,8 +141,18 @@ ExprPtr Parser::assignment() {
         
         if (auto* varExpr = dynamic_cast<VariableExpr*>(expr.get())) {
             Token name = varExpr->getName();
+            
+            // Iterations of a parallel for may run at the same time
+            if (parallel_depth > 0 &&
+                std::find(parallel_locals.begin(), parallel_locals.end(), name.lexeme) == parallel_locals.end()) {
+                error(name, "Can't assign a variable declared outside a parallel for inside it");
+            }
             return std::make_shared<AssignExpr>(name, value);
         }
+        if (auto* indexExpr = dynamic_cast<IndexExpr*>(expr.get())) {
+            return std::make_shared<IndexAssignExpr>(
+                indexExpr->getArray(), indexExpr->getBracket(), indexExpr->getIndex(), value);
+        }
         
         error(equals, "Invalid assignment target");
     }
@@ -204,6 +240,15 @@ ExprPtr Parser::unary() {
         return std::make_shared<UnaryExpr>(op, right);
     }
     
+    if (checkSpawn()) {
+        Token keyword = advance();
+        auto task = std::dynamic_pointer_cast<CallExpr>(call());
+        if (!task) {
+            throw error(keyword, "Expect a function call after 'spawn'");
+        }
+        return std::make_shared<SpawnExpr>(keyword, task);
+    }
+    
     return call();
 }
 
@@ -213,6 +258,8 @@ ExprPtr Parser::call() {
     while (true) {
         if (match(TokenType::LEFT_PAREN)) {
             expr = finishCall(expr);
+        } else if (match(TokenType::LEFT_BRACKET)) {
+            expr = finishIndex(expr);
         } else {
             break;
         }
@@ -240,6 +287,49 @@ ExprPtr Parser::finishCall(ExprPtr callee) {
     return std::make_shared<CallExpr>(callee, paren, arguments);
 }
 
+ExprPtr Parser::finishIndex(ExprPtr array) {
+    // a[i], a[start:end], a[:end], a[start:], a[:]
+    ExprPtr start = nullptr;
+    if (!check(TokenType::COLON)) {
+        start = expression();
+    }
+    
+    if (match(TokenType::COLON)) {
+        ExprPtr end = nullptr;
+        if (!check(TokenType::RIGHT_BRACKET)) {
+            end = expression();
+        }
+        Token bracket = consume(TokenType::RIGHT_BRACKET, "Expect ']' after slice");
+        return std::make_shared<SliceExpr>(array, bracket, start, end);
+    }
+    
+    Token bracket = consume(TokenType::RIGHT_BRACKET, "Expect ']' after index");
+    return std::make_shared<IndexExpr>(array, bracket, start);
+}
+
+ExprPtr Parser::arrayLiteral() {
+    Token bracket = previous();
+    std::vector<ExprPtr> elements;
+    
+    if (!check(TokenType::RIGHT_BRACKET)) {
+        elements.push_back(expression());
+        
+        // [value; count]
+        if (match(TokenType::SEMICOLON)) {
+            ExprPtr count = expression();
+            consume(TokenType::RIGHT_BRACKET, "Expect ']' after array length");
+            return std::make_shared<ArrayExpr>(bracket, elements, count);
+        }
+        
+        while (match(TokenType::COMMA)) {
+            elements.push_back(expression());
+        }
+    }
+    
+    consume(TokenType::RIGHT_BRACKET, "Expect ']' after array elements");
+    return std::make_shared<ArrayExpr>(bracket, elements);
+}
+
 ExprPtr Parser::primary() {
     if (match(TokenType::FALSE)) {
         return std::make_shared<LiteralExpr>(false);
@@ -285,14 +375,56 @@ ExprPtr Parser::primary() {
         return std::make_shared<GroupingExpr>(expr);
     }
     
+    if (match(TokenType::LEFT_BRACKET)) {
+        return arrayLiteral();
+    }
+    
     throw error(peek(), "Expect expression");
 }
 
+bool Parser::checkSpawn() const {
+    // Only a keyword in front of a callee, so a function named spawn can still be called
+    return check(TokenType::IDENTIFIER) && peek().lexeme == "spawn" &&
+           tokens[current + 1].type == TokenType::IDENTIFIER;
+}
+
+bool Parser::checkParallelFor() const {
+    // `parallel` is a name anywhere else
+    return check(TokenType::IDENTIFIER) && peek().lexeme == "parallel" &&
+           tokens[current + 1].type == TokenType::FOR;
+}
+
+bool Parser::checkMemoFunction() const {
+    return check(TokenType::IDENTIFIER) && peek().lexeme == "memo" &&
+           tokens[current + 1].type == TokenType::FUNCTION;
+}
+
+bool Parser::checkImport() const {
+    return check(TokenType::IDENTIFIER) && peek().lexeme == "import" &&
+           tokens[current + 1].type == TokenType::STRING_LITERAL;
+}
+
+void Parser::importDeclaration() {
+    try {
+        Token keyword = advance();
+        Token path = advance();
+        consume(TokenType::SEMICOLON, "Expect ';' after import");
+        imports.push_back({keyword, path.lexeme});
+    } catch (const ParseError& error) {
+        synchronize();
+    }
+}
+
 StmtPtr Parser::declaration() {
     try {
         if (match(TokenType::FUNCTION)) {
             return functionDeclaration();
         }
+        if (checkMemoFunction()) {
+            advance();
+            advance();
+            return functionDeclaration(true);
+        }
         if (match(TokenType::VAR)) {
             return varDeclaration();
         }
@@ -307,9 +439,13 @@ StmtPtr Parser::declaration() {
     }
 }
 
-StmtPtr Parser::functionDeclaration() {
+StmtPtr Parser::functionDeclaration(bool memo) {
     Token name = consume(TokenType::IDENTIFIER, "Expect function name");
     
+    // Loops around a nested declaration are not around its body
+    ScopedValue<int> loops(loop_depth, 0);
+    ScopedValue<int> parallel(parallel_depth, 0);
+    
     consume(TokenType::LEFT_PAREN, "Expect '(' after function name");
     
     std::vector<Token> parameters;
@@ -335,7 +471,7 @@ StmtPtr Parser::functionDeclaration() {
     
     consume(TokenType::RIGHT_BRACE, "Expect '}' after function body");
     
-    return std::make_shared<FunctionStmt>(name, parameters, body);
+    return std::make_shared<FunctionStmt>(name, parameters, body, memo);
 }
 
 StmtPtr Parser::varDeclaration(bool is_const) {
@@ -349,6 +485,9 @@ StmtPtr Parser::varDeclaration(bool is_const) {
     }
     
     consume(TokenType::SEMICOLON, "Expect ';' after variable declaration");
+    if (parallel_depth > 0) {
+        parallel_locals.push_back(name.lexeme);
+    }
     return std::make_shared<VarDeclStmt>(name, initializer, is_const);
 }
 
@@ -359,6 +498,20 @@ StmtPtr Parser::statement() {
     if (match(TokenType::WHILE)) {
         return whileStatement();
     }
+    if (match(TokenType::FOR)) {
+        return forStatement();
+    }
+    if (checkParallelFor()) {
+        advance();
+        advance();
+        return forStatement(true);
+    }
+    if (match(TokenType::BREAK)) {
+        return breakStatement();
+    }
+    if (match(TokenType::CONTINUE)) {
+        return continueStatement();
+    }
     if (match(TokenType::RETURN)) {
         return returnStatement();
     }
@@ -385,17 +538,121 @@ StmtPtr Parser::ifStatement() {
 }
 
 StmtPtr Parser::whileStatement() {
+    Token keyword = previous();
     consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'");
     ExprPtr condition = expression();
     consume(TokenType::RIGHT_PAREN, "Expect ')' after while condition");
     
-    StmtPtr body = statement();
+    StmtPtr body = loopBody(false);
+    
+    return std::make_shared<WhileStmt>(keyword, condition, body);
+}
+
+StmtPtr Parser::forStatement(bool parallel) {
+    Token keyword = previous();
+    consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'");
+    
+    // The initializer's variable is scoped to the loop
+    size_t locals_mark = parallel_locals.size();
+    StmtPtr initializer = nullptr;
+    if (match(TokenType::VAR)) {
+        initializer = varDeclaration();
+    } else if (!match(TokenType::SEMICOLON)) {
+        initializer = expressionStatement();
+    }
+    
+    ExprPtr condition = nullptr;
+    if (!check(TokenType::SEMICOLON)) {
+        condition = expression();
+    }
+    consume(TokenType::SEMICOLON, "Expect ';' after loop condition");
+    
+    ExprPtr increment = nullptr;
+    if (!check(TokenType::RIGHT_PAREN)) {
+        increment = expression();
+    }
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after for clauses");
+    
+    if (parallel && !isCountingLoop(initializer, condition, increment)) {
+        error(keyword, "A parallel for must have the form (var i = start; i < end; i = i + 1)");
+        parallel = false;
+    }
+    
+    StmtPtr body = loopBody(parallel);
+    parallel_locals.resize(locals_mark);
     
-    return std::make_shared<WhileStmt>(condition, body);
+    return std::make_shared<ForStmt>(keyword, initializer, condition, increment, body, parallel);
+}
+
+StmtPtr Parser::loopBody(bool parallel) {
+    ScopedValue<int> loops(loop_depth, loop_depth + 1);
+    if (!parallel) {
+        return statement();
+    }
+    
+    ScopedValue<int> parallel_loop(parallel_depth, loop_depth);
+    ScopedValue<std::vector<std::string>> locals(parallel_locals, {});
+    return statement();
+}
+
+bool Parser::isCountingLoop(const StmtPtr& initializer, const ExprPtr& condition,
+                            const ExprPtr& increment) const {
+    auto* variable = dynamic_cast<VarDeclStmt*>(initializer.get());
+    if (!variable || !variable->getInitializer()) {
+        return false;
+    }
+    auto isVariable = [&](const ExprPtr& expr) {
+        auto* var_expr = dynamic_cast<VariableExpr*>(expr.get());
+        return var_expr && var_expr->getName().lexeme == variable->getName().lexeme;
+    };
+    
+    // i < end or i <= end
+    auto* test = dynamic_cast<BinaryExpr*>(condition.get());
+    if (!test || !isVariable(test->getLeft()) ||
+        (test->getOperator().type != TokenType::LESS && test->getOperator().type != TokenType::LESS_EQUAL)) {
+        return false;
+    }
+    
+    // i = i + 1
+    auto* step = dynamic_cast<AssignExpr*>(increment.get());
+    if (!step || step->getName().lexeme != variable->getName().lexeme) {
+        return false;
+    }
+    auto* sum = dynamic_cast<BinaryExpr*>(step->getValue().get());
+    if (!sum || sum->getOperator().type != TokenType::PLUS || !isVariable(sum->getLeft())) {
+        return false;
+    }
+    auto* one = dynamic_cast<LiteralExpr*>(sum->getRight().get());
+    return one && std::holds_alternative<int>(one->getValue()) && std::get<int>(one->getValue()) == 1;
+}
+
+StmtPtr Parser::breakStatement() {
+    Token keyword = previous();
+    if (loop_depth == 0) {
+        error(keyword, "Can't use 'break' outside of a loop");
+    } else if (loop_depth == parallel_depth) {
+        error(keyword, "Can't break out of a parallel for");
+    }
+    
+    consume(TokenType::SEMICOLON, "Expect ';' after 'break'");
+    return std::make_shared<BreakStmt>(keyword);
+}
+
+StmtPtr Parser::continueStatement() {
+    Token keyword = previous();
+    if (loop_depth == 0) {
+        error(keyword, "Can't use 'continue' outside of a loop");
+    }
+    
+    consume(TokenType::SEMICOLON, "Expect ';' after 'continue'");
+    return std::make_shared<ContinueStmt>(keyword);
 }
 
 StmtPtr Parser::returnStatement() {
     Token keyword = previous();
+    if (parallel_depth > 0) {
+        error(keyword, "Can't return from inside a parallel for");
+    }
     ExprPtr value = nullptr;
     
     if (!check(TokenType::SEMICOLON)) {
@@ -408,10 +665,12 @@ StmtPtr Parser::returnStatement() {
 
 StmtPtr Parser::blockStatement() {
     std::vector<StmtPtr> statements;
+    size_t locals_mark = parallel_locals.size();
     
     while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
         statements.push_back(declaration());
     }
+    parallel_locals.resize(locals_mark);
     
     consume(TokenType::RIGHT_BRACE, "Expect '}' after block");
     return std::make_shared<BlockStmt>(statements);
@@ -20,6 +20,18 @@ public:
     ParseError(const std::string& message) : std::runtime_error(message) {}
 };
 
+/**
+ * @brief An `import "path";` declaration
+ *
+ * `import` is not reserved: it only starts an import at the top level of a
+ * file and when followed by a string, so existing scripts may still use it as
+ * a name.
+ */
+struct Import {
+    Token keyword;
+    std::string path;   // Relative to the importing file
+};
+
 /**
  * @brief Recursive Descent Parser for Manascript
  */
@@ -29,6 +41,16 @@ private:
     int current = 0;
     int max_params = 255;  // Maximum number of parameters in a function
     std::string filename;
+    std::vector<Import> imports;
+    
+    // Loops around the statement being parsed, within the current function;
+    // break and continue need one, and a parallel for limits what its body does
+    int loop_depth = 0;
+    int parallel_depth = 0;    // loop_depth at the innermost parallel for, or 0
+    
+    // Variables declared inside the innermost parallel for's body so far,
+    // the only ones that body may assign
+    std::vector<std::string> parallel_locals;
     
     // Helper methods
     bool isAtEnd() const;
@@ -57,18 +79,31 @@ private:
     ExprPtr call();
     ExprPtr primary();
     
+    bool checkSpawn() const;
+    bool checkParallelFor() const;
+    bool checkMemoFunction() const;
+    bool checkImport() const;
+    void importDeclaration();
     StmtPtr declaration();
     StmtPtr varDeclaration(bool is_const = false);
-    StmtPtr functionDeclaration();
+    StmtPtr functionDeclaration(bool memo = false);
     StmtPtr statement();
     StmtPtr expressionStatement();
     StmtPtr ifStatement();
     StmtPtr whileStatement();
+    StmtPtr forStatement(bool parallel = false);
+    StmtPtr loopBody(bool parallel);
+    StmtPtr breakStatement();
+    StmtPtr continueStatement();
     StmtPtr returnStatement();
     StmtPtr blockStatement();
     
     // Parsing utilities
     ExprPtr finishCall(ExprPtr callee);
+    ExprPtr finishIndex(ExprPtr array);
+    ExprPtr arrayLiteral();
+    bool isCountingLoop(const StmtPtr& initializer, const ExprPtr& condition,
+                        const ExprPtr& increment) const;
     
 public:
     Parser(const std::vector<Token>& tokens, const std::string& filename = "");
@@ -78,6 +113,11 @@ public:
      * @return Vector of statements
      */
     std::vector<StmtPtr> parse();
+    
+    /**
+     * @brief Imports found by parse(), in source order
+     */
+    const std::vector<Import>& getImports() const { return imports; }
 };
 
 } // namespace mana
@@ -0,0 +1,476 @@
+#include "profile.hpp"
+
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_os_ostream.h>
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define MANA_PROFILE_SAMPLING 1
+#endif
+
+// This thread's counters; on x86-64 compiled code reads them in place
+extern "C" {
+__attribute__((tls_model("initial-exec"))) thread_local mana::ProfileThread profile_block;
+}
+
+namespace mana {
+
+namespace {
+
+struct ProfileSite {
+    bool loop = false;
+    std::string function;
+    std::string file;
+    int line = 0;
+    int column = 0;
+    int32_t slot = 0;
+};
+
+struct ThreadCounters {
+    std::vector<uint64_t> storage;
+
+    // Bounds of the thread's stack, scanned by samples
+    uintptr_t stack_low = 0;
+    uintptr_t stack_high = 0;
+
+    // Set while `storage` moves, so that a sample skips it
+    volatile std::sig_atomic_t resizing = 0;
+};
+
+// Where compiled code of a function was loaded
+struct CodeRange {
+    uintptr_t start = 0;
+    uintptr_t end = 0;
+    int32_t slot = 0;
+};
+
+struct CodeMap {
+    std::vector<CodeRange> ranges; // By start address
+    uintptr_t low = UINTPTR_MAX;   // Bounds of every range, to skip most stack words quickly
+    uintptr_t high = 0;
+};
+
+// Read by the signal handler, so set once per thread and never freed
+__attribute__((tls_model("initial-exec"))) thread_local ThreadCounters* thread_counters = nullptr;
+
+/**
+ * @brief Every registered site and the counters of every thread that ran one
+ */
+class ProfileRegistry {
+public:
+    int32_t registerSite(const std::string& key, ProfileSite site, int32_t slots) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = slots_by_key.find(key);
+        if (it != slots_by_key.end()) {
+            return it->second;
+        }
+
+        site.slot = slot_count.load(std::memory_order_relaxed);
+        slot_count.store(site.slot + slots, std::memory_order_release);
+        slots_by_key[key] = site.slot;
+        sites.push_back(std::move(site));
+        return sites.back().slot;
+    }
+
+    void attach(ThreadCounters*& counters, ProfileThread& block) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!counters) {
+            threads.push_back(std::make_unique<ThreadCounters>());
+            counters = threads.back().get();
+            findStack(*counters);
+        }
+
+        // Sites registered since the last call get zeroed counters
+        counters->resizing = 1;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        counters->storage.resize(slot_count.load(std::memory_order_relaxed), 0);
+        block.counters = counters->storage.data();
+        block.size = counters->storage.size();
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        counters->resizing = 0;
+    }
+
+    void addCode(const std::string& name, uintptr_t address, uint64_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = slots_by_key.find("f:" + name);
+        if (it == slots_by_key.end()) {
+            return;
+        }
+
+        // The handler may be reading the current map, so a new one replaces it
+        auto map = std::make_unique<CodeMap>(maps.empty() ? CodeMap() : *maps.back());
+        CodeRange range{address, address + size, it->second};
+        map->ranges.insert(std::upper_bound(map->ranges.begin(), map->ranges.end(), range,
+                                            [](const CodeRange& a, const CodeRange& b) {
+                                                return a.start < b.start;
+                                            }),
+                           range);
+        map->low = std::min(map->low, range.start);
+        map->high = std::max(map->high, range.end);
+        maps.push_back(std::move(map));
+        code.store(maps.back().get(), std::memory_order_release);
+    }
+
+    const CodeMap* codeMap() const { return code.load(std::memory_order_acquire); }
+
+    uint64_t slotCount() const { return slot_count.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Sum of one counter over every thread
+     */
+    uint64_t total(int32_t slot) const {
+        uint64_t sum = 0;
+        for (const auto& thread : threads) {
+            if (static_cast<size_t>(slot) < thread->storage.size()) {
+                sum += thread->storage[slot];
+            }
+        }
+        return sum;
+    }
+
+    std::mutex mutex;
+    std::vector<ProfileSite> sites;
+
+private:
+    static void findStack(ThreadCounters& counters) {
+        pthread_attr_t attributes;
+        if (pthread_getattr_np(pthread_self(), &attributes) != 0) {
+            return;
+        }
+        void* low = nullptr;
+        size_t size = 0;
+        if (pthread_attr_getstack(&attributes, &low, &size) == 0) {
+            counters.stack_low = reinterpret_cast<uintptr_t>(low);
+            counters.stack_high = counters.stack_low + size;
+        }
+        pthread_attr_destroy(&attributes);
+    }
+
+    std::map<std::string, int32_t> slots_by_key;
+    std::atomic<int32_t> slot_count{0};
+    std::vector<std::unique_ptr<ThreadCounters>> threads;
+    std::vector<std::unique_ptr<CodeMap>> maps;
+    std::atomic<const CodeMap*> code{nullptr};
+};
+
+ProfileRegistry& registry() {
+    static ProfileRegistry instance;
+    return instance;
+}
+
+#ifdef MANA_PROFILE_SAMPLING
+
+std::atomic<bool> sampling{false};
+
+// Distinct functions credited per sample; deeper mixes lose inclusive samples
+const size_t MAX_SAMPLED_FUNCTIONS = 256;
+
+// Stack scanned per sample, so that deep recursion keeps samples cheap; callers
+// further out miss inclusive samples
+const size_t MAX_SCANNED_STACK = size_t(256) << 10;
+
+int32_t findFunction(const CodeMap& map, uintptr_t pc) {
+    if (pc < map.low || pc >= map.high) {
+        return -1;
+    }
+    auto it = std::upper_bound(map.ranges.begin(), map.ranges.end(), pc,
+                               [](uintptr_t address, const CodeRange& range) {
+                                   return address < range.start;
+                               });
+    if (it == map.ranges.begin()) {
+        return -1;
+    }
+    --it;
+    return pc < it->end ? it->slot : -1;
+}
+
+/**
+ * @brief Credit the innermost compiled function with an exclusive sample, and
+ * every function with a return address on the stack with an inclusive one
+ *
+ * Scanning the stack rather than walking frames needs no frame pointers, at
+ * the price of counting stale return addresses left in live frames. Time in
+ * runtime calls counts as the calling function's own.
+ */
+void sampleStack(ThreadCounters& counters, const CodeMap& map, uintptr_t pc, uintptr_t sp) {
+    if (sp < counters.stack_low || sp >= counters.stack_high) {
+        return;
+    }
+    uint64_t* storage = counters.storage.data();
+    size_t size = counters.storage.size();
+    int32_t seen[MAX_SAMPLED_FUNCTIONS];
+    size_t seen_count = 0;
+
+    auto credit = [&](uintptr_t address) {
+        int32_t slot = findFunction(map, address);
+        if (slot < 0 || static_cast<size_t>(slot) + PROFILE_FUNCTION_SLOTS > size) {
+            return;
+        }
+        if (seen_count == 0) {
+            storage[slot + PROFILE_EXCLUSIVE] += 1;
+        }
+        if (std::find(seen, seen + seen_count, slot) == seen + seen_count &&
+            seen_count < MAX_SAMPLED_FUNCTIONS) {
+            seen[seen_count++] = slot;
+            storage[slot + PROFILE_INCLUSIVE] += 1;
+        }
+    };
+
+    credit(pc);
+    uintptr_t end = counters.stack_high - sp > MAX_SCANNED_STACK ? sp + MAX_SCANNED_STACK
+                                                                 : counters.stack_high;
+    sp &= ~(sizeof(uintptr_t) - 1);
+    for (const uintptr_t* word = reinterpret_cast<const uintptr_t*>(sp);
+         word < reinterpret_cast<const uintptr_t*>(end); ++word) {
+        credit(*word);
+    }
+}
+
+void onProfileSignal(int, siginfo_t*, void* context) {
+    ThreadCounters* counters = thread_counters;
+    const CodeMap* map = registry().codeMap();
+    if (!sampling.load(std::memory_order_relaxed) || !counters || counters->resizing || !map) {
+        return;
+    }
+
+    const mcontext_t& machine = static_cast<ucontext_t*>(context)->uc_mcontext;
+#if defined(__x86_64__)
+    sampleStack(*counters, *map, machine.gregs[REG_RIP], machine.gregs[REG_RSP]);
+#else
+    sampleStack(*counters, *map, machine.pc, machine.sp);
+#endif
+}
+
+#endif // MANA_PROFILE_SAMPLING
+
+struct FunctionProfile {
+    const ProfileSite* site;
+    uint64_t calls;
+    double inclusive_ns;
+    double exclusive_ns;
+};
+
+struct LoopProfile {
+    const ProfileSite* site;
+    uint64_t iterations;
+};
+
+/**
+ * @brief Totals of every site that ran, hottest first
+ */
+void collectProfile(std::vector<FunctionProfile>& functions, std::vector<LoopProfile>& loops) {
+    ProfileRegistry& profile = registry();
+    const double ns_per_sample = static_cast<double>(PROFILE_SAMPLE_INTERVAL_US) * 1e3;
+
+    for (const ProfileSite& site : profile.sites) {
+        if (site.loop) {
+            uint64_t iterations = profile.total(site.slot);
+            if (iterations > 0) {
+                loops.push_back({&site, iterations});
+            }
+            continue;
+        }
+
+        uint64_t calls = profile.total(site.slot + PROFILE_CALLS);
+        if (calls > 0) {
+            functions.push_back({
+                &site, calls,
+                static_cast<double>(profile.total(site.slot + PROFILE_INCLUSIVE)) * ns_per_sample,
+                static_cast<double>(profile.total(site.slot + PROFILE_EXCLUSIVE)) * ns_per_sample
+            });
+        }
+    }
+
+    // Functions too quick to be sampled are ordered by calls
+    std::stable_sort(functions.begin(), functions.end(),
+                     [](const FunctionProfile& a, const FunctionProfile& b) {
+                         if (a.exclusive_ns != b.exclusive_ns) {
+                             return a.exclusive_ns > b.exclusive_ns;
+                         }
+                         return a.calls > b.calls;
+                     });
+    std::stable_sort(loops.begin(), loops.end(), [](const LoopProfile& a, const LoopProfile& b) {
+        return a.iterations > b.iterations;
+    });
+}
+
+const size_t HOT_LOOPS_SHOWN = 10;
+
+} // namespace
+
+int32_t registerProfileFunction(const std::string& name, const std::string& file, int line) {
+    ProfileSite site;
+    site.function = name;
+    site.file = file;
+    site.line = line;
+    return registry().registerSite("f:" + name, std::move(site), PROFILE_FUNCTION_SLOTS);
+}
+
+int32_t registerProfileLoop(const std::string& function, const std::string& file, int line, int column) {
+    ProfileSite site;
+    site.loop = true;
+    site.function = function;
+    site.file = file;
+    site.line = line;
+    site.column = column;
+    std::string key = "l:" + function + ":" + std::to_string(line) + ":" + std::to_string(column);
+    return registry().registerSite(key, std::move(site), 1);
+}
+
+int32_t profileSlotCount() {
+    return static_cast<int32_t>(registry().slotCount());
+}
+
+bool profileBlockIsThreadLocal() {
+#if defined(__linux__) && defined(__x86_64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t profileBlockOffset() {
+#if defined(__linux__) && defined(__x86_64__)
+    // Initial-exec variables sit at a fixed offset from %fs in every thread
+    uintptr_t thread_pointer = 0;
+    asm("mov %%fs:0, %0" : "=r"(thread_pointer));
+    return reinterpret_cast<uintptr_t>(&profile_block) - thread_pointer;
+#else
+    return 0;
+#endif
+}
+
+void addProfileCode(const std::string& name, uint64_t address, uint64_t size) {
+    const std::string outlined = ".pfor";
+    std::string function = name;
+    if (function.size() > outlined.size() &&
+        function.compare(function.size() - outlined.size(), outlined.size(), outlined) == 0) {
+        function.resize(function.size() - outlined.size());
+    }
+    registry().addCode(function, static_cast<uintptr_t>(address), size);
+}
+
+void startProfileSampling() {
+#ifdef MANA_PROFILE_SAMPLING
+    // A signal arriving after stopProfileSampling() finds `sampling` clear, so
+    // the handler stays installed rather than SIGPROF's default, which exits
+    static std::once_flag installed;
+    std::call_once(installed, []() {
+        struct sigaction action = {};
+        action.sa_sigaction = onProfileSignal;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, nullptr);
+    });
+    registry();
+    sampling.store(true, std::memory_order_relaxed);
+
+    struct itimerval timer = {};
+    timer.it_interval.tv_usec = PROFILE_SAMPLE_INTERVAL_US;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+#endif
+}
+
+void stopProfileSampling() {
+#ifdef MANA_PROFILE_SAMPLING
+    struct itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sampling.store(false, std::memory_order_relaxed);
+#endif
+}
+
+void printProfile(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    std::vector<FunctionProfile> functions;
+    std::vector<LoopProfile> loops;
+    collectProfile(functions, loops);
+
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << "Profile (calls and iterations are counted; times in ms are sampled every "
+        << PROFILE_SAMPLE_INTERVAL_US / 1000.0 << " ms of CPU time)\n"
+        << std::setw(12) << "calls" << std::setw(14) << "inclusive" << std::setw(14) << "exclusive"
+        << "  function\n";
+    for (const FunctionProfile& function : functions) {
+        out << std::setw(12) << function.calls
+            << std::setw(14) << function.inclusive_ns / 1e6
+            << std::setw(14) << function.exclusive_ns / 1e6
+            << "  " << function.site->function << " (" << function.site->file << ":"
+            << function.site->line << ")\n";
+    }
+
+    if (!loops.empty()) {
+        out << "Hottest loops\n" << std::setw(12) << "iterations" << "  loop\n";
+        for (size_t i = 0; i < loops.size() && i < HOT_LOOPS_SHOWN; ++i) {
+            out << std::setw(12) << loops[i].iterations << "  " << loops[i].site->function << " ("
+                << loops[i].site->file << ":" << loops[i].site->line << ":"
+                << loops[i].site->column << ")\n";
+        }
+    }
+    out.flags(flags);
+}
+
+void writeProfileJson(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    std::vector<FunctionProfile> functions;
+    std::vector<LoopProfile> loops;
+    collectProfile(functions, loops);
+
+    llvm::raw_os_ostream stream(out);
+    llvm::json::OStream json(stream, 2);
+    json.object([&]() {
+        json.attribute("sample_interval_ns", PROFILE_SAMPLE_INTERVAL_US * 1000);
+        json.attributeArray("functions", [&]() {
+            for (const FunctionProfile& function : functions) {
+                json.object([&]() {
+                    json.attribute("name", function.site->function);
+                    json.attribute("file", function.site->file);
+                    json.attribute("line", function.site->line);
+                    json.attribute("calls", static_cast<int64_t>(function.calls));
+                    json.attribute("inclusive_ns", function.inclusive_ns);
+                    json.attribute("exclusive_ns", function.exclusive_ns);
+                });
+            }
+        });
+        json.attributeArray("loops", [&]() {
+            for (const LoopProfile& loop : loops) {
+                json.object([&]() {
+                    json.attribute("function", loop.site->function);
+                    json.attribute("file", loop.site->file);
+                    json.attribute("line", loop.site->line);
+                    json.attribute("column", loop.site->column);
+                    json.attribute("iterations", static_cast<int64_t>(loop.iterations));
+                });
+            }
+        });
+    });
+    stream << "\n";
+}
+
+} // namespace mana
+
+extern "C" {
+
+mana::ProfileThread* profile_thread() {
+    // Compiled code calls in only when the block lacks a counter it needs
+    if (profile_block.size < mana::registry().slotCount()) {
+        mana::registry().attach(mana::thread_counters, profile_block);
+    }
+    return &profile_block;
+}
+
+} // extern "C"
@@ -0,0 +1,109 @@
+#ifndef MANASCRIPT_PROFILE_HPP
+#define MANASCRIPT_PROFILE_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace mana {
+
+/**
+ * @brief Counters of one thread running profiled code
+ *
+ * On x86-64 compiled code reads the thread's block straight from thread-local
+ * storage and bumps a call counter inline, so a call costs a compare and an
+ * add; elsewhere it fetches the block with profile_thread() on every call.
+ * Time isn't measured per call but sampled, see startProfileSampling().
+ * Layout is shared with CodeGenerator: do not reorder.
+ */
+struct ProfileThread {
+    uint64_t* counters = nullptr; // Indexed by the slots of registered sites
+    uint64_t size = 0;            // Zero until the thread first runs profiled code
+};
+
+// Counter slots of a profiled function, relative to its first slot
+const int32_t PROFILE_CALLS = 0;
+const int32_t PROFILE_INCLUSIVE = 1; // Samples with the function anywhere on the stack
+const int32_t PROFILE_EXCLUSIVE = 2; // Samples taken in the function itself
+const int32_t PROFILE_FUNCTION_SLOTS = 3;
+
+/**
+ * @brief Reserve the counters of a function
+ * @param name Mangled specialization name
+ * @param file Script the function is defined in
+ * @param line Line of the definition
+ * @return First counter slot; the same slot for the same name
+ */
+int32_t registerProfileFunction(const std::string& name, const std::string& file, int line);
+
+/**
+ * @brief Reserve the iteration counter of a loop
+ * @param function Mangled name of the function containing the loop
+ * @return Counter slot; the same slot for the same loop
+ */
+int32_t registerProfileLoop(const std::string& function, const std::string& file, int line, int column);
+
+/**
+ * @brief Number of counter slots registered so far
+ *
+ * A thread whose block is at least this large has a counter for every site
+ * registered before the call.
+ */
+int32_t profileSlotCount();
+
+/**
+ * @brief Whether compiled code can read its block from thread-local storage
+ *
+ * When true, the JIT binds `profile_block` to profileBlockOffset().
+ */
+bool profileBlockIsThreadLocal();
+
+/**
+ * @brief Offset of this thread's `profile_block` from the thread pointer;
+ * the same in every thread
+ */
+uint64_t profileBlockOffset();
+
+/**
+ * @brief Attribute samples taken in [address, address + size) to a function
+ * @param name Symbol of the compiled function; `.pfor` bodies count toward
+ *             the function they were outlined from, unknown names are ignored
+ */
+void addProfileCode(const std::string& name, uint64_t address, uint64_t size);
+
+// CPU time each sample stands for
+const int64_t PROFILE_SAMPLE_INTERVAL_US = 1000;
+
+/**
+ * @brief Sample the stacks of threads running profiled code every
+ * PROFILE_SAMPLE_INTERVAL_US of CPU time
+ *
+ * Each sample scans the stack of the interrupted thread for return addresses
+ * into compiled code, so no frame pointers are needed. Does nothing on hosts
+ * the sampler doesn't know.
+ */
+void startProfileSampling();
+
+/**
+ * @brief Stop the timer started by startProfileSampling()
+ */
+void stopProfileSampling();
+
+/**
+ * @brief Print call counts, inclusive/exclusive time and the hottest loops
+ */
+void printProfile(std::ostream& out);
+
+/**
+ * @brief Write the profile as JSON
+ */
+void writeProfileJson(std::ostream& out);
+
+} // namespace mana
+
+// Accessed from compiled code
+extern "C" {
+mana::ProfileThread* profile_thread();
+}
+
+#endif // MANASCRIPT_PROFILE_HPP
@@ -0,0 +1,388 @@
+#include "runtime.hpp"
+#include "error.hpp"
+#include "memo.hpp"
+#include "profile.hpp"
+#include "tasks.hpp"
+
+#include <charconv>
+#include <cmath>
+#include <csetjmp>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace mana {
+
+namespace {
+
+const size_t ARRAY_ALIGNMENT = 64;
+
+/**
+ * @brief Every block handed out by allocateArrayStorage()
+ */
+class ArrayStorage {
+public:
+    ~ArrayStorage() {
+        for (void* block : blocks) {
+            std::free(block);
+        }
+    }
+
+    void* allocate(size_t bytes) {
+        // aligned_alloc needs a size that is a multiple of the alignment
+        size_t rounded = (bytes + ARRAY_ALIGNMENT - 1) / ARRAY_ALIGNMENT * ARRAY_ALIGNMENT;
+        void* block = std::aligned_alloc(ARRAY_ALIGNMENT, rounded == 0 ? ARRAY_ALIGNMENT : rounded);
+        if (!block) {
+            throw std::bad_alloc();
+        }
+        std::memset(block, 0, bytes);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        blocks.push_back(block);
+        return block;
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<void*> blocks;
+};
+
+ArrayStorage& arrayStorage() {
+    static ArrayStorage storage;
+    return storage;
+}
+
+// Set by trapRuntimeErrors() for the code it runs on this thread
+thread_local std::jmp_buf* error_trap = nullptr;
+thread_local int fatal_depth = 0;
+
+[[noreturn]] void fatalError(const char* file, int32_t line, int32_t column, const std::string& message) {
+    flushOutput();
+    diagnostics.report(DiagnosticSeverity::ERROR, message, SourceLocation(file, line, column));
+    if (error_trap && fatal_depth == 0) {
+        // Compiled code holds no locks or destructors, so its frames can be dropped
+        std::longjmp(*error_trap, 1);
+    }
+    diagnostics.printDiagnostics();
+    std::exit(1);
+}
+
+#ifndef _WIN32
+void onCrash(int signal) {
+    standardOutput().flushFromSignal();
+    const char message[] = "error: Stack overflow or invalid memory access\n";
+    (void)!::write(STDERR_FILENO, message, sizeof(message) - 1);
+
+    // The default action is back (SA_RESETHAND), so this ends the process
+    raise(signal);
+}
+#endif
+
+} // namespace
+
+OutputBuffer::OutputBuffer(std::FILE* file, size_t capacity)
+    : file(file), buffer(new char[capacity]), capacity(capacity) {}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+void OutputBuffer::write(const char* data, size_t length) {
+    std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+    if (shared.load(std::memory_order_relaxed)) {
+        lock.lock();
+    }
+
+    if (size + length > capacity) {
+        std::fwrite(buffer.get(), 1, size, file);
+        size = 0;
+
+        // Too large to be worth buffering
+        if (length > capacity) {
+            std::fwrite(data, 1, length, file);
+            return;
+        }
+    }
+
+    std::memcpy(buffer.get() + size, data, length);
+    size += length;
+}
+
+void OutputBuffer::flushFromSignal() {
+#ifndef _WIN32
+    size_t written = 0;
+    while (written < size) {
+        ssize_t result = ::write(fileno(file), buffer.get() + written, size - written);
+        if (result <= 0) {
+            break;
+        }
+        written += static_cast<size_t>(result);
+    }
+    size = 0;
+#endif
+}
+
+void OutputBuffer::flush() {
+    std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+    if (shared.load(std::memory_order_relaxed)) {
+        lock.lock();
+    }
+
+    if (size > 0) {
+        std::fwrite(buffer.get(), 1, size, file);
+        size = 0;
+    }
+    std::fflush(file);
+}
+
+OutputBuffer& standardOutput() {
+    // Destroyed (and therefore flushed) at exit
+    static OutputBuffer output(stdout);
+    return output;
+}
+
+void flushOutput() {
+    standardOutput().flush();
+}
+
+void installCrashHandler() {
+#ifndef _WIN32
+    static char stack[1 << 16];
+    stack_t alternate = {};
+    alternate.ss_sp = stack;
+    alternate.ss_size = sizeof(stack);
+    sigaltstack(&alternate, nullptr);
+
+    // Touch the buffer now; constructing it inside the handler would allocate
+    standardOutput();
+
+    struct sigaction action = {};
+    action.sa_handler = onCrash;
+    action.sa_flags = SA_ONSTACK | SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, nullptr);
+    sigaction(SIGBUS, &action, nullptr);
+#endif
+}
+
+void printValue(const Value& value) {
+    switch (value.getType()) {
+        case Value::Type::INT:
+            print_i64(value.asInt());
+            break;
+        case Value::Type::DOUBLE:
+            print_f64(value.asDouble());
+            break;
+        case Value::Type::STRING: {
+            const std::string& text = value.asString();
+            standardOutput().write(text.data(), text.size());
+            break;
+        }
+        default: {
+            std::string text = value.toString();
+            standardOutput().write(text.data(), text.size());
+            break;
+        }
+    }
+}
+
+bool trapRuntimeErrors(void (*body)(void*), void* context) {
+    std::jmp_buf trap;
+    std::jmp_buf* outer = error_trap;
+    error_trap = &trap;
+    if (setjmp(trap) != 0) {
+        error_trap = outer;
+        return false;
+    }
+    body(context);
+    error_trap = outer;
+    return true;
+}
+
+FatalRuntimeErrors::FatalRuntimeErrors() {
+    ++fatal_depth;
+}
+
+FatalRuntimeErrors::~FatalRuntimeErrors() {
+    --fatal_depth;
+}
+
+size_t formatDouble(double value, char* out, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    // NaN prints without a sign, as in Value::toString
+    if (value != value) {
+        value = std::fabs(value);
+    }
+    auto [end, ec] = std::to_chars(out, out + size - 1, value);
+    size_t length = ec == std::errc() ? static_cast<size_t>(end - out) : 0;
+    out[length] = '\0';
+    return length;
+}
+
+void* allocateArrayStorage(int32_t count, size_t element_size) {
+    return arrayStorage().allocate(static_cast<size_t>(count) * element_size);
+}
+
+std::string arrayIndexError(int32_t index, int32_t length) {
+    return "Index " + std::to_string(index) + " out of bounds for array of length " +
+           std::to_string(length);
+}
+
+std::string arraySliceError(int32_t start, int32_t end, int32_t length) {
+    return "Slice [" + std::to_string(start) + ":" + std::to_string(end) +
+           "] out of bounds for array of length " + std::to_string(length);
+}
+
+std::string arrayLengthError(int32_t length) {
+    return "Negative array length: " + std::to_string(length);
+}
+
+const std::vector<RuntimeSymbol>& getRuntimeSymbols() {
+    static const std::vector<RuntimeSymbol> symbols = {
+        {"print_str", reinterpret_cast<void*>(&print_str)},
+        {"print_i64", reinterpret_cast<void*>(&print_i64)},
+        {"print_f64", reinterpret_cast<void*>(&print_f64)},
+        {"print_i32_array", reinterpret_cast<void*>(&print_i32_array)},
+        {"print_f64_array", reinterpret_cast<void*>(&print_f64_array)},
+        {"array_alloc", reinterpret_cast<void*>(&array_alloc)},
+        {"string_concat", reinterpret_cast<void*>(&string_concat)},
+        {"string_from_i64", reinterpret_cast<void*>(&string_from_i64)},
+        {"string_from_f64", reinterpret_cast<void*>(&string_from_f64)},
+        {"string_equal", reinterpret_cast<void*>(&string_equal)},
+        {"array_index_error", reinterpret_cast<void*>(&array_index_error)},
+        {"array_slice_error", reinterpret_cast<void*>(&array_slice_error)},
+        {"array_length_error", reinterpret_cast<void*>(&array_length_error)},
+        {"division_error", reinterpret_cast<void*>(&division_error)},
+        {"profile_thread", reinterpret_cast<void*>(&profile_thread)},
+        {"memo_lookup", reinterpret_cast<void*>(&memo_lookup)},
+        {"memo_store", reinterpret_cast<void*>(&memo_store)},
+        {"task_alloc", reinterpret_cast<void*>(&task_alloc)},
+        {"task_spawn", reinterpret_cast<void*>(&task_spawn)},
+        {"task_join", reinterpret_cast<void*>(&task_join)},
+        {"task_wait_all", reinterpret_cast<void*>(&task_wait_all)},
+        {"task_parallel_for", reinterpret_cast<void*>(&task_parallel_for)},
+    };
+    return symbols;
+}
+
+} // namespace mana
+
+extern "C" {
+
+void print_str(const char* text) {
+    mana::standardOutput().write(text, std::strlen(text));
+}
+
+void print_i64(int64_t value) {
+    // Digits are produced backwards into the end of the buffer
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* p = end;
+
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    do {
+        *--p = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0) {
+        *--p = '-';
+    }
+    mana::standardOutput().write(p, static_cast<size_t>(end - p));
+}
+
+void print_f64(double value) {
+    char text[32];
+    size_t length = mana::formatDouble(value, text, sizeof(text));
+    mana::standardOutput().write(text, length);
+}
+
+void print_i32_array(const int32_t* data, int32_t length) {
+    print_str("[");
+    for (int32_t i = 0; i < length; ++i) {
+        if (i > 0) {
+            print_str(", ");
+        }
+        print_i64(data[i]);
+    }
+    print_str("]");
+}
+
+void print_f64_array(const double* data, int32_t length) {
+    print_str("[");
+    for (int32_t i = 0; i < length; ++i) {
+        if (i > 0) {
+            print_str(", ");
+        }
+        print_f64(data[i]);
+    }
+    print_str("]");
+}
+
+void* array_alloc(int32_t count, int32_t element_size) {
+    // Compiled code checks the count before calling
+    return mana::allocateArrayStorage(count, static_cast<size_t>(element_size));
+}
+
+const char* string_concat(const char* left, const char* right) {
+    left = left ? left : "nil";
+    right = right ? right : "nil";
+    size_t left_size = std::strlen(left);
+    size_t right_size = std::strlen(right);
+
+    // The storage is zeroed, so the terminator is already there
+    auto* text = static_cast<char*>(mana::allocateArrayStorage(
+        static_cast<int32_t>(left_size + right_size + 1), 1));
+    std::memcpy(text, left, left_size);
+    std::memcpy(text + left_size, right, right_size);
+    return text;
+}
+
+const char* string_from_i64(int64_t value) {
+    std::string digits = std::to_string(value);
+    auto* text = static_cast<char*>(mana::allocateArrayStorage(static_cast<int32_t>(digits.size() + 1), 1));
+    std::memcpy(text, digits.data(), digits.size());
+    return text;
+}
+
+const char* string_from_f64(double value) {
+    char digits[32];
+    size_t length = mana::formatDouble(value, digits, sizeof(digits));
+    auto* text = static_cast<char*>(mana::allocateArrayStorage(static_cast<int32_t>(length + 1), 1));
+    std::memcpy(text, digits, length);
+    return text;
+}
+
+int32_t string_equal(const char* left, const char* right) {
+    if (!left || !right) {
+        return left == right;
+    }
+    return std::strcmp(left, right) == 0;
+}
+
+void array_index_error(const char* file, int32_t line, int32_t column, int32_t index, int32_t length) {
+    mana::fatalError(file, line, column, mana::arrayIndexError(index, length));
+}
+
+void array_slice_error(const char* file, int32_t line, int32_t column, int32_t start, int32_t end,
+                       int32_t length) {
+    mana::fatalError(file, line, column, mana::arraySliceError(start, end, length));
+}
+
+void array_length_error(const char* file, int32_t line, int32_t column, int32_t length) {
+    mana::fatalError(file, line, column, mana::arrayLengthError(length));
+}
+
+void division_error(const char* file, int32_t line, int32_t column) {
+    mana::fatalError(file, line, column, "Division by zero");
+}
+
+} // extern "C"
@@ -0,0 +1,181 @@
+#ifndef MANASCRIPT_RUNTIME_HPP
+#define MANASCRIPT_RUNTIME_HPP
+
+#include "value.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Large write buffer in front of a FILE
+ *
+ * Output is copied into the buffer and handed to the OS only when the buffer
+ * fills up, on flush(), or when the buffer is destroyed. One writer at a
+ * time until share() is called; after that every write takes a lock.
+ */
+class OutputBuffer {
+public:
+    explicit OutputBuffer(std::FILE* file, size_t capacity = 1 << 20);
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void write(const char* data, size_t size);
+    void flush();
+
+    /**
+     * @brief Hand the buffered bytes to the OS without locking or stdio
+     *
+     * Only for a crash handler: a write in progress may be cut short.
+     */
+    void flushFromSignal();
+
+    /**
+     * @brief Let several threads write at once, as tasks do; cannot be undone
+     */
+    void share() { shared.store(true); }
+
+private:
+    std::mutex mutex;
+    std::atomic<bool> shared{false};
+    std::FILE* file;
+    std::unique_ptr<char[]> buffer;
+    size_t capacity;
+    size_t size = 0;
+};
+
+/**
+ * @brief Buffer shared by every engine for program output to stdout
+ *
+ * Flushed automatically at exit; drivers flush explicitly before writing
+ * diagnostics so the two streams don't interleave out of order.
+ */
+OutputBuffer& standardOutput();
+
+/**
+ * @brief Flush program output written so far
+ */
+void flushOutput();
+
+/**
+ * @brief Keep program output when the process crashes
+ *
+ * Deep recursion ends in SIGSEGV, which would otherwise drop everything still
+ * in the output buffer. The handler runs on a stack of its own, writes the
+ * buffer and a message, and lets the signal end the process. Covers the main
+ * thread; called by the driver, never by the library.
+ */
+void installCrashHandler();
+
+/**
+ * @brief Print a value exactly as compiled code would
+ *
+ * Used by the interpreter and the VM so every tier shares one output buffer
+ * and interleaves correctly when a program moves between tiers.
+ */
+void printValue(const Value& value);
+
+/**
+ * @brief Run body(context), returning false if it stops on a runtime error
+ *
+ * Runtime errors of compiled code, such as an index out of bounds, normally
+ * print and end the process. Raised on this thread under a trap, they are
+ * reported to `diagnostics` and unwind back here instead. Errors inside
+ * tasks still end the process: workers have no trap, and a thread waiting
+ * for tasks runs other tasks meanwhile. A stack overflow is always fatal.
+ */
+bool trapRuntimeErrors(void (*body)(void*), void* context);
+
+template <typename F>
+bool trapRuntimeErrors(F body) {
+    return trapRuntimeErrors([](void* context) { (*static_cast<F*>(context))(); }, &body);
+}
+
+/**
+ * @brief Keeps runtime errors on this thread fatal while alive, trap or not
+ *
+ * For code that can't be unwound halfway, like a scheduler running tasks.
+ */
+class FatalRuntimeErrors {
+public:
+    FatalRuntimeErrors();
+    ~FatalRuntimeErrors();
+
+    FatalRuntimeErrors(const FatalRuntimeErrors&) = delete;
+    FatalRuntimeErrors& operator=(const FatalRuntimeErrors&) = delete;
+};
+
+/**
+ * @brief Format a double the way Manascript prints it
+ *
+ * The shortest text that reads back as the same double, as Value::toString
+ * gives: 0.1, 100, 1e-07, 1e+300.
+ * @return Number of characters written, excluding the terminator
+ */
+size_t formatDouble(double value, char* out, size_t size);
+
+/**
+ * @brief Zeroed storage for array elements
+ *
+ * Aligned to 64 bytes so vectorized loops start on a cache line. Owned by the
+ * runtime and released at exit; slices may point into it at any time.
+ */
+void* allocateArrayStorage(int32_t count, size_t element_size);
+
+// Messages of array runtime errors, shared by every engine
+std::string arrayIndexError(int32_t index, int32_t length);
+std::string arraySliceError(int32_t start, int32_t end, int32_t length);
+std::string arrayLengthError(int32_t length);
+
+/**
+ * @brief A native function the JIT resolves by name
+ */
+struct RuntimeSymbol {
+    const char* name;
+    void* address;
+};
+
+/**
+ * @brief Every runtime function compiled code may call
+ */
+const std::vector<RuntimeSymbol>& getRuntimeSymbols();
+
+} // namespace mana
+
+// Entry points called from compiled code
+extern "C" {
+void print_str(const char* text);
+void print_i64(int64_t value);
+void print_f64(double value);
+void print_i32_array(const int32_t* data, int32_t length);
+void print_f64_array(const double* data, int32_t length);
+
+void* array_alloc(int32_t count, int32_t element_size);
+
+// Strings built at run time live as long as arrays; null reads as "nil"
+const char* string_concat(const char* left, const char* right);
+const char* string_from_i64(int64_t value);
+const char* string_from_f64(double value);
+int32_t string_equal(const char* left, const char* right);
+
+// Report an array error at file:line:column and exit
+[[noreturn]] void array_index_error(const char* file, int32_t line, int32_t column, int32_t index,
+                                    int32_t length);
+[[noreturn]] void array_slice_error(const char* file, int32_t line, int32_t column, int32_t start,
+                                    int32_t end, int32_t length);
+[[noreturn]] void array_length_error(const char* file, int32_t line, int32_t column, int32_t length);
+
+// Report an integer division by zero at file:line:column and exit
+[[noreturn]] void division_error(const char* file, int32_t line, int32_t column);
+}
+
+#endif // MANASCRIPT_RUNTIME_HPP
@@ -0,0 +1,142 @@
+#include "source_cache.hpp"
+#include "error.hpp"
+#include "lexer.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+namespace mana {
+
+namespace {
+
+// Source bytes kept at most; files beyond that are parsed by every worker
+const size_t MAX_CACHED_BYTES = size_t(64) << 20;
+
+// What tells an edited file from the one that was parsed
+struct FileIdentity {
+    off_t size = 0;
+    struct timespec modified = {0, 0};
+
+    bool operator==(const FileIdentity& other) const {
+        return size == other.size && modified.tv_sec == other.modified.tv_sec &&
+               modified.tv_nsec == other.modified.tv_nsec;
+    }
+};
+
+struct CachedSource {
+    FileIdentity identity;
+    std::shared_ptr<const ParsedSource> source;
+};
+
+std::mutex mutex;
+bool keeping = false;
+size_t cached_bytes = 0;
+
+// By absolute path and the name the file was parsed under, NUL-separated
+std::unordered_map<std::string, CachedSource> sources;
+std::vector<std::pair<std::string, std::string>> missed;
+
+bool identify(const std::string& path, FileIdentity& identity) {
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+        return false;
+    }
+    identity.size = status.st_size;
+    identity.modified = status.st_mtim;
+    return true;
+}
+
+std::string cacheKey(const std::string& path, const std::string& name) {
+    return path + '\0' + name;
+}
+
+} // namespace
+
+void keepParsedSources() {
+    std::lock_guard<std::mutex> lock(mutex);
+    keeping = true;
+}
+
+std::shared_ptr<const ParsedSource> findParsedSource(const std::string& name) {
+    // Only set before the daemon forks, so outside of it this costs nothing
+    if (!keeping) {
+        return nullptr;
+    }
+    std::error_code error;
+    std::string path = std::filesystem::absolute(name, error).lexically_normal().string();
+    FileIdentity identity;
+    if (error || !identify(path, identity)) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sources.find(cacheKey(path, name));
+    if (it != sources.end() && it->second.identity == identity) {
+        return it->second.source;
+    }
+    missed.emplace_back(path, name);
+    return nullptr;
+}
+
+std::vector<std::pair<std::string, std::string>> takeMissedSources() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::move(missed);
+}
+
+void loadParsedSource(const std::string& path, const std::string& name) {
+    // Taken before reading, so an edit made meanwhile shows as a change later
+    FileIdentity identity;
+    if (!identify(path, identity)) {
+        return;
+    }
+    std::string key = cacheKey(path, name);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = sources.find(key);
+        if (it != sources.end() && it->second.identity == identity) {
+            return;
+        }
+    }
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return;
+    }
+    auto parsed = std::make_shared<ParsedSource>();
+    parsed->content.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // A file with warnings is parsed again, so that workers report them
+    DiagnosticManager report;
+    {
+        DiagnosticCapture capture(report);
+        Lexer lexer(parsed->content, name);
+        std::vector<Token> tokens = lexer.scanTokens();
+        parsed->tokens = tokens.size();
+        Parser parser(tokens, name);
+        parsed->statements = parser.parse();
+        parsed->imports = parser.getImports();
+    }
+    if (!report.getDiagnostics().empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    CachedSource& cached = sources[key];
+    size_t replaced = cached.source ? cached.source->content.size() : 0;
+    if (cached_bytes - replaced + parsed->content.size() > MAX_CACHED_BYTES) {
+        if (!cached.source) {
+            sources.erase(key);
+        }
+        return;
+    }
+    cached_bytes = cached_bytes - replaced + parsed->content.size();
+    cached.identity = identity;
+    cached.source = std::move(parsed);
+}
+
+} // namespace mana
@@ -0,0 +1,58 @@
+#ifndef MANASCRIPT_SOURCE_CACHE_HPP
+#define MANASCRIPT_SOURCE_CACHE_HPP
+
+#include "ast.hpp"
+#include "parser.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief A source file as it was read and parsed without any diagnostics
+ */
+struct ParsedSource {
+    std::string content;
+    size_t tokens = 0;
+    std::vector<StmtPtr> statements;
+    std::vector<Import> imports;
+};
+
+/**
+ * @brief Keep parsed files in memory for the processes forked from this one
+ *
+ * Called by the daemon. A worker forked afterwards finds every file the
+ * daemon parsed through findParsedSource(), and records the files it had to
+ * parse itself for takeMissedSources().
+ */
+void keepParsedSources();
+
+/**
+ * @brief A file parsed under `name` whose size and modification time are
+ * unchanged since, or nullptr
+ *
+ * The AST is shared; the caller may mutate it only in a forked worker, whose
+ * copy of the daemon's memory is its own. Safe to call from several threads.
+ */
+std::shared_ptr<const ParsedSource> findParsedSource(const std::string& name);
+
+/**
+ * @brief Files findParsedSource() missed since the last call, as absolute
+ * path and the name they were parsed under
+ */
+std::vector<std::pair<std::string, std::string>> takeMissedSources();
+
+/**
+ * @brief Read and parse a file into the cache; files with diagnostics are skipped
+ * @param path Absolute path
+ * @param name Name tokens and diagnostics refer to the file by
+ */
+void loadParsedSource(const std::string& path, const std::string& name);
+
+} // namespace mana
+
+#endif // MANASCRIPT_SOURCE_CACHE_HPP
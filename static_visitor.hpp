@@ -0,0 +1,95 @@
+#ifndef MANASCRIPT_STATIC_VISITOR_HPP
+#define MANASCRIPT_STATIC_VISITOR_HPP
+
+#include "ast.hpp"
+
+namespace mana {
+
+/**
+ * @brief Statically dispatched AST visitor that returns results directly
+ *
+ * Dispatches on the node's NodeKind tag and calls the derived class's
+ * visit*() method through CRTP, so a visit costs one switch instead of a
+ * virtual accept() plus a virtual visit*(), and handlers can be inlined.
+ *
+ * Derived classes implement:
+ *   ExprResult visitLiteralExpr(LiteralExpr&), ... for every expression node
+ *   StmtResult visitExpressionStmt(ExpressionStmt&), ... for every statement node
+ *
+ * @tparam Derived The visitor class itself
+ * @tparam ExprResult Result of visiting an expression
+ * @tparam StmtResult Result of visiting a statement
+ */
+template <typename Derived, typename ExprResult, typename StmtResult = void>
+class StaticVisitor {
+public:
+    ExprResult visit(Expression& expr) {
+        switch (expr.getKind()) {
+            case NodeKind::LITERAL_EXPR:
+                return derived().visitLiteralExpr(static_cast<LiteralExpr&>(expr));
+            case NodeKind::UNARY_EXPR:
+                return derived().visitUnaryExpr(static_cast<UnaryExpr&>(expr));
+            case NodeKind::BINARY_EXPR:
+                return derived().visitBinaryExpr(static_cast<BinaryExpr&>(expr));
+            case NodeKind::GROUPING_EXPR:
+                return derived().visitGroupingExpr(static_cast<GroupingExpr&>(expr));
+            case NodeKind::VARIABLE_EXPR:
+                return derived().visitVariableExpr(static_cast<VariableExpr&>(expr));
+            case NodeKind::ASSIGN_EXPR:
+                return derived().visitAssignExpr(static_cast<AssignExpr&>(expr));
+            case NodeKind::CALL_EXPR:
+                return derived().visitCallExpr(static_cast<CallExpr&>(expr));
+            case NodeKind::ARRAY_EXPR:
+                return derived().visitArrayExpr(static_cast<ArrayExpr&>(expr));
+            case NodeKind::INDEX_EXPR:
+                return derived().visitIndexExpr(static_cast<IndexExpr&>(expr));
+            case NodeKind::INDEX_ASSIGN_EXPR:
+                return derived().visitIndexAssignExpr(static_cast<IndexAssignExpr&>(expr));
+            case NodeKind::SLICE_EXPR:
+                return derived().visitSliceExpr(static_cast<SliceExpr&>(expr));
+            case NodeKind::SPAWN_EXPR:
+                return derived().visitSpawnExpr(static_cast<SpawnExpr&>(expr));
+            default:
+                break;
+        }
+        return ExprResult();
+    }
+
+    StmtResult visit(Statement& stmt) {
+        switch (stmt.getKind()) {
+            case NodeKind::EXPRESSION_STMT:
+                return derived().visitExpressionStmt(static_cast<ExpressionStmt&>(stmt));
+            case NodeKind::VAR_DECL_STMT:
+                return derived().visitVarDeclStmt(static_cast<VarDeclStmt&>(stmt));
+            case NodeKind::BLOCK_STMT:
+                return derived().visitBlockStmt(static_cast<BlockStmt&>(stmt));
+            case NodeKind::IF_STMT:
+                return derived().visitIfStmt(static_cast<IfStmt&>(stmt));
+            case NodeKind::WHILE_STMT:
+                return derived().visitWhileStmt(static_cast<WhileStmt&>(stmt));
+            case NodeKind::FOR_STMT:
+                return derived().visitForStmt(static_cast<ForStmt&>(stmt));
+            case NodeKind::BREAK_STMT:
+                return derived().visitBreakStmt(static_cast<BreakStmt&>(stmt));
+            case NodeKind::CONTINUE_STMT:
+                return derived().visitContinueStmt(static_cast<ContinueStmt&>(stmt));
+            case NodeKind::FUNCTION_STMT:
+                return derived().visitFunctionStmt(static_cast<FunctionStmt&>(stmt));
+            case NodeKind::RETURN_STMT:
+                return derived().visitReturnStmt(static_cast<ReturnStmt&>(stmt));
+            default:
+                break;
+        }
+        return StmtResult();
+    }
+
+protected:
+    ~StaticVisitor() = default;
+
+private:
+    Derived& derived() { return static_cast<Derived&>(*this); }
+};
+
+} // namespace mana
+
+#endif // MANASCRIPT_STATIC_VISITOR_HPP
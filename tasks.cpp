@@ -0,0 +1,459 @@
+#include "tasks.hpp"
+#include "error.hpp"
+#include "memo.hpp"
+#include "runtime.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace mana {
+
+namespace {
+
+const size_t TASK_ALIGNMENT = 16;
+const size_t TASK_CHUNK_SIZE = 1 << 16;
+const int64_t INITIAL_DEQUE_CAPACITY = 256;
+
+// Failed searches for work before an idle worker goes to sleep
+const int IDLE_SPINS = 64;
+
+// Pieces a parallel for's range is cut into per thread, so threads that
+// finish early can steal the rest
+const int64_t CHUNKS_PER_THREAD = 4;
+
+/**
+ * @brief Header the runtime keeps in front of every task environment
+ */
+struct alignas(TASK_ALIGNMENT) Task {
+    void (*run)(void*);
+    std::atomic<bool> done;
+};
+
+static_assert(sizeof(Task) == TASK_ALIGNMENT, "environments must stay 16-byte aligned");
+
+Task* taskOf(void* env) {
+    return reinterpret_cast<Task*>(static_cast<char*>(env) - sizeof(Task));
+}
+
+void* environmentOf(Task* task) {
+    return reinterpret_cast<char*>(task) + sizeof(Task);
+}
+
+/**
+ * @brief A piece of a parallel for's range, run as a task
+ */
+struct alignas(TASK_ALIGNMENT) RangeTask {
+    Task header;
+    int64_t begin;
+    int64_t end;
+    void* env;
+    void (*body)(void*, int64_t, int64_t);
+
+    static void run(void* range) {
+        auto* task = reinterpret_cast<RangeTask*>(taskOf(range));
+        task->body(task->env, task->begin, task->end);
+    }
+};
+
+/**
+ * @brief Memory for a task, carved out of chunks owned by the calling thread
+ *
+ * Tasks are small and spawned often, so allocation takes no lock. Like array
+ * storage, the memory lives until exit: a handle can be joined any number of
+ * times, from any thread.
+ */
+void* allocateTask(size_t bytes) {
+    thread_local char* next = nullptr;
+    thread_local char* end = nullptr;
+
+    size_t rounded = (bytes + TASK_ALIGNMENT - 1) / TASK_ALIGNMENT * TASK_ALIGNMENT;
+    if (rounded > TASK_CHUNK_SIZE / 4) {
+        void* block = std::aligned_alloc(TASK_ALIGNMENT, rounded);
+        if (!block) {
+            throw std::bad_alloc();
+        }
+        return block;
+    }
+
+    if (static_cast<size_t>(end - next) < rounded) {
+        next = static_cast<char*>(std::aligned_alloc(TASK_ALIGNMENT, TASK_CHUNK_SIZE));
+        if (!next) {
+            throw std::bad_alloc();
+        }
+        end = next + TASK_CHUNK_SIZE;
+    }
+    void* block = next;
+    next += rounded;
+    return block;
+}
+
+/**
+ * @brief Chase-Lev work-stealing deque of one worker
+ *
+ * The owner pushes and pops at the bottom without locking; any other thread
+ * steals from the top with a single compare-and-swap. Memory orders follow
+ * Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models".
+ */
+class WorkDeque {
+public:
+    WorkDeque() {
+        rings.push_back(std::make_unique<Ring>(INITIAL_DEQUE_CAPACITY));
+        ring.store(rings.back().get(), std::memory_order_relaxed);
+    }
+
+    // Owner only
+    void push(Task* task) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Ring* r = ring.load(std::memory_order_relaxed);
+
+        if (b - t > r->capacity - 1) {
+            rings.push_back(std::make_unique<Ring>(r->capacity * 2));
+            Ring* grown = rings.back().get();
+            for (int64_t i = t; i < b; ++i) {
+                grown->put(i, r->get(i));
+            }
+            ring.store(grown, std::memory_order_release);
+            r = grown;
+        }
+
+        r->put(b, task);
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    // Owner only; takes the newest task
+    Task* pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Ring* r = ring.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Task* task = r->get(b);
+        if (t == b) {
+            // The last task: thieves may be after it too
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed)) {
+                task = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    // Any thread; takes the oldest task
+    Task* steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return nullptr;
+        }
+
+        Task* task = ring.load(std::memory_order_acquire)->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return task;
+    }
+
+private:
+    struct Ring {
+        explicit Ring(int64_t capacity)
+            : capacity(capacity), slots(new std::atomic<Task*>[static_cast<size_t>(capacity)]) {}
+
+        Task* get(int64_t i) const { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+        void put(int64_t i, Task* task) { slots[i & (capacity - 1)].store(task, std::memory_order_relaxed); }
+
+        int64_t capacity;
+        std::unique_ptr<std::atomic<Task*>[]> slots;
+    };
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Ring*> ring{nullptr};
+
+    // Every ring ever used: a thief may still be reading one that was outgrown
+    std::vector<std::unique_ptr<Ring>> rings;
+};
+
+// Index of the worker running on this thread, or -1
+thread_local int current_worker = -1;
+
+/**
+ * @brief Worker threads and the queues they take tasks from
+ *
+ * There is one worker per core besides the thread that started the first
+ * task, which helps whenever it waits. Tasks spawned by a worker go to the
+ * bottom of its own deque, and it runs its newest task first; a worker that
+ * runs out steals the oldest task of a random other worker. Other threads
+ * hand their tasks over through a shared queue. Workers that find nothing
+ * for a while sleep until a task is queued.
+ */
+class Scheduler {
+public:
+    static Scheduler& get() {
+        // Never destroyed: workers are still running when static destructors run
+        static Scheduler* scheduler = [] {
+            auto* created = new Scheduler();
+            instance.store(created, std::memory_order_release);
+            return created;
+        }();
+        return *scheduler;
+    }
+
+    /**
+     * @brief The scheduler if a task was ever spawned, else null
+     */
+    static Scheduler* running() {
+        return instance.load(std::memory_order_acquire);
+    }
+
+    void spawn(Task* task) {
+        pending.fetch_add(1, std::memory_order_relaxed);
+
+        // Counted before it's visible, so a thief never sees the count drop below zero
+        queued.fetch_add(1, std::memory_order_seq_cst);
+        if (current_worker >= 0) {
+            workers[static_cast<size_t>(current_worker)]->push(task);
+        } else {
+            std::lock_guard<std::mutex> lock(mutex);
+            injected.push_back(task);
+            injected_count.fetch_add(1, std::memory_order_release);
+        }
+
+        if (sleepers.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            wake.notify_one();
+        }
+    }
+
+    void join(Task* task) {
+        while (!task->done.load(std::memory_order_acquire)) {
+            if (Task* other = findWork()) {
+                execute(other);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    /**
+     * @brief Threads that run tasks: the workers and one that waits
+     */
+    size_t threads() const {
+        return workers.size() + 1;
+    }
+
+    void waitAll() {
+        while (pending.load(std::memory_order_acquire) > 0) {
+            if (Task* other = findWork()) {
+                execute(other);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    static std::atomic<Scheduler*> instance;
+
+    std::vector<std::unique_ptr<WorkDeque>> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Task*> injected;
+    std::atomic<size_t> injected_count{0};
+
+    std::atomic<int64_t> queued{0};     // In a queue, not yet taken
+    std::atomic<int64_t> pending{0};    // Spawned, not yet finished
+    std::atomic<int> sleepers{0};
+
+    Scheduler() {
+        // Tasks print and call memoized functions from several threads from now on
+        standardOutput().share();
+        shareMemoCaches();
+
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        size_t count = std::max(1u, cores - 1);
+        for (size_t i = 0; i < count; ++i) {
+            workers.push_back(std::make_unique<WorkDeque>());
+        }
+        for (size_t i = 0; i < count; ++i) {
+            std::thread([this, i] { run(static_cast<int>(i)); }).detach();
+        }
+    }
+
+    void run(int index) {
+        current_worker = index;
+        int idle = 0;
+        for (;;) {
+            if (Task* task = findWork()) {
+                execute(task);
+                idle = 0;
+                continue;
+            }
+            if (++idle < IDLE_SPINS) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // spawn() increments `queued` before reading `sleepers`, and we do
+            // the reverse, so one of us sees the other and no wakeup is lost
+            idle = 0;
+            std::unique_lock<std::mutex> lock(mutex);
+            sleepers.fetch_add(1, std::memory_order_seq_cst);
+            if (queued.load(std::memory_order_seq_cst) == 0) {
+                wake.wait(lock);
+            }
+            sleepers.fetch_sub(1, std::memory_order_seq_cst);
+        }
+    }
+
+    void execute(Task* task) {
+        task->run(environmentOf(task));
+        task->done.store(true, std::memory_order_release);
+        pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    Task* findWork() {
+        Task* task = nullptr;
+        if (current_worker >= 0) {
+            task = workers[static_cast<size_t>(current_worker)]->pop();
+        }
+        if (!task && injected_count.load(std::memory_order_acquire) > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!injected.empty()) {
+                task = injected.front();
+                injected.pop_front();
+                injected_count.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        if (!task) {
+            task = steal();
+        }
+        if (task) {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    Task* steal() {
+        // xorshift; victims are picked at random so thieves spread out
+        thread_local uint64_t seed = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+
+        size_t count = workers.size();
+        size_t first = static_cast<size_t>(seed % count);
+        for (size_t i = 0; i < count; ++i) {
+            size_t victim = (first + i) % count;
+            if (static_cast<int>(victim) == current_worker) {
+                continue;
+            }
+            if (Task* task = workers[victim]->steal()) {
+                return task;
+            }
+        }
+        return nullptr;
+    }
+};
+
+std::atomic<Scheduler*> Scheduler::instance{nullptr};
+
+} // namespace
+
+} // namespace mana
+
+extern "C" {
+
+void* task_alloc(int64_t size) {
+    void* block = mana::allocateTask(sizeof(mana::Task) + static_cast<size_t>(size));
+    mana::Task* task = new (block) mana::Task();
+    task->done.store(false, std::memory_order_relaxed);
+    return mana::environmentOf(task);
+}
+
+void task_spawn(void* env, void (*run)(void*)) {
+    mana::Task* task = mana::taskOf(env);
+    task->run = run;
+    mana::Scheduler::get().spawn(task);
+}
+
+void task_join(void* env) {
+    if (!env) {
+        mana::flushOutput();
+        mana::diagnostics.report(mana::DiagnosticSeverity::ERROR,
+                                 "Joined a task that was never spawned", mana::SourceLocation());
+        mana::diagnostics.printDiagnostics();
+        std::exit(1);
+    }
+
+    mana::Task* task = mana::taskOf(env);
+    if (!task->done.load(std::memory_order_acquire)) {
+        mana::FatalRuntimeErrors fatal;
+        mana::Scheduler::get().join(task);
+    }
+}
+
+void task_wait_all() {
+    if (mana::Scheduler* scheduler = mana::Scheduler::running()) {
+        mana::FatalRuntimeErrors fatal;
+        scheduler->waitAll();
+    }
+}
+
+void task_parallel_for(int64_t begin, int64_t end, void* env, void (*body)(void*, int64_t, int64_t)) {
+    if (end <= begin) {
+        return;
+    }
+
+    // Pieces run here and on workers at once; none of them can be unwound
+    mana::FatalRuntimeErrors fatal;
+    mana::Scheduler& scheduler = mana::Scheduler::get();
+    int64_t count = end - begin;
+    int64_t chunks = std::min(count, static_cast<int64_t>(scheduler.threads()) * mana::CHUNKS_PER_THREAD);
+    if (chunks <= 1) {
+        body(env, begin, end);
+        return;
+    }
+
+    // Pieces live on this frame: nothing returns before they have all run
+    std::vector<mana::RangeTask> pieces(static_cast<size_t>(chunks));
+    for (int64_t i = 0; i < chunks; ++i) {
+        mana::RangeTask& piece = pieces[static_cast<size_t>(i)];
+        piece.header.run = &mana::RangeTask::run;
+        piece.header.done.store(false, std::memory_order_relaxed);
+        piece.begin = begin + count * i / chunks;
+        piece.end = begin + count * (i + 1) / chunks;
+        piece.env = env;
+        piece.body = body;
+    }
+
+    // This thread takes the first piece itself
+    for (size_t i = 1; i < pieces.size(); ++i) {
+        scheduler.spawn(&pieces[i].header);
+    }
+    body(env, pieces[0].begin, pieces[0].end);
+    for (size_t i = 1; i < pieces.size(); ++i) {
+        scheduler.join(&pieces[i].header);
+    }
+}
+
+}
@@ -0,0 +1,27 @@
+#ifndef MANASCRIPT_TASKS_HPP
+#define MANASCRIPT_TASKS_HPP
+
+#include <cstdint>
+
+// Entry points called from compiled code. A task is a call whose arguments and
+// result live in an environment the compiled code lays out; the handle of a
+// task is the address of its environment.
+extern "C" {
+// Allocate the environment of a task, 16-byte aligned and `size` bytes long
+void* task_alloc(int64_t size);
+
+// Start running `run(env)` on some thread; env must come from task_alloc
+void task_spawn(void* env, void (*run)(void*));
+
+// Wait until the task of `env` has finished, running other tasks meanwhile
+void task_join(void* env);
+
+// Wait until every task spawned so far has finished
+void task_wait_all();
+
+// Run body(env, lo, hi) over pieces [lo, hi) covering [begin, end), spread
+// across the worker threads; returns once every piece has run
+void task_parallel_for(int64_t begin, int64_t end, void* env, void (*body)(void*, int64_t, int64_t));
+}
+
+#endif // MANASCRIPT_TASKS_HPP
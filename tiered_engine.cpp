@@ -0,0 +1,322 @@
+#include "tiered_engine.hpp"
+#include "codegen.hpp"
+#include "optimizer.hpp"
+#include "tasks.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace mana {
+
+namespace {
+
+// Arguments passed to native code; an array takes two slots
+const size_t MAX_NATIVE_SLOTS = 16;
+
+using NativeEntry = uint64_t (*)(const uint64_t*);
+
+/**
+ * @brief Static type of a value as compiled code would receive it
+ * @return False for values native code can't take: strings, nil and tasks
+ */
+bool nativeType(const Value& value, StaticType& type) {
+    if (value.isInt()) {
+        type = StaticType::INT;
+    } else if (value.isDouble()) {
+        type = StaticType::DOUBLE;
+    } else if (value.isBool()) {
+        type = StaticType::BOOL;
+    } else if (value.isArray()) {
+        type = value.asArray().element == Array::Element::DOUBLE ? StaticType::DOUBLE_ARRAY : StaticType::INT_ARRAY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool overlaps(const Array& a, const Array& b) {
+    auto begin = [](const Array& array) { return static_cast<const char*>(array.data); };
+    auto end = [](const Array& array) {
+        return static_cast<const char*>(array.data) + array.length * elementSize(array.element);
+    };
+    return begin(a) < end(b) && begin(b) < end(a);
+}
+
+} // namespace
+
+TieredEngine::TieredEngine(const TieredOptions& options) : options(options), interpreter(options.filename) {
+    interpreter.setTierController(this, options.call_threshold, options.loop_threshold);
+    if (options.modules) {
+        options.modules->annotate(interpreter);
+    }
+}
+
+TieredEngine::~TieredEngine() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        queue.clear();
+    }
+    queue_cv.notify_all();
+    
+    if (compile_thread.joinable()) {
+        compile_thread.join();
+    }
+}
+
+int TieredEngine::run(const std::vector<StmtPtr>& statements) {
+    program = &statements;
+    int status = interpreter.run(statements);
+    
+    // Compiled functions may have spawned tasks nobody joined
+    task_wait_all();
+    return status;
+}
+
+void TieredEngine::notifyHot(FunctionEntry& entry, const std::vector<Value>& args) {
+    if (entry.queued.exchange(true)) {
+        return;
+    }
+    
+    // Specialize for the arguments seen, so a function called with doubles
+    // is compiled for doubles
+    std::vector<StaticType> params(args.size());
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (!nativeType(args[i], params[i])) {
+            if (options.log) {
+                std::cerr << "[tier] " << entry.stmt->getName().lexeme << " takes "
+                          << args[i].toString() << ", which native code can't\n";
+            }
+            return;
+        }
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) {
+            return;
+        }
+        queue.push_back({&entry, std::move(params)});
+        
+        // Start the compile thread on the first tier-up only
+        if (!compile_thread.joinable()) {
+            compile_thread = std::thread(&TieredEngine::compileLoop, this);
+        }
+    }
+    queue_cv.notify_one();
+}
+
+bool TieredEngine::callNative(FunctionEntry& entry, const std::vector<Value>& args, Value& result) {
+    const std::vector<StaticType>& params = entry.native_params;
+    if (args.size() != params.size()) {
+        return false;
+    }
+    
+    uint64_t slots[MAX_NATIVE_SLOTS];
+    size_t used = 0;
+    for (size_t i = 0; i < args.size(); ++i) {
+        StaticType type;
+        if (!nativeType(args[i], type) || type != params[i] || used + 2 > MAX_NATIVE_SLOTS) {
+            return false;
+        }
+        
+        const Value& arg = args[i];
+        if (type == StaticType::INT) {
+            slots[used++] = static_cast<uint32_t>(arg.asInt());
+        } else if (type == StaticType::DOUBLE) {
+            double value = arg.asDouble();
+            std::memcpy(&slots[used++], &value, sizeof(value));
+        } else if (type == StaticType::BOOL) {
+            slots[used++] = arg.asBool();
+        } else {
+            // Compiled code may assume its arrays don't overlap
+            const Array& array = arg.asArray();
+            for (size_t j = 0; j < i; ++j) {
+                if (args[j].isArray() && overlaps(args[j].asArray(), array)) {
+                    return false;
+                }
+            }
+            slots[used++] = reinterpret_cast<uintptr_t>(array.data);
+            slots[used++] = static_cast<uint32_t>(array.length);
+        }
+    }
+    
+    auto native = reinterpret_cast<NativeEntry>(entry.native.load(std::memory_order_acquire));
+    uint64_t bits = native(slots);
+    if (entry.native_result == StaticType::DOUBLE) {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        result = Value::fromDouble(value);
+    } else if (entry.native_result == StaticType::BOOL) {
+        result = Value::fromBool(bits != 0);
+    } else {
+        result = Value::fromInt(static_cast<int32_t>(bits));
+    }
+    return true;
+}
+
+void TieredEngine::compileLoop() {
+    while (true) {
+        HotFunction hot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queue_cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (stopping) {
+                return;
+            }
+            hot = std::move(queue.front());
+            queue.pop_front();
+        }
+        
+        compile(*hot.entry, hot.params);
+    }
+}
+
+bool TieredEngine::ensureJIT() {
+    if (jit) {
+        return true;
+    }
+    
+    auto created = ManaJIT::create(options.cache, options.perf);
+    if (!created) {
+        llvm::consumeError(created.takeError());
+        return false;
+    }
+    jit = std::move(*created);
+    return true;
+}
+
+void TieredEngine::collectReachable(const Specialization& root,
+                                    std::vector<const Specialization*>& out) {
+    std::vector<const Specialization*> worklist = {&root};
+    std::unordered_set<const Specialization*> seen = {&root};
+    
+    while (!worklist.empty()) {
+        const Specialization* spec = worklist.back();
+        worklist.pop_back();
+        out.push_back(spec);
+        
+        for (const auto& call : spec->calls) {
+            if (seen.insert(call.second).second) {
+                worklist.push_back(call.second);
+            }
+        }
+    }
+}
+
+void TieredEngine::publish(FunctionEntry& entry, const Specialization& spec) {
+    if (entry.native.load(std::memory_order_relaxed)) {
+        return;
+    }
+    
+    auto address = jit->lookup(spec.name + ".entry");
+    if (!address) {
+        llvm::consumeError(address.takeError());
+        return;
+    }
+    
+    entry.native_params = spec.param_types;
+    entry.native_result = spec.return_type;
+    entry.queued.store(true);
+    entry.native.store(reinterpret_cast<void*>(static_cast<uintptr_t>(*address)),
+                       std::memory_order_release);
+    compiled_count++;
+}
+
+void TieredEngine::compile(FunctionEntry& entry, const std::vector<StaticType>& params) {
+    if (entry.native.load(std::memory_order_relaxed) || !ensureJIT()) {
+        return;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    const std::string& name = entry.stmt->getName().lexeme;
+    
+    // Failures here must not surface as script errors
+    DiagnosticManager compile_diagnostics;
+    DiagnosticCapture capture(compile_diagnostics);
+    
+    if (!types) {
+        types = std::make_unique<TypeInference>();
+        if (options.modules) {
+            options.modules->annotate(*types);
+        }
+        types->addFunctions(*program);
+    }
+    
+    const Specialization* root = types->specialize(name, params);
+    if (!root) {
+        if (options.log) {
+            std::cerr << "[tier] could not compile " << name << "\n";
+        }
+        return;
+    }
+    
+    // Compile the specialization with every callee that has no native code
+    // yet; already-compiled callees are only declared and resolved by the JIT
+    std::vector<const Specialization*> reachable;
+    collectReachable(*root, reachable);
+    
+    llvm::orc::ThreadSafeContext context(std::make_unique<llvm::LLVMContext>());
+    CodeGenerator generator;
+    generator.setTypeInference(types.get());
+    generator.initialize(*context.getContext(), "mana.tier" + std::to_string(module_counter++));
+    if (!options.filename.empty()) {
+        generator.setSourceFile(options.filename);
+    }
+    generator.setFramePointers(options.perf);
+    generator.setDebugInfo(options.debug_info);
+    
+    std::vector<const Specialization*> bodies;
+    for (const Specialization* spec : reachable) {
+        if (!defined.count(spec->name)) {
+            bodies.push_back(spec);
+        }
+    }
+    generator.generateSpecializations(bodies);
+    
+    // Every compiled function the interpreter can pass its arguments to gets
+    // an entry, so callees can be entered directly as well
+    std::vector<const Specialization*> entries;
+    for (const Specialization* spec : bodies) {
+        if (generator.generateNativeEntry(*spec)) {
+            entries.push_back(spec);
+        }
+    }
+    
+    // Leave everything interpreted if any function can't be compiled
+    if (entries.empty() || entries[0] != root || compile_diagnostics.hasErrors() || !generator.verify()) {
+        if (options.log) {
+            std::cerr << "[tier] could not compile " << name << "\n";
+        }
+        return;
+    }
+    
+    std::unique_ptr<llvm::Module> module = generator.takeModule();
+    optimizeModule(*module, options.opt_level);
+    if (auto err = jit->addModule(llvm::orc::ThreadSafeModule(std::move(module), context))) {
+        llvm::consumeError(std::move(err));
+        return;
+    }
+    
+    for (const Specialization* spec : bodies) {
+        defined.insert(spec->name);
+    }
+    
+    for (const Specialization* spec : entries) {
+        if (FunctionEntry* callee = interpreter.findFunction(spec->stmt->getName().lexeme)) {
+            publish(*callee, *spec);
+        }
+    }
+    
+    if (options.log) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start
+        );
+        std::cerr << "[tier] compiled " << root->name
+                  << " (" << bodies.size() << " functions) in "
+                  << elapsed.count() << " us\n";
+    }
+}
+
+} // namespace mana
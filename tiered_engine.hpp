@@ -0,0 +1,105 @@
+#ifndef MANASCRIPT_TIERED_ENGINE_HPP
+#define MANASCRIPT_TIERED_ENGINE_HPP
+
+#include "interpreter.hpp"
+#include "jit.hpp"
+#include "module_graph.hpp"
+#include "type_inference.hpp"
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Options for the tiered execution engine
+ */
+struct TieredOptions {
+    uint32_t call_threshold = 100;      // Calls before a function is compiled
+    uint32_t loop_threshold = 10000;    // Loop back-edges before a function is compiled
+    unsigned opt_level = 2;             // Optimization level for compiled functions
+    bool log = false;                   // Report tier-ups on stderr
+    llvm::ObjectCache* cache = nullptr; // Optional object cache for the JIT
+    std::string filename;               // Script name for runtime errors and debug info
+    const ModuleGraph* modules = nullptr; // Files of imported functions; optional
+    bool perf = false;                  // Publish compiled code to perf, keep frame pointers
+    bool debug_info = false;            // Emit line tables for compiled code
+};
+
+/**
+ * @brief Runs scripts in the interpreter and moves hot functions to the JIT
+ *
+ * Every function starts in the interpreter. When one crosses a threshold it is
+ * queued for a background thread, which specializes it for the argument types
+ * of the call that made it hot, generates it (together with any
+ * not-yet-compiled callees) with CodeGenerator, compiles it with ManaJIT and
+ * publishes the native entry point atomically. Calls with other argument types
+ * stay in the interpreter.
+ * The interpreter picks up the native entry on the next call; a running loop
+ * finishes in the interpreter.
+ * No thread or LLVM state is created until the first function turns hot, so
+ * short scripts pay nothing for the JIT.
+ */
+class TieredEngine : public TierController {
+public:
+    explicit TieredEngine(const TieredOptions& options = TieredOptions());
+    ~TieredEngine() override;
+    
+    /**
+     * @brief Execute a program
+     * @return Exit code of the script
+     */
+    int run(const std::vector<StmtPtr>& statements);
+    
+    /**
+     * @brief Number of functions running native code
+     */
+    size_t getCompiledCount() const { return compiled_count.load(); }
+    
+    void notifyHot(FunctionEntry& entry, const std::vector<Value>& args) override;
+    bool callNative(FunctionEntry& entry, const std::vector<Value>& args, Value& result) override;
+    
+private:
+    TieredOptions options;
+    Interpreter interpreter;
+    
+    const std::vector<StmtPtr>* program = nullptr;
+    
+    // Owned by the compile thread once it has started
+    std::unique_ptr<ManaJIT> jit;
+    std::unique_ptr<TypeInference> types;
+    std::unordered_set<std::string> defined;
+    size_t module_counter = 0;
+    
+    std::thread compile_thread;
+    std::mutex mutex;
+    std::condition_variable queue_cv;
+    // A function that turned hot, with the argument types it was seen with
+    struct HotFunction {
+        FunctionEntry* entry = nullptr;
+        std::vector<StaticType> params;
+    };
+    std::deque<HotFunction> queue;
+    bool stopping = false;
+    
+    std::atomic<size_t> compiled_count{0};
+    
+    void compileLoop();
+    bool ensureJIT();
+    void compile(FunctionEntry& entry, const std::vector<StaticType>& params);
+    void collectReachable(const Specialization& root, std::vector<const Specialization*>& out);
+    void publish(FunctionEntry& entry, const Specialization& spec);
+};
+
+} // namespace mana
+
+#endif // MANASCRIPT_TIERED_ENGINE_HPP
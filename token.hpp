@@ -0,0 +1,107 @@
+#ifndef MANASCRIPT_TOKEN_HPP
+#define MANASCRIPT_TOKEN_HPP
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace mana {
+
+/**
+ * @brief Kinds of tokens produced by the lexer
+ */
+enum class TokenType {
+    // Special tokens
+    END_OF_FILE,
+    ERROR,
+
+    // Literals
+    IDENTIFIER,
+    INTEGER_LITERAL,
+    FLOAT_LITERAL,
+    STRING_LITERAL,
+    BOOL_LITERAL,
+
+    // Keywords
+    FUNCTION,
+    VAR,
+    CONST,
+    IF,
+    ELSE,
+    WHILE,
+    FOR,
+    RETURN,
+    BREAK,
+    CONTINUE,
+    TRUE,
+    FALSE,
+    NIL,
+
+    // Operators
+    PLUS,
+    MINUS,
+    STAR,
+    SLASH,
+    PERCENT,
+    EQUAL,
+    EQUAL_EQUAL,
+    BANG,
+    BANG_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    AND,
+    OR,
+
+    // Punctuation
+    DOT,
+    COMMA,
+    SEMICOLON,
+    COLON,
+    LEFT_PAREN,
+    RIGHT_PAREN,
+    LEFT_BRACE,
+    RIGHT_BRACE,
+    LEFT_BRACKET,
+    RIGHT_BRACKET
+};
+
+/**
+ * @brief A token with its text and where it starts in the source
+ */
+struct Token {
+    TokenType type = TokenType::ERROR;
+    std::string lexeme;
+    int line = 0;
+    int column = 0;
+
+    Token() = default;
+    Token(TokenType type, std::string lexeme, int line, int column)
+        : type(type), lexeme(std::move(lexeme)), line(line), column(column) {}
+
+    std::string toString() const;
+};
+
+/**
+ * @brief Reserved words of the language
+ *
+ * Contextual keywords (`memo`, `parallel`, `spawn`, `import`) are identifiers
+ * here and recognized by the parser.
+ */
+class Keywords {
+public:
+    static TokenType getKeyword(const std::string& text);
+    static bool isKeyword(const std::string& text);
+
+private:
+    static std::unordered_map<std::string, TokenType> keywords;
+};
+
+std::string tokenTypeToString(TokenType type);
+std::ostream& operator<<(std::ostream& os, const Token& token);
+
+} // namespace mana
+
+#endif // MANASCRIPT_TOKEN_HPP
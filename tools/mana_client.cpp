@@ -0,0 +1,172 @@
+// Thin client for `manascript --daemon`; see daemon.hpp
+//
+// Usage: mana-client [--socket=PATH] [manascript arguments...]
+//
+// Sends the arguments, working directory, MANA_* environment and standard
+// streams to the daemon and exits with the script's status. Without a daemon
+// it runs $MANA_EXECUTABLE (default: manascript) directly, so job runners can
+// always go through the client.
+#include "daemon_protocol.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace {
+
+int connectDaemon(const std::string& path) {
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+[[noreturn]] void runDirectly(const std::vector<std::string>& args) {
+    const char* executable = std::getenv("MANA_EXECUTABLE");
+    if (!executable) {
+        executable = "manascript";
+    }
+
+    std::vector<char*> argv = {const_cast<char*>(executable)};
+    for (const std::string& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    execvp(executable, argv.data());
+
+    std::fprintf(stderr, "mana-client: no daemon and could not run %s: %s\n", executable, std::strerror(errno));
+    std::exit(127);
+}
+
+bool writeFully(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t count = write(fd, data, size);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        data += count;
+        size -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+bool sendRequest(int fd, const std::vector<std::string>& args) {
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        return false;
+    }
+
+    std::string payload(cwd);
+    payload += '\0';
+    for (const std::string& arg : args) {
+        payload += arg;
+        payload += '\0';
+    }
+    uint32_t envc = 0;
+    for (char** entry = environ; *entry; ++entry) {
+        if (std::strncmp(*entry, "MANA_", 5) == 0) {
+            payload += *entry;
+            payload += '\0';
+            envc++;
+        }
+    }
+
+    mana::DaemonRequest header = {
+        mana::DAEMON_MAGIC, mana::DAEMON_PROTOCOL_VERSION,
+        static_cast<uint32_t>(args.size()), envc, static_cast<uint32_t>(payload.size())
+    };
+
+    // Our stdin, stdout and stderr travel with the header
+    int streams[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(streams))];
+    std::memset(control, 0, sizeof(control));
+    struct iovec iov = {&header, sizeof(header)};
+    struct msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(streams));
+    std::memcpy(CMSG_DATA(cmsg), streams, sizeof(streams));
+
+    ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+    if (sent < 0) {
+        return false;
+    }
+    return writeFully(fd, reinterpret_cast<const char*>(&header) + sent, sizeof(header) - sent) &&
+           writeFully(fd, payload.data(), payload.size());
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string socket_path = mana::getDefaultDaemonSocket();
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i == 1 && arg.rfind("--socket=", 0) == 0) {
+            socket_path = arg.substr(9);
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    int fd = connectDaemon(socket_path);
+    if (fd >= 0 && !mana::isPeerSameUser(fd)) {
+        std::fprintf(stderr, "mana-client: %s is served by another user; not using it\n", socket_path.c_str());
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) {
+        runDirectly(args);
+    }
+    if (!sendRequest(fd, args)) {
+        std::fprintf(stderr, "mana-client: could not send request: %s\n", std::strerror(errno));
+        return 1;
+    }
+
+    // The status arrives once the script has exited
+    int32_t status;
+    size_t received = 0;
+    while (received < sizeof(status)) {
+        ssize_t count = read(fd, reinterpret_cast<char*>(&status) + received, sizeof(status) - received);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            std::fprintf(stderr, "mana-client: daemon closed the connection\n");
+            return 1;
+        }
+        received += static_cast<size_t>(count);
+    }
+    return status;
+}
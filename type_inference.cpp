@@ -0,0 +1,912 @@
+#include "type_inference.hpp"
+
+namespace mana {
+
+namespace {
+
+bool isNumeric(StaticType type) {
+    return type == StaticType::BOOL || type == StaticType::INT || type == StaticType::DOUBLE;
+}
+
+} // namespace
+
+const char* staticTypeSuffix(StaticType type) {
+    switch (type) {
+        case StaticType::BOOL:              return "i1";
+        case StaticType::INT:               return "i32";
+        case StaticType::DOUBLE:            return "f64";
+        case StaticType::STRING:            return "str";
+        case StaticType::INT_ARRAY:         return "ai32";
+        case StaticType::DOUBLE_ARRAY:      return "af64";
+        case StaticType::VOID:              return "void";
+        case StaticType::TASK_BOOL:         return "ti1";
+        case StaticType::TASK_INT:          return "ti32";
+        case StaticType::TASK_DOUBLE:       return "tf64";
+        case StaticType::TASK_STRING:       return "tstr";
+        case StaticType::TASK_INT_ARRAY:    return "tai32";
+        case StaticType::TASK_DOUBLE_ARRAY: return "taf64";
+        default:                            return "unknown";
+    }
+}
+
+const char* staticTypeName(StaticType type) {
+    switch (type) {
+        case StaticType::UNKNOWN:           return "unknown";
+        case StaticType::BOOL:              return "bool";
+        case StaticType::INT:               return "int";
+        case StaticType::DOUBLE:            return "double";
+        case StaticType::STRING:            return "string";
+        case StaticType::INT_ARRAY:         return "[int]";
+        case StaticType::DOUBLE_ARRAY:      return "[double]";
+        case StaticType::VOID:              return "void";
+        case StaticType::TASK_BOOL:         return "task<bool>";
+        case StaticType::TASK_INT:          return "task<int>";
+        case StaticType::TASK_DOUBLE:       return "task<double>";
+        case StaticType::TASK_STRING:       return "task<string>";
+        case StaticType::TASK_INT_ARRAY:    return "task<[int]>";
+        case StaticType::TASK_DOUBLE_ARRAY: return "task<[double]>";
+    }
+    return "unknown";
+}
+
+bool parseExport(const std::string& text, ExportedFunction& exported) {
+    size_t open = text.find('(');
+    if (open == 0 || open == std::string::npos || text.back() != ')') {
+        return false;
+    }
+    exported.name = text.substr(0, open);
+    exported.params.clear();
+
+    std::string list = text.substr(open + 1, text.size() - open - 2);
+    if (list.find_first_not_of(' ') == std::string::npos) {
+        return true;
+    }
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        size_t first = list.find_first_not_of(' ', start);
+        size_t last = list.find_last_not_of(' ', end - 1);
+        if (first == std::string::npos || first >= end) {
+            return false;
+        }
+        std::string name = list.substr(first, last - first + 1);
+
+        // Only values the host can pass in
+        bool known = false;
+        for (StaticType type : {StaticType::BOOL, StaticType::INT, StaticType::DOUBLE,
+                                StaticType::STRING, StaticType::INT_ARRAY, StaticType::DOUBLE_ARRAY}) {
+            if (name == staticTypeName(type)) {
+                exported.params.push_back(type);
+                known = true;
+            }
+        }
+        if (!known) {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+std::string describeExport(const ExportedFunction& exported) {
+    std::string text = exported.name + "(";
+    for (size_t i = 0; i < exported.params.size(); ++i) {
+        text += (i > 0 ? ", " : "") + std::string(staticTypeName(exported.params[i]));
+    }
+    return text + ")";
+}
+
+StaticType joinTypes(StaticType a, StaticType b, bool& ok) {
+    ok = true;
+    if (a == b || b == StaticType::UNKNOWN) {
+        return a;
+    }
+    if (a == StaticType::UNKNOWN) {
+        return b;
+    }
+
+    // Numeric types widen bool -> int -> double
+    if (isNumeric(a) && isNumeric(b)) {
+        if (a == StaticType::DOUBLE || b == StaticType::DOUBLE) {
+            return StaticType::DOUBLE;
+        }
+        return StaticType::INT;
+    }
+
+    ok = false;
+    return a;
+}
+
+bool canMemoize(const Specialization& spec, std::string* reason) {
+    std::string why;
+    if (!spec.side_effect.empty()) {
+        why = "it " + spec.side_effect;
+    }
+    for (size_t i = 0; i < spec.param_types.size() && why.empty(); ++i) {
+        if (!isNumeric(spec.param_types[i])) {
+            why = "parameter '" + spec.stmt->getParams()[i].lexeme + "' is " +
+                  staticTypeName(spec.param_types[i]) + ", not a number or bool";
+        }
+    }
+    if (why.empty() && !isNumeric(spec.return_type)) {
+        why = std::string("it returns ") + staticTypeName(spec.return_type) + ", not a number or bool";
+    }
+
+    if (reason) {
+        *reason = why;
+    }
+    return why.empty();
+}
+
+TypeInference::TypeInference(std::string filename) : filename(std::move(filename)) {}
+
+std::string TypeInference::mangle(const std::string& name, const std::vector<StaticType>& params) {
+    std::string mangled = name;
+    for (StaticType type : params) {
+        mangled += '$';
+        mangled += staticTypeSuffix(type);
+    }
+    return mangled;
+}
+
+bool TypeInference::analyze(const std::vector<StmtPtr>& statements) {
+    program = &statements;
+    collectFunctions(statements);
+
+    main_spec = std::make_unique<Specialization>();
+    main_spec->name = "main";
+    main_spec->return_type = StaticType::INT;
+
+    solve(0);
+    prune();
+    propagateSideEffects();
+    checkMemoFunctions();
+    return error_count == 0;
+}
+
+const std::string* TypeInference::findSourceFile(const FunctionStmt& stmt) const {
+    auto it = source_files.find(&stmt);
+    return it == source_files.end() ? nullptr : &it->second;
+}
+
+const NativeFunction* TypeInference::findNative(const std::string& name) const {
+    auto it = natives.find(name);
+    return it == natives.end() ? nullptr : &it->second;
+}
+
+void TypeInference::addFunctions(const std::vector<StmtPtr>& statements) {
+    program = &statements;
+    collectFunctions(statements);
+}
+
+const Specialization* TypeInference::specialize(const std::string& name,
+                                                const std::vector<StaticType>& params) {
+    auto it = function_stmts.find(name);
+    if (it == function_stmts.end() || it->second->getParams().size() != params.size()) {
+        return nullptr;
+    }
+
+    size_t first = specializations.size();
+    Specialization* spec = getSpecialization(*it->second, params);
+    entry_points.insert(spec);
+
+    size_t errors_before = error_count;
+    solve(first);
+    prune();
+    propagateSideEffects();
+    checkMemoFunctions();
+    return error_count == errors_before ? spec : nullptr;
+}
+
+bool TypeInference::addExports(const std::vector<ExportedFunction>& exports) {
+    bool ok = true;
+    for (const ExportedFunction& exported : exports) {
+        size_t errors_before = error_count;
+        if (specialize(exported.name, exported.params)) {
+            continue;
+        }
+        if (error_count == errors_before) {
+            diagnostics.report(DiagnosticSeverity::ERROR,
+                               "No function " + describeExport(exported) + " to export",
+                               SourceLocation(filename));
+            error_count++;
+        }
+        ok = false;
+    }
+    return ok;
+}
+
+void TypeInference::collectFunctions(const std::vector<StmtPtr>& statements) {
+    for (const auto& stmt : statements) {
+        if (auto* func = dynamic_cast<FunctionStmt*>(stmt.get())) {
+            const Token& name = func->getName();
+            if (!function_stmts.emplace(name.lexeme, func).second) {
+                error(name, "Redefinition of function: " + name.lexeme);
+            }
+            collectFunctions(func->getBody());
+        }
+        else if (auto* block = dynamic_cast<BlockStmt*>(stmt.get())) {
+            collectFunctions(block->getStatements());
+        }
+        else if (auto* if_stmt = dynamic_cast<IfStmt*>(stmt.get())) {
+            collectFunctions({if_stmt->getThenBranch(), if_stmt->getElseBranch()});
+        }
+        else if (auto* while_stmt = dynamic_cast<WhileStmt*>(stmt.get())) {
+            collectFunctions({while_stmt->getBody()});
+        }
+        else if (auto* for_stmt = dynamic_cast<ForStmt*>(stmt.get())) {
+            collectFunctions({for_stmt->getBody()});
+        }
+    }
+}
+
+Specialization* TypeInference::getSpecialization(const FunctionStmt& stmt,
+                                                 const std::vector<StaticType>& params) {
+    std::string name = mangle(stmt.getName().lexeme, params);
+    auto it = by_name.find(name);
+    if (it != by_name.end()) {
+        return it->second;
+    }
+
+    auto spec = std::make_unique<Specialization>();
+    spec->stmt = &stmt;
+    spec->name = name;
+    spec->param_types = params;
+    spec->param_slots = params;
+
+    Specialization* ptr = spec.get();
+    by_name[name] = ptr;
+    specializations.push_back(std::move(spec));
+    changed = true;
+    return ptr;
+}
+
+void TypeInference::solve(size_t first) {
+    // Types only ever widen, so iterating until nothing changes terminates
+    for (bool final_pass : {false, true}) {
+        finalizing = final_pass;
+        do {
+            changed = false;
+            if (first == 0 && main_spec) {
+                analyzeBody(*main_spec);
+            }
+            for (size_t i = first; i < specializations.size(); ++i) {
+                analyzeBody(*specializations[i]);
+            }
+        } while (changed);
+    }
+    finalizing = false;
+
+    // Whatever is still unknown never received a value; default to int
+    auto settle = [](Specialization& spec) {
+        if (spec.return_type == StaticType::UNKNOWN) {
+            spec.return_type = StaticType::INT;
+        }
+        for (auto& slot : spec.param_slots) {
+            if (slot == StaticType::UNKNOWN) {
+                slot = StaticType::INT;
+            }
+        }
+        for (auto& local : spec.locals) {
+            if (local.second == StaticType::UNKNOWN) {
+                local.second = StaticType::INT;
+            }
+        }
+    };
+    if (first == 0 && main_spec) {
+        settle(*main_spec);
+    }
+    for (size_t i = first; i < specializations.size(); ++i) {
+        settle(*specializations[i]);
+    }
+}
+
+void TypeInference::prune() {
+    // Intermediate iterations may have created specializations for argument
+    // types that later widened; drop those no call site ended up using
+    std::unordered_set<const Specialization*> reachable;
+    std::vector<const Specialization*> worklist;
+
+    auto visit = [&](const Specialization* spec) {
+        if (reachable.insert(spec).second) {
+            worklist.push_back(spec);
+        }
+    };
+
+    if (main_spec) {
+        visit(main_spec.get());
+    }
+    for (const Specialization* spec : entry_points) {
+        visit(spec);
+    }
+    while (!worklist.empty()) {
+        const Specialization* spec = worklist.back();
+        worklist.pop_back();
+        for (const auto& call : spec->calls) {
+            visit(call.second);
+        }
+    }
+
+    std::vector<std::unique_ptr<Specialization>> kept;
+    for (auto& spec : specializations) {
+        if (reachable.count(spec.get())) {
+            kept.push_back(std::move(spec));
+        } else {
+            by_name.erase(spec->name);
+        }
+    }
+    specializations = std::move(kept);
+}
+
+void TypeInference::propagateSideEffects() {
+    // Calls between pure functions, recursive or not, keep them pure; a side
+    // effect spreads to every caller until nothing changes
+    bool spread = true;
+    while (spread) {
+        spread = false;
+        for (const auto& spec : specializations) {
+            if (!spec->side_effect.empty()) {
+                continue;
+            }
+            for (const auto& call : spec->calls) {
+                const Specialization& callee = *call.second;
+                if (!callee.side_effect.empty()) {
+                    spec->side_effect = "calls '" + callee.stmt->getName().lexeme + "', which " +
+                                        callee.side_effect;
+                    spread = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void TypeInference::checkMemoFunctions() {
+    for (const auto& spec : specializations) {
+        std::string reason;
+        if (spec->stmt->isMemo() && !canMemoize(*spec, &reason)) {
+            error(spec->stmt->getName(), "Can't memoize '" + spec->stmt->getName().lexeme + "': " + reason);
+        }
+    }
+}
+
+void TypeInference::analyzeBody(Specialization& spec) {
+    current = &spec;
+    bindings.clear();
+    scope_marks.clear();
+    spec.stores_arrays = false;
+    spec.passes_arrays = false;
+    spec.side_effect.clear();
+
+    if (spec.stmt) {
+        const auto& params = spec.stmt->getParams();
+        for (size_t i = 0; i < params.size(); ++i) {
+            bindings.push_back({params[i].lexeme, &spec.param_slots[i]});
+        }
+        for (const auto& stmt : spec.stmt->getBody()) {
+            analyze(stmt);
+        }
+    } else {
+        for (const auto& stmt : *program) {
+            if (stmt && !dynamic_cast<FunctionStmt*>(stmt.get())) {
+                analyze(stmt);
+            }
+        }
+    }
+
+    current = nullptr;
+}
+
+StaticType TypeInference::infer(const ExprPtr& expr) {
+    result = StaticType::UNKNOWN;
+    if (expr) {
+        expr->accept(*this);
+    }
+    return result;
+}
+
+void TypeInference::analyze(const StmtPtr& stmt) {
+    if (stmt) {
+        stmt->accept(*this);
+    }
+}
+
+StaticType* TypeInference::lookup(const std::string& name) {
+    for (auto it = bindings.rbegin(); it != bindings.rend(); ++it) {
+        if (it->name == name) {
+            return it->slot;
+        }
+    }
+    return nullptr;
+}
+
+StaticType TypeInference::inferArray(const ExprPtr& expr, const Token& at) {
+    StaticType type = infer(expr);
+    if (type != StaticType::UNKNOWN && !isArrayType(type)) {
+        error(at, std::string("Expected an array but got ") + staticTypeName(type));
+        return StaticType::UNKNOWN;
+    }
+    return type;
+}
+
+void TypeInference::expectInt(const ExprPtr& expr, const Token& at, const char* what) {
+    StaticType type = infer(expr);
+    if (type != StaticType::UNKNOWN && type != StaticType::INT) {
+        error(at, std::string(what) + " must be an int, not " + staticTypeName(type));
+    }
+}
+
+void TypeInference::sideEffect(const std::string& what) {
+    if (current->side_effect.empty()) {
+        current->side_effect = what;
+    }
+}
+
+void TypeInference::widen(StaticType& slot, StaticType type, const Token& at) {
+    if (type == StaticType::UNKNOWN) {
+        return;
+    }
+    if (type == StaticType::VOID) {
+        error(at, "Expression does not produce a value");
+        return;
+    }
+
+    bool ok = true;
+    StaticType joined = joinTypes(slot, type, ok);
+    if (!ok) {
+        error(at, std::string("Conflicting types for '") + at.lexeme + "': " +
+                  staticTypeName(slot) + " and " + staticTypeName(type));
+        return;
+    }
+
+    if (joined != slot) {
+        slot = joined;
+        changed = true;
+    }
+}
+
+void TypeInference::enterScope() {
+    scope_marks.push_back(bindings.size());
+}
+
+void TypeInference::exitScope() {
+    bindings.resize(scope_marks.back());
+    scope_marks.pop_back();
+}
+
+void TypeInference::error(const Token& at, const std::string& message) {
+    error_count++;
+    const std::string* file = current && current->stmt ? findSourceFile(*current->stmt) : nullptr;
+    if (!file) {
+        file = &filename;
+    }
+    if (!reported.insert({*file, at.line, at.column}).second) {
+        return;
+    }
+
+    diagnostics.report(
+        DiagnosticSeverity::ERROR,
+        message,
+        SourceLocation(*file, at.line, at.column)
+    );
+}
+
+// Expression visitors
+void TypeInference::visitLiteralExpr(LiteralExpr& expr) {
+    const auto& value = expr.getValue();
+
+    if (std::holds_alternative<int>(value)) {
+        result = StaticType::INT;
+    }
+    else if (std::holds_alternative<double>(value)) {
+        result = StaticType::DOUBLE;
+    }
+    else if (std::holds_alternative<bool>(value)) {
+        result = StaticType::BOOL;
+    }
+    else {
+        // Strings and nil are both pointers in compiled code
+        result = StaticType::STRING;
+    }
+}
+
+void TypeInference::visitUnaryExpr(UnaryExpr& expr) {
+    StaticType operand = infer(expr.getRight());
+
+    if (expr.getOperator().type == TokenType::MINUS) {
+        if (isArrayType(operand) || isTaskType(operand) || operand == StaticType::STRING) {
+            error(expr.getOperator(), "Invalid operand type for unary minus");
+            operand = StaticType::UNKNOWN;
+        }
+        else if (operand == StaticType::BOOL) {
+            // Bools are not numbers, as in the interpreter and the VM
+            error(expr.getOperator(), "Invalid operand type for unary minus");
+            operand = StaticType::UNKNOWN;
+        }
+        result = operand;
+    } else {
+        result = StaticType::BOOL;
+    }
+}
+
+void TypeInference::visitBinaryExpr(BinaryExpr& expr) {
+    StaticType left = infer(expr.getLeft());
+    StaticType right = infer(expr.getRight());
+    TokenType op = expr.getOperator().type;
+
+    // Arrays and tasks only take part in logical operators, where they are truthy
+    if (op != TokenType::AND && op != TokenType::OR &&
+        (isArrayType(left) || isArrayType(right) || isTaskType(left) || isTaskType(right))) {
+        error(expr.getOperator(), "Invalid operands for binary operation");
+        result = StaticType::UNKNOWN;
+        return;
+    }
+
+    // Compiled code concatenates strings with anything printable and compares
+    // two strings for equality; nothing else takes a string
+    if (left == StaticType::STRING || right == StaticType::STRING) {
+        bool concat = op == TokenType::PLUS && left != StaticType::VOID && right != StaticType::VOID;
+        bool equality = (op == TokenType::EQUAL_EQUAL || op == TokenType::BANG_EQUAL) &&
+                        (left == right || left == StaticType::UNKNOWN || right == StaticType::UNKNOWN);
+        if (!concat && !equality) {
+            error(expr.getOperator(), "Operator '" + expr.getOperator().lexeme + "' cannot take " +
+                  staticTypeName(left) + " and " + staticTypeName(right) + " operands");
+            result = StaticType::UNKNOWN;
+            return;
+        }
+        result = concat ? StaticType::STRING : StaticType::BOOL;
+        return;
+    }
+
+    // Bools are not numbers: they are only compared for equality
+    if ((left == StaticType::BOOL || right == StaticType::BOOL) &&
+        op != TokenType::AND && op != TokenType::OR &&
+        op != TokenType::EQUAL_EQUAL && op != TokenType::BANG_EQUAL) {
+        error(expr.getOperator(), "Invalid operands for binary operation");
+        result = StaticType::UNKNOWN;
+        return;
+    }
+
+    switch (op) {
+        case TokenType::AND:
+        case TokenType::OR:
+        case TokenType::EQUAL_EQUAL:
+        case TokenType::BANG_EQUAL:
+        case TokenType::LESS:
+        case TokenType::LESS_EQUAL:
+        case TokenType::GREATER:
+        case TokenType::GREATER_EQUAL:
+            result = StaticType::BOOL;
+            return;
+        default:
+            break;
+    }
+
+    if (left == StaticType::UNKNOWN || right == StaticType::UNKNOWN) {
+        result = StaticType::UNKNOWN;
+    }
+    else if (left == StaticType::DOUBLE || right == StaticType::DOUBLE) {
+        result = StaticType::DOUBLE;
+    }
+    else {
+        result = StaticType::INT;
+    }
+}
+
+void TypeInference::visitGroupingExpr(GroupingExpr& expr) {
+    result = infer(expr.getExpression());
+}
+
+void TypeInference::visitVariableExpr(VariableExpr& expr) {
+    StaticType* slot = lookup(expr.getName().lexeme);
+    if (!slot) {
+        // Functions can't see globals, so a global read inside one lands here too
+        error(expr.getName(), "Unknown variable name: " + expr.getName().lexeme);
+        result = StaticType::UNKNOWN;
+        return;
+    }
+    result = *slot;
+
+    if (result == StaticType::UNKNOWN && finalizing) {
+        result = StaticType::INT;
+    }
+}
+
+void TypeInference::visitAssignExpr(AssignExpr& expr) {
+    StaticType value = infer(expr.getValue());
+
+    StaticType* slot = lookup(expr.getName().lexeme);
+    if (!slot) {
+        error(expr.getName(), "Unknown variable name: " + expr.getName().lexeme);
+        result = value;
+        return;
+    }
+
+    widen(*slot, value, expr.getName());
+    result = *slot;
+}
+
+void TypeInference::visitCallExpr(CallExpr& expr) {
+    std::vector<StaticType> args;
+    args.reserve(expr.getArguments().size());
+    for (const auto& arg : expr.getArguments()) {
+        args.push_back(infer(arg));
+    }
+
+    result = StaticType::UNKNOWN;
+
+    auto* var_expr = dynamic_cast<VariableExpr*>(expr.getCallee().get());
+    if (!var_expr) {
+        return;
+    }
+
+    const std::string& name = var_expr->getName().lexeme;
+    auto it = function_stmts.find(name);
+    if (it == function_stmts.end()) {
+        if (const NativeFunction* native = findNative(name)) {
+            checkNativeCall(expr, *native, args);
+            result = native->return_type;
+            sideEffect("calls host function '" + name + "'");
+        }
+        else if (name == "print") {
+            sideEffect("prints");
+            if (args.size() == 1 && isTaskType(args[0])) {
+                error(expr.getParen(), "Cannot print a task; join it first");
+            }
+            result = StaticType::VOID;
+        }
+        else if (name == "len") {
+            if (args.size() != 1) {
+                error(expr.getParen(), "len expects exactly one argument");
+            } else if (args[0] != StaticType::UNKNOWN && !isArrayType(args[0])) {
+                error(expr.getParen(), std::string("Expected an array but got ") +
+                      staticTypeName(args[0]));
+            }
+            result = StaticType::INT;
+        }
+        else if (name == "join") {
+            result = StaticType::UNKNOWN;
+            sideEffect("joins a task");
+            if (args.size() != 1) {
+                error(expr.getParen(), "join expects exactly one argument");
+            } else if (isTaskType(args[0])) {
+                result = taskResultType(args[0]);
+                current->joins[&expr] = result;
+            } else if (args[0] != StaticType::UNKNOWN) {
+                error(expr.getParen(), std::string("Expected a task but got ") +
+                      staticTypeName(args[0]));
+            }
+        }
+        return;
+    }
+
+    const FunctionStmt& callee = *it->second;
+    if (args.size() != callee.getParams().size()) {
+        error(expr.getParen(), "Expected " + std::to_string(callee.getParams().size()) +
+              " arguments but got " + std::to_string(args.size()));
+        return;
+    }
+
+    for (StaticType& type : args) {
+        if (isArrayType(type)) {
+            current->passes_arrays = true;
+        }
+        if (type == StaticType::VOID) {
+            error(expr.getParen(), "Expression does not produce a value");
+            return;
+        }
+        if (type == StaticType::UNKNOWN) {
+            // Wait for the argument types to settle before specializing
+            if (!finalizing) {
+                return;
+            }
+            type = StaticType::INT;
+        }
+    }
+
+    const Specialization* target = getSpecialization(callee, args);
+    current->calls[&expr] = target;
+
+    result = target->return_type;
+    if (result == StaticType::UNKNOWN && finalizing) {
+        result = StaticType::INT;
+    }
+}
+
+void TypeInference::checkNativeCall(const CallExpr& expr, const NativeFunction& native,
+                                    const std::vector<StaticType>& args) {
+    if (args.size() != native.param_types.size()) {
+        error(expr.getParen(), "Expected " + std::to_string(native.param_types.size()) +
+              " arguments but got " + std::to_string(args.size()));
+        return;
+    }
+
+    // Ints widen to double parameters; nothing else converts
+    for (size_t i = 0; i < args.size(); ++i) {
+        StaticType param = native.param_types[i];
+        if (args[i] == StaticType::UNKNOWN || args[i] == param ||
+            (args[i] == StaticType::INT && param == StaticType::DOUBLE)) {
+            continue;
+        }
+        error(expr.getParen(), "Argument " + std::to_string(i + 1) + " of " + native.name +
+              " must be " + staticTypeName(param) + ", not " + staticTypeName(args[i]));
+    }
+}
+
+void TypeInference::visitArrayExpr(ArrayExpr& expr) {
+    const Token& at = expr.getBracket();
+    result = StaticType::UNKNOWN;
+
+    if (expr.getElements().empty()) {
+        error(at, "Empty array literal has no element type");
+        return;
+    }
+    if (expr.getCount()) {
+        expectInt(expr.getCount(), at, "Array length");
+    }
+
+    // Ints are widened to double if any element is a double
+    StaticType element = StaticType::UNKNOWN;
+    bool known = true;
+    for (const auto& value : expr.getElements()) {
+        StaticType type = infer(value);
+        if (type == StaticType::UNKNOWN) {
+            known = false;
+        } else if (type != StaticType::INT && type != StaticType::DOUBLE) {
+            error(at, std::string("Array elements must be numbers, not ") + staticTypeName(type));
+            result = StaticType::UNKNOWN;
+            return;
+        } else if (element != StaticType::DOUBLE) {
+            element = type;
+        }
+    }
+
+    if (element == StaticType::DOUBLE) {
+        result = StaticType::DOUBLE_ARRAY;
+    } else if (known || finalizing) {
+        result = StaticType::INT_ARRAY;
+    } else {
+        result = StaticType::UNKNOWN;
+    }
+}
+
+void TypeInference::visitIndexExpr(IndexExpr& expr) {
+    StaticType array = inferArray(expr.getArray(), expr.getBracket());
+    expectInt(expr.getIndex(), expr.getBracket(), "Array index");
+
+    if (array != StaticType::UNKNOWN) {
+        result = elementType(array);
+    } else {
+        result = finalizing ? StaticType::INT : StaticType::UNKNOWN;
+    }
+}
+
+void TypeInference::visitIndexAssignExpr(IndexAssignExpr& expr) {
+    StaticType value = infer(expr.getValue());
+    StaticType array = inferArray(expr.getArray(), expr.getBracket());
+    expectInt(expr.getIndex(), expr.getBracket(), "Array index");
+    current->stores_arrays = true;
+
+    result = StaticType::UNKNOWN;
+    if (array == StaticType::UNKNOWN) {
+        return;
+    }
+
+    StaticType element = elementType(array);
+    bool ok = value == StaticType::UNKNOWN || value == StaticType::BOOL ||
+              value == StaticType::INT || (value == StaticType::DOUBLE && element == StaticType::DOUBLE);
+    if (!ok) {
+        error(expr.getBracket(), std::string("Cannot store ") + staticTypeName(value) +
+              " in " + staticTypeName(array));
+        return;
+    }
+    result = element;
+}
+
+void TypeInference::visitSliceExpr(SliceExpr& expr) {
+    StaticType array = inferArray(expr.getArray(), expr.getBracket());
+
+    if (expr.getStart()) {
+        expectInt(expr.getStart(), expr.getBracket(), "Slice start");
+    }
+    if (expr.getEnd()) {
+        expectInt(expr.getEnd(), expr.getBracket(), "Slice end");
+    }
+    result = array;
+}
+
+void TypeInference::visitSpawnExpr(SpawnExpr& expr) {
+    CallExpr& call = *expr.getCall();
+    StaticType value = infer(expr.getCall());
+    uses_tasks = true;
+    sideEffect("spawns a task");
+
+    auto* callee = dynamic_cast<VariableExpr*>(call.getCallee().get());
+    if (!callee || !function_stmts.count(callee->getName().lexeme)) {
+        error(expr.getKeyword(), "spawn needs a call to a script function");
+        result = StaticType::UNKNOWN;
+        return;
+    }
+
+    result = taskType(value);
+    if (value != StaticType::UNKNOWN && result == StaticType::UNKNOWN) {
+        error(expr.getKeyword(), std::string("A task cannot return ") + staticTypeName(value));
+    }
+}
+
+// Statement visitors
+void TypeInference::visitExpressionStmt(ExpressionStmt& stmt) {
+    infer(stmt.getExpression());
+}
+
+void TypeInference::visitVarDeclStmt(VarDeclStmt& stmt) {
+    StaticType init = infer(stmt.getInitializer());
+
+    StaticType& slot = current->locals[&stmt];
+    widen(slot, init, stmt.getName());
+    bindings.push_back({stmt.getName().lexeme, &slot});
+}
+
+void TypeInference::visitBlockStmt(BlockStmt& stmt) {
+    enterScope();
+    for (const auto& s : stmt.getStatements()) {
+        analyze(s);
+    }
+    exitScope();
+}
+
+void TypeInference::visitIfStmt(IfStmt& stmt) {
+    infer(stmt.getCondition());
+    analyze(stmt.getThenBranch());
+    analyze(stmt.getElseBranch());
+}
+
+void TypeInference::visitWhileStmt(WhileStmt& stmt) {
+    infer(stmt.getCondition());
+    analyze(stmt.getBody());
+}
+
+void TypeInference::visitForStmt(ForStmt& stmt) {
+    enterScope();
+    analyze(stmt.getInitializer());
+    if (stmt.isParallel()) {
+        StaticType start = current->locals[&stmt.getVariable()];
+        if (start != StaticType::UNKNOWN && start != StaticType::INT) {
+            error(stmt.getKeyword(), std::string("Start of a parallel for must be an int, not ") +
+                  staticTypeName(start));
+        }
+        expectInt(stmt.getLimit(), stmt.getKeyword(), "End of a parallel for");
+
+        // The body runs on other threads with whatever arrays it uses
+        current->passes_arrays = true;
+    } else {
+        infer(stmt.getCondition());
+    }
+    infer(stmt.getIncrement());
+    analyze(stmt.getBody());
+    exitScope();
+}
+
+void TypeInference::visitBreakStmt(BreakStmt&) {}
+
+void TypeInference::visitContinueStmt(ContinueStmt&) {}
+
+void TypeInference::visitFunctionStmt(FunctionStmt&) {
+    // Nested functions are analyzed per specialization, like top-level ones
+}
+
+void TypeInference::visitReturnStmt(ReturnStmt& stmt) {
+    if (!stmt.getValue()) {
+        return;
+    }
+
+    StaticType value = infer(stmt.getValue());
+    if (current->stmt) {
+        widen(current->return_type, value, stmt.getKeyword());
+    }
+}
+
+} // namespace mana
@@ -0,0 +1,341 @@
+#ifndef MANASCRIPT_TYPE_INFERENCE_HPP
+#define MANASCRIPT_TYPE_INFERENCE_HPP
+
+#include "ast.hpp"
+#include "error.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Static type of an expression, variable or function result
+ */
+enum class StaticType : uint8_t {
+    UNKNOWN,    // Not inferred yet
+    BOOL,
+    INT,
+    DOUBLE,
+    STRING,     // Also the type of nil
+    INT_ARRAY,
+    DOUBLE_ARRAY,
+    VOID,       // Result of calls to built-ins like print
+
+    // Handles returned by spawn, one per result type
+    TASK_BOOL,
+    TASK_INT,
+    TASK_DOUBLE,
+    TASK_STRING,
+    TASK_INT_ARRAY,
+    TASK_DOUBLE_ARRAY
+};
+
+/**
+ * @brief Short type name used in specialization names (e.g. "i32", "af64")
+ */
+const char* staticTypeSuffix(StaticType type);
+
+/**
+ * @brief Type name used in diagnostics (e.g. "int", "[double]")
+ */
+const char* staticTypeName(StaticType type);
+
+/**
+ * @brief A function the host calls with parameter types of its choosing
+ */
+struct ExportedFunction {
+    std::string name;
+    std::vector<StaticType> params;
+};
+
+/**
+ * @brief Parse a signature such as "scale([double], double)", with the type
+ * names of staticTypeName()
+ * @return False if `text` is not a name followed by parenthesized types
+ */
+bool parseExport(const std::string& text, ExportedFunction& exported);
+
+/**
+ * @brief The signature as parseExport() reads it
+ */
+std::string describeExport(const ExportedFunction& exported);
+
+inline bool isArrayType(StaticType type) {
+    return type == StaticType::INT_ARRAY || type == StaticType::DOUBLE_ARRAY;
+}
+
+/**
+ * @brief Element type of an array type
+ */
+inline StaticType elementType(StaticType array) {
+    return array == StaticType::DOUBLE_ARRAY ? StaticType::DOUBLE : StaticType::INT;
+}
+
+inline bool isTaskType(StaticType type) {
+    return type >= StaticType::TASK_BOOL && type <= StaticType::TASK_DOUBLE_ARRAY;
+}
+
+/**
+ * @brief Type of a task whose call returns `result`; UNKNOWN if there is none
+ */
+inline StaticType taskType(StaticType result) {
+    if (result < StaticType::BOOL || result > StaticType::DOUBLE_ARRAY) {
+        return StaticType::UNKNOWN;
+    }
+    return static_cast<StaticType>(static_cast<int>(StaticType::TASK_BOOL) +
+                                   static_cast<int>(result) - static_cast<int>(StaticType::BOOL));
+}
+
+/**
+ * @brief Result type of a task type, what join() returns
+ */
+inline StaticType taskResultType(StaticType task) {
+    return static_cast<StaticType>(static_cast<int>(StaticType::BOOL) +
+                                   static_cast<int>(task) - static_cast<int>(StaticType::TASK_BOOL));
+}
+
+/**
+ * @brief Smallest type both types convert to without loss
+ * @param ok Set to false if the types are incompatible
+ */
+StaticType joinTypes(StaticType a, StaticType b, bool& ok);
+
+/**
+ * @brief One monomorphized instance of a function
+ *
+ * A specialization exists for every distinct signature a function is called
+ * with. Its body is compiled on native types: the types of locals, parameters
+ * and calls are resolved here and read by the code generator.
+ */
+struct Specialization {
+    const FunctionStmt* stmt = nullptr;     // Null for the synthesized main
+    std::string name;                       // Mangled, e.g. "add$i32$i32"
+    std::vector<StaticType> param_types;    // Signature seen by callers
+    StaticType return_type = StaticType::UNKNOWN;
+
+    // Types of the parameter variables; wider than param_types if a
+    // parameter is later assigned a wider value
+    std::vector<StaticType> param_slots;
+    std::unordered_map<const VarDeclStmt*, StaticType> locals;
+
+    // Target of every call to a user function in the body
+    std::unordered_map<const CallExpr*, const Specialization*> calls;
+
+    // Result type of every join in the body
+    std::unordered_map<const CallExpr*, StaticType> joins;
+
+    // Whether the body stores into arrays or passes arrays to user functions;
+    // when neither, array parameters can't be written while the body runs
+    bool stores_arrays = false;
+    bool passes_arrays = false;
+
+    // First side effect of the body or of a callee, e.g. "prints" or
+    // "calls 'log', which prints"; empty when the function is pure
+    std::string side_effect;
+};
+
+/**
+ * @brief Whether calls to a specialization can return cached results
+ *
+ * It must be pure and take and return only numbers and bools.
+ * @param reason Set to why not, when it can't
+ */
+bool canMemoize(const Specialization& spec, std::string* reason = nullptr);
+
+/**
+ * @brief A function supplied by the host program (see Engine::registerFunction)
+ *
+ * Scripts call it like a built-in; script functions of the same name take
+ * precedence. Arguments convert the way they do for script functions.
+ */
+struct NativeFunction {
+    std::string name;
+    std::vector<StaticType> param_types;
+    StaticType return_type = StaticType::VOID;
+};
+
+/**
+ * @brief Whole-program type inference with function specialization
+ *
+ * Types flow from literals and call sites: each function is analyzed once per
+ * argument signature, and locals take the join of every value assigned to
+ * them. Recursive functions are solved by iterating to a fixed point.
+ */
+class TypeInference : public AstVisitor {
+public:
+    explicit TypeInference(std::string filename = "");
+
+    /**
+     * @brief Infer types for the top-level statements and every function they reach
+     * @return False if a type error was reported
+     */
+    bool analyze(const std::vector<StmtPtr>& statements);
+
+    /**
+     * @brief Make the program's functions known without analyzing the top level
+     *
+     * For engines that only compile selected functions through specialize().
+     */
+    void addFunctions(const std::vector<StmtPtr>& statements);
+
+    /**
+     * @brief Specialize a function for a signature not seen in the program
+     *
+     * Used by callers that enter compiled code directly. analyze() or
+     * addFunctions() must have run first so that the program's functions are known.
+     * @return The specialization, or nullptr if the function can't be typed
+     */
+    const Specialization* specialize(const std::string& name, const std::vector<StaticType>& params);
+
+    /**
+     * @brief Specialize every exported function after analyze()
+     *
+     * The program need not call them; they are compiled for the host all the same.
+     * @return False if an export names no function or its body has type errors
+     */
+    bool addExports(const std::vector<ExportedFunction>& exports);
+
+    /**
+     * @brief Make a host function callable from the program; call before analyze()
+     */
+    void addNative(const NativeFunction& native) { natives[native.name] = native; }
+
+    /**
+     * @brief Host function called `name`, or nullptr
+     */
+    const NativeFunction* findNative(const std::string& name) const;
+
+    /**
+     * @brief Record that a function was declared in another file than the program's
+     *
+     * Errors in its body are reported against that file.
+     */
+    void setSourceFile(const FunctionStmt& stmt, const std::string& file) { source_files[&stmt] = file; }
+
+    /**
+     * @brief File recorded with setSourceFile(), or nullptr for the program's own file
+     */
+    const std::string* findSourceFile(const FunctionStmt& stmt) const;
+
+    /**
+     * @brief Specialization of the top-level statements
+     */
+    const Specialization& getMain() const { return *main_spec; }
+
+    /**
+     * @brief Function specializations in the order they were discovered
+     */
+    const std::vector<std::unique_ptr<Specialization>>& getSpecializations() const {
+        return specializations;
+    }
+
+    /**
+     * @brief Build the symbol name of a specialization
+     */
+    static std::string mangle(const std::string& name, const std::vector<StaticType>& params);
+
+    /**
+     * @brief Whether the program spawns tasks, so main must wait for them before it returns
+     */
+    bool usesTasks() const { return uses_tasks; }
+
+    // Expression visitors
+    void visitLiteralExpr(LiteralExpr& expr) override;
+    void visitUnaryExpr(UnaryExpr& expr) override;
+    void visitBinaryExpr(BinaryExpr& expr) override;
+    void visitGroupingExpr(GroupingExpr& expr) override;
+    void visitVariableExpr(VariableExpr& expr) override;
+    void visitAssignExpr(AssignExpr& expr) override;
+    void visitCallExpr(CallExpr& expr) override;
+    void visitArrayExpr(ArrayExpr& expr) override;
+    void visitIndexExpr(IndexExpr& expr) override;
+    void visitIndexAssignExpr(IndexAssignExpr& expr) override;
+    void visitSliceExpr(SliceExpr& expr) override;
+    void visitSpawnExpr(SpawnExpr& expr) override;
+
+    // Statement visitors
+    void visitExpressionStmt(ExpressionStmt& stmt) override;
+    void visitVarDeclStmt(VarDeclStmt& stmt) override;
+    void visitBlockStmt(BlockStmt& stmt) override;
+    void visitIfStmt(IfStmt& stmt) override;
+    void visitWhileStmt(WhileStmt& stmt) override;
+    void visitForStmt(ForStmt& stmt) override;
+    void visitBreakStmt(BreakStmt& stmt) override;
+    void visitContinueStmt(ContinueStmt& stmt) override;
+    void visitFunctionStmt(FunctionStmt& stmt) override;
+    void visitReturnStmt(ReturnStmt& stmt) override;
+
+private:
+    struct Binding {
+        std::string name;
+        StaticType* slot;
+    };
+
+    std::string filename;
+    const std::vector<StmtPtr>* program = nullptr;
+    std::unordered_map<const FunctionStmt*, std::string> source_files;
+
+    std::unordered_map<std::string, const FunctionStmt*> function_stmts;
+    std::unordered_map<std::string, NativeFunction> natives;
+    std::vector<std::unique_ptr<Specialization>> specializations;
+    std::unordered_map<std::string, Specialization*> by_name;
+    std::unique_ptr<Specialization> main_spec;
+
+    // Specializations requested through specialize(); kept even if unused
+    std::unordered_set<const Specialization*> entry_points;
+
+    // State of the body being analyzed
+    Specialization* current = nullptr;
+    std::vector<Binding> bindings;
+    std::vector<size_t> scope_marks;
+    StaticType result = StaticType::UNKNOWN;
+
+    // Set whenever a type widens or a specialization is added
+    bool changed = false;
+
+    bool uses_tasks = false;
+
+    // Once the fixed point is reached, types still unknown default to int
+    bool finalizing = false;
+
+    // Positions already reported, so iterations don't repeat errors
+    std::set<std::tuple<std::string, int, int>> reported;
+    size_t error_count = 0;
+
+    void collectFunctions(const std::vector<StmtPtr>& statements);
+    Specialization* getSpecialization(const FunctionStmt& stmt, const std::vector<StaticType>& params);
+
+    void solve(size_t first);
+    void prune();
+    void propagateSideEffects();
+    void checkMemoFunctions();
+    void analyzeBody(Specialization& spec);
+
+    StaticType infer(const ExprPtr& expr);
+    void analyze(const StmtPtr& stmt);
+
+    StaticType* lookup(const std::string& name);
+    StaticType inferArray(const ExprPtr& expr, const Token& at);
+    void expectInt(const ExprPtr& expr, const Token& at, const char* what);
+    void checkNativeCall(const CallExpr& expr, const NativeFunction& native,
+                         const std::vector<StaticType>& args);
+    void widen(StaticType& slot, StaticType type, const Token& at);
+    void sideEffect(const std::string& what);
+
+    void enterScope();
+    void exitScope();
+
+    void error(const Token& at, const std::string& message);
+};
+
+} // namespace mana
+
+#endif // MANASCRIPT_TYPE_INFERENCE_HPP
@@ -0,0 +1,241 @@
+#ifndef MANASCRIPT_VALUE_HPP
+#define MANASCRIPT_VALUE_HPP
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace mana {
+
+/**
+ * @brief Contiguous array of ints or doubles
+ *
+ * A pointer and a length, like arrays in compiled code. Slices point into the
+ * storage of the array they were taken from. Storage and headers are owned by
+ * the executing engine for the whole run.
+ */
+struct Array {
+    enum class Element : uint8_t {
+        INT,
+        DOUBLE
+    };
+
+    Element element;
+    int32_t length;
+    void* data;
+
+    int32_t* ints() const { return static_cast<int32_t*>(data); }
+    double* doubles() const { return static_cast<double*>(data); }
+};
+
+/**
+ * @brief Runtime value used by the interpreter and the VM
+ *
+ * NaN-boxed into 64 bits. A double is stored as itself. Every other value is
+ * a negative quiet NaN with bit 50 set, which no double is once such NaNs are
+ * made canonical: the top 14 bits are set, bits 47-49 hold the type and the
+ * low 47 bits hold an int, a bool or a pointer. Strings are not owned: they
+ * point into storage kept alive by the executing engine for the whole run.
+ */
+class Value {
+public:
+    enum class Type : uint8_t {
+        NIL,
+        BOOL,
+        INT,
+        DOUBLE,
+        STRING,
+        ARRAY,
+        TASK
+    };
+
+    Value() : bits(box(NIL_TAG, 0)) {}
+
+    static Value nil() { return Value(); }
+    static Value fromBool(bool b) { return Value(box(BOOL_TAG, b ? 1 : 0)); }
+    static Value fromInt(int32_t i) { return Value(box(INT_TAG, static_cast<uint32_t>(i))); }
+    static Value fromDouble(double d) {
+        uint64_t raw;
+        std::memcpy(&raw, &d, sizeof(raw));
+        return Value((raw & BOX) == BOX ? CANONICAL_NAN : raw);
+    }
+    static Value fromString(const std::string* s) { return Value(box(STRING_TAG, address(s))); }
+    static Value fromArray(const Array* a) { return Value(box(ARRAY_TAG, address(a))); }
+    static Value fromTask(const Value* t) { return Value(box(TASK_TAG, address(t))); }
+
+    Type getType() const {
+        if (isDouble()) {
+            return Type::DOUBLE;
+        }
+        switch (tag()) {
+            case BOOL_TAG:   return Type::BOOL;
+            case INT_TAG:    return Type::INT;
+            case STRING_TAG: return Type::STRING;
+            case ARRAY_TAG:  return Type::ARRAY;
+            case TASK_TAG:   return Type::TASK;
+            default:         return Type::NIL;
+        }
+    }
+    bool isNil() const { return bits == box(NIL_TAG, 0); }
+    bool isBool() const { return (bits >> 47) == (box(BOOL_TAG, 0) >> 47); }
+    bool isInt() const { return (bits >> 47) == (box(INT_TAG, 0) >> 47); }
+    bool isDouble() const { return (bits & BOX) != BOX; }
+    bool isNumber() const { return isInt() || isDouble(); }
+    bool isString() const { return (bits >> 47) == (box(STRING_TAG, 0) >> 47); }
+    bool isArray() const { return (bits >> 47) == (box(ARRAY_TAG, 0) >> 47); }
+    bool isTask() const { return (bits >> 47) == (box(TASK_TAG, 0) >> 47); }
+
+    /**
+     * @brief Whether both values are ints, in one test
+     *
+     * The int tag has every tag bit set, so only two ints keep all of them
+     * through the AND.
+     */
+    static bool bothInt(const Value& a, const Value& b) {
+        return ((a.bits & b.bits) >> 47) == (box(INT_TAG, 0) >> 47);
+    }
+
+    bool asBool() const { return (bits & PAYLOAD) != 0; }
+    int32_t asInt() const { return static_cast<int32_t>(static_cast<uint32_t>(bits)); }
+    double asDouble() const {
+        double d;
+        std::memcpy(&d, &bits, sizeof(d));
+        return d;
+    }
+    const std::string& asString() const { return *reinterpret_cast<const std::string*>(bits & PAYLOAD); }
+    const Array& asArray() const { return *reinterpret_cast<const Array*>(bits & PAYLOAD); }
+    const Value& asTask() const { return *reinterpret_cast<const Value*>(bits & PAYLOAD); }   // The finished call's result
+
+    /**
+     * @brief Numeric value widened to double (ints are converted)
+     */
+    double toDouble() const { return isInt() ? static_cast<double>(asInt()) : asDouble(); }
+
+    /**
+     * @brief Truthiness: nil, false and zero are false
+     */
+    bool isTruthy() const {
+        if (isDouble()) {
+            return asDouble() != 0.0;
+        }
+        switch (tag()) {
+            case NIL_TAG:  return false;
+            case BOOL_TAG: return asBool();
+            case INT_TAG:  return asInt() != 0;
+            default:       return true;
+        }
+    }
+
+    bool operator==(const Value& other) const {
+        if (isNumber() && other.isNumber()) {
+            if (bothInt(*this, other)) {
+                return bits == other.bits;
+            }
+            return toDouble() == other.toDouble();
+        }
+        switch (getType()) {
+            case Type::STRING: return other.isString() && asString() == other.asString();
+            // Arrays compare by identity: the same view of the same storage
+            case Type::ARRAY:  return other.isArray() && asArray().data == other.asArray().data &&
+                                      asArray().length == other.asArray().length;
+            // Nil, bools and tasks are equal when their bits are
+            default:           return bits == other.bits;
+        }
+    }
+
+    bool operator!=(const Value& other) const { return !(*this == other); }
+
+    std::string toString() const {
+        switch (getType()) {
+            case Type::NIL:    return "nil";
+            case Type::BOOL:   return asBool() ? "true" : "false";
+            case Type::INT:    return std::to_string(asInt());
+            case Type::DOUBLE: {
+                // NaN prints without a sign, whichever operation produced it
+                if (asDouble() != asDouble()) {
+                    return "nan";
+                }
+                // Shortest text that reads back as the same double
+                char digits[32];
+                auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), asDouble());
+                return std::string(digits, ec == std::errc() ? end : digits);
+            }
+            case Type::STRING: return asString();
+            case Type::ARRAY: {
+                const Array& array = asArray();
+                std::string s = "[";
+                for (int32_t i = 0; i < array.length; ++i) {
+                    if (i > 0) {
+                        s += ", ";
+                    }
+                    s += array.element == Array::Element::INT
+                        ? fromInt(array.ints()[i]).toString()
+                        : fromDouble(array.doubles()[i]).toString();
+                }
+                return s + "]";
+            }
+            case Type::TASK:   return "<task>";
+        }
+        return "";
+    }
+
+private:
+    // Sign, exponent, quiet bit and bit 50: set in every boxed value, never in a double
+    static constexpr uint64_t BOX = 0xFFFC000000000000ull;
+    static constexpr uint64_t PAYLOAD = 0x00007FFFFFFFFFFFull;
+    static constexpr uint64_t CANONICAL_NAN = 0x7FF8000000000000ull;
+
+    // Stored in bits 47-49; INT_TAG must stay the one with all three bits set
+    static constexpr uint64_t NIL_TAG = 1;
+    static constexpr uint64_t BOOL_TAG = 2;
+    static constexpr uint64_t STRING_TAG = 3;
+    static constexpr uint64_t ARRAY_TAG = 4;
+    static constexpr uint64_t TASK_TAG = 5;
+    static constexpr uint64_t INT_TAG = 7;
+
+    explicit Value(uint64_t bits) : bits(bits) {}
+
+    static constexpr uint64_t box(uint64_t tag, uint64_t payload) { return BOX | (tag << 47) | payload; }
+
+    // User-space addresses fit in the 47-bit payload on x86-64 and AArch64 Linux
+    static uint64_t address(const void* pointer) { return reinterpret_cast<uintptr_t>(pointer); }
+
+    uint64_t tag() const { return (bits >> 47) & 7; }
+
+    uint64_t bits;
+};
+
+static_assert(sizeof(Value) == sizeof(uint64_t), "Value must stay one register wide");
+
+/**
+ * @brief Bytes per element of an array
+ */
+inline size_t elementSize(Array::Element element) {
+    return element == Array::Element::DOUBLE ? sizeof(double) : sizeof(int32_t);
+}
+
+/**
+ * @brief Read element i of an array; the index must be in bounds
+ */
+inline Value loadElement(const Array& array, int32_t i) {
+    return array.element == Array::Element::DOUBLE
+        ? Value::fromDouble(array.doubles()[i])
+        : Value::fromInt(array.ints()[i]);
+}
+
+/**
+ * @brief Write a bool or number to element i of an array, converting it to the element type
+ */
+inline void storeElement(const Array& array, int32_t i, const Value& value) {
+    if (array.element == Array::Element::DOUBLE) {
+        array.doubles()[i] = value.isBool() ? (value.asBool() ? 1.0 : 0.0) : value.toDouble();
+    } else {
+        array.ints()[i] = value.isBool() ? (value.asBool() ? 1 : 0) : value.asInt();
+    }
+}
+
+} // namespace mana
+
+#endif // MANASCRIPT_VALUE_HPP
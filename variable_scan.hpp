@@ -0,0 +1,97 @@
+#ifndef MANASCRIPT_VARIABLE_SCAN_HPP
+#define MANASCRIPT_VARIABLE_SCAN_HPP
+
+#include "static_visitor.hpp"
+
+#include <string>
+#include <unordered_set>
+
+namespace mana {
+
+/**
+ * @brief Collects the names of the variables code reads or assigns
+ *
+ * Names of called functions are variables too. Nested function declarations
+ * are skipped; their bodies are not part of the code scanned.
+ */
+class VariableScan : public StaticVisitor<VariableScan, void> {
+public:
+    std::unordered_set<std::string> names;
+
+    void scan(const ExprPtr& expr) { if (expr) visit(*expr); }
+    void scan(const StmtPtr& stmt) { if (stmt) visit(*stmt); }
+
+    void visitLiteralExpr(LiteralExpr&) {}
+    void visitUnaryExpr(UnaryExpr& expr) { scan(expr.getRight()); }
+    void visitBinaryExpr(BinaryExpr& expr) { scan(expr.getLeft()); scan(expr.getRight()); }
+    void visitGroupingExpr(GroupingExpr& expr) { scan(expr.getExpression()); }
+    void visitVariableExpr(VariableExpr& expr) { names.insert(expr.getName().lexeme); }
+
+    void visitAssignExpr(AssignExpr& expr) {
+        names.insert(expr.getName().lexeme);
+        scan(expr.getValue());
+    }
+
+    void visitCallExpr(CallExpr& expr) {
+        scan(expr.getCallee());
+        for (const auto& arg : expr.getArguments()) {
+            scan(arg);
+        }
+    }
+
+    void visitArrayExpr(ArrayExpr& expr) {
+        for (const auto& element : expr.getElements()) {
+            scan(element);
+        }
+        scan(expr.getCount());
+    }
+
+    void visitIndexExpr(IndexExpr& expr) { scan(expr.getArray()); scan(expr.getIndex()); }
+
+    void visitIndexAssignExpr(IndexAssignExpr& expr) {
+        scan(expr.getArray());
+        scan(expr.getIndex());
+        scan(expr.getValue());
+    }
+
+    void visitSliceExpr(SliceExpr& expr) {
+        scan(expr.getArray());
+        scan(expr.getStart());
+        scan(expr.getEnd());
+    }
+
+    void visitSpawnExpr(SpawnExpr& expr) { visitCallExpr(*expr.getCall()); }
+
+    void visitExpressionStmt(ExpressionStmt& stmt) { scan(stmt.getExpression()); }
+    void visitVarDeclStmt(VarDeclStmt& stmt) { scan(stmt.getInitializer()); }
+
+    void visitBlockStmt(BlockStmt& stmt) {
+        for (const auto& s : stmt.getStatements()) {
+            scan(s);
+        }
+    }
+
+    void visitIfStmt(IfStmt& stmt) {
+        scan(stmt.getCondition());
+        scan(stmt.getThenBranch());
+        scan(stmt.getElseBranch());
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) { scan(stmt.getCondition()); scan(stmt.getBody()); }
+
+    void visitForStmt(ForStmt& stmt) {
+        scan(stmt.getInitializer());
+        scan(stmt.getCondition());
+        scan(stmt.getIncrement());
+        scan(stmt.getBody());
+    }
+
+    void visitBreakStmt(BreakStmt&) {}
+    void visitContinueStmt(ContinueStmt&) {}
+    void visitFunctionStmt(FunctionStmt&) {}
+    void visitReturnStmt(ReturnStmt& stmt) { scan(stmt.getValue()); }
+};
+
+} // namespace mana
+
+#endif // MANASCRIPT_VARIABLE_SCAN_HPP
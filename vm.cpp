@@ -0,0 +1,492 @@
+#include "vm.hpp"
+#include "runtime.hpp"
+
+namespace mana {
+
+namespace {
+
+int32_t wrapInt(int64_t value) {
+    return static_cast<int32_t>(static_cast<uint32_t>(value));
+}
+
+} // namespace
+
+VM::VM(const BytecodeProgram& program, size_t register_slots, size_t max_frames)
+    : program(program), registers(register_slots), max_frames(max_frames) {
+    frames.reserve(max_frames);
+}
+
+void VM::runtimeError(const FunctionProto& proto, const Instruction* pc, const std::string& message) {
+    size_t index = static_cast<size_t>(pc - proto.code.data());
+    int line = index < proto.lines.size() ? proto.lines[index] : 0;
+    int column = index < proto.columns.size() ? proto.columns[index] : 0;
+    
+    diagnostics.report(DiagnosticSeverity::ERROR, message, SourceLocation(proto.file, line, column));
+}
+
+const Array* VM::newArray(Array::Element element, int32_t length) {
+    arrays.push_back(Array{element, length, allocateArrayStorage(length, elementSize(element))});
+    return &arrays.back();
+}
+
+bool VM::arithmetic(OpCode op, Value& dst, const Value& a, const Value& b) {
+    if (op == OpCode::ADD && (a.isString() || b.isString())) {
+        strings.push_back(a.toString() + b.toString());
+        dst = Value::fromString(&strings.back());
+        return true;
+    }
+    
+    if (!a.isNumber() || !b.isNumber()) {
+        return false;
+    }
+    
+    if (Value::bothInt(a, b)) {
+        int64_t x = a.asInt();
+        int64_t y = b.asInt();
+        switch (op) {
+            case OpCode::ADD: dst = Value::fromInt(wrapInt(x + y)); return true;
+            case OpCode::SUB: dst = Value::fromInt(wrapInt(x - y)); return true;
+            case OpCode::MUL: dst = Value::fromInt(wrapInt(x * y)); return true;
+            case OpCode::DIV:
+                if (y == 0) return false;
+                dst = Value::fromInt(wrapInt(x / y));
+                return true;
+            case OpCode::MOD:
+                if (y == 0) return false;
+                dst = Value::fromInt(wrapInt(x % y));
+                return true;
+            default: return false;
+        }
+    }
+    
+    double x = a.toDouble();
+    double y = b.toDouble();
+    switch (op) {
+        case OpCode::ADD: dst = Value::fromDouble(x + y); return true;
+        case OpCode::SUB: dst = Value::fromDouble(x - y); return true;
+        case OpCode::MUL: dst = Value::fromDouble(x * y); return true;
+        case OpCode::DIV: dst = Value::fromDouble(x / y); return true;
+        default: return false;
+    }
+}
+
+bool VM::compare(OpCode op, Value& dst, const Value& a, const Value& b) {
+    if (op == OpCode::EQ) {
+        dst = Value::fromBool(a == b);
+        return true;
+    }
+    if (op == OpCode::NE) {
+        dst = Value::fromBool(a != b);
+        return true;
+    }
+    
+    if (!a.isNumber() || !b.isNumber()) {
+        return false;
+    }
+    
+    bool r;
+    if (Value::bothInt(a, b)) {
+        int32_t x = a.asInt();
+        int32_t y = b.asInt();
+        switch (op) {
+            case OpCode::LT: r = x < y; break;
+            case OpCode::LE: r = x <= y; break;
+            case OpCode::GT: r = x > y; break;
+            default:         r = x >= y; break;
+        }
+    } else {
+        double x = a.toDouble();
+        double y = b.toDouble();
+        switch (op) {
+            case OpCode::LT: r = x < y; break;
+            case OpCode::LE: r = x <= y; break;
+            case OpCode::GT: r = x > y; break;
+            default:         r = x >= y; break;
+        }
+    }
+    dst = Value::fromBool(r);
+    return true;
+}
+
+int VM::run() {
+    const FunctionProto* proto = &program.functions[program.main_index];
+    const Instruction* pc = proto->code.data();
+    Value* base = registers.data();
+    Value* const registers_end = registers.data() + registers.size();
+    const Value* constants = program.constants.data();
+    Instruction i;
+    
+    if (proto->num_registers > registers.size()) {
+        runtimeError(*proto, pc, "Stack overflow");
+        return 1;
+    }
+    
+#define R(x) base[(x)]
+#define FAIL(message) do { runtimeError(*proto, pc - 1, (message)); return 1; } while (0)
+    
+#if defined(__GNUC__) || defined(__clang__)
+    // Threaded dispatch: every handler jumps straight to the next one
+    static void* const dispatch_table[] = {
+        &&op_LOADK, &&op_LOADI, &&op_LOADNIL, &&op_LOADTRUE, &&op_LOADFALSE, &&op_MOVE,
+        &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_MOD, &&op_NEG, &&op_NOT,
+        &&op_EQ, &&op_NE, &&op_LT, &&op_LE, &&op_GT, &&op_GE,
+        &&op_NEWARRAY, &&op_FILLARRAY, &&op_GETINDEX, &&op_SETINDEX, &&op_SLICE, &&op_LEN,
+        &&op_TASK, &&op_JOIN,
+        &&op_JMP, &&op_JMPIF, &&op_JMPIFNOT, &&op_LOOP,
+        &&op_CALL, &&op_TAILCALL, &&op_PRINT, &&op_RETURN, &&op_RETURN0
+    };
+    static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) ==
+                  static_cast<size_t>(OpCode::COUNT), "dispatch table out of sync with OpCode");
+    
+#define DISPATCH() do { i = *pc++; goto *dispatch_table[i & 0xff]; } while (0)
+#define CASE(op) op_##op:
+#define NEXT DISPATCH()
+    
+    DISPATCH();
+#else
+#define DISPATCH() break
+#define CASE(op) case OpCode::op:
+#define NEXT break
+    
+    for (;;) {
+    i = *pc++;
+    switch (decodeOp(i)) {
+#endif
+    
+    CASE(LOADK) {
+        R(decodeA(i)) = constants[decodeBx(i)];
+        NEXT;
+    }
+    CASE(LOADI) {
+        R(decodeA(i)) = Value::fromInt(decodeSBx(i));
+        NEXT;
+    }
+    CASE(LOADNIL) {
+        R(decodeA(i)) = Value::nil();
+        NEXT;
+    }
+    CASE(LOADTRUE) {
+        R(decodeA(i)) = Value::fromBool(true);
+        NEXT;
+    }
+    CASE(LOADFALSE) {
+        R(decodeA(i)) = Value::fromBool(false);
+        NEXT;
+    }
+    CASE(MOVE) {
+        R(decodeA(i)) = R(decodeB(i));
+        NEXT;
+    }
+    
+#define BINARY_INT_FAST_PATH(expr)                                          \
+    {                                                                       \
+        const Value& a = R(decodeB(i));                                     \
+        const Value& b = R(decodeC(i));                                     \
+        if (Value::bothInt(a, b)) {                                         \
+            int64_t x = a.asInt();                                          \
+            int64_t y = b.asInt();                                          \
+            R(decodeA(i)) = Value::fromInt(wrapInt(expr));                  \
+            NEXT;                                                           \
+        }                                                                   \
+        if (!arithmetic(decodeOp(i), R(decodeA(i)), a, b)) {                \
+            FAIL("Invalid operands for binary operation");                  \
+        }                                                                   \
+        NEXT;                                                               \
+    }
+    
+    CASE(ADD) BINARY_INT_FAST_PATH(x + y)
+    CASE(SUB) BINARY_INT_FAST_PATH(x - y)
+    CASE(MUL) BINARY_INT_FAST_PATH(x * y)
+#undef BINARY_INT_FAST_PATH
+    
+    CASE(DIV)
+    CASE(MOD) {
+        if (!arithmetic(decodeOp(i), R(decodeA(i)), R(decodeB(i)), R(decodeC(i)))) {
+            FAIL(R(decodeC(i)).isInt() && R(decodeC(i)).asInt() == 0
+                 ? "Division by zero" : "Invalid operands for binary operation");
+        }
+        NEXT;
+    }
+    CASE(NEG) {
+        const Value& v = R(decodeB(i));
+        if (v.isInt()) {
+            R(decodeA(i)) = Value::fromInt(wrapInt(-static_cast<int64_t>(v.asInt())));
+        } else if (v.isDouble()) {
+            R(decodeA(i)) = Value::fromDouble(-v.asDouble());
+        } else {
+            FAIL("Invalid operand type for unary minus");
+        }
+        NEXT;
+    }
+    CASE(NOT) {
+        R(decodeA(i)) = Value::fromBool(!R(decodeB(i)).isTruthy());
+        NEXT;
+    }
+    
+#define COMPARE_INT_FAST_PATH(cmp)                                          \
+    {                                                                       \
+        const Value& a = R(decodeB(i));                                     \
+        const Value& b = R(decodeC(i));                                     \
+        if (Value::bothInt(a, b)) {                                         \
+            R(decodeA(i)) = Value::fromBool(a.asInt() cmp b.asInt());       \
+            NEXT;                                                           \
+        }                                                                   \
+        if (!compare(decodeOp(i), R(decodeA(i)), a, b)) {                   \
+            FAIL("Invalid operands for comparison");                        \
+        }                                                                   \
+        NEXT;                                                               \
+    }
+    
+    CASE(EQ) COMPARE_INT_FAST_PATH(==)
+    CASE(NE) COMPARE_INT_FAST_PATH(!=)
+    CASE(LT) COMPARE_INT_FAST_PATH(<)
+    CASE(LE) COMPARE_INT_FAST_PATH(<=)
+    CASE(GT) COMPARE_INT_FAST_PATH(>)
+    CASE(GE) COMPARE_INT_FAST_PATH(>=)
+#undef COMPARE_INT_FAST_PATH
+    
+    CASE(NEWARRAY) {
+        const Value* elements = &R(decodeB(i));
+        uint8_t count = decodeC(i);
+        if (count == 0) {
+            FAIL("Empty array literal has no element type");
+        }
+        
+        Array::Element element = Array::Element::INT;
+        for (uint8_t e = 0; e < count; ++e) {
+            if (!elements[e].isNumber()) {
+                FAIL("Array elements must be numbers, not " + elements[e].toString());
+            }
+            if (elements[e].isDouble()) {
+                element = Array::Element::DOUBLE;
+            }
+        }
+        
+        const Array* array = newArray(element, count);
+        for (uint8_t e = 0; e < count; ++e) {
+            storeElement(*array, e, elements[e]);
+        }
+        R(decodeA(i)) = Value::fromArray(array);
+        NEXT;
+    }
+    CASE(FILLARRAY) {
+        const Value& value = R(decodeB(i));
+        const Value& count = R(decodeC(i));
+        if (!value.isNumber()) {
+            FAIL("Array elements must be numbers, not " + value.toString());
+        }
+        if (!count.isInt()) {
+            FAIL("Array length must be an int, not " + count.toString());
+        }
+        if (count.asInt() < 0) {
+            FAIL(arrayLengthError(count.asInt()));
+        }
+        
+        const Array* array = newArray(
+            value.isDouble() ? Array::Element::DOUBLE : Array::Element::INT, count.asInt()
+        );
+        for (int32_t e = 0; e < array->length; ++e) {
+            storeElement(*array, e, value);
+        }
+        R(decodeA(i)) = Value::fromArray(array);
+        NEXT;
+    }
+    CASE(GETINDEX) {
+        const Value& array = R(decodeB(i));
+        const Value& index = R(decodeC(i));
+        if (!array.isArray()) {
+            FAIL("Expected an array but got " + array.toString());
+        }
+        if (!index.isInt()) {
+            FAIL("Array index must be an int, not " + index.toString());
+        }
+        if (static_cast<uint32_t>(index.asInt()) >= static_cast<uint32_t>(array.asArray().length)) {
+            FAIL(arrayIndexError(index.asInt(), array.asArray().length));
+        }
+        R(decodeA(i)) = loadElement(array.asArray(), index.asInt());
+        NEXT;
+    }
+    CASE(SETINDEX) {
+        const Value& array = R(decodeA(i));
+        const Value& index = R(decodeB(i));
+        const Value& value = R(decodeC(i));
+        if (!array.isArray()) {
+            FAIL("Expected an array but got " + array.toString());
+        }
+        if (!index.isInt()) {
+            FAIL("Array index must be an int, not " + index.toString());
+        }
+        if (static_cast<uint32_t>(index.asInt()) >= static_cast<uint32_t>(array.asArray().length)) {
+            FAIL(arrayIndexError(index.asInt(), array.asArray().length));
+        }
+        if (!value.isNumber() && !value.isBool()) {
+            FAIL("Cannot store " + value.toString() + " in an array");
+        }
+        if (value.isDouble() && array.asArray().element == Array::Element::INT) {
+            FAIL("Cannot store double in [int]");
+        }
+        storeElement(array.asArray(), index.asInt(), value);
+        NEXT;
+    }
+    CASE(SLICE) {
+        const Value& value = R(decodeB(i));
+        const Value& start_value = R(decodeC(i));
+        const Value& end_value = R(decodeC(i) + 1);
+        if (!value.isArray()) {
+            FAIL("Expected an array but got " + value.toString());
+        }
+        for (const Value* bound : {&start_value, &end_value}) {
+            if (!bound->isNil() && !bound->isInt()) {
+                FAIL("Slice bound must be an int, not " + bound->toString());
+            }
+        }
+        
+        const Array& array = value.asArray();
+        int32_t start = start_value.isNil() ? 0 : start_value.asInt();
+        int32_t end = end_value.isNil() ? array.length : end_value.asInt();
+        if (start < 0 || start > end || end > array.length) {
+            FAIL(arraySliceError(start, end, array.length));
+        }
+        
+        // Slices share storage with the array they are taken from
+        arrays.push_back(Array{
+            array.element, end - start, static_cast<char*>(array.data) + start * elementSize(array.element)
+        });
+        R(decodeA(i)) = Value::fromArray(&arrays.back());
+        NEXT;
+    }
+    CASE(LEN) {
+        const Value& array = R(decodeB(i));
+        if (!array.isArray()) {
+            FAIL("Expected an array but got " + array.toString());
+        }
+        R(decodeA(i)) = Value::fromInt(array.asArray().length);
+        NEXT;
+    }
+    
+    CASE(TASK) {
+        task_results.push_back(R(decodeB(i)));
+        R(decodeA(i)) = Value::fromTask(&task_results.back());
+        NEXT;
+    }
+    CASE(JOIN) {
+        const Value& task = R(decodeB(i));
+        if (!task.isTask()) {
+            FAIL("Expected a task but got " + task.toString());
+        }
+        R(decodeA(i)) = task.asTask();
+        NEXT;
+    }
+    
+    CASE(JMP) {
+        pc += decodeSBx(i);
+        NEXT;
+    }
+    CASE(JMPIF) {
+        if (R(decodeA(i)).isTruthy()) {
+            pc += decodeSBx(i);
+        }
+        NEXT;
+    }
+    CASE(JMPIFNOT) {
+        if (!R(decodeA(i)).isTruthy()) {
+            pc += decodeSBx(i);
+        }
+        NEXT;
+    }
+    CASE(LOOP) {
+        pc += decodeSBx(i);
+        NEXT;
+    }
+    
+    CASE(CALL) {
+        const FunctionProto* callee = &program.functions[*pc++];
+        uint8_t argc = decodeB(i);
+        
+        if (argc != callee->num_params) {
+            FAIL("Expected " + std::to_string(callee->num_params) +
+                 " arguments but got " + std::to_string(argc));
+        }
+        
+        Value* callee_base = base + decodeA(i);
+        if (frames.size() >= max_frames || callee_base + callee->num_registers > registers_end) {
+            FAIL("Stack overflow");
+        }
+        
+        frames.push_back({proto, pc, base});
+        proto = callee;
+        base = callee_base;
+        pc = callee->code.data();
+        NEXT;
+    }
+    CASE(TAILCALL) {
+        const FunctionProto* callee = &program.functions[*pc++];
+        uint8_t argc = decodeB(i);
+        
+        if (argc != callee->num_params) {
+            FAIL("Expected " + std::to_string(callee->num_params) +
+                 " arguments but got " + std::to_string(argc));
+        }
+        if (base + callee->num_registers > registers_end) {
+            FAIL("Stack overflow");
+        }
+        
+        // The callee takes over this frame: its parameters become our first registers
+        const Value* args = &R(decodeA(i));
+        for (uint8_t a = 0; a < argc; ++a) {
+            base[a] = args[a];
+        }
+        proto = callee;
+        pc = callee->code.data();
+        NEXT;
+    }
+    CASE(PRINT) {
+        printValue(R(decodeA(i)));
+        NEXT;
+    }
+    CASE(RETURN) {
+        // The callee's first register is the caller's destination register
+        Value result = R(decodeA(i));
+        if (frames.empty()) {
+            return 0;
+        }
+        
+        base[0] = result;
+        const CallFrame& frame = frames.back();
+        proto = frame.proto;
+        pc = frame.return_pc;
+        base = frame.base;
+        frames.pop_back();
+        NEXT;
+    }
+    CASE(RETURN0) {
+        if (frames.empty()) {
+            return 0;
+        }
+        
+        base[0] = Value::fromInt(0);
+        const CallFrame& frame = frames.back();
+        proto = frame.proto;
+        pc = frame.return_pc;
+        base = frame.base;
+        frames.pop_back();
+        NEXT;
+    }
+    
+#if !(defined(__GNUC__) || defined(__clang__))
+    default:
+        FAIL("Invalid instruction");
+    }
+    }
+#endif
+    
+#undef R
+#undef FAIL
+#undef DISPATCH
+#undef CASE
+#undef NEXT
+    
+    return 0;
+}
+
+} // namespace mana
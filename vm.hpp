@@ -0,0 +1,68 @@
+#ifndef MANASCRIPT_VM_HPP
+#define MANASCRIPT_VM_HPP
+
+#include "bytecode.hpp"
+#include "error.hpp"
+#include "value.hpp"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Register-based virtual machine executing BytecodeProgram
+ *
+ * The register file and the call frames are allocated once up front; a call
+ * only slides the register window so that the callee's parameters are the
+ * argument registers the caller filled. Dispatch uses computed goto where the
+ * compiler supports it and a switch otherwise. The VM has no LLVM dependency.
+ */
+class VM {
+public:
+    /**
+     * @param program Program to execute; must outlive the VM
+     * @param register_slots Size of the register file shared by all frames
+     * @param max_frames Maximum call depth
+     */
+    explicit VM(const BytecodeProgram& program,
+                size_t register_slots = 1 << 16,
+                size_t max_frames = 10000);
+    
+    /**
+     * @brief Execute the program's main function
+     * @return Exit code (0 on success, 1 after a runtime error)
+     */
+    int run();
+    
+private:
+    struct CallFrame {
+        const FunctionProto* proto;
+        const Instruction* return_pc;
+        Value* base;
+    };
+    
+    const BytecodeProgram& program;
+    std::vector<Value> registers;
+    std::vector<CallFrame> frames;
+    size_t max_frames;
+    
+    // Strings created at runtime; a deque keeps pointers stable
+    std::deque<std::string> strings;
+    
+    // Array headers; element storage comes from allocateArrayStorage()
+    std::deque<Array> arrays;
+    
+    // Results of spawned calls, which task values point to
+    std::deque<Value> task_results;
+    
+    bool arithmetic(OpCode op, Value& dst, const Value& a, const Value& b);
+    bool compare(OpCode op, Value& dst, const Value& a, const Value& b);
+    const Array* newArray(Array::Element element, int32_t length);
+    void runtimeError(const FunctionProto& proto, const Instruction* pc, const std::string& message);
+};
+
+} // namespace mana
+
+#endif // MANASCRIPT_VM_HPP
@@ -0,0 +1,521 @@
+#include "watch.hpp"
+#include "codegen.hpp"
+#include "error.hpp"
+#include "lexer.hpp"
+#include "optimizer.hpp"
+#include "parser.hpp"
+#include "static_visitor.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace mana {
+
+namespace {
+
+/**
+ * @brief Hashes the structure of code, ignoring where it sits in the file
+ *
+ * Names, operators and literals count; lines, columns and whitespace don't, so
+ * moving a function or editing the one above it leaves its hash alone. Nested
+ * function declarations are part of the hash of the function holding them.
+ */
+class AstHash : public StaticVisitor<AstHash, void> {
+public:
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    // Nested functions met on the way
+    std::vector<const FunctionStmt*> functions;
+
+    // The kind of every node is mixed in, so different shapes hash apart
+    void scan(const ExprPtr& expr) {
+        mix(expr ? static_cast<uint64_t>(expr->getKind()) + 1 : 0);
+        if (expr) {
+            visit(*expr);
+        }
+    }
+
+    void scan(const StmtPtr& stmt) {
+        mix(stmt ? static_cast<uint64_t>(stmt->getKind()) + 1 : 0);
+        if (stmt) {
+            visit(*stmt);
+        }
+    }
+
+    void mix(uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            hash = (hash ^ ((value >> (i * 8)) & 0xff)) * 0x100000001b3ull;
+        }
+    }
+
+    void mix(const std::string& text) {
+        mix(static_cast<uint64_t>(text.size()));
+        for (unsigned char c : text) {
+            hash = (hash ^ c) * 0x100000001b3ull;
+        }
+    }
+
+    void mix(const Token& token) { mix(token.lexeme); }
+
+    void visitLiteralExpr(LiteralExpr& expr) {
+        const LiteralExpr::LiteralValue& value = expr.getValue();
+        mix(static_cast<uint64_t>(value.index()));
+        if (auto* i = std::get_if<int>(&value)) {
+            mix(static_cast<uint64_t>(*i));
+        } else if (auto* d = std::get_if<double>(&value)) {
+            uint64_t bits;
+            std::memcpy(&bits, d, sizeof(bits));
+            mix(bits);
+        } else if (auto* s = std::get_if<std::string>(&value)) {
+            mix(*s);
+        } else if (auto* b = std::get_if<bool>(&value)) {
+            mix(static_cast<uint64_t>(*b));
+        }
+    }
+
+    void visitUnaryExpr(UnaryExpr& expr) { mix(expr.getOperator()); scan(expr.getRight()); }
+
+    void visitBinaryExpr(BinaryExpr& expr) {
+        scan(expr.getLeft());
+        mix(expr.getOperator());
+        scan(expr.getRight());
+    }
+
+    void visitGroupingExpr(GroupingExpr& expr) { scan(expr.getExpression()); }
+    void visitVariableExpr(VariableExpr& expr) { mix(expr.getName()); }
+    void visitAssignExpr(AssignExpr& expr) { mix(expr.getName()); scan(expr.getValue()); }
+
+    void visitCallExpr(CallExpr& expr) {
+        scan(expr.getCallee());
+        mix(static_cast<uint64_t>(expr.getArguments().size()));
+        for (const auto& arg : expr.getArguments()) {
+            scan(arg);
+        }
+    }
+
+    void visitArrayExpr(ArrayExpr& expr) {
+        mix(static_cast<uint64_t>(expr.getElements().size()));
+        for (const auto& element : expr.getElements()) {
+            scan(element);
+        }
+        scan(expr.getCount());
+    }
+
+    void visitIndexExpr(IndexExpr& expr) { scan(expr.getArray()); scan(expr.getIndex()); }
+
+    void visitIndexAssignExpr(IndexAssignExpr& expr) {
+        scan(expr.getArray());
+        scan(expr.getIndex());
+        scan(expr.getValue());
+    }
+
+    void visitSliceExpr(SliceExpr& expr) {
+        scan(expr.getArray());
+        scan(expr.getStart());
+        scan(expr.getEnd());
+    }
+
+    void visitSpawnExpr(SpawnExpr& expr) { visitCallExpr(*expr.getCall()); }
+
+    void visitExpressionStmt(ExpressionStmt& stmt) { scan(stmt.getExpression()); }
+
+    void visitVarDeclStmt(VarDeclStmt& stmt) {
+        mix(stmt.getName());
+        mix(static_cast<uint64_t>(stmt.isConst()));
+        scan(stmt.getInitializer());
+    }
+
+    void visitBlockStmt(BlockStmt& stmt) { scanAll(stmt.getStatements()); }
+
+    void visitIfStmt(IfStmt& stmt) {
+        scan(stmt.getCondition());
+        scan(stmt.getThenBranch());
+        scan(stmt.getElseBranch());
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) { scan(stmt.getCondition()); scan(stmt.getBody()); }
+
+    void visitForStmt(ForStmt& stmt) {
+        mix(static_cast<uint64_t>(stmt.isParallel()));
+        scan(stmt.getInitializer());
+        scan(stmt.getCondition());
+        scan(stmt.getIncrement());
+        scan(stmt.getBody());
+    }
+
+    void visitBreakStmt(BreakStmt&) {}
+    void visitContinueStmt(ContinueStmt&) {}
+
+    void visitFunctionStmt(FunctionStmt& stmt) {
+        functions.push_back(&stmt);
+        mix(stmt.getName());
+        mix(static_cast<uint64_t>(stmt.isMemo()));
+        mix(static_cast<uint64_t>(stmt.getParams().size()));
+        for (const Token& param : stmt.getParams()) {
+            mix(param);
+        }
+        scanAll(stmt.getBody());
+    }
+
+    void visitReturnStmt(ReturnStmt& stmt) { scan(stmt.getValue()); }
+
+    void scanAll(const std::vector<StmtPtr>& statements) {
+        mix(static_cast<uint64_t>(statements.size()));
+        for (const auto& stmt : statements) {
+            scan(stmt);
+        }
+    }
+};
+
+std::string joinNames(const std::vector<std::string>& names) {
+    std::string text;
+    for (const std::string& name : names) {
+        text += (text.empty() ? "" : ", ") + name;
+    }
+    return text;
+}
+
+} // namespace
+
+WatchSession::WatchSession(const WatchOptions& options) : options(options) {}
+
+WatchSession::~WatchSession() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stop_cv.notify_all();
+
+    if (watch_thread.joinable()) {
+        watch_thread.join();
+    }
+}
+
+int WatchSession::run(ModuleGraph graph) {
+    current = analyze(std::make_unique<ModuleGraph>(std::move(graph)));
+    if (!current) {
+        diagnostics.printDiagnostics();
+        return 1;
+    }
+
+    auto created = ManaJIT::create(nullptr, options.perf);
+    if (!created) {
+        std::cerr << "Error: " << llvm::toString(created.takeError()) << "\n";
+        return 1;
+    }
+    jit = std::move(*created);
+
+    std::vector<const Specialization*> bodies;
+    for (const auto& spec : current->types->getSpecializations()) {
+        bodies.push_back(spec.get());
+    }
+    for (const auto& call : current->types->getMain().calls) {
+        main_callees.insert(call.second->name);
+    }
+    std::string suffix;
+    if (!compile(*current, bodies, true, suffix)) {
+        diagnostics.printDiagnostics();
+        return 1;
+    }
+
+    watchFiles(*current->graph);
+    watch_thread = std::thread(&WatchSession::watchLoop, this);
+
+    auto result = jit->runMain();
+
+    // A reload in progress finishes first, so nothing is compiled past here
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stop_cv.notify_all();
+    watch_thread.join();
+
+    if (!result) {
+        std::cerr << "Error: " << llvm::toString(result.takeError()) << "\n";
+        return 1;
+    }
+    return *result;
+}
+
+std::unique_ptr<ModuleGraph> WatchSession::parse() {
+    std::ifstream file(options.filename);
+    if (!file.is_open()) {
+        diagnostics.report(DiagnosticSeverity::ERROR, "Could not open file '" + options.filename + "'",
+                           SourceLocation());
+        return nullptr;
+    }
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Lexer lexer(content, options.filename);
+    std::vector<Token> tokens = lexer.scanTokens();
+    Parser parser(tokens, options.filename);
+    std::vector<StmtPtr> statements = parser.parse();
+    if (diagnostics.hasErrors()) {
+        return nullptr;
+    }
+
+    auto graph = std::make_unique<ModuleGraph>(options.filename, std::move(statements), parser.getImports());
+    if (!graph->getModules()[0].import_decls.empty() && !graph->load()) {
+        return nullptr;
+    }
+    graph->removeDeadFunctions(options.exports);
+    return graph;
+}
+
+std::unique_ptr<WatchSession::Version> WatchSession::analyze(std::unique_ptr<ModuleGraph> graph) {
+    auto version = std::make_unique<Version>();
+    version->statements = graph->link();
+    version->types = std::make_unique<TypeInference>(options.filename);
+    graph->annotate(*version->types);
+    if (!version->types->analyze(version->statements) || !version->types->addExports(options.exports) ||
+        diagnostics.hasErrors()) {
+        return nullptr;
+    }
+    version->graph = std::move(graph);
+
+    AstHash top_level;
+    for (const auto& stmt : version->statements) {
+        auto* func = dynamic_cast<FunctionStmt*>(stmt.get());
+        if (!func) {
+            top_level.scan(stmt);
+            continue;
+        }
+
+        AstHash body;
+        body.visitFunctionStmt(*func);
+        version->function_hashes[func->getName().lexeme] = body.hash;
+        for (const FunctionStmt* nested : body.functions) {
+            version->owners[nested] = func->getName().lexeme;
+        }
+    }
+    version->top_level_hash = top_level.hash;
+    return version;
+}
+
+bool WatchSession::compile(const Version& version, const std::vector<const Specialization*>& bodies,
+                           bool with_main, std::string& suffix) {
+    suffix = "v" + std::to_string(version_counter++);
+
+    llvm::orc::ThreadSafeContext context(std::make_unique<llvm::LLVMContext>());
+    CodeGenerator generator;
+    generator.setTypeInference(version.types.get());
+    generator.initialize(*context.getContext(), with_main ? options.filename : "mana.watch." + suffix);
+    generator.setSourceFile(options.filename);
+    generator.setFramePointers(options.perf);
+    generator.setDebugInfo(options.debug_info);
+    generator.setAutoMemo(options.auto_memo);
+    generator.setHotReload(suffix);
+
+    if (with_main) {
+        generator.generateMain(version.statements);
+    }
+    generator.generateSpecializations(bodies);
+
+    std::vector<const Specialization*> new_stubs;
+    for (const Specialization* spec : bodies) {
+        if (!stubs.count(spec->name)) {
+            new_stubs.push_back(spec);
+        }
+    }
+    generator.generateHotStubs(new_stubs);
+
+    if (diagnostics.hasErrors() || !generator.verify()) {
+        return false;
+    }
+
+    std::unique_ptr<llvm::Module> module = generator.takeModule();
+    optimizeModule(*module, options.opt_level);
+    if (auto err = jit->addModule(llvm::orc::ThreadSafeModule(std::move(module), context))) {
+        diagnostics.report(DiagnosticSeverity::ERROR, llvm::toString(std::move(err)), SourceLocation());
+        return false;
+    }
+
+    for (const Specialization* spec : new_stubs) {
+        auto owner = version.owners.find(spec->stmt);
+        stubs[spec->name] = {spec->return_type, owner != version.owners.end() ? owner->second : ""};
+    }
+    return true;
+}
+
+void WatchSession::watchFiles(const ModuleGraph& graph) {
+    watched.clear();
+    for (const SourceModule& module : graph.getModules()) {
+        std::error_code error;
+        watched[module.path] = std::filesystem::last_write_time(module.path, error);
+    }
+}
+
+bool WatchSession::filesChanged() {
+    bool changed = false;
+    for (auto& [path, time] : watched) {
+        // A file being replaced may be missing for a moment
+        std::error_code error;
+        auto now = std::filesystem::last_write_time(path, error);
+        if (!error && now != time) {
+            time = now;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void WatchSession::watchLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stop_cv.wait_for(lock, options.poll_interval, [this]() { return stopping; })) {
+        lock.unlock();
+        if (filesChanged()) {
+            reload();
+        }
+        lock.lock();
+    }
+}
+
+void WatchSession::reload() {
+    auto start = std::chrono::steady_clock::now();
+
+    // Errors in the new sources are shown but never end the program
+    DiagnosticManager reload_diagnostics;
+    DiagnosticCapture capture(reload_diagnostics);
+    std::unique_ptr<Version> next;
+    try {
+        if (std::unique_ptr<ModuleGraph> graph = parse()) {
+            watchFiles(*graph);
+            next = analyze(std::move(graph));
+        }
+    } catch (const std::exception& e) {
+        reload_diagnostics.report(DiagnosticSeverity::ERROR, e.what(), SourceLocation());
+    }
+    if (!next) {
+        reload_diagnostics.printDiagnostics();
+        std::cerr << "[watch] kept the running version\n";
+        return;
+    }
+
+    std::vector<std::string> changed;
+    for (const auto& [name, hash] : next->function_hashes) {
+        auto it = current->function_hashes.find(name);
+        if (it == current->function_hashes.end() || it->second != hash) {
+            changed.push_back(name);
+        }
+    }
+    std::sort(changed.begin(), changed.end());
+    if (next->top_level_hash != current->top_level_hash) {
+        std::cerr << "[watch] top-level code changed; restart to run the new version\n";
+    }
+
+    // Recompile specializations of changed functions and those without a
+    // stub yet, then everything calling them
+    std::unordered_set<std::string> changed_set(changed.begin(), changed.end());
+    std::unordered_map<const Specialization*, std::vector<const Specialization*>> callers;
+    std::vector<const Specialization*> worklist;
+    for (const auto& spec : next->types->getSpecializations()) {
+        for (const auto& call : spec->calls) {
+            callers[call.second].push_back(spec.get());
+        }
+        auto owner = next->owners.find(spec->stmt);
+        if ((owner != next->owners.end() && changed_set.count(owner->second)) || !stubs.count(spec->name)) {
+            worklist.push_back(spec.get());
+        }
+    }
+
+    std::vector<const Specialization*> bodies;
+    std::unordered_set<const Specialization*> seen;
+    while (!worklist.empty()) {
+        const Specialization* spec = worklist.back();
+        worklist.pop_back();
+        if (!seen.insert(spec).second) {
+            continue;
+        }
+        bodies.push_back(spec);
+        for (const Specialization* caller : callers[spec]) {
+            worklist.push_back(caller);
+        }
+    }
+
+    // Code already running calls through the stubs with the old prototypes
+    for (const Specialization* spec : bodies) {
+        auto it = stubs.find(spec->name);
+        if (it != stubs.end() && it->second.return_type != spec->return_type) {
+            std::cerr << "[watch] '" << spec->stmt->getName().lexeme << "' now returns "
+                      << staticTypeName(spec->return_type) << " instead of "
+                      << staticTypeName(it->second.return_type) << "; restart to apply the change\n";
+            return;
+        }
+    }
+    
+    // A stub of a changed function that the new sources no longer specialize
+    // would keep running its old body, e.g. after `step$i32` became `step$f64`,
+    // and so would one the top-level code calls
+    std::unordered_set<std::string> next_names;
+    for (const auto& spec : next->types->getSpecializations()) {
+        next_names.insert(spec->name);
+    }
+    for (const auto& [name, stub] : stubs) {
+        if ((changed_set.count(stub.owner) || main_callees.count(name)) && !next_names.count(name)) {
+            std::cerr << "[watch] the parameter types of '" << stub.owner << "' changed (" << name
+                      << " is no longer called); restart to apply the change\n";
+            return;
+        }
+    }
+
+    if (bodies.empty()) {
+        current = std::move(next);
+        return;
+    }
+
+    std::vector<const Specialization*> existing;
+    for (const Specialization* spec : bodies) {
+        if (stubs.count(spec->name)) {
+            existing.push_back(spec);
+        }
+    }
+
+    std::string suffix;
+    if (!compile(*next, bodies, false, suffix)) {
+        reload_diagnostics.printDiagnostics();
+        std::cerr << "[watch] kept the running version\n";
+        return;
+    }
+
+    // Compile everything before redirecting anything, so the stubs switch
+    // over within a few stores of each other
+    std::vector<std::pair<void**, void*>> redirects;
+    for (const Specialization* spec : existing) {
+        auto body = jit->lookup(spec->name + "." + suffix);
+        auto impl = jit->lookup(spec->name + ".impl");
+        if (!body || !impl) {
+            if (!body) {
+                std::cerr << "[watch] " << llvm::toString(body.takeError()) << "\n";
+            }
+            if (!impl) {
+                std::cerr << "[watch] " << llvm::toString(impl.takeError()) << "\n";
+            }
+            std::cerr << "[watch] kept the running version\n";
+            return;
+        }
+        redirects.emplace_back(reinterpret_cast<void**>(static_cast<uintptr_t>(*impl)),
+                               reinterpret_cast<void*>(static_cast<uintptr_t>(*body)));
+    }
+    for (const auto& [impl, body] : redirects) {
+        __atomic_store_n(impl, body, __ATOMIC_RELEASE);
+    }
+    current = std::move(next);
+
+    // New specializations alone are only reachable from code that isn't reloaded
+    if (redirects.empty()) {
+        std::cerr << "[watch] nothing running calls the changed code; restart to run the new version\n";
+        return;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start
+    );
+    std::cerr << "[watch] reloaded " << (changed.empty() ? "new specializations" : joinNames(changed))
+              << " (" << redirects.size() << " functions) in " << elapsed.count() << " ms\n";
+}
+
+} // namespace mana
@@ -0,0 +1,116 @@
+#ifndef MANASCRIPT_WATCH_HPP
+#define MANASCRIPT_WATCH_HPP
+
+#include "jit.hpp"
+#include "module_graph.hpp"
+#include "type_inference.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace mana {
+
+/**
+ * @brief Options for running a script in watch mode
+ */
+struct WatchOptions {
+    std::string filename;               // Main script; its imports are watched too
+    unsigned opt_level = 0;             // Optimization level of every version
+    bool perf = false;                  // Publish compiled code to perf, keep frame pointers
+    bool debug_info = false;            // Emit line tables for compiled code
+    bool auto_memo = false;             // Memoize every pure function
+    std::vector<ExportedFunction> exports;  // Kept and compiled though never called
+    std::chrono::milliseconds poll_interval{200};
+};
+
+/**
+ * @brief Runs a script in the JIT and swaps in functions edited meanwhile
+ *
+ * Every specialization is compiled behind a call stub (see
+ * CodeGenerator::setHotReload()). A background thread polls the script and
+ * its imports. When one changes, the program is parsed and analyzed again,
+ * and the top-level functions whose AST hash differs are compiled as a new
+ * version, together with the functions calling them and any specialization
+ * that is new. Once that version is in the JIT, its addresses are stored
+ * into the stubs, so calls made from then on run the new code while calls
+ * already running finish in the old one. Top-level code keeps running as it
+ * was first compiled.
+ *
+ * A change is applied whole or not at all: errors in the new sources, or a
+ * function whose inferred return type or parameter types changed, leave the
+ * running version in place. Old versions are never unloaded.
+ */
+class WatchSession {
+public:
+    explicit WatchSession(const WatchOptions& options);
+    ~WatchSession();
+
+    /**
+     * @brief Compile and run a program, reloading functions until it exits
+     * @param graph The program's modules, loaded and with dead functions removed
+     * @return Exit code of the script
+     */
+    int run(ModuleGraph graph);
+
+private:
+    /**
+     * @brief One analyzed state of the sources
+     */
+    struct Version {
+        std::unique_ptr<ModuleGraph> graph;
+        std::vector<StmtPtr> statements;
+        std::unique_ptr<TypeInference> types;
+        std::unordered_map<std::string, uint64_t> function_hashes;  // Top-level functions
+        uint64_t top_level_hash = 0;                                // Everything else
+
+        // Top-level function each function is declared in, itself if top-level
+        std::unordered_map<const FunctionStmt*, std::string> owners;
+    };
+
+    WatchOptions options;
+    std::unique_ptr<ManaJIT> jit;
+
+    // Owned by the watch thread once the program runs
+    std::unique_ptr<Version> current;
+    // Every stub by name; the prototype can't change once code calls it
+    struct Stub {
+        StaticType return_type = StaticType::UNKNOWN;
+        std::string owner;  // Top-level function it belongs to
+    };
+    std::unordered_map<std::string, Stub> stubs;
+    std::unordered_set<std::string> main_callees;          // Stubs the running top-level code calls
+    std::unordered_map<std::string, std::filesystem::file_time_type> watched;
+    size_t version_counter = 0;
+
+    std::thread watch_thread;
+    std::mutex mutex;
+    std::condition_variable stop_cv;
+    bool stopping = false;
+
+    // Analyze `graph` into a Version; null (with diagnostics) on errors
+    std::unique_ptr<Version> analyze(std::unique_ptr<ModuleGraph> graph);
+    std::unique_ptr<ModuleGraph> parse();
+
+    // Add `bodies` to the JIT as the next version, named `<name>.<suffix>`;
+    // specializations without a stub yet get one
+    bool compile(const Version& version, const std::vector<const Specialization*>& bodies,
+                 bool with_main, std::string& suffix);
+
+    void watchFiles(const ModuleGraph& graph);
+    bool filesChanged();
+    void watchLoop();
+    void reload();
+};
+
+} // namespace mana
+
+#endif // MANASCRIPT_WATCH_HPP